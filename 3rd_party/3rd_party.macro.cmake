@@ -124,6 +124,9 @@ if (MINGW)
     list(APPEND 3RD_PARTY_CRYPT_LINK_NAME gdi32)
 endif()
 
+# =========== 3rd_party - compression ===========
+include("${PROJECT_3RD_PARTY_ROOT_DIR}/compression/compression.cmake")
+
 # =========== 3rd_party - libcopp ===========
 include("${PROJECT_3RD_PARTY_ROOT_DIR}/libcopp/libcopp.cmake")
 ## 导入所有工程项目
@@ -0,0 +1,49 @@
+# =========== 3rdparty compression(zstd/lz4) ==================
+# both zstd and lz4 are optional, atgateway will only negotiate the compression algorithms found here
+
+unset (3RD_PARTY_COMPRESSION_LINK_NAME)
+
+if (ATFRAME_GATEWAY_ENABLE_COMPRESSION)
+    if (ZSTD_ROOT)
+        set (3RD_PARTY_ZSTD_ROOT_DIR ${ZSTD_ROOT})
+    endif ()
+
+    find_path(3RD_PARTY_ZSTD_INC_DIR NAMES zstd.h HINTS ${3RD_PARTY_ZSTD_ROOT_DIR} PATH_SUFFIXES include)
+    find_library(3RD_PARTY_ZSTD_LINK_NAME NAMES zstd zstd_static libzstd HINTS ${3RD_PARTY_ZSTD_ROOT_DIR} PATH_SUFFIXES lib lib64)
+
+    # ZSTD_compress2 and advanced parameters of ZSTD_CCtx are stable since 1.4.0
+    unset (3RD_PARTY_ZSTD_VERSION)
+    if (3RD_PARTY_ZSTD_INC_DIR AND EXISTS "${3RD_PARTY_ZSTD_INC_DIR}/zstd.h")
+        file(STRINGS "${3RD_PARTY_ZSTD_INC_DIR}/zstd.h" 3RD_PARTY_ZSTD_VERSION_DEFINES REGEX "^#define[ \t]+ZSTD_VERSION_(MAJOR|MINOR|RELEASE)[ \t]+[0-9]+")
+        foreach (3RD_PARTY_ZSTD_VERSION_PART MAJOR MINOR RELEASE)
+            string(REGEX REPLACE ".*#define[ \t]+ZSTD_VERSION_${3RD_PARTY_ZSTD_VERSION_PART}[ \t]+([0-9]+).*" "\\1" 3RD_PARTY_ZSTD_VERSION_${3RD_PARTY_ZSTD_VERSION_PART} "${3RD_PARTY_ZSTD_VERSION_DEFINES}")
+        endforeach ()
+        set (3RD_PARTY_ZSTD_VERSION "${3RD_PARTY_ZSTD_VERSION_MAJOR}.${3RD_PARTY_ZSTD_VERSION_MINOR}.${3RD_PARTY_ZSTD_VERSION_RELEASE}")
+    endif ()
+
+    if (3RD_PARTY_ZSTD_INC_DIR AND 3RD_PARTY_ZSTD_LINK_NAME AND (NOT 3RD_PARTY_ZSTD_VERSION OR 3RD_PARTY_ZSTD_VERSION VERSION_LESS "1.4.0"))
+        EchoWithColor(COLOR YELLOW "-- Dependency: zstd ${3RD_PARTY_ZSTD_VERSION} found but 1.4.0 or upper is required, zstd compression disabled")
+    elseif (3RD_PARTY_ZSTD_INC_DIR AND 3RD_PARTY_ZSTD_LINK_NAME)
+        include_directories(${3RD_PARTY_ZSTD_INC_DIR})
+        add_compiler_define(ATFRAME_GATEWAY_ENABLE_ZSTD=1)
+        list(APPEND 3RD_PARTY_COMPRESSION_LINK_NAME ${3RD_PARTY_ZSTD_LINK_NAME})
+        EchoWithColor(COLOR GREEN "-- Dependency: zstd ${3RD_PARTY_ZSTD_VERSION} found.(${3RD_PARTY_ZSTD_LINK_NAME})")
+    else ()
+        EchoWithColor(COLOR YELLOW "-- Dependency: zstd not found, zstd compression disabled")
+    endif ()
+
+    if (LZ4_ROOT)
+        set (3RD_PARTY_LZ4_ROOT_DIR ${LZ4_ROOT})
+    endif ()
+
+    find_path(3RD_PARTY_LZ4_INC_DIR NAMES lz4.h HINTS ${3RD_PARTY_LZ4_ROOT_DIR} PATH_SUFFIXES include)
+    find_library(3RD_PARTY_LZ4_LINK_NAME NAMES lz4 liblz4 HINTS ${3RD_PARTY_LZ4_ROOT_DIR} PATH_SUFFIXES lib lib64)
+    if (3RD_PARTY_LZ4_INC_DIR AND 3RD_PARTY_LZ4_LINK_NAME)
+        include_directories(${3RD_PARTY_LZ4_INC_DIR})
+        add_compiler_define(ATFRAME_GATEWAY_ENABLE_LZ4=1)
+        list(APPEND 3RD_PARTY_COMPRESSION_LINK_NAME ${3RD_PARTY_LZ4_LINK_NAME})
+        EchoWithColor(COLOR GREEN "-- Dependency: lz4 found.(${3RD_PARTY_LZ4_LINK_NAME})")
+    else ()
+        EchoWithColor(COLOR YELLOW "-- Dependency: lz4 not found, lz4 compression disabled")
+    endif ()
+endif ()
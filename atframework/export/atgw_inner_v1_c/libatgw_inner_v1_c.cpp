@@ -244,6 +244,80 @@ UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_send_buffer_limit(libatgw
     ATGW_CONTEXT(context)->set_send_buffer_limit((size_t)max_size, (size_t)max_number);
 }
 
+UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_compression_types(libatgw_inner_v1_c_context context, const char *compression_types) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return;
+    }
+
+    ATGW_CONTEXT(context)->set_compression_types(NULL == compression_types ? std::string() : std::string(compression_types));
+}
+
+UTIL_SYMBOL_EXPORT int32_t __cdecl libatgw_inner_v1_c_get_compression_type(libatgw_inner_v1_c_context context) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return 0;
+    }
+
+    return ATGW_CONTEXT(context)->get_compression_type();
+}
+
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_get_received_sequence(libatgw_inner_v1_c_context context) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return 0;
+    }
+
+    return ATGW_CONTEXT(context)->get_received_sequence();
+}
+
+UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_received_sequence(libatgw_inner_v1_c_context context, uint64_t sequence) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return;
+    }
+
+    ATGW_CONTEXT(context)->set_received_sequence(sequence);
+}
+
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_get_lost_post_number(libatgw_inner_v1_c_context context) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return 0;
+    }
+
+    return ATGW_CONTEXT(context)->get_lost_post_number();
+}
+
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_get_ticket_size(libatgw_inner_v1_c_context context) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return 0;
+    }
+
+    return (uint64_t)(ATGW_CONTEXT(context)->get_ticket().size());
+}
+
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_copy_ticket(libatgw_inner_v1_c_context context, unsigned char *ticket, uint64_t available_size) {
+    if (ATGW_CONTEXT_IS_NULL(context) || 0 == available_size) {
+        return 0;
+    }
+
+    size_t len = ATGW_CONTEXT(context)->get_ticket().size();
+    if (len >= available_size) {
+        len = (size_t)available_size;
+    }
+
+    memcpy(ticket, ATGW_CONTEXT(context)->get_ticket().data(), len);
+    return len;
+}
+
+UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_ticket(libatgw_inner_v1_c_context context, const unsigned char *ticket, uint64_t ticket_len) {
+    if (ATGW_CONTEXT_IS_NULL(context)) {
+        return;
+    }
+
+    if (NULL == ticket || 0 == ticket_len) {
+        ATGW_CONTEXT(context)->set_ticket(std::vector<unsigned char>());
+    } else {
+        ATGW_CONTEXT(context)->set_ticket(std::vector<unsigned char>(ticket, ticket + ticket_len));
+    }
+}
+
 UTIL_SYMBOL_EXPORT int32_t __cdecl libatgw_inner_v1_c_start_session(libatgw_inner_v1_c_context context, const char *crypt_type) {
     if (ATGW_CONTEXT_IS_NULL(context)) {
         return ::atframe::gateway::error_code_t::EN_ECT_PARAM;
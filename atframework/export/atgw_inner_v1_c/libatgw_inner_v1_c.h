@@ -12,6 +12,9 @@
 extern "C" {
 #endif
 
+// returned by libatgw_inner_v1_c_get_lost_post_number when some posts may be lost but the number is unknown
+#define LIBATGW_INNER_V1_C_LOST_POST_NUMBER_UNKNOWN 0xFFFFFFFFFFFFFFFFULL
+
 typedef void *libatgw_inner_v1_c_context;
 // typedef union {
 //     void *pa;
@@ -48,6 +51,17 @@ UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_destroy(libatgw_inner_v1_c_co
 UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_recv_buffer_limit(libatgw_inner_v1_c_context context, uint64_t max_size, uint64_t max_number);
 UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_send_buffer_limit(libatgw_inner_v1_c_context context, uint64_t max_size, uint64_t max_number);
 
+UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_compression_types(libatgw_inner_v1_c_context context, const char *compression_types);
+UTIL_SYMBOL_EXPORT int32_t __cdecl libatgw_inner_v1_c_get_compression_type(libatgw_inner_v1_c_context context);
+
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_get_received_sequence(libatgw_inner_v1_c_context context);
+UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_received_sequence(libatgw_inner_v1_c_context context, uint64_t sequence);
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_get_lost_post_number(libatgw_inner_v1_c_context context);
+
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_get_ticket_size(libatgw_inner_v1_c_context context);
+UTIL_SYMBOL_EXPORT uint64_t __cdecl libatgw_inner_v1_c_copy_ticket(libatgw_inner_v1_c_context context, unsigned char *ticket, uint64_t available_size);
+UTIL_SYMBOL_EXPORT void __cdecl libatgw_inner_v1_c_set_ticket(libatgw_inner_v1_c_context context, const unsigned char *ticket, uint64_t ticket_len);
+
 UTIL_SYMBOL_EXPORT int32_t __cdecl libatgw_inner_v1_c_start_session(libatgw_inner_v1_c_context context, const char *crypt_type);
 UTIL_SYMBOL_EXPORT int32_t __cdecl libatgw_inner_v1_c_reconnect_session(libatgw_inner_v1_c_context context, uint64_t sessios_id, const char *crypt_type,
                                                                         const unsigned char *secret_buf, uint64_t secret_len);
@@ -1,4 +1,5 @@
 ﻿
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -16,8 +17,17 @@
 #include <log/log_wrapper.h>
 #include <time/time_utility.h>
 
+#include "config/atframe_utils_build_feature.h"
+#include "std/thread.h"
 
+#if (defined(THREAD_TLS_USE_PTHREAD) && THREAD_TLS_USE_PTHREAD) || !(defined(THREAD_TLS_ENABLED) && THREAD_TLS_ENABLED)
+#include <pthread.h>
+#endif
+
+
+#include "session_group.h"
 #include "session_manager.h"
+#include "session_shard.h"
 #include <atframe/atapp.h>
 #include <libatbus.h>
 #include <libatbus_protocol.h>
@@ -35,10 +45,71 @@ static int app_handle_on_send_fail(atapp::app &, atapp::app::app_id_t src_pd, at
     return 0;
 }
 
+struct write_req_t {
+    uv_write_t req; // must be the first member, so we can convert uv_write_t* back in callback
+};
+
+// sessions are always written in the thread of their event loop, so every thread has its own pool
+// every session has at most one writing request, so a pool will not be larger than the max number of sessions in its thread
+struct write_req_pool_t {
+    std::vector<write_req_t *> free_reqs;
+
+    ~write_req_pool_t() {
+        for (std::vector<write_req_t *>::iterator iter = free_reqs.begin(); iter != free_reqs.end(); ++iter) {
+            delete *iter;
+        }
+        free_reqs.clear();
+    }
+};
+
+#if !(defined(THREAD_TLS_USE_PTHREAD) && THREAD_TLS_USE_PTHREAD) && defined(THREAD_TLS_ENABLED) && THREAD_TLS_ENABLED
+static write_req_pool_t *get_tls_write_req_pool() {
+    static THREAD_TLS write_req_pool_t *ret = NULL;
+    if (NULL == ret) {
+        ret = new (std::nothrow) write_req_pool_t();
+    }
+    return ret;
+}
+#else
+static pthread_once_t gt_atgateway_write_req_pool_tls_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  gt_atgateway_write_req_pool_tls_key;
+
+static void dtor_pthread_atgateway_write_req_pool_tls(void *p) {
+    if (NULL != p) {
+        delete reinterpret_cast<write_req_pool_t *>(p);
+    }
+}
+
+static void init_pthread_atgateway_write_req_pool_tls() {
+    (void)pthread_key_create(&gt_atgateway_write_req_pool_tls_key, dtor_pthread_atgateway_write_req_pool_tls);
+}
+
+static write_req_pool_t *get_tls_write_req_pool() {
+    (void)pthread_once(&gt_atgateway_write_req_pool_tls_once, init_pthread_atgateway_write_req_pool_tls);
+    write_req_pool_t *ret = reinterpret_cast<write_req_pool_t *>(pthread_getspecific(gt_atgateway_write_req_pool_tls_key));
+    if (NULL == ret) {
+        ret = new (std::nothrow) write_req_pool_t();
+        pthread_setspecific(gt_atgateway_write_req_pool_tls_key, ret);
+    }
+    return ret;
+}
+#endif
+
 class gateway_module : public ::atapp::module_impl {
+private:
+    struct async_work_req_t {
+        uv_work_t req; // must be the first member, so we can convert uv_work_t* back in callback
+        gateway_module *owner;
+        ::atframe::gateway::proto_base::async_work_fn_t work_fn;
+        ::atframe::gateway::proto_base::async_done_fn_t done_fn;
+    };
+
 public:
-    gateway_module() {}
-    virtual ~gateway_module() {}
+    gateway_module() : async_work_pending_(0) {}
+    virtual ~gateway_module() {
+        // workers must be stopped before callbacks are destroyed
+        stop_workers();
+    }
 
 public:
     virtual int init() UTIL_CONFIG_OVERRIDE {
@@ -55,6 +126,8 @@ public:
             // init callbacks
             proto_callbacks_.write_fn = std::bind<int>(&gateway_module::proto_inner_callback_on_write, this, std::placeholders::_1, std::placeholders::_2,
                                                        std::placeholders::_3, std::placeholders::_4);
+            proto_callbacks_.writev_fn = std::bind<int>(&gateway_module::proto_inner_callback_on_writev, this, std::placeholders::_1, std::placeholders::_2,
+                                                        std::placeholders::_3, std::placeholders::_4);
             proto_callbacks_.message_fn =
                 std::bind<int>(&gateway_module::proto_inner_callback_on_message, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
             proto_callbacks_.new_session_fn =
@@ -71,6 +144,9 @@ public:
             proto_callbacks_.on_error_fn = std::bind<int>(&gateway_module::proto_inner_callback_on_error, this, std::placeholders::_1, std::placeholders::_2,
                                                           std::placeholders::_3, std::placeholders::_4, std::placeholders::_5);
 
+            proto_callbacks_.async_work_fn = std::bind<int>(&gateway_module::proto_inner_callback_on_async_work, this, std::placeholders::_1,
+                                                            std::placeholders::_2, std::placeholders::_3);
+
 
         } else {
             PSTDERROR("listen type %s not supported.\n", gw_mgr_.get_conf().listen.type.c_str());
@@ -78,7 +154,13 @@ public:
         }
 
         // init limits
-        res = gw_mgr_.listen_all();
+        if (gw_mgr_.get_conf().listen.workers > 0) {
+            res = init_workers();
+        } else {
+            // routes are also used to check members of groups when there is no worker
+            gw_mgr_.set_on_session_route(std::bind(&gateway_module::main_on_session_route, this, 0, std::placeholders::_1, std::placeholders::_2));
+            res = gw_mgr_.listen_all();
+        }
         if (res <= 0) {
             PSTDERROR("nothing listened for client, please see log for more details.\n");
             return -1;
@@ -91,55 +173,100 @@ public:
         ++gw_mgr_.get_conf().version;
 
         // load init cluster member from configure
-        gw_mgr_.get_conf().limits.total_recv_bytes  = 0;
-        gw_mgr_.get_conf().limits.total_send_bytes  = 0;
-        gw_mgr_.get_conf().limits.hour_recv_bytes   = 0;
-        gw_mgr_.get_conf().limits.hour_send_bytes   = 0;
-        gw_mgr_.get_conf().limits.minute_recv_bytes = 0;
-        gw_mgr_.get_conf().limits.minute_send_bytes = 0;
-        gw_mgr_.get_conf().limits.total_recv_times  = 0;
-        gw_mgr_.get_conf().limits.total_send_times  = 0;
-        gw_mgr_.get_conf().limits.hour_recv_times   = 0;
-        gw_mgr_.get_conf().limits.hour_send_times   = 0;
-        gw_mgr_.get_conf().limits.minute_recv_times = 0;
-        gw_mgr_.get_conf().limits.minute_send_times = 0;
-        gw_mgr_.get_conf().limits.max_client_number = 65536;
+        gw_mgr_.get_conf().limits.total_recv_bytes      = 0;
+        gw_mgr_.get_conf().limits.total_send_bytes      = 0;
+        gw_mgr_.get_conf().limits.total_recv_times      = 0;
+        gw_mgr_.get_conf().limits.total_send_times      = 0;
+        gw_mgr_.get_conf().limits.recv_bytes.rate       = 0;
+        gw_mgr_.get_conf().limits.recv_bytes.burst      = 0;
+        gw_mgr_.get_conf().limits.send_bytes.rate       = 0;
+        gw_mgr_.get_conf().limits.send_bytes.burst      = 0;
+        gw_mgr_.get_conf().limits.recv_times.rate       = 0;
+        gw_mgr_.get_conf().limits.recv_times.burst      = 0;
+        gw_mgr_.get_conf().limits.send_times.rate       = 0;
+        gw_mgr_.get_conf().limits.send_times.burst      = 0;
+        gw_mgr_.get_conf().limits.peer_recv_bytes.rate  = 0;
+        gw_mgr_.get_conf().limits.peer_recv_bytes.burst = 0;
+        gw_mgr_.get_conf().limits.peer_recv_times.rate  = 0;
+        gw_mgr_.get_conf().limits.peer_recv_times.burst = 0;
+        gw_mgr_.get_conf().limits.action                = ::atframe::gateway::session_manager::limit_action_t::EN_LAT_DELAY;
+        gw_mgr_.get_conf().limits.send_delay_size       = 1048576; // 1MB
+        gw_mgr_.get_conf().limits.message_size          = 0;
+        gw_mgr_.get_conf().limits.max_client_number     = 65536;
 
         gw_mgr_.get_conf().listen.address.clear();
         gw_mgr_.get_conf().listen.type.clear();
-        gw_mgr_.get_conf().listen.backlog = 1024;
+        gw_mgr_.get_conf().listen.backlog    = 1024;
+        gw_mgr_.get_conf().listen.reuse_port = false;
+        gw_mgr_.get_conf().listen.workers    = 0;
 
         gw_mgr_.get_conf().reconnect_timeout  = 180;     // 60s
         gw_mgr_.get_conf().send_buffer_size   = 1048576; // 1MB
         gw_mgr_.get_conf().default_router     = 0;
         gw_mgr_.get_conf().first_idle_timeout = 10; // 10s
 
+        gw_mgr_.get_conf().send_cork.enable    = false;
+        gw_mgr_.get_conf().send_cork.max_bytes = 65536; // 64KB
+        gw_mgr_.get_conf().send_cork.max_delay = 0;
+
+        gw_mgr_.get_conf().crypt_max_pending = 1024;
+
+        gw_mgr_.get_conf().crypt_update.jitter = 60;   // 1min
+        gw_mgr_.get_conf().crypt_update.budget = 1000; // 1000 sessions per second
+
         util::config::ini_loader &cfg = get_app()->get_configure();
         // listen configures
         cfg.dump_to("atgateway.listen.address", gw_mgr_.get_conf().listen.address);
         cfg.dump_to("atgateway.listen.type", gw_mgr_.get_conf().listen.type);
         cfg.dump_to("atgateway.listen.max_client", gw_mgr_.get_conf().limits.max_client_number);
         cfg.dump_to("atgateway.listen.backlog", gw_mgr_.get_conf().listen.backlog);
+        cfg.dump_to("atgateway.listen.reuse_port", gw_mgr_.get_conf().listen.reuse_port);
+        // workers can not be changed after started
+        if (shards_.empty()) {
+            cfg.dump_to("atgateway.listen.workers", gw_mgr_.get_conf().listen.workers);
+        } else {
+            gw_mgr_.get_conf().listen.workers = shards_.size();
+        }
 
         // client session configure
         cfg.dump_to("atgateway.client.router.default", gw_mgr_.get_conf().default_router);
         cfg.dump_to("atgateway.client.send_buffer_size", gw_mgr_.get_conf().send_buffer_size);
         cfg.dump_to("atgateway.client.reconnect_timeout", gw_mgr_.get_conf().reconnect_timeout);
         cfg.dump_to("atgateway.client.first_idle_timeout", gw_mgr_.get_conf().first_idle_timeout);
+        cfg.dump_to("atgateway.client.send_cork.enable", gw_mgr_.get_conf().send_cork.enable);
+        cfg.dump_to("atgateway.client.send_cork.max_bytes", gw_mgr_.get_conf().send_cork.max_bytes);
+        cfg.dump_to("atgateway.client.send_cork.max_delay", gw_mgr_.get_conf().send_cork.max_delay);
 
         // client limit
         cfg.dump_to("atgateway.client.limit.total_send_bytes", gw_mgr_.get_conf().limits.total_send_bytes);
         cfg.dump_to("atgateway.client.limit.total_recv_bytes", gw_mgr_.get_conf().limits.total_recv_bytes);
-        cfg.dump_to("atgateway.client.limit.hour_send_bytes", gw_mgr_.get_conf().limits.hour_send_bytes);
-        cfg.dump_to("atgateway.client.limit.hour_recv_bytes", gw_mgr_.get_conf().limits.hour_recv_bytes);
-        cfg.dump_to("atgateway.client.limit.minute_send_bytes", gw_mgr_.get_conf().limits.minute_send_bytes);
-        cfg.dump_to("atgateway.client.limit.minute_recv_bytes", gw_mgr_.get_conf().limits.minute_recv_bytes);
         cfg.dump_to("atgateway.client.limit.total_send_times", gw_mgr_.get_conf().limits.total_send_times);
         cfg.dump_to("atgateway.client.limit.total_recv_times", gw_mgr_.get_conf().limits.total_recv_times);
-        cfg.dump_to("atgateway.client.limit.hour_send_times", gw_mgr_.get_conf().limits.hour_send_times);
-        cfg.dump_to("atgateway.client.limit.hour_recv_times", gw_mgr_.get_conf().limits.hour_recv_times);
-        cfg.dump_to("atgateway.client.limit.minute_send_times", gw_mgr_.get_conf().limits.minute_send_times);
-        cfg.dump_to("atgateway.client.limit.minute_recv_times", gw_mgr_.get_conf().limits.minute_recv_times);
+        cfg.dump_to("atgateway.client.limit.message_size", gw_mgr_.get_conf().limits.message_size);
+
+        // client traffic shaping
+        cfg.dump_to("atgateway.client.limit.recv_bytes.rate", gw_mgr_.get_conf().limits.recv_bytes.rate);
+        cfg.dump_to("atgateway.client.limit.recv_bytes.burst", gw_mgr_.get_conf().limits.recv_bytes.burst);
+        cfg.dump_to("atgateway.client.limit.send_bytes.rate", gw_mgr_.get_conf().limits.send_bytes.rate);
+        cfg.dump_to("atgateway.client.limit.send_bytes.burst", gw_mgr_.get_conf().limits.send_bytes.burst);
+        cfg.dump_to("atgateway.client.limit.recv_times.rate", gw_mgr_.get_conf().limits.recv_times.rate);
+        cfg.dump_to("atgateway.client.limit.recv_times.burst", gw_mgr_.get_conf().limits.recv_times.burst);
+        cfg.dump_to("atgateway.client.limit.send_times.rate", gw_mgr_.get_conf().limits.send_times.rate);
+        cfg.dump_to("atgateway.client.limit.send_times.burst", gw_mgr_.get_conf().limits.send_times.burst);
+        cfg.dump_to("atgateway.client.limit.peer_recv_bytes.rate", gw_mgr_.get_conf().limits.peer_recv_bytes.rate);
+        cfg.dump_to("atgateway.client.limit.peer_recv_bytes.burst", gw_mgr_.get_conf().limits.peer_recv_bytes.burst);
+        cfg.dump_to("atgateway.client.limit.peer_recv_times.rate", gw_mgr_.get_conf().limits.peer_recv_times.rate);
+        cfg.dump_to("atgateway.client.limit.peer_recv_times.burst", gw_mgr_.get_conf().limits.peer_recv_times.burst);
+        cfg.dump_to("atgateway.client.limit.send_delay_size", gw_mgr_.get_conf().limits.send_delay_size);
+        do {
+            std::string val;
+            cfg.dump_to("atgateway.client.limit.action", val);
+            if (0 == UTIL_STRFUNC_STRNCASE_CMP("kick", val.c_str(), 4)) {
+                gw_mgr_.get_conf().limits.action = ::atframe::gateway::session_manager::limit_action_t::EN_LAT_KICK;
+            } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("drop", val.c_str(), 4)) {
+                gw_mgr_.get_conf().limits.action = ::atframe::gateway::session_manager::limit_action_t::EN_LAT_DROP;
+            }
+        } while (false);
 
         // crypt
         ::atframe::gateway::session_manager::crypt_conf_t &crypt_conf = gw_mgr_.get_conf().crypt;
@@ -154,11 +281,18 @@ public:
         // crypt_conf.rsa_public_key.clear();
         // crypt_conf.rsa_private_key.clear();
         crypt_conf.dh_param.clear();
+        crypt_conf.dh_pool_size      = 64;
+        crypt_conf.dh_context_number = 0;
+        crypt_conf.benchmark_time    = 10;
         do {
             std::string val;
             cfg.dump_to("atgateway.client.crypt.key", crypt_conf.default_key);
             cfg.dump_to("atgateway.client.crypt.update_interval", crypt_conf.update_interval);
+            cfg.dump_to("atgateway.client.crypt.update_jitter", gw_mgr_.get_conf().crypt_update.jitter);
+            cfg.dump_to("atgateway.client.crypt.update_budget", gw_mgr_.get_conf().crypt_update.budget);
             cfg.dump_to("atgateway.client.crypt.type", crypt_conf.type);
+            cfg.dump_to("atgateway.client.crypt.benchmark_time", crypt_conf.benchmark_time);
+            cfg.dump_to("atgateway.client.crypt.max_pending", gw_mgr_.get_conf().crypt_max_pending);
 
             // rsa
             // cfg.dump_to("atgateway.client.crypt.rsa.public_key", crypt_conf.rsa_public_key);
@@ -179,6 +313,17 @@ public:
 
             // dh
             cfg.dump_to("atgateway.client.crypt.dhparam", crypt_conf.dh_param);
+            cfg.dump_to("atgateway.client.crypt.dh_pool_size", crypt_conf.dh_pool_size);
+            cfg.dump_to("atgateway.client.crypt.dh_context_number", crypt_conf.dh_context_number);
+            // worker loops and libuv threadpool may make keys at the same time, give each of them a shared context
+            if (0 == crypt_conf.dh_context_number && gw_mgr_.get_conf().listen.workers > 0) {
+                size_t      threadpool_size = 4; // default size of libuv threadpool
+                const char *threadpool_env  = getenv("UV_THREADPOOL_SIZE");
+                if (NULL != threadpool_env && atoi(threadpool_env) > 0) {
+                    threadpool_size = static_cast<size_t>(atoi(threadpool_env));
+                }
+                crypt_conf.dh_context_number = gw_mgr_.get_conf().listen.workers + threadpool_size;
+            }
             if (!crypt_conf.dh_param.empty()) {
                 if (0 == UTIL_STRFUNC_STRNCASE_CMP("ecdh:", crypt_conf.dh_param.c_str(), 5)) {
                     crypt_conf.switch_secret_type = ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH;
@@ -192,6 +337,30 @@ public:
             // cfg.dump_to("atgateway.client.crypt.hash_id", crypt_conf.hash_id);
         } while (false);
 
+        // compression
+        crypt_conf.compression_type.clear();
+        crypt_conf.compression_threshold = 1024; // 1KB
+        crypt_conf.compression_level     = 0;
+        cfg.dump_to("atgateway.client.compression.type", crypt_conf.compression_type);
+        cfg.dump_to("atgateway.client.compression.threshold", crypt_conf.compression_threshold);
+        cfg.dump_to("atgateway.client.compression.level", crypt_conf.compression_level);
+
+        // frame checksum
+        crypt_conf.checksum_type = "crc32c";
+        cfg.dump_to("atgateway.client.checksum.type", crypt_conf.checksum_type);
+
+        // messages kept to send again after reconnect
+        crypt_conf.replay_window = 65536; // 64KB
+        cfg.dump_to("atgateway.client.replay.window", crypt_conf.replay_window);
+
+        // resumption ticket
+        crypt_conf.ticket_key.clear();
+        crypt_conf.ticket_type     = "AES-256-GCM";
+        crypt_conf.ticket_lifetime = 1800; // 30min
+        cfg.dump_to("atgateway.client.ticket.key", crypt_conf.ticket_key);
+        cfg.dump_to("atgateway.client.ticket.type", crypt_conf.ticket_type);
+        cfg.dump_to("atgateway.client.ticket.lifetime", crypt_conf.ticket_lifetime);
+
         // protocol reload
         if ("inner" == gw_mgr_.get_conf().listen.type) {
             int res = ::atframe::gateway::libatgw_proto_inner_v1::global_reload(crypt_conf);
@@ -201,11 +370,20 @@ public:
             }
         }
 
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            ::atframe::gateway::session_manager::conf_t worker_conf;
+            make_worker_conf(worker_conf);
+            shards_[i]->post(std::bind(&gateway_module::worker_on_reload, &shards_[i]->get_session_manager(), worker_conf));
+        }
+
         return 0;
     }
 
     virtual int stop() UTIL_CONFIG_OVERRIDE {
+        stop_workers();
         gw_mgr_.reset();
+        groups_.reset();
+        session_routes_.clear();
         return 0;
     }
 
@@ -218,12 +396,381 @@ public:
     inline ::atframe::gateway::session_manager &      get_session_manager() { return gw_mgr_; }
     inline const ::atframe::gateway::session_manager &get_session_manager() const { return gw_mgr_; }
 
+    /**
+     * @brief send data to a session, it's run in the worker owning the session
+     * @param from server sending the data, remove notify will be sent to it if session not found
+     */
+    void push_data(::atbus::node::bus_id_t from, ::atframe::gateway::session::id_t sess_id, const void *buffer, size_t s, int priority) {
+        if (shards_.empty()) {
+            worker_push_data(&gw_mgr_, from, sess_id, buffer, s, priority);
+            return;
+        }
+
+        // buffer will be released after this returns, so copy it for workers
+        std::shared_ptr<std::string> data = std::make_shared<std::string>(reinterpret_cast<const char *>(buffer), s);
+        post_to_session(sess_id, std::bind(&gateway_module::worker_push_shared_data, std::placeholders::_1, from, sess_id, data, priority));
+    }
+
+    void multicast_data(::atbus::node::bus_id_t from, const std::vector<uint64_t> &sess_ids, const void *buffer, size_t s, int priority) {
+        if (shards_.empty()) {
+            worker_multicast_data(&gw_mgr_, from, sess_ids, buffer, s, priority);
+            return;
+        }
+
+        // group sessions by worker, so every worker only get one task
+        std::vector<std::vector<uint64_t> > worker_sess_ids;
+        worker_sess_ids.resize(shards_.size() + 1);
+        for (std::vector<uint64_t>::const_iterator iter = sess_ids.begin(); iter != sess_ids.end(); ++iter) {
+            session_route_map_t::iterator route = session_routes_.find(*iter);
+            worker_sess_ids[session_routes_.end() == route ? shards_.size() : route->second].push_back(*iter);
+        }
+
+        std::shared_ptr<std::string> data = std::make_shared<std::string>(reinterpret_cast<const char *>(buffer), s);
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            if (!worker_sess_ids[i].empty()) {
+                shards_[i]->post(std::bind(&gateway_module::worker_multicast_shared_data, &shards_[i]->get_session_manager(), from, worker_sess_ids[i],
+                                           data, priority));
+            }
+        }
+
+        // sessions not found
+        if (!worker_sess_ids[shards_.size()].empty()) {
+            worker_multicast_data(&gw_mgr_, from, worker_sess_ids[shards_.size()], buffer, s, priority);
+        }
+    }
+
+    void broadcast_data(::atbus::node::bus_id_t from, const void *buffer, size_t s, int priority) {
+        if (shards_.empty()) {
+            worker_broadcast_data(&gw_mgr_, from, buffer, s, priority);
+            return;
+        }
+
+        std::shared_ptr<std::string> data = std::make_shared<std::string>(reinterpret_cast<const char *>(buffer), s);
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            shards_[i]->post(std::bind(&gateway_module::worker_broadcast_shared_data, &shards_[i]->get_session_manager(), from, data, priority));
+        }
+    }
+
+    /**
+     * @brief close a session, it's run in the worker owning the session
+     * @param cmd_name command name to log result, NULL to skip logging
+     */
+    void close_session(::atframe::gateway::session::id_t sess_id, int reason, bool allow_reconnect, const char *cmd_name) {
+        post_to_session(sess_id, std::bind(&gateway_module::worker_close_session, std::placeholders::_1, sess_id, reason, allow_reconnect, cmd_name));
+    }
+
+    void set_session_router(::atbus::node::bus_id_t from, ::atframe::gateway::session::id_t sess_id, ::atbus::node::bus_id_t router) {
+        post_to_session(sess_id, std::bind(&gateway_module::worker_set_session_router, std::placeholders::_1, from, sess_id, router));
+    }
+
+    /**
+     * @brief add sessions into group, sessions not found are skipped
+     * @return the number of sessions joined
+     */
+    size_t join_group(::atbus::node::bus_id_t from, ::atframe::gateway::session_group::id_t group_id, const std::vector<uint64_t> &sess_ids) {
+        size_t ret = 0;
+        for (std::vector<uint64_t>::const_iterator iter = sess_ids.begin(); iter != sess_ids.end(); ++iter) {
+            // session removed will never be removed from groups if it's joined
+            if (session_routes_.end() == session_routes_.find(*iter)) {
+                WLOGERROR("from server 0x%llx: session 0x%llx join group 0x%llx failed, session not found", static_cast<unsigned long long>(from),
+                          static_cast<unsigned long long>(*iter), static_cast<unsigned long long>(group_id));
+                continue;
+            }
+
+            int res = groups_.join(group_id, *iter);
+            if (0 != res && ::atframe::gateway::error_code_t::EN_ECT_SESSION_ALREADY_EXIST != res) {
+                WLOGERROR("from server 0x%llx: session 0x%llx join group 0x%llx failed, res: %d", static_cast<unsigned long long>(from),
+                          static_cast<unsigned long long>(*iter), static_cast<unsigned long long>(group_id), res);
+                continue;
+            }
+
+            ++ret;
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief remove sessions from group, the whole group is removed if sess_ids is empty
+     * @return the number of sessions left
+     */
+    size_t leave_group(::atframe::gateway::session_group::id_t group_id, const std::vector<uint64_t> &sess_ids) {
+        if (sess_ids.empty()) {
+            return groups_.remove_group(group_id);
+        }
+
+        size_t ret = 0;
+        for (std::vector<uint64_t>::const_iterator iter = sess_ids.begin(); iter != sess_ids.end(); ++iter) {
+            if (0 == groups_.leave(group_id, *iter)) {
+                ++ret;
+            }
+        }
+
+        return ret;
+    }
+
+    void post_group(::atbus::node::bus_id_t from, ::atframe::gateway::session_group::id_t group_id, const void *buffer, size_t s, int priority) {
+        ::atframe::gateway::session_group::member_list_ptr_t sess_ids;
+        int res = groups_.get_members(group_id, sess_ids);
+        if (0 != res) {
+            WLOGERROR("from server 0x%llx: post to group 0x%llx failed, res: %d", static_cast<unsigned long long>(from),
+                      static_cast<unsigned long long>(group_id), res);
+            return;
+        }
+
+        // list is shared with the group and kept alive by sess_ids, even if members changed when sending
+        multicast_data(from, *sess_ids, buffer, s, priority);
+    }
+
 private:
+    typedef std::function<void(::atframe::gateway::session_manager *)> session_manager_fn_t;
+    typedef ATFRAME_GATEWAY_AUTO_MAP(::atframe::gateway::session::id_t, size_t) session_route_map_t;
+
+    int init_workers() {
+        int res = main_tasks_.init(get_app()->get_bus_node()->get_evloop());
+        if (0 != res) {
+            WLOGERROR("init task queue of workers failed, res: %d(%s)", res, uv_strerror(res));
+            return -1;
+        }
+
+        typedef std::unique_ptr< ::atframe::gateway::proto_base> proto_ptr_t;
+        std::vector< ::atframe::gateway::session_manager *> peers;
+        for (size_t i = 0; i < gw_mgr_.get_conf().listen.workers; ++i) {
+            std::shared_ptr< ::atframe::gateway::session_shard> shard = std::make_shared< ::atframe::gateway::session_shard>(i);
+            if (!shard || 0 != shard->init()) {
+                WLOGERROR("create worker %llu failed", static_cast<unsigned long long>(i));
+                return -1;
+            }
+            shards_.push_back(shard);
+
+            ::atframe::gateway::session_manager &mgr = shard->get_session_manager();
+            make_worker_conf(mgr.get_conf());
+            mgr.init(shard->get_evloop(), std::bind<proto_ptr_t>(&gateway_module::create_proto_inner, this));
+            mgr.set_on_create_session(
+                std::bind<int>(&gateway_module::proto_inner_callback_on_create_session, this, std::placeholders::_1, std::placeholders::_2));
+            mgr.set_post_data_fn(std::bind<int>(&gateway_module::worker_post_data, this, std::placeholders::_1, std::placeholders::_2,
+                                                std::placeholders::_3, std::placeholders::_4));
+            mgr.set_on_session_route(std::bind(&gateway_module::worker_on_session_route, this, i, std::placeholders::_1, std::placeholders::_2));
+            mgr.set_post_remove_fn(std::bind<int>(&gateway_module::worker_post_remove, this, i, std::placeholders::_1, std::placeholders::_2,
+                                                  std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+            mgr.set_post_task_fn(std::bind(&::atframe::gateway::session_shard::post, shard.get(), std::placeholders::_1));
+            peers.push_back(&mgr);
+        }
+
+        // sessions can be reconnected by a connection accepted by any worker
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            shards_[i]->get_session_manager().set_reconnect_peers(peers);
+        }
+
+        int ret = 0;
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            res = shards_[i]->start();
+            if (res <= 0) {
+                WLOGERROR("worker %llu listen failed, res: %d", static_cast<unsigned long long>(i), res);
+                return -1;
+            }
+            ret += res;
+        }
+
+        WLOGINFO("%llu workers started", static_cast<unsigned long long>(shards_.size()));
+        return ret;
+    }
+
+    void stop_workers() {
+        // sessions closed by workers will send remove notify to servers by main_tasks_
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            shards_[i]->stop();
+        }
+        shards_.clear();
+        session_routes_.clear();
+
+        main_tasks_.run();
+        main_tasks_.close();
+    }
+
+    void make_worker_conf(::atframe::gateway::session_manager::conf_t &conf) const {
+        conf = gw_mgr_.get_conf();
+        // every worker listen the same address, and kernel will balance connections to them
+        conf.listen.reuse_port = true;
+        if (conf.limits.max_client_number > 0 && conf.listen.workers > 0) {
+            conf.limits.max_client_number = (conf.limits.max_client_number + conf.listen.workers - 1) / conf.listen.workers;
+        }
+    }
+
+    void post_to_session(::atframe::gateway::session::id_t sess_id, session_manager_fn_t fn) {
+        session_route_map_t::iterator iter = session_routes_.find(sess_id);
+        if (session_routes_.end() == iter || iter->second >= shards_.size()) {
+            // gw_mgr_ has no session in worker mode, so fn will get the same result as session not found
+            fn(&gw_mgr_);
+            return;
+        }
+
+        shards_[iter->second]->post(std::bind(fn, &shards_[iter->second]->get_session_manager()));
+    }
+
+    // called in worker thread
+    int worker_post_data(::atbus::node::bus_id_t tid, int type, const void *buffer, size_t s) {
+        std::shared_ptr<std::string> data = std::make_shared<std::string>(reinterpret_cast<const char *>(buffer), s);
+        return main_tasks_.post(std::bind(&gateway_module::main_post_data, this, tid, type, data));
+    }
+
+    // called in worker thread
+    void worker_on_session_route(size_t index, ::atframe::gateway::session::id_t sess_id, bool is_add) {
+        main_tasks_.post(std::bind(&gateway_module::main_on_session_route, this, index, sess_id, is_add));
+    }
+
+    // called in worker thread
+    int worker_post_remove(size_t index, ::atframe::gateway::session::id_t sess_id, ::atbus::node::bus_id_t tid, int type, const void *buffer,
+                           size_t s) {
+        std::shared_ptr<std::string> data = std::make_shared<std::string>(reinterpret_cast<const char *>(buffer), s);
+        return main_tasks_.post(std::bind(&gateway_module::main_post_remove, this, index, sess_id, tid, type, data));
+    }
+
+    void main_post_data(::atbus::node::bus_id_t tid, int type, const std::shared_ptr<std::string> &data) {
+        int res = gw_mgr_.post_data(tid, type, data->data(), data->size());
+        if (0 != res) {
+            WLOGERROR("send data from workers to server 0x%llx failed, res: %d", static_cast<unsigned long long>(tid), res);
+        }
+    }
+
+    void main_on_session_route(size_t index, ::atframe::gateway::session::id_t sess_id, bool is_add) {
+        if (is_add) {
+            session_routes_[sess_id] = index;
+            return;
+        }
+
+        // session may be reconnected in another worker
+        session_route_map_t::iterator iter = session_routes_.find(sess_id);
+        if (session_routes_.end() != iter && iter->second == index) {
+            session_routes_.erase(iter);
+            groups_.remove_session(sess_id);
+        }
+    }
+
+    void main_post_remove(size_t index, ::atframe::gateway::session::id_t sess_id, ::atbus::node::bus_id_t tid, int type,
+                          const std::shared_ptr<std::string> &data) {
+        // session id may be reconnected or resumed in another worker, and server should keep it
+        session_route_map_t::iterator iter = session_routes_.find(sess_id);
+        if (session_routes_.end() != iter && iter->second != index) {
+            WLOGDEBUG("session 0x%llx is routed to worker %llu now, skip remove notify from worker %llu", static_cast<unsigned long long>(sess_id),
+                      static_cast<unsigned long long>(iter->second), static_cast<unsigned long long>(index));
+            return;
+        }
+
+        main_on_session_route(index, sess_id, false);
+        main_post_data(tid, type, data);
+    }
+
+    static void worker_on_reload(::atframe::gateway::session_manager *mgr, const ::atframe::gateway::session_manager::conf_t &conf) {
+        mgr->get_conf() = conf;
+    }
+
+    static void worker_push_data(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, ::atframe::gateway::session::id_t sess_id,
+                                 const void *buffer, size_t s, int priority) {
+        int res = mgr->push_data(sess_id, buffer, s, priority);
+        if (0 != res) {
+            WLOGERROR("from server 0x%llx: session 0x%llx push data failed, res: %d ", static_cast<unsigned long long>(from),
+                      static_cast<unsigned long long>(sess_id), res);
+
+            // session not found, maybe gateway has restarted or server cache expired without remove
+            // notify to remove the expired session
+            if (::atframe::gateway::error_code_t::EN_ECT_SESSION_NOT_FOUND == res) {
+                ::atframe::gw::ss_msg rsp;
+                rsp.init(ATFRAME_GW_CMD_SESSION_REMOVE, sess_id);
+                res = mgr->post_data(from, rsp);
+                if (0 != res) {
+                    WLOGERROR("send remove notify to server 0x%llx failed, res: %d", static_cast<unsigned long long>(from), res);
+                }
+            }
+        }
+    }
+
+    static void worker_push_shared_data(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, ::atframe::gateway::session::id_t sess_id,
+                                        const std::shared_ptr<std::string> &data, int priority) {
+        worker_push_data(mgr, from, sess_id, data->data(), data->size(), priority);
+    }
+
+    static void worker_multicast_data(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, const std::vector<uint64_t> &sess_ids,
+                                      const void *buffer, size_t s, int priority) {
+        size_t not_found_number = 0;
+        int    res              = mgr->multicast_data(sess_ids, buffer, s, priority, not_found_number);
+        if (0 != res || 0 != not_found_number) {
+            WLOGERROR("from server 0x%llx: multicast data to %llu sessions failed, %llu sessions not found, res: %d ", static_cast<unsigned long long>(from),
+                      static_cast<unsigned long long>(sess_ids.size()), static_cast<unsigned long long>(not_found_number), res);
+        }
+    }
+
+    static void worker_multicast_shared_data(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, const std::vector<uint64_t> &sess_ids,
+                                             const std::shared_ptr<std::string> &data, int priority) {
+        worker_multicast_data(mgr, from, sess_ids, data->data(), data->size(), priority);
+    }
+
+    static void worker_broadcast_data(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, const void *buffer, size_t s, int priority) {
+        int res = mgr->broadcast_data(buffer, s, priority);
+        if (0 != res) {
+            WLOGERROR("from server 0x%llx: broadcast data failed, res: %d ", static_cast<unsigned long long>(from), res);
+        }
+    }
+
+    static void worker_broadcast_shared_data(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, const std::shared_ptr<std::string> &data,
+                                             int priority) {
+        worker_broadcast_data(mgr, from, data->data(), data->size(), priority);
+    }
+
+    static void worker_close_session(::atframe::gateway::session_manager *mgr, ::atframe::gateway::session::id_t sess_id, int reason, bool allow_reconnect,
+                                     const char *cmd_name) {
+        int res = mgr->close(sess_id, reason, allow_reconnect);
+        if (NULL == cmd_name) {
+            return;
+        }
+
+        if (0 != res) {
+            WLOGERROR("command %s session 0x%llx failed, res: %d", cmd_name, static_cast<unsigned long long>(sess_id), res);
+        } else {
+            WLOGINFO("command %s session 0x%llx success", cmd_name, static_cast<unsigned long long>(sess_id));
+        }
+    }
+
+    static void worker_set_session_router(::atframe::gateway::session_manager *mgr, ::atbus::node::bus_id_t from, ::atframe::gateway::session::id_t sess_id,
+                                          ::atbus::node::bus_id_t router) {
+        int res = mgr->set_session_router(sess_id, router);
+        WLOGINFO("from server 0x%llx: session 0x%llx set router to 0x%llx by server, res: %d", static_cast<unsigned long long>(from),
+                 static_cast<unsigned long long>(sess_id), static_cast<unsigned long long>(router), res);
+
+        ::atframe::gw::ss_msg rsp;
+        rsp.init(ATFRAME_GW_CMD_SET_ROUTER_RSP, sess_id);
+        rsp.head.error_code = res;
+
+        res = mgr->post_data(from, rsp);
+        if (0 != res) {
+            WLOGERROR("send set router response to server 0x%llx failed, res: %d", static_cast<unsigned long long>(from), res);
+        }
+    }
+
+    static void worker_log_memory_usage(::atframe::gateway::session_manager *mgr, size_t index) {
+        size_t session_number = 0;
+        size_t total_bytes    = mgr->get_memory_usage(session_number);
+        WLOGINFO("command memory_usage: worker %llu, %llu sessions use %llu bytes, %llu bytes per session", static_cast<unsigned long long>(index),
+                 static_cast<unsigned long long>(session_number), static_cast<unsigned long long>(total_bytes),
+                 static_cast<unsigned long long>(0 == session_number ? 0 : total_bytes / session_number));
+    }
+
+    /**
+     * @brief get session manager of session, it's only NULL in worker mode when session lost its fd
+     */
+    ::atframe::gateway::session_manager *get_session_manager(::atframe::gateway::session *sess) {
+        if (NULL != sess && NULL != sess->get_manager()) {
+            return sess->get_manager();
+        }
+
+        return shards_.empty() ? &gw_mgr_ : NULL;
+    }
+
     std::unique_ptr< ::atframe::gateway::proto_base> create_proto_inner() {
         ::atframe::gateway::libatgw_proto_inner_v1 *ret = new (std::nothrow)::atframe::gateway::libatgw_proto_inner_v1();
         if (NULL != ret) {
             ret->set_callbacks(&proto_callbacks_);
-            ret->set_write_header_offset(sizeof(uv_write_t));
+            // uv_write_t is allocated from write_req_pool_t only when writing, so no headspace is needed in message blocks
         }
 
         return std::unique_ptr< ::atframe::gateway::proto_base>(ret);
@@ -311,10 +858,39 @@ private:
         return 0;
     }
 
+    static write_req_t *alloc_write_req() {
+        write_req_pool_t *pool = get_tls_write_req_pool();
+        if (NULL == pool || pool->free_reqs.empty()) {
+            return new (std::nothrow) write_req_t();
+        }
+
+        write_req_t *ret = pool->free_reqs.back();
+        pool->free_reqs.pop_back();
+        return ret;
+    }
+
+    static void release_write_req(write_req_t *req) {
+        if (NULL == req) {
+            return;
+        }
+
+        req->req.data = NULL;
+        write_req_pool_t *pool = get_tls_write_req_pool();
+        if (NULL == pool) {
+            delete req;
+            return;
+        }
+        pool->free_reqs.push_back(req);
+    }
+
     static void proto_inner_callback_on_written_fn(uv_write_t *req, int status) {
         ::atframe::gateway::session *sess = reinterpret_cast< ::atframe::gateway::session *>(req->data);
         assert(sess);
 
+        // req is always the first member of write_req_t, give it back before on_write_done(status) which may start a new writing
+        write_req_t *write_req = reinterpret_cast<write_req_t *>(req);
+        release_write_req(write_req);
+
         if (NULL != sess) {
             sess->set_flag(::atframe::gateway::session::flag_t::EN_FT_WRITING_FD, false);
             sess->on_write_done(status);
@@ -340,19 +916,25 @@ private:
         assert(sz >= proto->get_write_header_offset());
         int ret = 0;
         do {
-            // uv_write_t
             void *real_buffer = ::atbus::detail::fn::buffer_next(buffer, proto->get_write_header_offset());
             sz -= proto->get_write_header_offset();
-            uv_write_t *req = reinterpret_cast<uv_write_t *>(buffer);
-            req->data       = proto->get_private_data();
-            assert(sizeof(uv_write_t) <= proto->get_write_header_offset());
+
+            // uv_write_t
+            write_req_t *write_req = alloc_write_req();
+            if (NULL == write_req) {
+                ret = ::atframe::gateway::error_code_t::EN_ECT_MALLOC;
+                WLOGERROR("send data to proto %p failed, malloc uv_write_t failed", proto);
+                break;
+            }
+            write_req->req.data = proto->get_private_data();
 
             uv_buf_t bufs[1] = {uv_buf_init(reinterpret_cast<char *>(real_buffer), static_cast<unsigned int>(sz))};
             sess->set_flag(::atframe::gateway::session::flag_t::EN_FT_WRITING_FD, true);
 
-            ret = uv_write(req, sess->get_uv_stream(), bufs, 1, proto_inner_callback_on_written_fn);
+            ret = uv_write(&write_req->req, sess->get_uv_stream(), bufs, 1, proto_inner_callback_on_written_fn);
             if (0 != ret) {
                 sess->set_flag(::atframe::gateway::session::flag_t::EN_FT_WRITING_FD, false);
+                release_write_req(write_req);
                 WLOGERROR("send data to proto %p failed, res: %d", proto, ret);
             }
 
@@ -365,6 +947,59 @@ private:
         return ret;
     }
 
+    int proto_inner_callback_on_writev(::atframe::gateway::proto_base *proto, ::atframe::gateway::proto_base::write_vector_t *bufs, size_t bufs_num,
+                                       bool *is_done) {
+        if (NULL == proto || NULL == bufs || 0 == bufs_num || bufs_num > ATFRAME_GATEWAY_MACRO_WRITEV_MAX_BLOCKS) {
+            if (NULL != is_done) {
+                *is_done = true;
+            }
+            return ::atframe::gateway::error_code_t::EN_ECT_PARAM;
+        }
+
+        ::atframe::gateway::session *sess = reinterpret_cast< ::atframe::gateway::session *>(proto->get_private_data());
+        if (NULL == sess) {
+            if (NULL != is_done) {
+                *is_done = true;
+            }
+            return -1;
+        }
+
+        int ret = 0;
+        do {
+            // one uv_write_t for all buffers
+            write_req_t *write_req = alloc_write_req();
+            if (NULL == write_req) {
+                ret = ::atframe::gateway::error_code_t::EN_ECT_MALLOC;
+                WLOGERROR("send %llu buffers to proto %p failed, malloc uv_write_t failed", static_cast<unsigned long long>(bufs_num), proto);
+                break;
+            }
+            write_req->req.data = proto->get_private_data();
+
+            // uv_write will copy the uv_buf_t list, so it's safe to use a stack array here
+            uv_buf_t uv_bufs[ATFRAME_GATEWAY_MACRO_WRITEV_MAX_BLOCKS];
+            for (size_t i = 0; i < bufs_num; ++i) {
+                assert(bufs[i].length >= proto->get_write_header_offset());
+                void *real_buffer = ::atbus::detail::fn::buffer_next(bufs[i].buffer, proto->get_write_header_offset());
+                uv_bufs[i] = uv_buf_init(reinterpret_cast<char *>(real_buffer), static_cast<unsigned int>(bufs[i].length - proto->get_write_header_offset()));
+            }
+            sess->set_flag(::atframe::gateway::session::flag_t::EN_FT_WRITING_FD, true);
+
+            ret = uv_write(&write_req->req, sess->get_uv_stream(), uv_bufs, static_cast<unsigned int>(bufs_num), proto_inner_callback_on_written_fn);
+            if (0 != ret) {
+                sess->set_flag(::atframe::gateway::session::flag_t::EN_FT_WRITING_FD, false);
+                release_write_req(write_req);
+                WLOGERROR("send %llu buffers to proto %p failed, res: %d", static_cast<unsigned long long>(bufs_num), proto, ret);
+            }
+
+        } while (false);
+
+        if (NULL != is_done) {
+            // if not writting, notify write finished
+            *is_done = !sess->check_flag(::atframe::gateway::session::flag_t::EN_FT_WRITING_FD);
+        }
+        return ret;
+    }
+
     int proto_inner_callback_on_message(::atframe::gateway::proto_base *proto, const void *buffer, size_t sz) {
         ::atframe::gateway::session *sess = reinterpret_cast< ::atframe::gateway::session *>(proto->get_private_data());
         if (NULL == sess) {
@@ -373,6 +1008,13 @@ private:
         }
         ::atframe::gateway::session::ptr_t sess_holder = sess->shared_from_this();
 
+        // traffic shaping, message may be dropped or session may be closed here
+        if (!sess_holder->check_recv_limit(sz)) {
+            WLOGDEBUG("session 0x%llx drop %llu bytes data by traffic limit", static_cast<unsigned long long>(sess_holder->get_id()),
+                      static_cast<unsigned long long>(sz));
+            return 0;
+        }
+
         ::atframe::gw::ss_msg post_msg;
         post_msg.init(ATFRAME_GW_CMD_POST, sess_holder->get_id());
         post_msg.head.error_code = 0;
@@ -382,7 +1024,12 @@ private:
         WLOGDEBUG("session 0x%llx send %llu bytes data to server 0x%llx", static_cast<unsigned long long>(sess_holder->get_id()),
                   static_cast<unsigned long long>(sz), static_cast<unsigned long long>(sess_holder->get_router()));
 
-        return gw_mgr_.post_data(sess_holder->get_router(), post_msg);
+        ::atframe::gateway::session_manager *mgr = get_session_manager(sess);
+        if (NULL == mgr) {
+            WLOGERROR("session 0x%llx(%p) recv message but it's not in any worker", static_cast<unsigned long long>(sess_holder->get_id()), sess);
+            return -1;
+        }
+        return mgr->post_data(sess_holder->get_router(), post_msg);
     }
 
     int proto_inner_callback_on_new_session(::atframe::gateway::proto_base *proto, uint64_t &sess_id) {
@@ -393,10 +1040,19 @@ private:
         }
         ::atframe::gateway::session::ptr_t sess_holder = sess->shared_from_this();
 
-        int ret = sess_holder->init_new_session(gw_mgr_.get_conf().default_router);
-        sess_id = sess_holder->get_id();
+        ::atframe::gateway::session_manager *mgr = get_session_manager(sess);
+        if (NULL == mgr) {
+            WLOGERROR("create new session from proto object %p, but it's not in any worker", proto);
+            return -1;
+        }
+
+        uint64_t resume_id = sess_id;
+        int      ret       = sess_holder->init_new_session(mgr->get_conf().default_router, resume_id);
+        sess_id            = sess_holder->get_id();
         if (0 != ret) {
             WLOGERROR("create new session failed, ret: %d", ret);
+        } else if (0 != resume_id) {
+            WLOGINFO("session 0x%llx(%p) resumed by ticket", static_cast<unsigned long long>(sess_id), sess);
         }
 
         return ret;
@@ -422,8 +1078,18 @@ private:
             return -1;
         }
 
-        int res = gw_mgr_.reconnect(*sess_holder, sess_id);
-        if (0 != res) {
+        ::atframe::gateway::session_manager *mgr = get_session_manager(sess);
+        if (NULL == mgr) {
+            WLOGERROR("try to reconnect session 0x%llx(%p) from 0x%llx, but it's not in any worker", static_cast<unsigned long long>(sess_holder->get_id()),
+                      sess, static_cast<unsigned long long>(sess_id));
+            return -1;
+        }
+
+        int res = mgr->reconnect(*sess_holder, sess_id);
+        if (::atframe::gateway::error_code_t::EN_ECT_RECONNECT_PENDING == res) {
+            WLOGDEBUG("reconnect session 0x%llx(%p) from 0x%llx, waiting for another worker", static_cast<unsigned long long>(sess_holder->get_id()), sess,
+                      static_cast<unsigned long long>(sess_id));
+        } else if (0 != res) {
             if (::atframe::gateway::error_code_t::EN_ECT_SESSION_NOT_FOUND != res && ::atframe::gateway::error_code_t::EN_ECT_REFUSE_RECONNECT != res) {
                 WLOGERROR("reconnect session 0x%llx(%p) from 0x%llx failed, res: %d", static_cast<unsigned long long>(sess_holder->get_id()), sess,
                           static_cast<unsigned long long>(sess_id), res);
@@ -488,7 +1154,8 @@ private:
 
             WLOGINFO("session 0x%llx(%p) handshake done\n%s", static_cast<unsigned long long>(sess->get_id()), sess, proto->get_info().c_str());
 
-            int res = gw_mgr_.active_session(sess_holder);
+            ::atframe::gateway::session_manager *mgr = get_session_manager(sess);
+            int                                  res = NULL == mgr ? ::atframe::gateway::error_code_t::EN_ECT_CLOSING : mgr->active_session(sess_holder);
             if (0 != res) {
                 WLOGERROR("session 0x%llx send new session to router server failed, res: %d", static_cast<unsigned long long>(sess->get_id()), res);
                 return -1;
@@ -524,6 +1191,71 @@ private:
         return 0;
     }
 
+    static void proto_inner_callback_on_async_work_run(uv_work_t *req) {
+        // req is always the first member of async_work_req_t
+        async_work_req_t *work_req = reinterpret_cast<async_work_req_t *>(req);
+        if (work_req->work_fn) {
+            work_req->work_fn();
+        }
+    }
+
+    static void proto_inner_callback_on_async_work_done(uv_work_t *req, int status) {
+        async_work_req_t *work_req = reinterpret_cast<async_work_req_t *>(req);
+        assert(work_req->owner->async_work_pending_.load() > 0);
+        --work_req->owner->async_work_pending_;
+
+        if (work_req->done_fn) {
+            work_req->done_fn(UV_ECANCELED == status ? ::atframe::gateway::error_code_t::EN_ECT_CLOSING : status);
+        }
+        delete work_req;
+    }
+
+    int proto_inner_callback_on_async_work(::atframe::gateway::proto_base *proto, ::atframe::gateway::proto_base::async_work_fn_t work_fn,
+                                           ::atframe::gateway::proto_base::async_done_fn_t done_fn) {
+        if (NULL == proto || !work_fn || !done_fn) {
+            return ::atframe::gateway::error_code_t::EN_ECT_PARAM;
+        }
+
+        ::atframe::gateway::session *sess = reinterpret_cast< ::atframe::gateway::session *>(proto->get_private_data());
+        ::atframe::gateway::session_manager *mgr = get_session_manager(sess);
+        if (NULL == sess || NULL == mgr || NULL == sess->get_uv_stream()) {
+            return ::atframe::gateway::error_code_t::EN_ECT_CLOSING;
+        }
+
+        // run in event loop if crypt workers are disabled
+        if (0 == mgr->get_conf().crypt_max_pending) {
+            work_fn();
+            done_fn(0);
+            return 0;
+        }
+
+        // the limit is shared by all workers, because they share the same libuv threadpool
+        if (async_work_pending_.load() >= mgr->get_conf().crypt_max_pending) {
+            return ::atframe::gateway::error_code_t::EN_ECT_BUSY;
+        }
+
+        async_work_req_t *work_req = new (std::nothrow) async_work_req_t();
+        if (NULL == work_req) {
+            WLOGERROR("run async work of proto %p failed, malloc uv_work_t failed", proto);
+            return ::atframe::gateway::error_code_t::EN_ECT_MALLOC;
+        }
+        work_req->owner = this;
+        work_req->work_fn.swap(work_fn);
+        work_req->done_fn.swap(done_fn);
+
+        // works are run by libuv threadpool, whose size is set by UV_THREADPOOL_SIZE, and done in the loop of session
+        int res = uv_queue_work(sess->get_uv_stream()->loop, &work_req->req, proto_inner_callback_on_async_work_run,
+                                proto_inner_callback_on_async_work_done);
+        if (0 != res) {
+            delete work_req;
+            WLOGERROR("run async work of proto %p failed, res: %d", proto, res);
+            return res;
+        }
+
+        ++async_work_pending_;
+        return 0;
+    }
+
     int proto_inner_callback_on_error(::atframe::gateway::proto_base *, const char *filename, int line, int errcode, const char *errmsg) {
         if (::util::log::log_wrapper::check_level(WDTLOGGETCAT(::util::log::log_wrapper::categorize_t::DEFAULT),
                                                   ::util::log::log_wrapper::level_t::LOG_LW_ERROR)) {
@@ -551,13 +1283,7 @@ public:
         }
 
         // do not allow reconnect
-        int res = gw_mgr_.close(sess_id, reason, false);
-        if (0 != res) {
-            WLOGERROR("command kickoff session 0x%llx failed, res: %d", static_cast<unsigned long long>(sess_id), res);
-        } else {
-            WLOGINFO("command kickoff session 0x%llx success", static_cast<unsigned long long>(sess_id));
-        }
-
+        close_session(sess_id, reason, false, "kickoff");
         return 0;
     }
 
@@ -575,20 +1301,52 @@ public:
             util::string::str2int(reason, params[1]->to_string());
         }
 
-        // do not allow reconnect
-        int res = gw_mgr_.close(sess_id, reason, true);
-        if (0 != res) {
-            WLOGERROR("command disconnect session 0x%llx failed, res: %d", static_cast<unsigned long long>(sess_id), res);
-        } else {
-            WLOGINFO("command disconnect session 0x%llx success", static_cast<unsigned long long>(sess_id));
+        // allow reconnect
+        close_session(sess_id, reason, true, "disconnect");
+        return 0;
+    }
+
+    int cmd_on_crypt_benchmark(util::cli::callback_param) {
+        std::vector< ::atframe::gateway::libatgw_proto_inner_v1::crypt_benchmark_t> benchmarks;
+        ::atframe::gateway::libatgw_proto_inner_v1::get_crypt_benchmark(benchmarks);
+        if (benchmarks.empty()) {
+            WLOGINFO("command crypt_benchmark: no benchmark result, crypt is disabled or client.crypt.benchmark_time is 0");
+            return 0;
+        }
+
+        for (size_t i = 0; i < benchmarks.size(); ++i) {
+            WLOGINFO("command crypt_benchmark: %llu. %s, %llu bytes/s", static_cast<unsigned long long>(i + 1), benchmarks[i].type.c_str(),
+                     static_cast<unsigned long long>(benchmarks[i].bytes_per_second));
         }
 
         return 0;
     }
 
+    int cmd_on_memory_usage(util::cli::callback_param) {
+        // every worker log its own usage
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            shards_[i]->post(std::bind(&gateway_module::worker_log_memory_usage, &shards_[i]->get_session_manager(), i));
+        }
+
+        size_t session_number = 0;
+        size_t total_bytes    = gw_mgr_.get_memory_usage(session_number);
+        WLOGINFO("command memory_usage: %llu sessions use %llu bytes, %llu bytes per session", static_cast<unsigned long long>(session_number),
+                 static_cast<unsigned long long>(total_bytes), static_cast<unsigned long long>(0 == session_number ? 0 : total_bytes / session_number));
+        return 0;
+    }
+
 private:
     ::atframe::gateway::session_manager               gw_mgr_;
     ::atframe::gateway::proto_base::proto_callbacks_t proto_callbacks_;
+
+    // workers running sessions, it's empty if sessions run in the loop of atapp
+    std::vector<std::shared_ptr< ::atframe::gateway::session_shard> > shards_;
+    session_route_map_t                                                 session_routes_; /** session id => index of worker **/
+    ::atframe::gateway::session_group                                   groups_;         /** groups of sessions, only used in the loop of atapp **/
+    ::atframe::gateway::task_queue                                      main_tasks_;     /** tasks from workers, run in the loop of atapp **/
+
+    // number of works waiting for or running in libuv threadpool
+    std::atomic<size_t> async_work_pending_;
 };
 
 struct app_handle_on_recv {
@@ -616,40 +1374,21 @@ struct app_handle_on_recv {
                 break;
             }
 
-            // post to single client
-            if (0 != msg.head.session_id && msg.body.post->session_ids.empty()) {
+            // post to group
+            if (0 != msg.body.post->group_id) {
+                mod_.get().post_group(recv_msg.body.forward->from, msg.body.post->group_id, msg.body.post->content.ptr, msg.body.post->content.size,
+                                      msg.body.post->priority);
+            } else if (0 != msg.head.session_id && msg.body.post->session_ids.empty()) { // post to single client
                 WLOGDEBUG("from server 0x%llx: session 0x%llx send %llu bytes data to client", static_cast<unsigned long long>(recv_msg.body.forward->from),
                           static_cast<unsigned long long>(msg.head.session_id), static_cast<unsigned long long>(msg.body.post->content.size));
 
-                int res = mod_.get().get_session_manager().push_data(msg.head.session_id, msg.body.post->content.ptr, msg.body.post->content.size);
-                if (0 != res) {
-                    WLOGERROR("from server 0x%llx: session 0x%llx push data failed, res: %d ", static_cast<unsigned long long>(recv_msg.body.forward->from),
-                              static_cast<unsigned long long>(msg.head.session_id), res);
-
-                    // session not found, maybe gateway has restarted or server cache expired without remove
-                    // notify to remove the expired session
-                    if (::atframe::gateway::error_code_t::EN_ECT_SESSION_NOT_FOUND == res) {
-                        ::atframe::gw::ss_msg rsp;
-                        rsp.init(ATFRAME_GW_CMD_SESSION_REMOVE, msg.head.session_id);
-                        res = mod_.get().get_session_manager().post_data(recv_msg.body.forward->from, rsp);
-                        if (0 != res) {
-                            WLOGERROR("send remove notify to server 0x%llx failed, res: %d", static_cast<unsigned long long>(recv_msg.body.forward->from), res);
-                        }
-                    }
-                }
+                mod_.get().push_data(recv_msg.body.forward->from, msg.head.session_id, msg.body.post->content.ptr, msg.body.post->content.size,
+                                     msg.body.post->priority);
             } else if (msg.body.post->session_ids.empty()) { // broadcast to all actived session
-                int res = mod_.get().get_session_manager().broadcast_data(msg.body.post->content.ptr, msg.body.post->content.size);
-                if (0 != res) {
-                    WLOGERROR("from server 0x%llx: broadcast data failed, res: %d ", static_cast<unsigned long long>(recv_msg.body.forward->from), res);
-                }
+                mod_.get().broadcast_data(recv_msg.body.forward->from, msg.body.post->content.ptr, msg.body.post->content.size, msg.body.post->priority);
             } else { // multicast to more than one client
-                for (std::vector<uint64_t>::iterator iter = msg.body.post->session_ids.begin(); iter != msg.body.post->session_ids.end(); ++iter) {
-                    int res = mod_.get().get_session_manager().push_data(*iter, msg.body.post->content.ptr, msg.body.post->content.size);
-                    if (0 != res) {
-                        WLOGERROR("from server 0x%llx: session 0x%llx push data failed, res: %d ", static_cast<unsigned long long>(recv_msg.body.forward->from),
-                                  static_cast<unsigned long long>(*iter), res);
-                    }
-                }
+                mod_.get().multicast_data(recv_msg.body.forward->from, msg.body.post->session_ids, msg.body.post->content.ptr, msg.body.post->content.size,
+                                          msg.body.post->priority);
             }
             break;
         }
@@ -657,27 +1396,40 @@ struct app_handle_on_recv {
             WLOGINFO("from server 0x%llx: session 0x%llx kickoff by server", static_cast<unsigned long long>(recv_msg.body.forward->from),
                      static_cast<unsigned long long>(msg.head.session_id));
             if (0 == msg.head.error_code) {
-                mod_.get().get_session_manager().close(msg.head.session_id, ::atframe::gateway::close_reason_t::EN_CRT_KICKOFF);
+                mod_.get().close_session(msg.head.session_id, ::atframe::gateway::close_reason_t::EN_CRT_KICKOFF, false, NULL);
             } else {
-                mod_.get().get_session_manager().close(msg.head.session_id, msg.head.error_code,
-                                                       msg.head.error_code > 0 &&
-                                                           msg.head.error_code < ::atframe::gateway::close_reason_t::EN_CRT_RECONNECT_BOUND);
+                mod_.get().close_session(msg.head.session_id, msg.head.error_code,
+                                         msg.head.error_code > 0 && msg.head.error_code < ::atframe::gateway::close_reason_t::EN_CRT_RECONNECT_BOUND, NULL);
             }
             break;
         }
         case ATFRAME_GW_CMD_SET_ROUTER_REQ: {
-            int res = mod_.get().get_session_manager().set_session_router(msg.head.session_id, msg.body.router);
-            WLOGINFO("from server 0x%llx: session 0x%llx set router to 0x%llx by server, res: %d", static_cast<unsigned long long>(recv_msg.body.forward->from),
-                     static_cast<unsigned long long>(msg.head.session_id), static_cast<unsigned long long>(msg.body.router), res);
+            mod_.get().set_session_router(recv_msg.body.forward->from, msg.head.session_id, msg.body.router);
+            break;
+        }
+        case ATFRAME_GW_CMD_GROUP_JOIN:
+        case ATFRAME_GW_CMD_GROUP_LEAVE: {
+            if (NULL == msg.body.group) {
+                WLOGERROR("from server 0x%llx: recv bad group body", static_cast<unsigned long long>(recv_msg.body.forward->from));
+                break;
+            }
 
-            ::atframe::gw::ss_msg rsp;
-            rsp.init(ATFRAME_GW_CMD_SET_ROUTER_RSP, msg.head.session_id);
-            rsp.head.error_code = res;
+            // use session id in head if there is no session list
+            std::vector<uint64_t> &sess_ids = msg.body.group->session_ids;
+            if (sess_ids.empty() && 0 != msg.head.session_id) {
+                sess_ids.push_back(msg.head.session_id);
+            }
 
-            res = mod_.get().get_session_manager().post_data(recv_msg.body.forward->from, rsp);
-            if (0 != res) {
-                WLOGERROR("send set router response to server 0x%llx failed, res: %d", static_cast<unsigned long long>(recv_msg.body.forward->from), res);
+            size_t num;
+            if (ATFRAME_GW_CMD_GROUP_JOIN == msg.head.cmd) {
+                num = mod_.get().join_group(recv_msg.body.forward->from, msg.body.group->group_id, sess_ids);
+            } else {
+                num = mod_.get().leave_group(msg.body.group->group_id, sess_ids);
             }
+
+            WLOGDEBUG("from server 0x%llx: %llu sessions %s group 0x%llx", static_cast<unsigned long long>(recv_msg.body.forward->from),
+                      static_cast<unsigned long long>(num), ATFRAME_GW_CMD_GROUP_JOIN == msg.head.cmd ? "join" : "leave",
+                      static_cast<unsigned long long>(msg.body.group->group_id));
             break;
         }
         default: {
@@ -719,6 +1471,12 @@ int main(int argc, char *argv[]) {
     cmgr->bind_cmd("disconnect", &gateway_module::cmd_on_disconnect, gw_mod.get())
         ->set_help_msg("disconnect <session id> [reason]       disconnect a session, session can be reconnected later.");
 
+    cmgr->bind_cmd("crypt_benchmark", &gateway_module::cmd_on_crypt_benchmark, gw_mod.get())
+        ->set_help_msg("crypt_benchmark                        show throughput of crypt types, the fastest one is preferred in handshake.");
+
+    cmgr->bind_cmd("memory_usage", &gateway_module::cmd_on_memory_usage, gw_mod.get())
+        ->set_help_msg("memory_usage                           show memory used by sessions, it's approximate and used to size hosts.");
+
     // setup message handle
     app.set_evt_on_send_fail(app_handle_on_send_fail);
     app.set_evt_on_recv_msg(app_handle_on_recv(*gw_mod));
@@ -1,6 +1,12 @@
 ﻿#include <algorithm>
+#include <condition_variable>
 #include <limits>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
 #include <sstream>
+#include <thread>
 
 #include "algorithm/murmur_hash.h"
 #include "common/string_oprs.h"
@@ -11,6 +17,36 @@
 
 #include "libatgw_proto_inner.h"
 
+#include "config/atframe_utils_build_feature.h"
+#include "std/thread.h"
+
+#if (defined(THREAD_TLS_USE_PTHREAD) && THREAD_TLS_USE_PTHREAD) || !(defined(THREAD_TLS_ENABLED) && THREAD_TLS_ENABLED)
+#include <pthread.h>
+#endif
+
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(ATFRAME_GATEWAY_ENABLE_LZ4) && ATFRAME_GATEWAY_ENABLE_LZ4
+#include <lz4.h>
+#endif
+
+// crc32c instructions of frame checksum, SSE4.2 is detected when running
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define ATFRAME_GATEWAY_CRC32C_ARM 1
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define ATFRAME_GATEWAY_CRC32C_SSE42 1
+#define ATFRAME_GATEWAY_CRC32C_SSE42_TARGET __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define ATFRAME_GATEWAY_CRC32C_SSE42 1
+#define ATFRAME_GATEWAY_CRC32C_SSE42_TARGET
+#endif
+
 #if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1600)
 
 #include <unordered_map>
@@ -27,35 +63,846 @@
 
 #endif
 
-// DEBUG CIPHER PROGRESS
-#ifdef LIBATFRAME_ATGATEWAY_ENABLE_CIPHER_DEBUG
-#include <fstream>
-std::fstream debuger_fout = std::fstream("debug.log", std::ios::out);
+// DEBUG CIPHER PROGRESS
+#ifdef LIBATFRAME_ATGATEWAY_ENABLE_CIPHER_DEBUG
+#include <fstream>
+std::fstream debuger_fout = std::fstream("debug.log", std::ios::out);
+#endif
+
+namespace atframe {
+    namespace gateway {
+        namespace detail {
+            static uint64_t alloc_seq() {
+                static ::util::lock::seq_alloc_u64 seq_alloc;
+                uint64_t                           ret = seq_alloc.inc();
+                while (0 == ret) {
+                    ret = seq_alloc.inc();
+                }
+                return ret;
+            }
+
+            // flatbuffers will use some bytes for vtables, alignment padding and scratch data besides the message body
+            static const size_t reserved_msg_extend_size = 256;
+
+            // kinds of data cached in proto_base::broadcast_cache_t
+            struct broadcast_block_t {
+                enum type {
+                    EN_BBT_COMPRESSED = 0x1001, /** compressed post data, key is compression type and level **/
+                    EN_BBT_FRAME,               /** the whole frame without encryption, key is compression and checksum **/
+                };
+            };
+
+            /**
+             * @brief flatbuffers allocator which let the builder write into a block reserved in write buffer
+             * @note flatbuffers build message from back to front, so the finished message is always at the end of the reserved buffer.
+             *       If the builder grows out of the reserved buffer, it will fall back to heap memory.
+             */
+            class reserved_msg_allocator : public ::flatbuffers::Allocator {
+            public:
+                reserved_msg_allocator(void *buf, size_t len) : buffer_(reinterpret_cast<uint8_t *>(buf)), length_(len), used_(false) {}
+
+                virtual uint8_t *allocate(size_t size) {
+                    if (!used_ && NULL != buffer_ && size <= length_) {
+                        used_ = true;
+                        return buffer_ + (length_ - size);
+                    }
+
+                    return new uint8_t[size];
+                }
+
+                virtual void deallocate(uint8_t *p, size_t) {
+                    if (p >= buffer_ && p < buffer_ + length_) {
+                        used_ = false;
+                        return;
+                    }
+
+                    delete[] p;
+                }
+
+            private:
+                uint8_t *buffer_;
+                size_t   length_;
+                bool     used_;
+            };
+
+            // free blocks of receive staging buffer, shared by all sessions in the same thread(loop)
+            struct read_head_pool_t {
+                std::vector<void *> free_blocks;
+
+                ~read_head_pool_t() {
+                    for (size_t i = 0; i < free_blocks.size(); ++i) {
+                        delete[] reinterpret_cast<char *>(free_blocks[i]);
+                    }
+                    free_blocks.clear();
+                }
+            };
+
+#if !(defined(THREAD_TLS_USE_PTHREAD) && THREAD_TLS_USE_PTHREAD) && defined(THREAD_TLS_ENABLED) && THREAD_TLS_ENABLED
+            static read_head_pool_t *get_tls_read_head_pool() {
+                static THREAD_TLS read_head_pool_t *ret = NULL;
+                if (NULL == ret) {
+                    ret = new (std::nothrow) read_head_pool_t();
+                }
+                return ret;
+            }
+#else
+            static pthread_once_t gt_atgateway_read_head_pool_tls_once = PTHREAD_ONCE_INIT;
+            static pthread_key_t  gt_atgateway_read_head_pool_tls_key;
+
+            static void dtor_pthread_atgateway_read_head_pool_tls(void *p) {
+                if (NULL != p) {
+                    delete reinterpret_cast<read_head_pool_t *>(p);
+                }
+            }
+
+            static void init_pthread_atgateway_read_head_pool_tls() {
+                (void)pthread_key_create(&gt_atgateway_read_head_pool_tls_key, dtor_pthread_atgateway_read_head_pool_tls);
+            }
+
+            static read_head_pool_t *get_tls_read_head_pool() {
+                (void)pthread_once(&gt_atgateway_read_head_pool_tls_once, init_pthread_atgateway_read_head_pool_tls);
+                read_head_pool_t *ret = reinterpret_cast<read_head_pool_t *>(pthread_getspecific(gt_atgateway_read_head_pool_tls_key));
+                if (NULL == ret) {
+                    ret = new (std::nothrow) read_head_pool_t();
+                    pthread_setspecific(gt_atgateway_read_head_pool_tls_key, ret);
+                }
+                return ret;
+            }
+#endif
+
+            /**
+             * @brief borrow a receive staging block from the pool of current thread
+             * @param sz block size, it must be the same in all calls
+             * @return block address, NULL if malloc failed
+             */
+            static void *alloc_read_head(size_t sz) {
+                read_head_pool_t *pool = get_tls_read_head_pool();
+                if (NULL != pool && !pool->free_blocks.empty()) {
+                    void *ret = pool->free_blocks.back();
+                    pool->free_blocks.pop_back();
+                    return ret;
+                }
+
+                return new (std::nothrow) char[sz];
+            }
+
+            static void release_read_head(void *block) {
+                if (NULL == block) {
+                    return;
+                }
+
+                read_head_pool_t *pool = get_tls_read_head_pool();
+                if (NULL != pool && pool->free_blocks.size() < ATFRAME_GATEWAY_MACRO_READ_HEAD_POOL_SIZE) {
+                    pool->free_blocks.push_back(block);
+                    return;
+                }
+
+                delete[] reinterpret_cast<char *>(block);
+            }
+
+            // builders are usually only nested when sending in callbacks, so a few free builders is enough
+            static const size_t builder_pool_max_free = 4;
+
+            // allocator of pooled builders, it records the bytes reserved by builder to decide whether to release them
+            class builder_allocator_t : public ::flatbuffers::Allocator {
+            public:
+                builder_allocator_t() : reserved_(0) {}
+
+                virtual uint8_t *allocate(size_t size) {
+                    reserved_ += size;
+                    return new uint8_t[size];
+                }
+
+                virtual void deallocate(uint8_t *p, size_t size) {
+                    reserved_ -= size;
+                    delete[] p;
+                }
+
+                inline size_t get_reserved() const { return reserved_; }
+
+            private:
+                size_t reserved_;
+            };
+
+            struct pooled_builder_t {
+                builder_allocator_t            allocator; // must be declared before builder
+                ::flatbuffers::FlatBufferBuilder builder;
+
+                pooled_builder_t() : builder(1024, &allocator) {}
+            };
+
+            // free builders used to pack messages, shared by all sessions in the same thread(loop)
+            struct builder_pool_t {
+                std::vector<pooled_builder_t *> free_builders;
+
+                ~builder_pool_t() {
+                    for (size_t i = 0; i < free_builders.size(); ++i) {
+                        delete free_builders[i];
+                    }
+                    free_builders.clear();
+                }
+            };
+
+#if !(defined(THREAD_TLS_USE_PTHREAD) && THREAD_TLS_USE_PTHREAD) && defined(THREAD_TLS_ENABLED) && THREAD_TLS_ENABLED
+            static builder_pool_t *get_tls_builder_pool() {
+                static THREAD_TLS builder_pool_t *ret = NULL;
+                if (NULL == ret) {
+                    ret = new (std::nothrow) builder_pool_t();
+                }
+                return ret;
+            }
+#else
+            static pthread_once_t gt_atgateway_builder_pool_tls_once = PTHREAD_ONCE_INIT;
+            static pthread_key_t  gt_atgateway_builder_pool_tls_key;
+
+            static void dtor_pthread_atgateway_builder_pool_tls(void *p) {
+                if (NULL != p) {
+                    delete reinterpret_cast<builder_pool_t *>(p);
+                }
+            }
+
+            static void init_pthread_atgateway_builder_pool_tls() {
+                (void)pthread_key_create(&gt_atgateway_builder_pool_tls_key, dtor_pthread_atgateway_builder_pool_tls);
+            }
+
+            static builder_pool_t *get_tls_builder_pool() {
+                (void)pthread_once(&gt_atgateway_builder_pool_tls_once, init_pthread_atgateway_builder_pool_tls);
+                builder_pool_t *ret = reinterpret_cast<builder_pool_t *>(pthread_getspecific(gt_atgateway_builder_pool_tls_key));
+                if (NULL == ret) {
+                    ret = new (std::nothrow) builder_pool_t();
+                    pthread_setspecific(gt_atgateway_builder_pool_tls_key, ret);
+                }
+                return ret;
+            }
+#endif
+
+            /**
+             * @brief borrow a builder from the pool of current thread, and give it back when destroyed
+             * @note builder keeps its memory after Clear(), so the memory is released if the reserved buffer has grown larger than
+             *       ATFRAME_GATEWAY_MACRO_BUILDER_RETAIN_SIZE
+             * @note is_valid() must be checked before get(), it's false if malloc failed
+             */
+            class builder_holder_t {
+            public:
+                builder_holder_t() : builder_(NULL) {
+                    builder_pool_t *pool = get_tls_builder_pool();
+                    if (NULL != pool && !pool->free_builders.empty()) {
+                        builder_ = pool->free_builders.back();
+                        pool->free_builders.pop_back();
+                    } else {
+                        builder_ = new (std::nothrow) pooled_builder_t();
+                    }
+                }
+
+                ~builder_holder_t() {
+                    if (NULL == builder_) {
+                        return;
+                    }
+
+                    if (builder_->allocator.get_reserved() > ATFRAME_GATEWAY_MACRO_BUILDER_RETAIN_SIZE) {
+                        builder_->builder.Reset();
+                    } else {
+                        builder_->builder.Clear();
+                    }
+
+                    builder_pool_t *pool = get_tls_builder_pool();
+                    if (NULL != pool && pool->free_builders.size() < builder_pool_max_free) {
+                        pool->free_builders.push_back(builder_);
+                    } else {
+                        delete builder_;
+                    }
+                }
+
+                inline bool is_valid() const { return NULL != builder_; }
+
+                inline ::flatbuffers::FlatBufferBuilder &get() { return builder_->builder; }
+
+            private:
+                builder_holder_t(const builder_holder_t &);
+                builder_holder_t &operator=(const builder_holder_t &);
+
+            private:
+                pooled_builder_t *builder_;
+            };
+
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+#if !(defined(THREAD_TLS_USE_PTHREAD) && THREAD_TLS_USE_PTHREAD) && defined(THREAD_TLS_ENABLED) && THREAD_TLS_ENABLED
+            // zstd contexts are shared by all sessions in the same thread and are kept until the thread exits
+            static ZSTD_CCtx *get_tls_zstd_cctx() {
+                static THREAD_TLS ZSTD_CCtx *ret = NULL;
+                if (NULL == ret) {
+                    ret = ZSTD_createCCtx();
+                }
+                return ret;
+            }
+
+            static ZSTD_DCtx *get_tls_zstd_dctx() {
+                static THREAD_TLS ZSTD_DCtx *ret = NULL;
+                if (NULL == ret) {
+                    ret = ZSTD_createDCtx();
+                }
+                return ret;
+            }
+#else
+            static pthread_once_t gt_atgateway_zstd_tls_once = PTHREAD_ONCE_INIT;
+            static pthread_key_t  gt_atgateway_zstd_cctx_tls_key;
+            static pthread_key_t  gt_atgateway_zstd_dctx_tls_key;
+
+            static void dtor_pthread_atgateway_zstd_cctx_tls(void *p) {
+                if (NULL != p) {
+                    ZSTD_freeCCtx(reinterpret_cast<ZSTD_CCtx *>(p));
+                }
+            }
+
+            static void dtor_pthread_atgateway_zstd_dctx_tls(void *p) {
+                if (NULL != p) {
+                    ZSTD_freeDCtx(reinterpret_cast<ZSTD_DCtx *>(p));
+                }
+            }
+
+            static void init_pthread_atgateway_zstd_tls() {
+                (void)pthread_key_create(&gt_atgateway_zstd_cctx_tls_key, dtor_pthread_atgateway_zstd_cctx_tls);
+                (void)pthread_key_create(&gt_atgateway_zstd_dctx_tls_key, dtor_pthread_atgateway_zstd_dctx_tls);
+            }
+
+            static ZSTD_CCtx *get_tls_zstd_cctx() {
+                (void)pthread_once(&gt_atgateway_zstd_tls_once, init_pthread_atgateway_zstd_tls);
+                ZSTD_CCtx *ret = reinterpret_cast<ZSTD_CCtx *>(pthread_getspecific(gt_atgateway_zstd_cctx_tls_key));
+                if (NULL == ret) {
+                    ret = ZSTD_createCCtx();
+                    pthread_setspecific(gt_atgateway_zstd_cctx_tls_key, ret);
+                }
+                return ret;
+            }
+
+            static ZSTD_DCtx *get_tls_zstd_dctx() {
+                (void)pthread_once(&gt_atgateway_zstd_tls_once, init_pthread_atgateway_zstd_tls);
+                ZSTD_DCtx *ret = reinterpret_cast<ZSTD_DCtx *>(pthread_getspecific(gt_atgateway_zstd_dctx_tls_key));
+                if (NULL == ret) {
+                    ret = ZSTD_createDCtx();
+                    pthread_setspecific(gt_atgateway_zstd_dctx_tls_key, ret);
+                }
+                return ret;
+            }
+#endif
+
+            static ZSTD_CCtx *create_zstd_stream_compressor(int level) {
+                ZSTD_CCtx *ret = ZSTD_createCCtx();
+                if (NULL == ret) {
+                    return ret;
+                }
+
+                // limit the window to reduce the memory cost of every session
+                if (ZSTD_isError(ZSTD_CCtx_setParameter(ret, ZSTD_c_compressionLevel, level)) ||
+                    ZSTD_isError(ZSTD_CCtx_setParameter(ret, ZSTD_c_windowLog, ATFRAME_GATEWAY_MACRO_ZSTD_STREAM_WINDOW_LOG))) {
+                    ZSTD_freeCCtx(ret);
+                    return NULL;
+                }
+                return ret;
+            }
+
+            static ZSTD_DCtx *create_zstd_stream_decompressor() {
+                ZSTD_DCtx *ret = ZSTD_createDCtx();
+                if (NULL == ret) {
+                    return ret;
+                }
+
+                // refuse peer to use a larger window
+                if (ZSTD_isError(ZSTD_DCtx_setParameter(ret, ZSTD_d_windowLogMax, ATFRAME_GATEWAY_MACRO_ZSTD_STREAM_WINDOW_LOG))) {
+                    ZSTD_freeDCtx(ret);
+                    return NULL;
+                }
+                return ret;
+            }
+
+            /**
+             * @brief compress data in stream mode and flush all data of this message
+             * @note the stream context can not be used any more if failed
+             * @return length of compressed data, 0 if failed or out buffer is not enough
+             */
+            static size_t compress_stream(ZSTD_CCtx *cctx, const void *in, size_t insz, void *out, size_t outsz) {
+                if (NULL == cctx || NULL == in || 0 == insz || NULL == out || 0 == outsz) {
+                    return 0;
+                }
+
+                ZSTD_inBuffer  input  = {in, insz, 0};
+                ZSTD_outBuffer output = {out, outsz, 0};
+                size_t         res    = 0;
+                do {
+                    res = ZSTD_compressStream2(cctx, &output, &input, ZSTD_e_flush);
+                    if (ZSTD_isError(res)) {
+                        return 0;
+                    }
+
+                    // output buffer is full but there is still data to flush
+                    if (0 != res && output.pos >= output.size) {
+                        return 0;
+                    }
+                } while (0 != res);
+
+                return output.pos;
+            }
+
+            /**
+             * @brief decompress data of one message in stream mode
+             * @note the stream context can not be used any more if failed
+             * @return length of decompressed data, 0 if failed or out buffer is not enough
+             */
+            static size_t decompress_stream(ZSTD_DCtx *dctx, const void *in, size_t insz, void *out, size_t outsz) {
+                if (NULL == dctx || NULL == in || 0 == insz || NULL == out || 0 == outsz) {
+                    return 0;
+                }
+
+                ZSTD_inBuffer  input  = {in, insz, 0};
+                ZSTD_outBuffer output = {out, outsz, 0};
+                while (input.pos < input.size) {
+                    size_t res = ZSTD_decompressStream(dctx, &output, &input);
+                    if (ZSTD_isError(res)) {
+                        return 0;
+                    }
+
+                    // output buffer is full but there is still data to decompress
+                    if (input.pos < input.size && output.pos >= output.size) {
+                        return 0;
+                    }
+                }
+
+                return output.pos;
+            }
+#endif
+
+            static int get_compression_type_by_name(std::string name) {
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+                if (name == "zstd") {
+                    return ::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD;
+                }
+
+                if (name == "zstd-stream") {
+                    return ::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD_STREAM;
+                }
+#endif
+#if defined(ATFRAME_GATEWAY_ENABLE_LZ4) && ATFRAME_GATEWAY_ENABLE_LZ4
+                if (name == "lz4") {
+                    return ::atframe::gw::inner::v1::compression_t_EN_CT_LZ4;
+                }
+#endif
+                return ::atframe::gw::inner::v1::compression_t_EN_CT_NONE;
+            }
+
+            static const char *get_compression_name(int compression_type) {
+                switch (compression_type) {
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD:
+                    return "zstd";
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD_STREAM:
+                    return "zstd-stream";
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_LZ4:
+                    return "lz4";
+                default:
+                    return "";
+                }
+            }
+
+            static std::string make_all_compression_names() {
+                std::string ret;
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+                ret += "zstd-stream:zstd";
+#endif
+#if defined(ATFRAME_GATEWAY_ENABLE_LZ4) && ATFRAME_GATEWAY_ENABLE_LZ4
+                if (!ret.empty()) {
+                    ret += ":";
+                }
+                ret += "lz4";
+#endif
+                return ret;
+            }
+
+            static const std::string &get_all_compression_names() {
+                static std::string ret = make_all_compression_names();
+                return ret;
+            }
+
+            /**
+             * @brief parse compression algorithm list, unsupported algorithms will be ignored
+             * @param types compression algorithm names, the same format as crypt type
+             * @param out output supported compression algorithms, keep the order in types
+             */
+            static void parse_compression_types(const char *types, std::vector<int> &out) {
+                out.clear();
+                if (NULL == types) {
+                    return;
+                }
+
+                std::pair<const char *, const char *> res;
+                res.first = res.second = types;
+                while (NULL != res.second) {
+                    res = util::crypto::cipher::ciphertok(res.second);
+
+                    if (NULL != res.first && NULL != res.second) {
+                        int compression_type = get_compression_type_by_name(std::string(res.first, res.second));
+                        if (::atframe::gw::inner::v1::compression_t_EN_CT_NONE != compression_type &&
+                            out.end() == std::find(out.begin(), out.end(), compression_type)) {
+                            out.push_back(compression_type);
+                        }
+                    }
+                }
+            }
+
+            static int get_checksum_type_by_name(std::string name) {
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                if (name == "crc32c") {
+                    return libatgw_proto_inner_v1::checksum_t::EN_CKT_CRC32C;
+                }
+
+                if (name == "none") {
+                    return libatgw_proto_inner_v1::checksum_t::EN_CKT_NONE;
+                }
+
+                if (name == "murmur3") {
+                    return libatgw_proto_inner_v1::checksum_t::EN_CKT_MURMUR3;
+                }
+
+                return -1;
+            }
+
+            static const char *get_checksum_name(int checksum_type) {
+                switch (checksum_type) {
+                case libatgw_proto_inner_v1::checksum_t::EN_CKT_CRC32C:
+                    return "crc32c";
+                case libatgw_proto_inner_v1::checksum_t::EN_CKT_NONE:
+                    return "none";
+                default:
+                    return "murmur3";
+                }
+            }
+
+            static const std::string &get_all_checksum_names() {
+                static std::string ret = "crc32c:none:murmur3";
+                return ret;
+            }
+
+            /**
+             * @brief parse checksum algorithm list, unsupported algorithms will be ignored
+             * @param types checksum algorithm names, the same format as crypt type
+             * @param out output supported checksum algorithms, keep the order in types
+             */
+            static void parse_checksum_types(const char *types, std::vector<int> &out) {
+                out.clear();
+                if (NULL == types) {
+                    return;
+                }
+
+                std::pair<const char *, const char *> res;
+                res.first = res.second = types;
+                while (NULL != res.second) {
+                    res = util::crypto::cipher::ciphertok(res.second);
+
+                    if (NULL != res.first && NULL != res.second) {
+                        int checksum_type = get_checksum_type_by_name(std::string(res.first, res.second));
+                        if (checksum_type >= 0 && out.end() == std::find(out.begin(), out.end(), checksum_type)) {
+                            out.push_back(checksum_type);
+                        }
+                    }
+                }
+            }
+
+            static int get_hex_value(char c) {
+                if (c >= '0' && c <= '9') {
+                    return c - '0';
+                }
+                if (c >= 'a' && c <= 'f') {
+                    return c - 'a' + 10;
+                }
+                if (c >= 'A' && c <= 'F') {
+                    return c - 'A' + 10;
+                }
+
+                return -1;
+            }
+
+            /**
+             * @brief get key of resumption tickets, it's used as the cipher key directly
+             * @param in key in configure, it must be key_size bytes or hex string of them
+             * @param key_size key length of ticket cipher in bytes
+             * @param out output key
+             * @return false if key length is not matched, keys padded with zero are easy to guess
+             */
+            static bool decode_ticket_key(const std::string &in, size_t key_size, std::vector<unsigned char> &out) {
+                out.clear();
+                if (0 == key_size) {
+                    return false;
+                }
+
+                if (in.size() == key_size) {
+                    out.assign(in.begin(), in.end());
+                    return true;
+                }
+
+                if (in.size() != key_size * 2) {
+                    return false;
+                }
+
+                out.reserve(key_size);
+                for (size_t i = 0; i < in.size(); i += 2) {
+                    int hi = get_hex_value(in[i]);
+                    int lo = get_hex_value(in[i + 1]);
+                    if (hi < 0 || lo < 0) {
+                        out.clear();
+                        return false;
+                    }
+
+                    out.push_back(static_cast<unsigned char>((hi << 4) | lo));
+                }
+
+                return true;
+            }
+
+            // crc32c(Castagnoli) with reversed polynomial 0x82F63B78, software version use slicing-by-8
+            struct crc32c_table_t {
+                uint32_t data[8][256];
+
+                crc32c_table_t() {
+                    for (uint32_t i = 0; i < 256; ++i) {
+                        uint32_t crc = i;
+                        for (int j = 0; j < 8; ++j) {
+                            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+                        }
+                        data[0][i] = crc;
+                    }
+
+                    for (uint32_t i = 0; i < 256; ++i) {
+                        for (int k = 1; k < 8; ++k) {
+                            data[k][i] = (data[k - 1][i] >> 8) ^ data[0][data[k - 1][i] & 0xFF];
+                        }
+                    }
+                }
+            };
+
+            static uint32_t crc32c_software(uint32_t crc, const unsigned char *buf, size_t len) {
+                static crc32c_table_t table;
+                while (len >= 8) {
+                    uint32_t low = crc ^ (static_cast<uint32_t>(buf[0]) | (static_cast<uint32_t>(buf[1]) << 8) | (static_cast<uint32_t>(buf[2]) << 16) |
+                                          (static_cast<uint32_t>(buf[3]) << 24));
+                    crc = table.data[7][low & 0xFF] ^ table.data[6][(low >> 8) & 0xFF] ^ table.data[5][(low >> 16) & 0xFF] ^ table.data[4][low >> 24] ^
+                          table.data[3][buf[4]] ^ table.data[2][buf[5]] ^ table.data[1][buf[6]] ^ table.data[0][buf[7]];
+                    buf += 8;
+                    len -= 8;
+                }
+
+                while (len > 0) {
+                    crc = table.data[0][(crc ^ *buf) & 0xFF] ^ (crc >> 8);
+                    ++buf;
+                    --len;
+                }
+
+                return crc;
+            }
+
+#if defined(ATFRAME_GATEWAY_CRC32C_ARM)
+            static uint32_t crc32c_hardware(uint32_t crc, const unsigned char *buf, size_t len) {
+                while (len >= 8) {
+                    uint64_t v;
+                    memcpy(&v, buf, sizeof(v));
+                    crc = __crc32cd(crc, v);
+                    buf += 8;
+                    len -= 8;
+                }
+
+                while (len > 0) {
+                    crc = __crc32cb(crc, *buf);
+                    ++buf;
+                    --len;
+                }
+
+                return crc;
+            }
+#elif defined(ATFRAME_GATEWAY_CRC32C_SSE42)
+            ATFRAME_GATEWAY_CRC32C_SSE42_TARGET static uint32_t crc32c_hardware(uint32_t crc, const unsigned char *buf, size_t len) {
+                uint64_t crc64 = crc;
+                while (len >= 8) {
+                    uint64_t v;
+                    memcpy(&v, buf, sizeof(v));
+                    crc64 = _mm_crc32_u64(crc64, v);
+                    buf += 8;
+                    len -= 8;
+                }
+
+                crc = static_cast<uint32_t>(crc64);
+                while (len > 0) {
+                    crc = _mm_crc32_u8(crc, *buf);
+                    ++buf;
+                    --len;
+                }
+
+                return crc;
+            }
+
+            static bool crc32c_hardware_supported() {
+#if defined(_MSC_VER)
+                int cpu_info[4];
+                __cpuid(cpu_info, 1);
+                return 0 != (cpu_info[2] & (1 << 20));
+#else
+                __builtin_cpu_init();
+                return 0 != __builtin_cpu_supports("sse4.2");
+#endif
+            }
+#endif
+
+            typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const unsigned char *buf, size_t len);
+            static crc32c_fn_t select_crc32c_fn() {
+#if defined(ATFRAME_GATEWAY_CRC32C_ARM)
+                return crc32c_hardware;
+#elif defined(ATFRAME_GATEWAY_CRC32C_SSE42)
+                return crc32c_hardware_supported() ? crc32c_hardware : crc32c_software;
+#else
+                return crc32c_software;
+#endif
+            }
+
+            static uint32_t crc32c(const void *buf, size_t len) {
+                static crc32c_fn_t fn = select_crc32c_fn();
+                return ~fn(0xFFFFFFFF, reinterpret_cast<const unsigned char *>(buf), len);
+            }
+
+            static uint32_t calc_frame_checksum(int checksum_type, const void *buf, size_t len) {
+                switch (checksum_type) {
+                case libatgw_proto_inner_v1::checksum_t::EN_CKT_CRC32C:
+                    return crc32c(buf, len);
+                case libatgw_proto_inner_v1::checksum_t::EN_CKT_NONE:
+                    return 0;
+                default:
+                    return util::hash::murmur_hash3_x86_32(reinterpret_cast<const char *>(buf), static_cast<int>(len), 0);
+                }
+            }
+
+            /**
+             * @brief compress data
+             * @return length of compressed data, 0 if failed or out buffer is not enough
+             */
+            static size_t compress_buffer(int compression_type, int level, const void *in, size_t insz, void *out, size_t outsz) {
+                if (NULL == in || 0 == insz || NULL == out || 0 == outsz) {
+                    return 0;
+                }
+
+                switch (compression_type) {
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD: {
+                    ZSTD_CCtx *cctx = get_tls_zstd_cctx();
+                    if (NULL == cctx) {
+                        return 0;
+                    }
+
+                    size_t res = ZSTD_compressCCtx(cctx, out, outsz, in, insz, level);
+                    if (ZSTD_isError(res)) {
+                        return 0;
+                    }
+                    return res;
+                }
+#endif
+#if defined(ATFRAME_GATEWAY_ENABLE_LZ4) && ATFRAME_GATEWAY_ENABLE_LZ4
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_LZ4: {
+                    if (insz > static_cast<size_t>(LZ4_MAX_INPUT_SIZE) || outsz > static_cast<size_t>(std::numeric_limits<int>::max())) {
+                        return 0;
+                    }
+
+                    int res = LZ4_compress_default(reinterpret_cast<const char *>(in), reinterpret_cast<char *>(out), static_cast<int>(insz),
+                                                   static_cast<int>(outsz));
+                    if (res <= 0) {
+                        return 0;
+                    }
+                    return static_cast<size_t>(res);
+                }
+#endif
+                default:
+                    return 0;
+                }
+            }
+
+            /**
+             * @brief decompress data
+             * @return length of decompressed data, 0 if failed or out buffer is not enough
+             */
+            static size_t decompress_buffer(int compression_type, const void *in, size_t insz, void *out, size_t outsz) {
+                if (NULL == in || 0 == insz || NULL == out || 0 == outsz) {
+                    return 0;
+                }
+
+                switch (compression_type) {
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD: {
+                    ZSTD_DCtx *dctx = get_tls_zstd_dctx();
+                    if (NULL == dctx) {
+                        return 0;
+                    }
+
+                    size_t res = ZSTD_decompressDCtx(dctx, out, outsz, in, insz);
+                    if (ZSTD_isError(res)) {
+                        return 0;
+                    }
+                    return res;
+                }
+#endif
+#if defined(ATFRAME_GATEWAY_ENABLE_LZ4) && ATFRAME_GATEWAY_ENABLE_LZ4
+                case ::atframe::gw::inner::v1::compression_t_EN_CT_LZ4: {
+                    if (insz > static_cast<size_t>(std::numeric_limits<int>::max()) || outsz > static_cast<size_t>(std::numeric_limits<int>::max())) {
+                        return 0;
+                    }
+
+                    int res = LZ4_decompress_safe(reinterpret_cast<const char *>(in), reinterpret_cast<char *>(out), static_cast<int>(insz),
+                                                  static_cast<int>(outsz));
+                    if (res <= 0) {
+                        return 0;
+                    }
+                    return static_cast<size_t>(res);
+                }
 #endif
-
-namespace atframe {
-    namespace gateway {
-        namespace detail {
-            static uint64_t alloc_seq() {
-                static ::util::lock::seq_alloc_u64 seq_alloc;
-                uint64_t                           ret = seq_alloc.inc();
-                while (0 == ret) {
-                    ret = seq_alloc.inc();
+                default:
+                    return 0;
                 }
-                return ret;
             }
 
+            /**
+             * @brief DH/ECDH shared context and its lock
+             * @note random engine in shared context is not thread-safe, and DH contexts initialized by it keep using it,
+             *       so random() and all operations of these DH contexts must be called under the lock
+             */
+            struct dh_context_slot_t {
+                util::crypto::dh::shared_context::ptr_t shared_context;
+                std::mutex                              lock;
+            };
+            typedef std::shared_ptr<dh_context_slot_t> dh_context_slot_ptr_t;
+
             struct crypt_global_configure_t {
                 typedef std::shared_ptr<crypt_global_configure_t> ptr_t;
 
-                crypt_global_configure_t(const libatgw_proto_inner_v1::crypt_conf_t &conf) : conf_(conf), inited_(false) {
-                    shared_dh_context_ = util::crypto::dh::shared_context::create();
+                crypt_global_configure_t(const libatgw_proto_inner_v1::crypt_conf_t &conf) : conf_(conf), inited_(false), dh_pool_stop_(false) {
+                    size_t dh_context_number = conf_.dh_context_number > 0 ? conf_.dh_context_number : ATFRAME_GATEWAY_MACRO_DH_CONTEXT_NUMBER;
+                    for (size_t i = 0; i < dh_context_number; ++i) {
+                        dh_context_slot_ptr_t slot = std::make_shared<dh_context_slot_t>();
+                        slot->shared_context       = util::crypto::dh::shared_context::create();
+                        dh_slots_.push_back(slot);
+                    }
+
+                    dh_generator_slot_                 = std::make_shared<dh_context_slot_t>();
+                    dh_generator_slot_->shared_context = util::crypto::dh::shared_context::create();
                 }
                 ~crypt_global_configure_t() { close(); }
 
+                struct prepared_dh_t {
+                    std::shared_ptr<util::crypto::dh> dh_ctx;
+                    dh_context_slot_ptr_t             dh_slot; /** shared context of dh_ctx **/
+                    std::vector<unsigned char>        params;  /** output of make_params, key pair is already in dh_ctx **/
+                };
+
                 int init() {
                     int ret = 0;
                     close();
+
+                    // compression and checksum are available even if crypt is disabled
+                    parse_compression_types(conf_.compression_type.c_str(), available_compression_types_);
+                    parse_checksum_types(conf_.checksum_type.c_str(), available_checksum_types_);
+
                     if (conf_.type.empty()) {
                         inited_ = true;
                         return ret;
@@ -65,16 +912,15 @@ namespace atframe {
                     case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH:
                     case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH: {
                         // do nothing in client mode
-                        if (conf_.client_mode || conf_.dh_param.empty()) {
-                            if (conf_.switch_secret_type == ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH) {
-                                shared_dh_context_->init(util::crypto::dh::method_t::EN_CDT_DH);
-                            } else {
-                                shared_dh_context_->init(util::crypto::dh::method_t::EN_CDT_ECDH);
-                            }
-                        } else {
-                            shared_dh_context_->init(conf_.dh_param.c_str());
+                        for (size_t i = 0; i < dh_slots_.size(); ++i) {
+                            init_dh_slot(*dh_slots_[i]);
                         }
 
+                        // key pairs used by server is made in background
+                        if (!conf_.client_mode && conf_.dh_pool_size > 0) {
+                            init_dh_slot(*dh_generator_slot_);
+                            start_dh_generator();
+                        }
                         break;
                     }
                     case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DIRECT: {
@@ -106,21 +952,64 @@ namespace atframe {
                                 std::transform(cipher_type.begin(), cipher_type.end(), cipher_type.begin(), ::tolower);
                                 if (all_supported_type_set.find(cipher_type) != all_supported_type_set.end()) {
                                     available_types_.insert(cipher_type);
+
+                                    util::crypto::cipher cipher;
+                                    if (cipher.init(cipher_type.c_str()) >= 0 && cipher.is_aead()) {
+                                        aead_types_.insert(cipher_type);
+                                    }
                                 }
                             }
                         }
                     }
 
+                    // only server select crypt type
+                    if (!conf_.client_mode && conf_.benchmark_time > 0) {
+                        run_crypt_benchmark();
+                    }
+
+                    // resumption tickets must be protected by AEAD tag, or they can be forged
+                    if (!conf_.client_mode && !conf_.ticket_key.empty()) {
+                        std::string ticket_type = conf_.ticket_type;
+                        std::transform(ticket_type.begin(), ticket_type.end(), ticket_type.begin(), ::tolower);
+
+                        std::vector<unsigned char> ticket_key;
+                        int                        libres = 0;
+                        ticket_crypt_                     = std::make_shared<libatgw_proto_inner_v1::crypt_session_t>();
+                        if (ticket_crypt_->setup(ticket_type) < 0 || !ticket_crypt_->is_aead()) {
+                            ticket_crypt_.reset();
+                            ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
+                        } else if (!decode_ticket_key(conf_.ticket_key, ticket_crypt_->cipher.get_key_bits() / 8, ticket_key) ||
+                                   ticket_crypt_->swap_secret(ticket_key, libres) < 0) {
+                            ticket_crypt_.reset();
+                            ret = error_code_t::EN_ECT_PARAM;
+                        }
+                    }
+
                     return ret;
                 }
 
                 void close() {
+                    stop_dh_generator();
+
                     if (!inited_) {
                         return;
                     }
                     inited_ = false;
                     available_types_.clear();
-                    shared_dh_context_->reset();
+                    aead_types_.clear();
+                    available_compression_types_.clear();
+                    available_checksum_types_.clear();
+                    crypt_benchmarks_.clear();
+                    ticket_crypt_.reset();
+                    for (size_t i = 0; i < dh_slots_.size(); ++i) {
+                        std::lock_guard<std::mutex> lock_guard(dh_slots_[i]->lock);
+                        dh_slots_[i]->shared_context->reset();
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock_guard(dh_generator_slot_->lock);
+                        dh_generator_slot_->shared_context->reset();
+                    }
                 }
 
                 bool check_type(std::string &crypt_type) {
@@ -132,28 +1021,481 @@ namespace atframe {
                     return available_types_.find(crypt_type) != available_types_.end();
                 }
 
+                /**
+                 * @brief select a available crypt type, the fastest one in benchmark is preferred, or the first one if there is no benchmark
+                 * @param crypt_type crypt types requested by peer, and will be set to the selected one
+                 * @return false if there is no available crypt type
+                 */
+                bool select_type(std::string &crypt_type) {
+                    std::string selected;
+                    size_t      selected_rank = 0;
+
+                    std::pair<const char *, const char *> res;
+                    res.first = res.second = crypt_type.c_str();
+                    while (NULL != res.second) {
+                        res = util::crypto::cipher::ciphertok(res.second);
+
+                        if (NULL != res.first && NULL != res.second) {
+                            std::string cipher_type;
+                            cipher_type.assign(res.first, res.second);
+                            if (cipher_type.empty() || !check_type(cipher_type)) {
+                                continue;
+                            }
+
+                            size_t rank = get_benchmark_rank(cipher_type);
+                            if (selected.empty() || rank < selected_rank) {
+                                selected.swap(cipher_type);
+                                selected_rank = rank;
+                            }
+                        }
+                    }
+
+                    crypt_type.swap(selected);
+                    return !crypt_type.empty();
+                }
+
+                size_t get_benchmark_rank(const std::string &crypt_type) const {
+                    for (size_t i = 0; i < crypt_benchmarks_.size(); ++i) {
+                        if (crypt_benchmarks_[i].type == crypt_type) {
+                            return crypt_benchmarks_[i].bytes_per_second > 0 ? i : crypt_benchmarks_.size();
+                        }
+                    }
+
+                    return crypt_benchmarks_.size();
+                }
+
+                /**
+                 * @brief select a compression algorithm, the configured order is used as priority
+                 * @param peer_types compression algorithms requested by peer
+                 * @return selected compression algorithm, see compression_t in libatgw_proto_inner.fbs
+                 */
+                int select_compression_type(const char *peer_types) const {
+                    std::vector<int> peer_compression_types;
+                    parse_compression_types(peer_types, peer_compression_types);
+
+                    for (size_t i = 0; i < available_compression_types_.size(); ++i) {
+                        if (peer_compression_types.end() !=
+                            std::find(peer_compression_types.begin(), peer_compression_types.end(), available_compression_types_[i])) {
+                            return available_compression_types_[i];
+                        }
+                    }
+
+                    return ::atframe::gw::inner::v1::compression_t_EN_CT_NONE;
+                }
+
+                bool is_aead_type(const std::string &crypt_type) const { return aead_types_.end() != aead_types_.find(crypt_type); }
+
+                /**
+                 * @brief select a frame checksum algorithm, the configured order is used as priority
+                 * @param peer_types checksum algorithms requested by peer
+                 * @param is_aead if selected crypt type is AEAD, NONE is only available when it's true
+                 * @return selected checksum algorithm, MURMUR3 if peer do not support negotiation
+                 */
+                int select_checksum_type(const char *peer_types, bool is_aead) const {
+                    std::vector<int> peer_checksum_types;
+                    parse_checksum_types(peer_types, peer_checksum_types);
+
+                    for (size_t i = 0; i < available_checksum_types_.size(); ++i) {
+                        if (!is_aead && libatgw_proto_inner_v1::checksum_t::EN_CKT_NONE == available_checksum_types_[i]) {
+                            continue;
+                        }
+
+                        if (peer_checksum_types.end() != std::find(peer_checksum_types.begin(), peer_checksum_types.end(), available_checksum_types_[i])) {
+                            return available_checksum_types_[i];
+                        }
+                    }
+
+                    return libatgw_proto_inner_v1::checksum_t::EN_CKT_MURMUR3;
+                }
+
+                /**
+                 * @brief get a shared context to initialize DH context, contexts are used in turn to reduce lock contention
+                 */
+                dh_context_slot_ptr_t alloc_dh_slot() {
+                    if (dh_slots_.empty()) {
+                        return dh_context_slot_ptr_t();
+                    }
+
+                    return dh_slots_[static_cast<size_t>(dh_slot_seq_.inc()) % dh_slots_.size()];
+                }
+
+                /**
+                 * @brief generate random data by the random engine of a shared context
+                 * @return 0 or error code of crypto library
+                 */
+                int random(void *output, size_t output_sz) {
+                    dh_context_slot_ptr_t slot = alloc_dh_slot();
+                    if (!slot) {
+                        return error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
+                    }
+
+                    std::lock_guard<std::mutex> lock_guard(slot->lock);
+                    return slot->shared_context->random(output, output_sz);
+                }
+
+                /**
+                 * @brief take a DH/ECDH key pair made by background generator
+                 * @return false if the pool is empty
+                 */
+                bool pop_prepared_dh(prepared_dh_t &out) {
+                    std::lock_guard<std::mutex> lock_guard(dh_pool_lock_);
+                    if (dh_pool_.empty()) {
+                        return false;
+                    }
+
+                    out = dh_pool_.back();
+                    dh_pool_.pop_back();
+                    dh_pool_cond_.notify_one();
+                    return true;
+                }
+
+                size_t get_prepared_dh_number() {
+                    std::lock_guard<std::mutex> lock_guard(dh_pool_lock_);
+                    return dh_pool_.size();
+                }
+
                 static void default_crypt_configure(libatgw_proto_inner_v1::crypt_conf_t &dconf) {
                     dconf.default_key = "atgw-key";
                     dconf.dh_param.clear();
+                    dconf.dh_pool_size       = 0;
+                    dconf.dh_context_number  = 0;
+                    dconf.benchmark_time     = 0;
                     dconf.switch_secret_type = ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DIRECT;
                     dconf.type.clear();
                     dconf.update_interval = 1200;
+                    dconf.compression_type.clear();
+                    dconf.compression_threshold = 1024;
+                    dconf.compression_level     = 0;
+                    dconf.checksum_type.clear();
+                    dconf.replay_window = 0;
+                    dconf.ticket_key.clear();
+                    dconf.ticket_type     = "aes-256-gcm";
+                    dconf.ticket_lifetime = 1800;
                     dconf.client_mode     = false;
                 }
 
                 libatgw_proto_inner_v1::crypt_conf_t conf_;
                 bool                                 inited_;
                 LIBATGW_ENV_AUTO_SET(std::string) available_types_;
-                util::crypto::dh::shared_context::ptr_t shared_dh_context_;
+                LIBATGW_ENV_AUTO_SET(std::string) aead_types_;
+                std::vector<int>                                       available_compression_types_;
+                std::vector<int>                                       available_checksum_types_;
+                std::vector<dh_context_slot_ptr_t>                     dh_slots_;
+                ::util::lock::seq_alloc_u64                            dh_slot_seq_;
+                std::vector<libatgw_proto_inner_v1::crypt_benchmark_t> crypt_benchmarks_; /** sorted by throughput, the fastest one is the first **/
+                libatgw_proto_inner_v1::crypt_session_ptr_t            ticket_crypt_;     /** encrypt resumption tickets, only set in server mode **/
+                std::mutex ticket_crypt_lock_; /** cipher context of ticket_crypt_ can not be used by more than one worker at the same time **/
+
+                // configure may be replaced by reload when workers are using it, so it's always copied under lock
+                static ptr_t current() {
+                    ::util::lock::lock_holder< ::util::lock::spin_lock> lh(current_lock());
+                    return current_inst();
+                }
+
+                /**
+                 * @brief mark a resumption ticket as used, so it can only resume session once in this process
+                 * @param expire expire time of ticket, it's forgotten after expired
+                 * @param nonce explicit nonce of ticket, it's unique for tickets encrypted by the same cipher context
+                 * @param now current unix timestamp in seconds
+                 * @return false if it's already used
+                 */
+                static bool consume_ticket(int64_t expire, uint64_t session_id, uint64_t nonce, int64_t now) {
+                    std::lock_guard<std::mutex> lock_guard(used_tickets_lock());
+                    used_ticket_set_t &         used_tickets = used_tickets_inst();
+
+                    // ordered by expire time, so expired ones are always at the beginning
+                    while (!used_tickets.empty() && used_tickets.begin()->first < now) {
+                        used_tickets.erase(used_tickets.begin());
+                    }
 
-                static ptr_t &current() {
+                    return used_tickets.insert(used_ticket_t(expire, std::make_pair(session_id, nonce))).second;
+                }
+
+                static void set_current(const ptr_t &inst) {
+                    ptr_t old_inst;
+                    {
+                        ::util::lock::lock_holder< ::util::lock::spin_lock> lh(current_lock());
+                        old_inst = current_inst();
+                        current_inst() = inst;
+                    }
+                    // old configure is released outside the lock
+                }
+
+            private:
+                static ptr_t &current_inst() {
                     static ptr_t ret;
                     return ret;
                 }
+
+                static ::util::lock::spin_lock &current_lock() {
+                    static ::util::lock::spin_lock ret;
+                    return ret;
+                }
+
+                // used tickets are kept when reload, tickets are still available if key is not changed
+                typedef std::pair<int64_t, std::pair<uint64_t, uint64_t> > used_ticket_t; // expire, session id, nonce
+                typedef std::set<used_ticket_t>                             used_ticket_set_t;
+                static used_ticket_set_t &used_tickets_inst() {
+                    static used_ticket_set_t ret;
+                    return ret;
+                }
+
+                static std::mutex &used_tickets_lock() {
+                    static std::mutex ret;
+                    return ret;
+                }
+
+
+                void run_crypt_benchmark() {
+                    crypt_benchmarks_.clear();
+
+                    // the same crypt types are not benchmarked again when reload, so reload will not block the event loop for too long
+                    ptr_t prev = current();
+                    if (prev && prev.get() != this && prev->conf_.benchmark_time == conf_.benchmark_time &&
+                        prev->crypt_benchmarks_.size() == available_types_.size()) {
+                        bool is_same = true;
+                        for (size_t i = 0; is_same && i < prev->crypt_benchmarks_.size(); ++i) {
+                            is_same = available_types_.end() != available_types_.find(prev->crypt_benchmarks_[i].type);
+                        }
+
+                        if (is_same) {
+                            crypt_benchmarks_ = prev->crypt_benchmarks_;
+                            return;
+                        }
+                    }
+
+                    std::vector<unsigned char> plain_text(ATFRAME_GATEWAY_MACRO_CRYPT_BENCHMARK_BLOCK_SIZE, 0x5A);
+                    // encrypted data may be padded to block size
+                    std::vector<unsigned char> cipher_text(ATFRAME_GATEWAY_MACRO_CRYPT_BENCHMARK_BLOCK_SIZE + 256);
+                    unsigned char              tag[ATFRAME_GATEWAY_MACRO_AEAD_TAG_SIZE];
+
+                    for (LIBATGW_ENV_AUTO_SET(std::string)::const_iterator iter = available_types_.begin(); iter != available_types_.end(); ++iter) {
+                        libatgw_proto_inner_v1::crypt_benchmark_t result;
+                        result.type             = *iter;
+                        result.bytes_per_second = 0;
+
+                        util::crypto::cipher cipher;
+                        if (cipher.init(iter->c_str()) >= 0) {
+                            std::vector<unsigned char> secret(cipher.get_key_bits() / 8 + cipher.get_iv_size(), 0xA5);
+                            int                        res = 0;
+                            if (cipher.get_iv_size() > 0) {
+                                res = cipher.set_iv(&secret[cipher.get_key_bits() / 8], cipher.get_iv_size());
+                            }
+                            if (res >= 0) {
+                                res = cipher.set_key(secret.empty() ? NULL : &secret[0], cipher.get_key_bits());
+                            }
+
+                            uint64_t                              bytes    = 0;
+                            std::chrono::steady_clock::time_point start    = std::chrono::steady_clock::now();
+                            std::chrono::steady_clock::time_point now      = start;
+                            std::chrono::steady_clock::time_point deadline = start + std::chrono::milliseconds(conf_.benchmark_time);
+                            while (res >= 0 && now < deadline) {
+                                size_t olen = cipher_text.size();
+                                if (cipher.is_aead()) {
+                                    res = cipher.encrypt_aead(&plain_text[0], plain_text.size(), &cipher_text[0], &olen, NULL, 0, tag, sizeof(tag));
+                                } else {
+                                    res = cipher.encrypt(&plain_text[0], plain_text.size(), &cipher_text[0], &olen);
+                                }
+
+                                bytes += plain_text.size();
+                                now = std::chrono::steady_clock::now();
+                            }
+
+                            int64_t cost_us = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+                            if (res >= 0 && cost_us > 0) {
+                                result.bytes_per_second = bytes * 1000000 / static_cast<uint64_t>(cost_us);
+                            }
+                            cipher.close();
+                        }
+
+                        crypt_benchmarks_.push_back(result);
+                    }
+
+                    std::sort(crypt_benchmarks_.begin(), crypt_benchmarks_.end(), crypt_benchmark_greater);
+                }
+
+                static bool crypt_benchmark_greater(const libatgw_proto_inner_v1::crypt_benchmark_t &l, const libatgw_proto_inner_v1::crypt_benchmark_t &r) {
+                    if (l.bytes_per_second != r.bytes_per_second) {
+                        return l.bytes_per_second > r.bytes_per_second;
+                    }
+
+                    return l.type < r.type;
+                }
+
+                void init_dh_slot(dh_context_slot_t &slot) {
+                    std::lock_guard<std::mutex> lock_guard(slot.lock);
+                    if (conf_.client_mode || conf_.dh_param.empty()) {
+                        if (conf_.switch_secret_type == ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH) {
+                            slot.shared_context->init(util::crypto::dh::method_t::EN_CDT_DH);
+                        } else {
+                            slot.shared_context->init(util::crypto::dh::method_t::EN_CDT_ECDH);
+                        }
+                    } else {
+                        slot.shared_context->init(conf_.dh_param.c_str());
+                    }
+                }
+
+                void start_dh_generator() {
+                    stop_dh_generator();
+
+                    dh_pool_stop_ = false;
+                    dh_pool_.reserve(conf_.dh_pool_size);
+                    dh_generator_ = std::thread(&crypt_global_configure_t::run_dh_generator, this);
+                }
+
+                void stop_dh_generator() {
+                    if (!dh_generator_.joinable()) {
+                        return;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock_guard(dh_pool_lock_);
+                        dh_pool_stop_ = true;
+                        dh_pool_cond_.notify_all();
+                    }
+                    dh_generator_.join();
+
+                    std::lock_guard<std::mutex> lock_guard(dh_pool_lock_);
+                    dh_pool_.clear();
+                }
+
+                void run_dh_generator() {
+                    while (true) {
+                        {
+                            std::unique_lock<std::mutex> lock_guard(dh_pool_lock_);
+                            while (!dh_pool_stop_ && dh_pool_.size() >= conf_.dh_pool_size) {
+                                dh_pool_cond_.wait(lock_guard);
+                            }
+
+                            if (dh_pool_stop_) {
+                                return;
+                            }
+                        }
+
+                        // make key pair without pool lock, the generator has its own shared context, which is kept until this thread exit
+                        // key pairs made before are still using the shared context in handshakes, so it must be locked
+                        prepared_dh_t prepared;
+                        prepared.dh_slot = dh_generator_slot_;
+                        prepared.dh_ctx  = std::make_shared<util::crypto::dh>();
+                        int res          = 0;
+                        {
+                            std::lock_guard<std::mutex> slot_lock_guard(dh_generator_slot_->lock);
+                            res = prepared.dh_ctx->init(dh_generator_slot_->shared_context);
+                            if (0 == res) {
+                                res = prepared.dh_ctx->make_params(prepared.params);
+                            }
+                        }
+
+                        std::unique_lock<std::mutex> lock_guard(dh_pool_lock_);
+                        if (0 == res) {
+                            dh_pool_.push_back(prepared);
+                        } else if (!dh_pool_stop_) {
+                            // do not retry too fast if something is wrong, handshakes will make their own key pairs
+                            dh_pool_cond_.wait_for(lock_guard, std::chrono::seconds(1));
+                        }
+                    }
+                }
+
+                // background generated DH/ECDH key pairs
+                std::mutex                 dh_pool_lock_;
+                std::condition_variable    dh_pool_cond_;
+                std::vector<prepared_dh_t> dh_pool_;
+                std::thread                dh_generator_;
+                dh_context_slot_ptr_t      dh_generator_slot_; /** shared context only used by generator to make key pairs **/
+                bool                       dh_pool_stop_;
+            };
+
+            /**
+             * @brief DH/ECDH operation of handshake which is run in worker thread
+             * @note only dh_ctx, dh_slot, input, output, result and errmsg can be used in worker thread
+             */
+            struct handshake_task_t {
+                enum type {
+                    EN_HTT_MAKE_PARAMS = 1, // make DH parameters and key pair for start response
+                    EN_HTT_CALC_SECRET,     // read peer's public key and compute shared secret
+                };
+
+                int                               task_type;
+                libatgw_proto_inner_v1 *          owner;       /** NULL if the handshake is closed before this task finished **/
+                crypt_global_configure_t::ptr_t   shared_conf; /** keep shared dh context alive **/
+                std::shared_ptr<util::crypto::dh> dh_ctx;
+                dh_context_slot_ptr_t             dh_slot; /** shared context of dh_ctx, locked when running the task **/
+                std::vector<unsigned char>        input;
+                std::vector<unsigned char>        output;
+                int                               result;
+                const char *                      errmsg;
+
+                int         msg_type; /** message type of start response, or the next handshake step **/
+                std::string crypt_type;
+
+                handshake_task_t() : task_type(0), owner(NULL), result(0), errmsg(NULL), msg_type(0) {}
+            };
+
+            static void run_handshake_task(const std::shared_ptr<handshake_task_t> &task) {
+                if (!task || !task->dh_ctx || !task->dh_slot) {
+                    return;
+                }
+
+                // other threads may use the same shared context at the same time
+                std::lock_guard<std::mutex> lock_guard(task->dh_slot->lock);
+                switch (task->task_type) {
+                case handshake_task_t::EN_HTT_MAKE_PARAMS: {
+                    task->result = task->dh_ctx->make_params(task->output);
+                    if (0 != task->result) {
+                        task->errmsg = "DH generate check public key failed";
+                    }
+                    break;
+                }
+                case handshake_task_t::EN_HTT_CALC_SECRET: {
+                    task->result = task->dh_ctx->read_public(task->input.empty() ? NULL : &task->input[0], task->input.size());
+                    if (0 != task->result) {
+                        task->errmsg = "DH read param failed";
+                        break;
+                    }
+
+                    task->result = task->dh_ctx->calc_secret(task->output);
+                    if (0 != task->result) {
+                        task->errmsg = "DH compute key failed";
+                    }
+                    break;
+                }
+                default: { break; }
+                }
+            }
+
+            // explicit nonce of AEAD cipher starts from a random number, so it will not be reused when the secret is reused by reconnect
+            // the highest bit is left, so it never wraps around and receiver can reject nonces not increased
+            static uint64_t make_aead_nonce_start() {
+                std::random_device rd;
+                return (static_cast<uint64_t>(rd() & 0x7FFFFFFF) << 32) | static_cast<uint64_t>(rd());
+            }
+
+            // additional data of AEAD cipher, so fields of post head and body can not be modified without the secret
+            enum post_aead_ad_t {
+                EN_PAAD_MSG_TYPE = 0,
+                EN_PAAD_SEQUENCE,
+                EN_PAAD_LENGTH,
+                EN_PAAD_COMPRESSION,
+                EN_PAAD_COMPRESSION_LENGTH,
+                EN_PAAD_TOTAL_LENGTH,
+                EN_PAAD_FRAGMENT_OFFSET,
+                EN_PAAD_MAX,
             };
+
+            static void make_post_aead_ad(uint64_t (&ad)[EN_PAAD_MAX], int msg_type, uint64_t sequence, uint64_t length, int compression,
+                                          uint64_t compression_length, uint64_t total_length, uint64_t fragment_offset) {
+                ad[EN_PAAD_MSG_TYPE]           = flatbuffers::EndianScalar(static_cast<uint64_t>(msg_type));
+                ad[EN_PAAD_SEQUENCE]           = flatbuffers::EndianScalar(sequence);
+                ad[EN_PAAD_LENGTH]             = flatbuffers::EndianScalar(length);
+                ad[EN_PAAD_COMPRESSION]        = flatbuffers::EndianScalar(static_cast<uint64_t>(compression));
+                ad[EN_PAAD_COMPRESSION_LENGTH] = flatbuffers::EndianScalar(compression_length);
+                ad[EN_PAAD_TOTAL_LENGTH]       = flatbuffers::EndianScalar(total_length);
+                ad[EN_PAAD_FRAGMENT_OFFSET]    = flatbuffers::EndianScalar(fragment_offset);
+            }
         } // namespace detail
 
-        libatgw_proto_inner_v1::crypt_session_t::crypt_session_t() : is_inited_(false) {}
+        libatgw_proto_inner_v1::crypt_session_t::crypt_session_t()
+            : aead_nonce(0), aead_read_nonce(0), aead_urgent_read_nonce(0), aead_tag_size(0), is_inited_(false) {}
 
         libatgw_proto_inner_v1::crypt_session_t::~crypt_session_t() { close(); }
 
@@ -175,9 +1517,12 @@ namespace atframe {
                 if (secret.size() * 8 > kb) {
                     secret.resize(kb / 8);
                 }
+
+                aead_tag_size = cipher.is_aead() ? ATFRAME_GATEWAY_MACRO_AEAD_TAG_SIZE : 0;
             } else {
                 secret.clear();
                 cipher.close();
+                aead_tag_size = 0;
             }
 
             type       = t;
@@ -188,7 +1533,8 @@ namespace atframe {
         void libatgw_proto_inner_v1::crypt_session_t::close() {
             cipher.close();
             type.clear();
-            is_inited_ = false;
+            aead_tag_size = 0;
+            is_inited_    = false;
         }
 
         int libatgw_proto_inner_v1::crypt_session_t::generate_secret(int &libres) {
@@ -202,7 +1548,7 @@ namespace atframe {
             // generate a secret key
             size_t secret_len = key_bits / 8 + iv_size;
             secret.resize(secret_len);
-            libres = shared_conf->shared_dh_context_->random(reinterpret_cast<void *>(&secret[0]), secret_len);
+            libres = shared_conf->random(reinterpret_cast<void *>(&secret[0]), secret_len);
             if (0 != libres) {
                 return error_code_t::EN_ECT_HANDSHAKE;
             }
@@ -253,14 +1599,53 @@ namespace atframe {
                 secret.swap(in);
             }
 
+            if (is_aead()) {
+                aead_nonce             = detail::make_aead_nonce_start();
+                aead_read_nonce        = 0;
+                aead_urgent_read_nonce = 0;
+            }
+
             libres = 0;
             return 0;
         }
 
-        libatgw_proto_inner_v1::libatgw_proto_inner_v1() : session_id_(0), last_write_ptr_(NULL), close_reason_(0) {
-            crypt_handshake_ = std::make_shared<crypt_session_t>();
+        size_t libatgw_proto_inner_v1::crypt_session_t::get_aead_extend_size() const {
+            if (!is_aead()) {
+                return 0;
+            }
+
+            return sizeof(uint64_t) + aead_tag_size;
+        }
+
+        size_t libatgw_proto_inner_v1::crypt_session_t::get_memory_usage() const {
+            return sizeof(crypt_session_t) + type.capacity() + secret.capacity();
+        }
+
+        int libatgw_proto_inner_v1::crypt_session_t::set_aead_nonce(uint64_t nonce) {
+            uint32_t key_size = cipher.get_key_bits() / 8;
+            uint32_t iv_size  = cipher.get_iv_size();
+
+            unsigned char iv[64] = {0};
+            if (0 == iv_size || iv_size > sizeof(iv)) {
+                return -1;
+            }
+
+            // iv should be just after key, or use zero iv just like the other ciphers when secret has no iv
+            if (secret.size() >= key_size + iv_size) {
+                memcpy(iv, &secret[key_size], iv_size);
+            }
+
+            // xor the last 64bits with nonce in big endian
+            for (uint32_t i = 0; i < sizeof(uint64_t) && i < iv_size; ++i) {
+                iv[iv_size - 1 - i] ^= static_cast<unsigned char>((nonce >> (i * 8)) & 0xFF);
+            }
+
+            return cipher.set_iv(iv, iv_size);
+        }
 
-            read_head_.len = 0;
+        libatgw_proto_inner_v1::libatgw_proto_inner_v1()
+            : session_id_(0), read_head_(NULL), write_urgent_barrier_(0), is_writing_urgent_(false), last_write_ptr_(NULL), close_reason_(0) {
+            crypt_handshake_ = std::make_shared<crypt_session_t>();
 
             ping_.last_ping  = ping_data_t::clk_t::from_time_t(0);
             ping_.last_delta = 0;
@@ -268,11 +1653,43 @@ namespace atframe {
             handshake_.switch_secret_type = 0;
             handshake_.has_data           = false;
             handshake_.ext_data           = NULL;
+            handshake_.params_ready       = false;
+
+            compression_.type            = ::atframe::gw::inner::v1::compression_t_EN_CT_NONE;
+            compression_.threshold       = 0;
+            compression_.level           = 0;
+            compression_.available_types = detail::get_all_compression_names();
+            compression_.stream_write    = NULL;
+            compression_.stream_read     = NULL;
+
+            checksum_.type              = checksum_t::EN_CKT_MURMUR3;
+            checksum_.next_type         = checksum_t::EN_CKT_MURMUR3;
+            checksum_.is_read_confirmed = true;
+            checksum_.available_types   = detail::get_all_checksum_names();
+
+            post_fragment_.total_length    = 0;
+            post_fragment_.received_length = 0;
+            message_size_limit_            = ATFRAME_GATEWAY_MACRO_MESSAGE_SIZE_LIMIT;
+
+            replay_.is_sending        = false;
+            replay_.is_receiving      = false;
+            replay_.window_size       = 0;
+            replay_.cached_size       = 0;
+            replay_.send_sequence     = 0;
+            replay_.received_sequence = 0;
+            replay_.acked_sequence    = 0;
+            replay_.lost_number       = 0;
         }
 
         libatgw_proto_inner_v1::~libatgw_proto_inner_v1() {
             close(close_reason_t::EN_CRT_UNKNOWN, false);
             close_handshake(error_code_t::EN_ECT_SESSION_EXPIRED);
+            reset_compression_stream();
+
+            if (NULL != read_head_) {
+                detail::release_read_head(read_head_);
+                read_head_ = NULL;
+            }
         }
 
         void libatgw_proto_inner_v1::alloc_recv_buffer(size_t /*suggested_size*/, char *&out_buf, size_t &out_len) {
@@ -291,14 +1708,25 @@ namespace atframe {
 
             // reading length and hash code, use small buffer block
             if (NULL == data || 0 == swrite) {
-                out_len = sizeof(read_head_.buffer) - read_head_.len;
+                // borrow small buffer block from pool, it will be given back when there is no partial message
+                if (NULL == read_head_) {
+                    read_head_ = reinterpret_cast<read_head_t *>(detail::alloc_read_head(sizeof(read_head_t)));
+                    if (NULL == read_head_) {
+                        out_buf = NULL;
+                        out_len = 0;
+                        return;
+                    }
+                    read_head_->len = 0;
+                }
+
+                out_len = sizeof(read_head_->buffer) - read_head_->len;
 
                 if (0 == out_len) {
                     // hash code and length shouldn't be greater than small buffer block
                     out_buf = NULL;
                     assert(false);
                 } else {
-                    out_buf = &read_head_.buffer[read_head_.len];
+                    out_buf = &read_head_->buffer[read_head_->len];
                 }
                 return;
             }
@@ -326,14 +1754,21 @@ namespace atframe {
             const size_t msg_header_len = sizeof(uint32_t) + sizeof(uint32_t);
 
             if (NULL == data || 0 == swrite) {
+                // small buffer block must be borrowed in alloc_recv_buffer
+                if (NULL == read_head_) {
+                    assert(read_head_);
+                    errcode = error_code_t::EN_ECT_NO_DATA;
+                    return;
+                }
+
                 // first, read from small buffer block
                 // read header
-                assert(nread_s <= sizeof(read_head_.buffer) - read_head_.len);
-                read_head_.len += nread_s; // 写数据计数
+                assert(nread_s <= sizeof(read_head_->buffer) - read_head_->len);
+                read_head_->len += nread_s; // 写数据计数
 
                 // try to unpack all messages
-                char * buff_start    = read_head_.buffer;
-                size_t buff_left_len = read_head_.len;
+                char * buff_start    = read_head_->buffer;
+                size_t buff_left_len = read_head_->len;
 
                 // maybe there are more than one message
                 while (buff_left_len > sizeof(uint32_t) + sizeof(uint32_t)) {
@@ -342,18 +1777,19 @@ namespace atframe {
 
                     // directly dispatch small message
                     if (buff_left_len >= msg_header_len + msg_len) {
-                        uint32_t check_hash = util::hash::murmur_hash3_x86_32(buff_start + msg_header_len, static_cast<int>(msg_len), 0);
                         uint32_t expect_hash;
                         memcpy(&expect_hash, buff_start, sizeof(uint32_t));
 
-                        if (check_hash != expect_hash) {
+                        // post data protected by AEAD tag need not to be hashed again
+                        bool is_tagged = is_tagged_frame(expect_hash);
+                        if (!is_tagged && !check_frame_checksum(buff_start + msg_header_len, msg_len, expect_hash)) {
                             errcode = error_code_t::EN_ECT_BAD_DATA;
                             // } else if (channel->conf.recv_buffer_limit_size > 0 && msg_len > channel->conf.recv_buffer_limit_size) {
                             //     errcode = EN_ATBUS_ERR_INVALID_SIZE;
                         }
 
                         // padding to 64bits
-                        dispatch_data(reinterpret_cast<char *>(buff_start) + msg_header_len, msg_len, errcode);
+                        dispatch_data(reinterpret_cast<char *>(buff_start) + msg_header_len, msg_len, errcode, is_tagged);
 
                         // 32bits hash+vint+buffer
                         buff_start += msg_header_len + msg_len;
@@ -379,10 +1815,10 @@ namespace atframe {
                 }
 
                 // move left data to front
-                if (buff_start != read_head_.buffer && buff_left_len > 0) {
-                    memmove(read_head_.buffer, buff_start, buff_left_len);
+                if (buff_start != read_head_->buffer && buff_left_len > 0) {
+                    memmove(read_head_->buffer, buff_start, buff_left_len);
                 }
-                read_head_.len = buff_left_len;
+                read_head_->len = buff_left_len;
             } else {
                 // mark data written
                 read_buffers_.pop_back(nread_s, false);
@@ -394,32 +1830,42 @@ namespace atframe {
                 data = reinterpret_cast<char *>(data) - sread;
 
                 // 32bits hash code
-                uint32_t check_hash =
-                    util::hash::murmur_hash3_x86_32(reinterpret_cast<char *>(data) + msg_header_len, static_cast<int>(sread - msg_header_len), 0);
                 uint32_t expect_hash;
                 memcpy(&expect_hash, data, sizeof(uint32_t));
                 size_t msg_len = sread - msg_header_len;
 
-                if (check_hash != expect_hash) {
+                bool is_tagged = is_tagged_frame(expect_hash);
+                if (!is_tagged && !check_frame_checksum(reinterpret_cast<char *>(data) + msg_header_len, msg_len, expect_hash)) {
                     errcode = error_code_t::EN_ECT_BAD_DATA;
                     // } else if (channel->conf.recv_buffer_limit_size > 0 && msg_len > channel->conf.recv_buffer_limit_size) {
                     //     errcode = EN_ATBUS_ERR_INVALID_SIZE;
                 }
 
-                dispatch_data(reinterpret_cast<char *>(data) + msg_header_len, msg_len, errcode);
+                dispatch_data(reinterpret_cast<char *>(data) + msg_header_len, msg_len, errcode, is_tagged);
                 // free the buffer block
                 read_buffers_.pop_front(0, true);
             }
 
             if (is_free) {
                 errcode = error_code_t::EN_ECT_INVALID_SIZE;
-                if (read_head_.len > 0) {
-                    dispatch_data(read_head_.buffer, read_head_.len, errcode);
+                if (NULL != read_head_ && read_head_->len > 0) {
+                    dispatch_data(read_head_->buffer, read_head_->len, errcode);
                 }
             }
+
+            // no partial message in small buffer block, give it back to pool
+            if (NULL != read_head_ && 0 == read_head_->len) {
+                detail::release_read_head(read_head_);
+                read_head_ = NULL;
+            }
+
+            // acknowledge posts once for every read, so server can release them from replay cache
+            if (replay_.is_receiving && replay_.acked_sequence != replay_.received_sequence) {
+                send_post_ack();
+            }
         }
 
-        void libatgw_proto_inner_v1::dispatch_data(const char *buffer, size_t len, int errcode) {
+        void libatgw_proto_inner_v1::dispatch_data(const char *buffer, size_t len, int errcode, bool is_tagged) {
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 return;
             }
@@ -442,6 +1888,12 @@ namespace atframe {
                 return;
             }
 
+            // only post data can be protected by AEAD tag, other messages must has the right hash
+            if (is_tagged && ::atframe::gw::inner::v1::cs_msg_body_cs_body_post != msg->body_type() && !check_frame_checksum(buffer, len, 0)) {
+                close(close_reason_t::EN_CRT_INVALID_DATA);
+                return;
+            }
+
             switch (msg->head()->type()) {
             case atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST: {
                 if (::atframe::gw::inner::v1::cs_msg_body_cs_body_post != msg->body_type()) {
@@ -456,10 +1908,61 @@ namespace atframe {
 
                 const ::atframe::gw::inner::v1::cs_body_post *msg_body = static_cast<const ::atframe::gw::inner::v1::cs_body_post *>(msg->body());
 
+                // already received by the old connection before reconnect, urgent posts have no sequence and are never sent again
+                uint64_t sequence = msg->head()->sequence();
+                if (replay_.is_receiving && 0 != sequence && sequence <= replay_.received_sequence) {
+                    break;
+                }
+
+                // fields of post head and body are also protected by AEAD tag, so sequence can not be changed to skip or replay posts
+                uint64_t aead_ad[detail::EN_PAAD_MAX];
+                detail::make_post_aead_ad(aead_ad, static_cast<int>(msg->head()->type()), sequence, msg_body->length(),
+                                          static_cast<int>(msg_body->compression()), msg_body->compression_length(), msg_body->total_length(),
+                                          msg_body->fragment_offset());
+
+                // explicit nonce of AEAD cipher increases in every lane, so posts recorded from this connection can not be replayed
+                // urgent posts have no sequence and may be sent before normal posts encrypted earlier
+                uint64_t *read_nonce = NULL;
+                uint64_t  aead_nonce = 0;
+                if (crypt_read_->is_aead() && NULL != msg_body->data() && msg_body->data()->size() >= sizeof(uint64_t)) {
+                    read_nonce = 0 == sequence ? &crypt_read_->aead_urgent_read_nonce : &crypt_read_->aead_read_nonce;
+                    aead_nonce = flatbuffers::ReadScalar<uint64_t>(msg_body->data()->data());
+                    if (aead_nonce < *read_nonce) {
+                        ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_BAD_DATA, "nonce of post is not increased, it may be replayed.");
+                        close(close_reason_t::EN_CRT_INVALID_DATA, false);
+                        break;
+                    }
+                }
+
                 const void *out;
                 size_t      outsz = static_cast<size_t>(msg_body->length());
-                int         res   = decode_post(msg_body->data()->data(), static_cast<size_t>(msg_body->data()->size()), out, outsz);
-                if (0 == res) {
+                int         res   = decode_post(msg_body->data()->data(), static_cast<size_t>(msg_body->data()->size()), static_cast<int>(msg_body->compression()),
+                                        static_cast<size_t>(msg_body->compression_length()), out, outsz, aead_ad, sizeof(aead_ad));
+
+                // only nonce of authenticated data is accepted
+                if (0 == res && NULL != read_nonce) {
+                    *read_nonce = aead_nonce + 1;
+                }
+
+                // fragments already received are dropped when reconnecting, so the message is received again from the first fragment
+                if (0 == res && replay_.is_receiving && 0 != sequence &&
+                    (0 == msg_body->total_length() || msg_body->fragment_offset() + msg_body->length() >= msg_body->total_length())) {
+                    replay_.received_sequence = sequence;
+                }
+
+                if (0 == res && msg_body->total_length() > 0) {
+                    // fragment of a large message
+                    if (static_cast<size_t>(msg_body->length()) > outsz) {
+                        res = error_code_t::EN_ECT_BAD_DATA;
+                    } else {
+                        res = dispatch_post_fragment(static_cast<size_t>(msg_body->total_length()), static_cast<size_t>(msg_body->fragment_offset()), out,
+                                                     static_cast<size_t>(msg_body->length()));
+                    }
+
+                    if (0 != res) {
+                        close(close_reason_t::EN_CRT_INVALID_DATA, false);
+                    }
+                } else if (0 == res) {
                     // on_message
                     if (NULL != callbacks_ && callbacks_->message_fn) {
                         callbacks_->message_fn(this, out, static_cast<size_t>(msg_body->length()));
@@ -496,6 +1999,24 @@ namespace atframe {
                 dispatch_handshake(*msg_body);
                 break;
             }
+            case atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST_ACK: {
+                release_replay_posts(msg->head()->sequence());
+                break;
+            }
+            case atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_TICKET: {
+                if (::atframe::gw::inner::v1::cs_msg_body_cs_body_handshake != msg->body_type()) {
+                    close(close_reason_t::EN_CRT_INVALID_DATA, false);
+                    break;
+                }
+
+                // ticket of the new secret replace the old one
+                const ::atframe::gw::inner::v1::cs_body_handshake *msg_body = static_cast<const ::atframe::gw::inner::v1::cs_body_handshake *>(msg->body());
+                if (NULL != msg_body->ticket() && msg_body->session_id() == session_id_) {
+                    const unsigned char *ticket_data = reinterpret_cast<const unsigned char *>(msg_body->ticket()->data());
+                    ticket_.assign(ticket_data, ticket_data + msg_body->ticket()->size());
+                }
+                break;
+            }
             case atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_PING: {
                 if (::atframe::gw::inner::v1::cs_msg_body_cs_body_ping != msg->body_type()) {
                     close(close_reason_t::EN_CRT_INVALID_DATA);
@@ -546,6 +2067,15 @@ namespace atframe {
 
             using namespace atframe::gw::inner::v1;
             int ret = 0;
+            // handshake is suspended until handshake task or reconnect in another thread finished, peer should not send anything here
+            if (handshake_.task || !handshake_.reconnect_req.empty()) {
+                ret = error_code_t::EN_ECT_HANDSHAKE;
+                ATFRAME_GATEWAY_ON_ERROR(ret, "handshake message received when handshake task is running");
+                close_handshake(ret);
+                close(close_reason_t::EN_CRT_HANDSHAKE, false);
+                return ret;
+            }
+
             switch (body_handshake.step()) {
             case handshake_step_t_EN_HST_START_REQ: {
                 ret = dispatch_handshake_start_req(body_handshake);
@@ -611,53 +2141,50 @@ namespace atframe {
 
             std::string crypt_type;
             if (NULL != body_handshake.crypt_type()) {
-                crypt_type = body_handshake.crypt_type()->str();
-            }
-
-            // select a available crypt type
-            if (!crypt_type.empty()) {
-                std::pair<const char *, const char *> res;
-                res.first = res.second = crypt_type.c_str();
-                while (NULL != res.second) {
-                    res = util::crypto::cipher::ciphertok(res.second);
-
-                    if (NULL != res.first && NULL != res.second) {
-                        std::string cipher_type;
-                        cipher_type.assign(res.first, res.second);
-                        if (global_cfg->check_type(cipher_type)) {
-                            crypt_type.swap(cipher_type);
-                            break;
-                        }
-                    }
-                }
+                crypt_type = body_handshake.crypt_type()->str();
+            }
 
-                // can not find a available crypt method, disable crypt
-                if (NULL == res.second) {
-                    crypt_type.clear();
-                }
+            // select a available crypt type, or disable crypt if there is no one
+            if (!crypt_type.empty() && (!global_cfg || !global_cfg->select_type(crypt_type))) {
+                crypt_type.clear();
             }
 
-            callbacks_->new_session_fn(this, session_id_);
+            // select a available frame checksum algorithm, it's used after start response is sent
+            checksum_.next_type = global_cfg ? global_cfg->select_checksum_type(body_handshake.checksum_type() ? body_handshake.checksum_type()->c_str() : NULL,
+                                                                                global_cfg->is_aead_type(crypt_type))
+                                             : checksum_t::EN_CKT_MURMUR3;
 
-            using namespace ::atframe::gw::inner::v1;
+            // select a available compression algorithm
+            setup_compression(global_cfg,
+                              global_cfg ? global_cfg->select_compression_type(body_handshake.compression_type() ? body_handshake.compression_type()->c_str() : NULL)
+                                         : ::atframe::gw::inner::v1::compression_t_EN_CT_NONE,
+                              true);
 
-            flatbuffers::FlatBufferBuilder   builder;
-            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
-            flatbuffers::Offset<cs_body_handshake> handshake_body;
+            // number and cache posts only if client can acknowledge them
+            replay_.window_size = global_cfg ? global_cfg->conf_.replay_window : 0;
+            replay_.is_sending  = replay_.window_size > 0 && 0 != body_handshake.replay_sequence();
 
-            //
-            ret = pack_handshake_start_rsp(builder, session_id_, crypt_type, handshake_body);
-            if (ret < 0) {
-                handshake_done(ret);
-                return ret;
-            }
+            callbacks_->new_session_fn(this, session_id_);
 
-            builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, handshake_body.Union()), cs_msgIdentifier());
-            ret = write_msg(builder);
-            if (ret < 0) {
-                handshake_done(ret);
+            // DH key pair is taken from background pool, or made in worker thread if possible, start response will be sent after that
+            if (0 != session_id_ && !crypt_type.empty() && (::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH == handshake_.switch_secret_type ||
+                                                            ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH == handshake_.switch_secret_type) &&
+                !use_prepared_dh()) {
+                ret = start_handshake_task(detail::handshake_task_t::EN_HTT_MAKE_PARAMS, ::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_HANDSHAKE,
+                                           crypt_type, NULL, 0);
+                if (0 == ret) {
+                    return ret;
+                }
+
+                // too many handshakes are waiting for workers, refuse new session
+                if (error_code_t::EN_ECT_BUSY == ret) {
+                    ATFRAME_GATEWAY_ON_ERROR(ret, "too many handshake tasks, refuse new session");
+                    close(close_reason_t::EN_CRT_SERVER_BUSY, true);
+                    return ret;
+                }
             }
-            return ret;
+
+            return send_handshake_start_rsp(::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_HANDSHAKE, crypt_type);
         }
 
         int libatgw_proto_inner_v1::dispatch_handshake_start_rsp(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake) {
@@ -698,6 +2225,20 @@ namespace atframe {
                 if (ret < 0) {
                     return ret;
                 }
+
+                // use the compression algorithm selected by server, it's also sent when secret is updated
+                // stream context should be kept when secret is updated, because compression is just before encryption
+                setup_compression(global_cfg,
+                                  NULL == body_handshake.compression_type() ? ::atframe::gw::inner::v1::compression_t_EN_CT_NONE
+                                                                             : detail::get_compression_type_by_name(body_handshake.compression_type()->str()),
+                                  false);
+
+                // server has switched to the selected checksum algorithm after this response
+                setup_checksum(NULL == body_handshake.checksum_type() ? checksum_t::EN_CKT_MURMUR3
+                                                                       : detail::get_checksum_type_by_name(body_handshake.checksum_type()->str()));
+
+                // posts are numbered by server, and should be acknowledged
+                replay_.is_receiving = 0 != body_handshake.replay_sequence();
             } else {
                 return error_code_t::EN_ECT_HANDSHAKE;
             }
@@ -741,7 +2282,11 @@ namespace atframe {
                 // if in DH handshake, generate and send pubkey
                 using namespace ::atframe::gw::inner::v1;
 
-                flatbuffers::FlatBufferBuilder   builder;
+                detail::builder_holder_t         builder_holder;
+                if (!builder_holder.is_valid()) {
+                    return error_code_t::EN_ECT_MALLOC;
+                }
+                flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
                 flatbuffers::Offset<cs_msg_head> header_data =
                     Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
                 flatbuffers::Offset<cs_body_handshake> handshake_body;
@@ -755,7 +2300,7 @@ namespace atframe {
                 }
 
                 builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, handshake_body.Union()), cs_msgIdentifier());
-                ret = write_msg(builder);
+                ret = write_msg(builder, false, false, true);
                 break;
             }
             default: {
@@ -778,34 +2323,151 @@ namespace atframe {
             handshake_.ext_data = &body_handshake;
 
             int ret = callbacks_->reconnect_fn(this, body_handshake.session_id());
+            // old session is owned by another thread, keep the request until finish_reconnect is called
+            if (error_code_t::EN_ECT_RECONNECT_PENDING == ret) {
+                using namespace ::atframe::gw::inner::v1;
+
+                detail::builder_holder_t builder_holder;
+                if (!builder_holder.is_valid()) {
+                    return error_code_t::EN_ECT_MALLOC;
+                }
+                flatbuffers::FlatBufferBuilder &builder = builder_holder.get();
+
+                flatbuffers::Offset<flatbuffers::String>          crypt_type, compression_type, checksum_type;
+                flatbuffers::Offset<flatbuffers::Vector<int8_t> > crypt_param, ticket;
+                if (NULL != body_handshake.crypt_type()) {
+                    crypt_type = builder.CreateString(body_handshake.crypt_type());
+                }
+                if (NULL != body_handshake.crypt_param()) {
+                    crypt_param = builder.CreateVector(body_handshake.crypt_param()->data(), body_handshake.crypt_param()->size());
+                }
+                if (NULL != body_handshake.compression_type()) {
+                    compression_type = builder.CreateString(body_handshake.compression_type());
+                }
+                if (NULL != body_handshake.checksum_type()) {
+                    checksum_type = builder.CreateString(body_handshake.checksum_type());
+                }
+                if (NULL != body_handshake.ticket()) {
+                    ticket = builder.CreateVector(body_handshake.ticket()->data(), body_handshake.ticket()->size());
+                }
+                builder.Finish(Createcs_body_handshake(builder, body_handshake.session_id(), body_handshake.step(), body_handshake.switch_type(), crypt_type,
+                                                       crypt_param, 0, compression_type, checksum_type, body_handshake.replay_sequence(), ticket));
+
+                handshake_.reconnect_req.assign(builder.GetBufferPointer(), builder.GetBufferPointer() + builder.GetSize());
+                handshake_.ext_data = flatbuffers::GetRoot<cs_body_handshake>(&handshake_.reconnect_req[0]);
+                return 0;
+            }
+
+            return send_handshake_reconn_rsp(body_handshake, ret);
+        }
+
+        int libatgw_proto_inner_v1::finish_reconnect(int status) {
+            if (handshake_.reconnect_req.empty()) {
+                return error_code_t::EN_ECT_HANDSHAKE;
+            }
+
+            std::vector<unsigned char> reconnect_req;
+            reconnect_req.swap(handshake_.reconnect_req);
+            handshake_.ext_data = NULL;
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            flag_guard_t flag_guard(flags_, flag_t::EN_PFT_IN_CALLBACK);
+
+            const ::atframe::gw::inner::v1::cs_body_handshake *body_handshake =
+                flatbuffers::GetRoot< ::atframe::gw::inner::v1::cs_body_handshake>(&reconnect_req[0]);
+            handshake_.ext_data = body_handshake;
+            int ret             = send_handshake_reconn_rsp(*body_handshake, status);
+            handshake_.ext_data = NULL;
+
+            // handshake failed will close the connection, just like dispatch_handshake
+            if (ret < 0) {
+                close_handshake(ret);
+                close(close_reason_t::EN_CRT_HANDSHAKE, false);
+            }
+            return ret;
+        }
+
+        int libatgw_proto_inner_v1::send_handshake_reconn_rsp(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake, int ret) {
+            // old session is not in this gateway, maybe it's restarted or client is switched from another gateway
+            if (error_code_t::EN_ECT_SESSION_NOT_FOUND == ret && NULL != body_handshake.ticket() && body_handshake.ticket()->size() > 0) {
+                ret = resume_ticket(body_handshake);
+            }
             // after this , can not failed any more, because session had already accepted.
 
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
             flatbuffers::Offset<cs_body_handshake> reconn_body;
 
             uint64_t sess_id = 0;
             if (0 == ret) {
                 sess_id = session_id_;
+
+                // select a available compression algorithm, just like start_req
+                std::shared_ptr<detail::crypt_global_configure_t> global_cfg = detail::crypt_global_configure_t::current();
+                setup_compression(global_cfg,
+                                  global_cfg ? global_cfg->select_compression_type(body_handshake.compression_type() ? body_handshake.compression_type()->c_str() : NULL)
+                                             : compression_t_EN_CT_NONE,
+                                  true);
+
+                // and frame checksum algorithm
+                checksum_.next_type =
+                    global_cfg ? global_cfg->select_checksum_type(body_handshake.checksum_type() ? body_handshake.checksum_type()->c_str() : NULL,
+                                                                  crypt_handshake_->is_aead())
+                               : checksum_t::EN_CKT_MURMUR3;
+
+                // posts taken from the old connection but already received by client are released, the rest will be sent again
+                replay_.window_size = global_cfg ? global_cfg->conf_.replay_window : 0;
+                replay_.is_sending  = replay_.window_size > 0 && 0 != body_handshake.replay_sequence();
+                release_replay_posts(replay_.is_sending ? body_handshake.replay_sequence() - 1 : replay_.send_sequence);
+            }
+
+            uint64_t replay_sequence = 0;
+            if (replay_.is_sending) {
+                replay_sequence = replay_.cache.empty() ? replay_.send_sequence + 1 : replay_.cache.front().sequence;
+
+                // session resumed by ticket does not know posts sent by the old connection, so do not pretend nothing is lost
+                // client restarts its sequence from the next post of this connection
+                if (0 == ret && replay_.send_sequence + 1 < body_handshake.replay_sequence()) {
+                    replay_sequence = ATFRAME_GATEWAY_MACRO_REPLAY_SEQUENCE_UNKNOWN;
+                }
             }
 
             reconn_body = Createcs_body_handshake(builder, sess_id, handshake_step_t_EN_HST_RECONNECT_RSP,
                                                   static_cast< ::atframe::gw::inner::v1::switch_secret_t>(handshake_.switch_secret_type),
-                                                  builder.CreateString(crypt_handshake_->type));
+                                                  builder.CreateString(crypt_handshake_->type), 0, 0,
+                                                  builder.CreateString(detail::get_compression_name(compression_.type)),
+                                                  builder.CreateString(detail::get_checksum_name(checksum_.next_type)), replay_sequence);
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, reconn_body.Union()), cs_msgIdentifier());
 
             if (0 != ret) {
-                write_msg(builder);
+                write_msg(builder, false, false, true);
                 close_handshake(ret);
                 close(ret, true);
             } else {
 
-                ret = write_msg(builder);
+                ret = write_msg(builder, false, false, true);
+                setup_checksum(checksum_.next_type);
                 close_handshake(ret);
 
+                // posts lost with the old connection, before any new one
+                if (0 == ret) {
+                    ret = replay_posts();
+                    if (0 != ret) {
+                        ATFRAME_GATEWAY_ON_ERROR(ret, "send posts again after reconnect failed.");
+                        close(close_reason_t::EN_CRT_EAGAIN, false);
+                        return ret;
+                    }
+                }
+
                 // change key immediately, in case of Man-in-the-Middle Attack
                 ret = handshake_update();
                 if (0 != ret) {
@@ -851,6 +2513,30 @@ namespace atframe {
             crypt_read_  = crypt_handshake_;
             crypt_write_ = crypt_handshake_;
 
+            // messages in old connection are discarded, so stream context must be reset
+            setup_compression(global_cfg,
+                              NULL == body_handshake.compression_type() ? ::atframe::gw::inner::v1::compression_t_EN_CT_NONE
+                                                                         : detail::get_compression_type_by_name(body_handshake.compression_type()->str()),
+                              true);
+            setup_checksum(NULL == body_handshake.checksum_type() ? checksum_t::EN_CKT_MURMUR3
+                                                                   : detail::get_checksum_type_by_name(body_handshake.checksum_type()->str()));
+
+            // posts not received are sent again just after this response, unless server has dropped some of them
+            replay_.is_receiving   = 0 != body_handshake.replay_sequence();
+            replay_.acked_sequence = replay_.received_sequence;
+            replay_.lost_number    = 0;
+            if (ATFRAME_GATEWAY_MACRO_REPLAY_SEQUENCE_UNKNOWN == body_handshake.replay_sequence()) {
+                // server does not know posts sent by the old connection, and numbers posts from 1 again
+                replay_.received_sequence = 0;
+                replay_.acked_sequence    = 0;
+                replay_.lost_number       = ATFRAME_GATEWAY_MACRO_REPLAY_SEQUENCE_UNKNOWN;
+                ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_NO_DATA, "posts sent before reconnecting are unknown.");
+            } else if (replay_.is_receiving && body_handshake.replay_sequence() > replay_.received_sequence + 1) {
+                // caller can not tell it from a successful reconnect, so keep it for get_lost_post_number
+                replay_.lost_number = body_handshake.replay_sequence() - replay_.received_sequence - 1;
+                ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_NO_DATA, "some posts are lost when reconnecting.");
+            }
+
             close_handshake(0);
             return 0;
         }
@@ -865,23 +2551,26 @@ namespace atframe {
                 return error_code_t::EN_ECT_HANDSHAKE;
             }
 
-            using namespace ::atframe::gw::inner::v1;
-            flatbuffers::FlatBufferBuilder   builder;
-            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
-            flatbuffers::Offset<cs_body_handshake> pubkey_rsp_body;
-
-
-            crypt_handshake_->param.clear();
+            handshake_.param.clear();
 
             do {
-                if (false == handshake_.has_data) {
+                if (false == handshake_.has_data || !handshake_.dh_ctx || !handshake_.dh_slot) {
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
                     ATFRAME_GATEWAY_ON_ERROR(ret, "DH not loaded");
                     break;
                 }
 
+                // compute shared secret in worker thread if possible, response will be sent after that
+                // in-progress handshake is never refused, so do it here if workers are busy
+                if (0 == start_handshake_task(detail::handshake_task_t::EN_HTT_CALC_SECRET, next_step, std::string(), peer_body.crypt_param()->data(),
+                                              peer_body.crypt_param()->size())) {
+                    return 0;
+                }
+
+                std::lock_guard<std::mutex> lock_guard(handshake_.dh_slot->lock);
+
                 int res =
-                    handshake_.dh_ctx.read_public(reinterpret_cast<const unsigned char *>(peer_body.crypt_param()->data()), peer_body.crypt_param()->size());
+                    handshake_.dh_ctx->read_public(reinterpret_cast<const unsigned char *>(peer_body.crypt_param()->data()), peer_body.crypt_param()->size());
                 if (0 != res) {
                     ATFRAME_GATEWAY_ON_ERROR(res, "DH read param failed");
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
@@ -889,21 +2578,39 @@ namespace atframe {
                 }
 
                 // generate secret
-                res = handshake_.dh_ctx.calc_secret(crypt_handshake_->secret);
+                res = handshake_.dh_ctx->calc_secret(crypt_handshake_->secret);
                 if (0 != res) {
                     ATFRAME_GATEWAY_ON_ERROR(res, "DH compute key failed");
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
                     break;
                 }
+            } while (false);
 
+            return send_handshake_dh_pubkey_rsp(next_step, ret);
+        }
+
+        int libatgw_proto_inner_v1::send_handshake_dh_pubkey_rsp(::atframe::gw::inner::v1::handshake_step_t next_step, int ret) {
+            using namespace ::atframe::gw::inner::v1;
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
+            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
+            flatbuffers::Offset<cs_body_handshake> pubkey_rsp_body;
+
+            // shared secret is already computed into crypt_handshake_->secret
+            if (0 == ret) {
+                int res = 0;
                 if (crypt_handshake_->swap_secret(crypt_handshake_->secret, res) < 0) {
                     ATFRAME_GATEWAY_ON_ERROR(res, "DH set key failed");
-                    break;
+                } else {
+                    crypt_read_  = crypt_handshake_;
+                    crypt_write_ = crypt_handshake_;
                 }
+            }
 
-                crypt_read_  = crypt_handshake_;
-                crypt_write_ = crypt_handshake_;
-            } while (false);
+            switch_secret_t switch_type = static_cast<switch_secret_t>(handshake_.switch_secret_type);
 
             // send verify text prefix
             const void *outbuf = NULL;
@@ -915,14 +2622,14 @@ namespace atframe {
                     // 3 * secret_len, 1 for binary data, 2 for hex data
                     unsigned char *verify_text = (unsigned char *)malloc((secret_len << 1) + secret_len);
                     if (NULL != verify_text) {
-                        int res = crypt_handshake_->shared_conf->shared_dh_context_->random(reinterpret_cast<void *>(verify_text), secret_len);
+                        int res = crypt_handshake_->shared_conf->random(reinterpret_cast<void *>(verify_text), secret_len);
                         if (0 == res) {
                             util::string::dumphex(verify_text, secret_len, verify_text + secret_len);
                             ret = encrypt_data(*crypt_handshake_, verify_text + secret_len, secret_len << 1, outbuf, outsz);
                         } else {
                             ATFRAME_GATEWAY_ON_ERROR(res, "generate verify text failed");
                         }
-                        crypt_handshake_->param.assign(verify_text + secret_len, verify_text + (secret_len << 1) + secret_len);
+                        handshake_.param.assign(verify_text + secret_len, verify_text + (secret_len << 1) + secret_len);
                         free(verify_text);
                     }
                 }
@@ -934,15 +2641,15 @@ namespace atframe {
             }
 
             if (0 == ret) {
-                pubkey_rsp_body = Createcs_body_handshake(builder, session_id_, next_step, peer_body.switch_type(), builder.CreateString(std::string()),
+                pubkey_rsp_body = Createcs_body_handshake(builder, session_id_, next_step, switch_type, builder.CreateString(std::string()),
                                                           builder.CreateVector(reinterpret_cast<const int8_t *>(outbuf), NULL == outbuf ? 0 : outsz));
             } else {
-                pubkey_rsp_body = Createcs_body_handshake(builder, 0, next_step, peer_body.switch_type(), builder.CreateString(std::string()),
+                pubkey_rsp_body = Createcs_body_handshake(builder, 0, next_step, switch_type, builder.CreateString(std::string()),
                                                           builder.CreateVector(reinterpret_cast<const int8_t *>(NULL), 0));
             }
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, pubkey_rsp_body.Union()), cs_msgIdentifier());
-            ret = write_msg(builder);
+            ret = write_msg(builder, false, false, true);
             return ret;
         }
 
@@ -963,8 +2670,8 @@ namespace atframe {
                 // add something and encrypt it again. and send verify message
                 std::string verify_data;
                 verify_data.resize(outsz, 0);
-                if (crypt_handshake_->shared_conf && crypt_handshake_->shared_conf->shared_dh_context_) {
-                    crypt_handshake_->shared_conf->shared_dh_context_->random(reinterpret_cast<void *>(&verify_data[0]), outsz);
+                if (crypt_handshake_->shared_conf) {
+                    crypt_handshake_->shared_conf->random(reinterpret_cast<void *>(&verify_data[0]), outsz);
                 }
                 // copy all the checked data
                 for (size_t i = 0; i < verify_data.size(); ++i) {
@@ -995,20 +2702,20 @@ namespace atframe {
             }
 
             // check hello message prefix
-            if (NULL != body_handshake.crypt_param() && !crypt_read_->param.empty() && crypt_read_->param.size() <= body_handshake.crypt_param()->size()) {
+            if (NULL != body_handshake.crypt_param() && !handshake_.param.empty() && handshake_.param.size() <= body_handshake.crypt_param()->size()) {
                 const void *outbuf = NULL;
                 size_t      outsz  = 0;
                 ret                = decrypt_data(*crypt_read_, body_handshake.crypt_param()->data(), body_handshake.crypt_param()->size(), outbuf, outsz);
                 if (0 != ret) {
                     ATFRAME_GATEWAY_ON_ERROR(ret, "verify crypt information but decode failed.");
-                } else if (outsz < crypt_read_->param.size()) { // maybe has padding
+                } else if (outsz < handshake_.param.size()) { // maybe has padding
                     ret = error_code_t::EN_ECT_HANDSHAKE;
                     ATFRAME_GATEWAY_ON_ERROR(ret, "verify data length error.");
                 } else {
                     const unsigned char *checked_ch = reinterpret_cast<const unsigned char *>(outbuf);
-                    for (size_t i = 0; checked_ch && *checked_ch && i < crypt_read_->param.size(); ++i, ++checked_ch) {
+                    for (size_t i = 0; checked_ch && *checked_ch && i < handshake_.param.size(); ++i, ++checked_ch) {
                         // just check half data
-                        if ((i & 0x01) && *checked_ch != crypt_read_->param[i]) {
+                        if ((i & 0x01) && *checked_ch != handshake_.param[i]) {
                             ret = error_code_t::EN_ECT_CRYPT_VERIFY;
                             break;
                         }
@@ -1019,6 +2726,12 @@ namespace atframe {
             if (0 == ret) {
                 // then read key updated
                 close_handshake(0);
+
+                // the secret is verified, so it can be used to resume session
+                int res = send_ticket();
+                if (0 != res) {
+                    ATFRAME_GATEWAY_ON_ERROR(res, "send resumption ticket failed.");
+                }
             } else {
                 ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_CRYPT_VERIFY, "verify failed.");
                 close_handshake(error_code_t::EN_ECT_CRYPT_VERIFY);
@@ -1027,16 +2740,55 @@ namespace atframe {
             return ret;
         }
 
+        int libatgw_proto_inner_v1::send_handshake_start_rsp(::atframe::gw::inner::v1::cs_msg_type_t msg_type, std::string &crypt_type) {
+            using namespace ::atframe::gw::inner::v1;
+
+            detail::builder_holder_t               builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder &       builder     = builder_holder.get();
+            flatbuffers::Offset<cs_msg_head>       header_data = Createcs_msg_head(builder, msg_type, ::atframe::gateway::detail::alloc_seq());
+            flatbuffers::Offset<cs_body_handshake> handshake_body;
+
+            int ret = pack_handshake_start_rsp(builder, session_id_, crypt_type, handshake_body);
+            if (ret < 0) {
+                handshake_done(ret);
+                return ret;
+            }
+
+            builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, handshake_body.Union()), cs_msgIdentifier());
+            ret = write_msg(builder, false, false, true);
+            if (ret < 0) {
+                handshake_done(ret);
+            }
+
+            // peer will use negotiated checksum algorithm after receiving the response
+            setup_checksum(checksum_.next_type);
+            return ret;
+        }
+
         int libatgw_proto_inner_v1::pack_handshake_start_rsp(flatbuffers::FlatBufferBuilder &builder, uint64_t sess_id, std::string &crypt_type,
                                                              flatbuffers::Offset< ::atframe::gw::inner::v1::cs_body_handshake> &handshake_data) {
             using namespace ::atframe::gw::inner::v1;
 
             int ret = crypt_handshake_->setup(crypt_type);
+            // frame checksum can not be disabled without AEAD cipher
+            if (checksum_t::EN_CKT_NONE == checksum_.next_type && (ret < 0 || !crypt_handshake_->is_aead())) {
+                checksum_.next_type = checksum_t::EN_CKT_MURMUR3;
+            }
+
+            // sequence of the next post, so client will acknowledge posts
+            uint64_t replay_sequence = replay_.is_sending ? replay_.send_sequence + 1 : 0;
+
             // if not use crypt, assign crypt information and close_handshake(0)
             if (0 == sess_id || !crypt_handshake_->shared_conf || crypt_type.empty() || ret < 0) {
                 // empty data
                 handshake_data = Createcs_body_handshake(builder, sess_id, handshake_step_t_EN_HST_START_RSP, switch_secret_t_EN_SST_DIRECT,
-                                                         builder.CreateString(crypt_type), builder.CreateVector(reinterpret_cast<const int8_t *>(NULL), 0));
+                                                         builder.CreateString(crypt_type), builder.CreateVector(reinterpret_cast<const int8_t *>(NULL), 0), 0,
+                                                         builder.CreateString(detail::get_compression_name(compression_.type)),
+                                                         builder.CreateString(detail::get_checksum_name(checksum_.next_type)),
+                                                         replay_sequence);
 
                 crypt_read_  = crypt_handshake_;
                 crypt_write_ = crypt_handshake_;
@@ -1045,7 +2797,13 @@ namespace atframe {
             }
 
             // TODO using crypt_type
-            crypt_handshake_->param.clear();
+            // DH parameters may be already made by handshake task
+            bool params_ready       = handshake_.params_ready;
+            handshake_.params_ready = false;
+            if (!params_ready) {
+                handshake_.param.clear();
+            }
+
             switch (handshake_.switch_secret_type) {
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DIRECT: {
                 int libres = 0;
@@ -1059,20 +2817,27 @@ namespace atframe {
                 handshake_data = Createcs_body_handshake(
                     builder, sess_id, handshake_step_t_EN_HST_START_RSP, static_cast< ::atframe::gw::inner::v1::switch_secret_t>(handshake_.switch_secret_type),
                     builder.CreateString(crypt_type),
-                    builder.CreateVector(reinterpret_cast<const int8_t *>(crypt_handshake_->secret.data()), crypt_handshake_->secret.size()));
+                    builder.CreateVector(reinterpret_cast<const int8_t *>(crypt_handshake_->secret.data()), crypt_handshake_->secret.size()), 0,
+                    builder.CreateString(detail::get_compression_name(compression_.type)), builder.CreateString(detail::get_checksum_name(checksum_.next_type)),
+                    replay_sequence);
 
                 break;
             }
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH:
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH: {
                 do {
-                    if (false == handshake_.has_data) {
+                    if (false == handshake_.has_data || !handshake_.dh_ctx || !handshake_.dh_slot) {
                         ret = error_code_t::EN_ECT_HANDSHAKE;
                         ATFRAME_GATEWAY_ON_ERROR(ret, "DH not loaded");
                         break;
                     }
 
-                    int res = handshake_.dh_ctx.make_params(crypt_handshake_->param);
+                    if (params_ready) {
+                        break;
+                    }
+
+                    std::lock_guard<std::mutex> lock_guard(handshake_.dh_slot->lock);
+                    int                         res = handshake_.dh_ctx->make_params(handshake_.param);
                     if (0 != res) {
                         ATFRAME_GATEWAY_ON_ERROR(res, "DH generate check public key failed");
                         ret = error_code_t::EN_ECT_CRYPT_OPERATION;
@@ -1083,7 +2848,9 @@ namespace atframe {
                 handshake_data = Createcs_body_handshake(
                     builder, sess_id, handshake_step_t_EN_HST_START_RSP, static_cast< ::atframe::gw::inner::v1::switch_secret_t>(handshake_.switch_secret_type),
                     builder.CreateString(crypt_type),
-                    builder.CreateVector(reinterpret_cast<const int8_t *>(crypt_handshake_->param.data()), crypt_handshake_->param.size()));
+                    builder.CreateVector(reinterpret_cast<const int8_t *>(handshake_.param.data()), handshake_.param.size()), 0,
+                    builder.CreateString(detail::get_compression_name(compression_.type)), builder.CreateString(detail::get_checksum_name(checksum_.next_type)),
+                    replay_sequence);
 
                 break;
             }
@@ -1112,24 +2879,25 @@ namespace atframe {
             }
 
             handshake_.switch_secret_type = peer_body.switch_type();
-            crypt_handshake_->param.clear();
+            handshake_.param.clear();
 
             do {
-                if (false == handshake_.has_data) {
+                if (false == handshake_.has_data || !handshake_.dh_ctx || !handshake_.dh_slot) {
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
                     ATFRAME_GATEWAY_ON_ERROR(ret, "DH not loaded");
                     break;
                 }
 
-                int res =
-                    handshake_.dh_ctx.read_params(reinterpret_cast<const unsigned char *>(peer_body.crypt_param()->data()), peer_body.crypt_param()->size());
+                std::lock_guard<std::mutex> lock_guard(handshake_.dh_slot->lock);
+                int                         res =
+                    handshake_.dh_ctx->read_params(reinterpret_cast<const unsigned char *>(peer_body.crypt_param()->data()), peer_body.crypt_param()->size());
                 if (0 != res) {
                     ATFRAME_GATEWAY_ON_ERROR(res, "DH read param failed");
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
                     break;
                 }
 
-                res = handshake_.dh_ctx.make_public(crypt_handshake_->param);
+                res = handshake_.dh_ctx->make_public(handshake_.param);
                 if (0 != res) {
                     ATFRAME_GATEWAY_ON_ERROR(res, "DH make public key failed");
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
@@ -1137,7 +2905,7 @@ namespace atframe {
                 }
 
                 // generate secret
-                res = handshake_.dh_ctx.calc_secret(crypt_handshake_->secret);
+                res = handshake_.dh_ctx->calc_secret(crypt_handshake_->secret);
                 if (0 != res) {
                     ATFRAME_GATEWAY_ON_ERROR(res, "DH compute key failed");
                     ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
@@ -1155,7 +2923,7 @@ namespace atframe {
             handshake_data = Createcs_body_handshake(
                 builder, peer_body.session_id(), next_step, static_cast< ::atframe::gw::inner::v1::switch_secret_t>(handshake_.switch_secret_type),
                 builder.CreateString(std::string()),
-                builder.CreateVector(reinterpret_cast<const int8_t *>(crypt_handshake_->param.data()), crypt_handshake_->param.size()));
+                builder.CreateVector(reinterpret_cast<const int8_t *>(handshake_.param.data()), handshake_.param.size()));
 
             return ret;
         }
@@ -1178,7 +2946,15 @@ namespace atframe {
             switch (handshake_.switch_secret_type) {
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH:
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH: {
-                handshake_.dh_ctx.init(shared_conf->shared_dh_context_);
+                handshake_.dh_slot = shared_conf->alloc_dh_slot();
+                if (!handshake_.dh_slot) {
+                    ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
+                    break;
+                }
+
+                std::lock_guard<std::mutex> lock_guard(handshake_.dh_slot->lock);
+                handshake_.dh_ctx = std::make_shared<util::crypto::dh>();
+                handshake_.dh_ctx->init(handshake_.dh_slot->shared_context);
                 break;
             }
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DIRECT: {
@@ -1199,7 +2975,16 @@ namespace atframe {
         }
 
         void libatgw_proto_inner_v1::close_handshake(int status) {
-            crypt_handshake_->param.clear();
+            // handshake data is useless after handshake, release the memory instead of just clearing it
+            std::vector<unsigned char>().swap(handshake_.param);
+            handshake_.params_ready = false;
+
+            // dh context may be still used by worker thread, it will be released with the task
+            bool is_task_running = !!handshake_.task;
+            if (is_task_running) {
+                handshake_.task->owner = NULL;
+                handshake_.task.reset();
+            }
 
             if (!handshake_.has_data) {
                 handshake_done(status);
@@ -1215,7 +3000,11 @@ namespace atframe {
             switch (handshake_.switch_secret_type) {
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH:
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH: {
-                handshake_.dh_ctx.close();
+                if (handshake_.dh_ctx && !is_task_running) {
+                    handshake_.dh_ctx->close();
+                }
+                handshake_.dh_ctx.reset();
+                handshake_.dh_slot.reset();
                 break;
             }
             case ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DIRECT: {
@@ -1235,6 +3024,194 @@ namespace atframe {
 #endif
         }
 
+        int libatgw_proto_inner_v1::start_handshake_task(int task_type, int msg_type, const std::string &crypt_type, const void *input, size_t input_len) {
+            if (NULL == callbacks_ || !callbacks_->async_work_fn) {
+                return error_code_t::EN_ECT_MISS_CALLBACKS;
+            }
+
+            if (!handshake_.has_data || !handshake_.dh_ctx || !handshake_.dh_slot || handshake_.task) {
+                return error_code_t::EN_ECT_HANDSHAKE;
+            }
+
+            std::shared_ptr<detail::handshake_task_t> task = std::make_shared<detail::handshake_task_t>();
+            if (!task) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+
+            task->task_type   = task_type;
+            task->owner       = this;
+            task->shared_conf = crypt_handshake_->shared_conf;
+            task->dh_ctx      = handshake_.dh_ctx;
+            task->dh_slot     = handshake_.dh_slot;
+            if (NULL != input && input_len > 0) {
+                task->input.assign(reinterpret_cast<const unsigned char *>(input), reinterpret_cast<const unsigned char *>(input) + input_len);
+            }
+            task->msg_type   = msg_type;
+            task->crypt_type = crypt_type;
+
+            // done callback may be called before async_work_fn returns
+            handshake_.task = task;
+
+            int ret = callbacks_->async_work_fn(this, std::bind(detail::run_handshake_task, task),
+                                                std::bind(&libatgw_proto_inner_v1::on_handshake_task_done, task, std::placeholders::_1));
+            if (0 != ret && handshake_.task == task) {
+                task->owner = NULL;
+                handshake_.task.reset();
+            }
+
+            return ret;
+        }
+
+        void libatgw_proto_inner_v1::on_handshake_task_done(const std::shared_ptr<detail::handshake_task_t> &task, int status) {
+            if (!task) {
+                return;
+            }
+
+            libatgw_proto_inner_v1 *self = task->owner;
+            task->owner                  = NULL;
+
+            // handshake is closed or proto object is destroyed
+            if (NULL == self || self->handshake_.task != task) {
+                return;
+            }
+            self->handshake_.task.reset();
+
+            self->finish_handshake_task(*task, status);
+        }
+
+        bool libatgw_proto_inner_v1::use_prepared_dh() {
+            if (!handshake_.has_data || handshake_.params_ready || handshake_.task || !crypt_handshake_->shared_conf) {
+                return false;
+            }
+
+            detail::crypt_global_configure_t::prepared_dh_t prepared;
+            if (!crypt_handshake_->shared_conf->pop_prepared_dh(prepared) || !prepared.dh_ctx || !prepared.dh_slot) {
+                return false;
+            }
+
+            // the key pair made in setup_handshake is not used
+            if (handshake_.dh_ctx) {
+                handshake_.dh_ctx->close();
+            }
+            handshake_.dh_ctx  = prepared.dh_ctx;
+            handshake_.dh_slot = prepared.dh_slot;
+            handshake_.param.swap(prepared.params);
+            handshake_.params_ready = true;
+            return true;
+        }
+
+        void libatgw_proto_inner_v1::finish_handshake_task(detail::handshake_task_t &task, int status) {
+            flag_guard_t flag_guard(flags_, flag_t::EN_PFT_IN_CALLBACK);
+
+            // resources will be released when closed
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return;
+            }
+
+            bool is_success = true;
+            if (0 != status) {
+                ATFRAME_GATEWAY_ON_ERROR(status, "handshake task failed");
+                is_success = false;
+            } else if (0 != task.result) {
+                ATFRAME_GATEWAY_ON_ERROR(task.result, NULL == task.errmsg ? "DH operation failed" : task.errmsg);
+                is_success = false;
+            }
+
+            int ret = 0;
+            switch (task.task_type) {
+            case detail::handshake_task_t::EN_HTT_MAKE_PARAMS: {
+                if (is_success) {
+                    handshake_.param.swap(task.output);
+                    handshake_.params_ready = true;
+                    ret                     = send_handshake_start_rsp(static_cast< ::atframe::gw::inner::v1::cs_msg_type_t>(task.msg_type), task.crypt_type);
+                } else {
+                    ret = error_code_t::EN_ECT_CRYPT_OPERATION;
+                }
+
+                if (ret < 0) {
+                    close_handshake(ret);
+                    // key updating failed will keep the old key, but new session must be closed
+                    if (::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_HANDSHAKE == task.msg_type) {
+                        close(close_reason_t::EN_CRT_HANDSHAKE, false);
+                    }
+                }
+                break;
+            }
+            case detail::handshake_task_t::EN_HTT_CALC_SECRET: {
+                if (is_success) {
+                    crypt_handshake_->secret.swap(task.output);
+                } else {
+                    ret = error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
+                }
+
+                ret = send_handshake_dh_pubkey_rsp(static_cast< ::atframe::gw::inner::v1::handshake_step_t>(task.msg_type), ret);
+                if (ret < 0) {
+                    close_handshake(ret);
+                    close(close_reason_t::EN_CRT_HANDSHAKE, false);
+                }
+                break;
+            }
+            default: {
+                close_handshake(error_code_t::EN_ECT_HANDSHAKE);
+                break;
+            }
+            }
+        }
+
+        int libatgw_proto_inner_v1::write_queue_t::push_back(void *&data, size_t s) {
+            int res = buffers_.push_back(data, s);
+            if (res < 0) {
+                return res;
+            }
+
+            blocks_.push_back(buffers_.back());
+            return res;
+        }
+
+        int libatgw_proto_inner_v1::write_queue_t::push_front(void *&data, size_t s) {
+            int res = buffers_.push_front(data, s);
+            if (res < 0) {
+                return res;
+            }
+
+            blocks_.push_front(buffers_.front());
+            return res;
+        }
+
+        void libatgw_proto_inner_v1::write_queue_t::pop_front() {
+            ::atbus::detail::buffer_block *bb = buffers_.front();
+            buffers_.pop_front(NULL == bb ? 0 : bb->size(), true);
+            if (!blocks_.empty()) {
+                blocks_.pop_front();
+            }
+        }
+
+        void libatgw_proto_inner_v1::write_queue_t::pop_back() {
+            ::atbus::detail::buffer_block *bb = buffers_.back();
+            buffers_.pop_back(NULL == bb ? 0 : bb->size(), true);
+            if (!blocks_.empty()) {
+                blocks_.pop_back();
+            }
+        }
+
+        void libatgw_proto_inner_v1::write_queue_t::clear() {
+            while (!buffers_.empty()) {
+                pop_front();
+            }
+            blocks_.clear();
+        }
+
+        void libatgw_proto_inner_v1::write_queue_t::set_mode(size_t max_size, size_t max_number) {
+            buffers_.set_mode(max_size, max_number);
+            blocks_.clear();
+        }
+
+        size_t libatgw_proto_inner_v1::write_queue_t::get_memory_usage() const {
+            // static buffer is allocated all at once
+            size_t ret = buffers_.is_static_mode() ? buffers_.limit().limit_size_ : buffers_.limit().cost_size_;
+            return ret + blocks_.size() * sizeof(::atbus::detail::buffer_block *);
+        }
+
         int libatgw_proto_inner_v1::try_write() {
             if (NULL == callbacks_ || !callbacks_->write_fn) {
                 return error_code_t::EN_ECT_MISS_CALLBACKS;
@@ -1244,8 +3221,13 @@ namespace atframe {
                 return 0;
             }
 
+            // corked, all data will be written when uncork() is called
+            if (check_flag(flag_t::EN_PFT_CORKED) && !check_flag(flag_t::EN_PFT_CLOSING)) {
+                return 0;
+            }
+
             // empty then skip write data
-            if (write_buffers_.empty()) {
+            if (write_queue_.empty() && write_urgent_queue_.empty()) {
                 return 0;
             }
 
@@ -1254,9 +3236,7 @@ namespace atframe {
 
             // closing or closed, cancle writing
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
-                while (!write_buffers_.empty()) {
-                    ::atbus::detail::buffer_block *bb     = write_buffers_.front();
-                    size_t                         nwrite = bb->raw_size();
+                while (!write_queue_.empty()) {
                     // // nwrite = write_header_offset_ + [data block...]
                     // // data block = 32bits hash+vint+data length
                     // char *buff_start = reinterpret_cast<char *>(bb->raw_data()) + write_header_offset_;
@@ -1282,8 +3262,10 @@ namespace atframe {
                     // }
 
                     // remove all cache buffer
-                    write_buffers_.pop_front(nwrite, true);
+                    write_queue_.pop_front();
                 }
+                write_urgent_barrier_ = 0;
+                write_urgent_queue_.clear();
 
                 // no need to call write_done(status) to trigger on_close_fn here
                 // because on_close_fn is triggered when close(reason) is called or write_done(status) is called ouside
@@ -1293,38 +3275,51 @@ namespace atframe {
             int  ret     = 0;
             bool is_done = false;
 
+            // urgent lane is always written first, but the block being written will not be interrupted
+            bool           is_urgent   = !write_urgent_queue_.empty();
+            write_queue_t &write_queue = is_urgent ? write_urgent_queue_ : write_queue_;
+
             // if not in writing mode, try to merge and write data
             // merge only if message is smaller than read buffer
-            if (write_buffers_.limit().cost_number_ > 1 && write_buffers_.front()->raw_size() <= ATFRAME_GATEWAY_MACRO_DATA_SMALL_SIZE) {
+            // writev_fn can send several blocks at once, so there is no need to merge them
+            if (!callbacks_->writev_fn && write_queue.limit().cost_number_ > 1 &&
+                write_queue.front()->size() <= ATFRAME_GATEWAY_MACRO_DATA_SMALL_SIZE) {
                 // left write_header_offset_ size at front
                 size_t available_bytes = get_tls_length(tls_buffer_t::EN_TBT_MERGE) - write_header_offset_;
                 char * buffer_start    = reinterpret_cast<char *>(get_tls_buffer(tls_buffer_t::EN_TBT_MERGE));
                 char * free_buffer     = buffer_start;
 
-                ::atbus::detail::buffer_block *preview_bb = NULL;
-                while (!write_buffers_.empty() && available_bytes > 0) {
-                    ::atbus::detail::buffer_block *bb = write_buffers_.front();
-                    if (NULL == bb || bb->raw_size() > available_bytes) {
+                ::atbus::detail::buffer_block *preview_bb    = NULL;
+                size_t                         merged_number = 0;
+                while (!write_queue.empty() && available_bytes > 0) {
+                    ::atbus::detail::buffer_block *bb = write_queue.front();
+                    if (NULL == bb || bb->size() > available_bytes) {
                         break;
                     }
 
-                    // if write_buffers_ is a static circle buffer, can not merge the bound blocks
-                    if (write_buffers_.is_static_mode() && NULL != preview_bb && preview_bb > bb) {
+                    // if write_queue is a static circle buffer, can not merge the bound blocks
+                    if (write_queue.is_static_mode() && NULL != preview_bb && preview_bb > bb) {
                         break;
                     }
                     preview_bb = bb;
 
                     // first write_header_offset_ should not be merged, the rest is 32bits hash+varint+len
-                    size_t bb_size = bb->raw_size() - write_header_offset_;
-                    memcpy(free_buffer, ::atbus::detail::fn::buffer_next(bb->raw_data(), write_header_offset_), bb_size);
+                    size_t bb_size = bb->size() - write_header_offset_;
+                    memcpy(free_buffer, ::atbus::detail::fn::buffer_next(bb->data(), write_header_offset_), bb_size);
                     free_buffer += bb_size;
                     available_bytes -= bb_size;
 
-                    write_buffers_.pop_front(bb->raw_size(), true);
+                    write_queue.pop_front();
+                    ++merged_number;
                 }
 
                 void *data = NULL;
-                write_buffers_.push_front(data, write_header_offset_ + (free_buffer - buffer_start));
+                write_queue.push_front(data, write_header_offset_ + (free_buffer - buffer_start));
+
+                // barrier is in the merged block or after it
+                if (!is_urgent && write_urgent_barrier_ > 0) {
+                    write_urgent_barrier_ = write_urgent_barrier_ > merged_number ? write_urgent_barrier_ - merged_number + 1 : 1;
+                }
 
                 // already pop more data than write_header_offset_ + (free_buffer - buffer_start)
                 // so this push_front should always success
@@ -1338,26 +3333,64 @@ namespace atframe {
                 memcpy(data, buffer_start, free_buffer - buffer_start);
             }
 
-            // prepare to writing
-            ::atbus::detail::buffer_block *writing_block = write_buffers_.front();
+            // prepare to writing
+            ::atbus::detail::buffer_block *writing_block = write_queue.front();
+
+            // should always exist, empty will cause return before
+            if (NULL == writing_block) {
+                assert(writing_block);
+                write_queue.pop_front();
+                set_flag(flag_t::EN_PFT_WRITING, true);
+                is_writing_urgent_ = is_urgent;
+                return write_done(error_code_t::EN_ECT_NO_DATA);
+            }
+
+            if (writing_block->size() <= write_header_offset_) {
+                write_queue.pop_front();
+                if (!is_urgent && write_urgent_barrier_ > 0) {
+                    --write_urgent_barrier_;
+                }
+                return try_write();
+            }
+
+            // call write
+            // data() may be not the same as raw_data(), if the message is built in a reserved block
+            set_flag(flag_t::EN_PFT_WRITING, true);
+            is_writing_urgent_ = is_urgent;
+            if (callbacks_->writev_fn) {
+                write_vector_t bufs[ATFRAME_GATEWAY_MACRO_WRITEV_MAX_BLOCKS];
+                size_t         bufs_num = 0;
+
+                ::atbus::detail::buffer_block *preview_bb = NULL;
+                for (write_queue_t::block_iterator iter = write_queue.block_begin();
+                     iter != write_queue.block_end() && bufs_num < ATFRAME_GATEWAY_MACRO_WRITEV_MAX_BLOCKS; ++iter) {
+                    ::atbus::detail::buffer_block *bb = *iter;
+                    if (NULL == bb || bb->size() <= write_header_offset_) {
+                        break;
+                    }
+
+                    // if write_queue is a static circle buffer, can not write the bound blocks together
+                    if (write_queue.is_static_mode() && NULL != preview_bb && preview_bb > bb) {
+                        break;
+                    }
+                    preview_bb = bb;
+
+                    bufs[bufs_num].buffer = bb->data();
+                    bufs[bufs_num].length = bb->size();
+                    ++bufs_num;
+                }
 
-            // should always exist, empty will cause return before
-            if (NULL == writing_block) {
-                assert(writing_block);
-                write_buffers_.pop_front(0, true);
-                set_flag(flag_t::EN_PFT_WRITING, true);
-                return write_done(error_code_t::EN_ECT_NO_DATA);
-            }
+                // the first one should always be writing_block
+                assert(bufs_num > 0 && bufs[0].buffer == writing_block->data());
 
-            if (writing_block->raw_size() <= write_header_offset_) {
-                write_buffers_.pop_front(writing_block->raw_size(), true);
-                return try_write();
+                // write_done(status) will pop all blocks until the last one
+                last_write_ptr_ = bufs[bufs_num - 1].buffer;
+                ret             = callbacks_->writev_fn(this, bufs, bufs_num, &is_done);
+            } else {
+                last_write_ptr_ = writing_block->data();
+                ret             = callbacks_->write_fn(this, writing_block->data(), writing_block->size(), &is_done);
             }
 
-            // call write
-            set_flag(flag_t::EN_PFT_WRITING, true);
-            last_write_ptr_ = writing_block->raw_data();
-            ret             = callbacks_->write_fn(this, writing_block->raw_data(), writing_block->raw_size(), &is_done);
             if (is_done) {
                 return write_done(ret);
             }
@@ -1365,7 +3398,7 @@ namespace atframe {
             return ret;
         }
 
-        int libatgw_proto_inner_v1::write_msg(flatbuffers::FlatBufferBuilder &builder) {
+        int libatgw_proto_inner_v1::write_msg(flatbuffers::FlatBufferBuilder &builder, bool is_tagged, bool is_urgent, bool is_barrier) {
             // first 32bits is hash code, and then 32bits length
             const size_t msg_header_len = sizeof(uint32_t) + sizeof(uint32_t);
 
@@ -1381,18 +3414,25 @@ namespace atframe {
                 // get the write block size: write_header_offset_ + header + len）
                 size_t total_buffer_size = write_header_offset_ + msg_header_len + len;
 
+                write_queue_t &write_queue = is_urgent ? write_urgent_queue_ : write_queue_;
+
                 // 判定内存限制
                 void *data;
-                int   res = write_buffers_.push_back(data, total_buffer_size);
+                int   res = write_queue.push_back(data, total_buffer_size);
                 if (res < 0) {
                     return res;
                 }
 
+                // handshake messages may change the key of peer, encrypted urgent posts can not be sent before them
+                if (is_barrier && !is_urgent) {
+                    write_urgent_barrier_ = write_queue_.block_size();
+                }
+
                 // skip custom write_header_offset_
                 char *buff_start = reinterpret_cast<char *>(data) + write_header_offset_;
 
-                // 32bits hash
-                uint32_t hash32 = util::hash::murmur_hash3_x86_32(reinterpret_cast<const char *>(buf), static_cast<int>(len), 0);
+                // 32bits hash, 0 if message is protected by AEAD tag
+                uint32_t hash32 = is_tagged ? 0 : detail::calc_frame_checksum(checksum_.type, buf, len);
                 memcpy(buff_start, &hash32, sizeof(uint32_t));
 
                 // length
@@ -1404,10 +3444,225 @@ namespace atframe {
             return try_write();
         }
 
+        int libatgw_proto_inner_v1::reserve_msg(size_t body_size, void *&builder_buf, size_t &builder_len, bool is_urgent) {
+            // first 32bits is hash code, and then 32bits length
+            const size_t msg_header_len = sizeof(uint32_t) + sizeof(uint32_t);
+
+            builder_buf = NULL;
+            builder_len = body_size + detail::reserved_msg_extend_size;
+            // padding to 64bits, so the message built by flatbuffers will be aligned
+            builder_len = (builder_len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+
+            if (builder_len >= std::numeric_limits<uint32_t>::max()) {
+                return error_code_t::EN_ECT_INVALID_SIZE;
+            }
+
+            write_queue_t &write_queue = is_urgent ? write_urgent_queue_ : write_queue_;
+
+            void *data = NULL;
+            int   res  = write_queue.push_back(data, write_header_offset_ + msg_header_len + builder_len);
+            if (res < 0) {
+                return res;
+            }
+
+            builder_buf = ::atbus::detail::fn::buffer_next(data, write_header_offset_ + msg_header_len);
+            return 0;
+        }
+
+        int libatgw_proto_inner_v1::write_reserved_msg(flatbuffers::FlatBufferBuilder &builder, void *builder_buf, size_t builder_len, bool is_tagged,
+                                                       bool is_urgent) {
+            // first 32bits is hash code, and then 32bits length
+            const size_t msg_header_len = sizeof(uint32_t) + sizeof(uint32_t);
+
+            write_queue_t &write_queue = is_urgent ? write_urgent_queue_ : write_queue_;
+
+            ::atbus::detail::buffer_block *bb = write_queue.back();
+            if (NULL == bb || ::atbus::detail::fn::buffer_next(bb->data(), write_header_offset_ + msg_header_len) != builder_buf) {
+                assert(false);
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            char * buf     = reinterpret_cast<char *>(builder.GetBufferPointer());
+            size_t len     = static_cast<size_t>(builder.GetSize());
+            char * buf_end = reinterpret_cast<char *>(builder_buf) + builder_len;
+
+            // builder has grown out of the reserved block, or nothing to send
+            if (NULL == buf || 0 == len || buf < reinterpret_cast<char *>(builder_buf) || buf + len != buf_end) {
+                write_queue.pop_back();
+                return write_msg(builder, is_tagged, is_urgent);
+            }
+
+            char *buff_start = buf - msg_header_len;
+
+            // 32bits hash, 0 if message is protected by AEAD tag
+            uint32_t hash32 = is_tagged ? 0 : detail::calc_frame_checksum(checksum_.type, buf, len);
+            memcpy(buff_start, &hash32, sizeof(uint32_t));
+
+            // length
+            flatbuffers::WriteScalar<uint32_t>(buff_start + sizeof(uint32_t), static_cast<uint32_t>(len));
+
+            // skip the unused space, so block's data() will be just write_header_offset_ before the message header
+            bb->pop(static_cast<size_t>(buff_start - write_header_offset_ - reinterpret_cast<char *>(bb->data())));
+
+            return try_write();
+        }
+
+        int libatgw_proto_inner_v1::write_frame(const void *frame, size_t len, bool is_urgent) {
+            if (NULL == frame || 0 == len) {
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            write_queue_t &write_queue = is_urgent ? write_urgent_queue_ : write_queue_;
+
+            void *data = NULL;
+            int   res  = write_queue.push_back(data, write_header_offset_ + len);
+            if (res < 0) {
+                return res;
+            }
+
+            // skip custom write_header_offset_
+            memcpy(::atbus::detail::fn::buffer_next(data, write_header_offset_), frame, len);
+            return try_write();
+        }
+
         int libatgw_proto_inner_v1::write(const void *buffer, size_t len) {
             return send_post(::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST, buffer, len);
         }
 
+        int libatgw_proto_inner_v1::write(const void *buffer, size_t len, int priority) {
+            return send_post(::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST, buffer, len, write_priority_t::EN_WPT_URGENT == priority);
+        }
+
+        int libatgw_proto_inner_v1::write_broadcast(broadcast_cache_t &cache) {
+            // large message is split into fragments, which are not shared
+            if (0 == cache.get_length() || cache.get_length() > ATFRAME_GATEWAY_MACRO_POST_FRAGMENT_SIZE || check_flag(flag_t::EN_PFT_CLOSING) ||
+                NULL == callbacks_ || !callbacks_->write_fn || !crypt_write_ || !crypt_write_->is_inited_) {
+                return write(cache.get_buffer(), cache.get_length(), cache.get_priority());
+            }
+
+            bool is_urgent = write_priority_t::EN_WPT_URGENT == cache.get_priority() && check_urgent_post();
+
+            // frames of sessions without encryption and replay are the same if they use the same compression and checksum
+            if (crypt_write_->type.empty() && !replay_.is_sending) {
+                const std::vector<unsigned char> *frame = get_broadcast_frame(cache, is_urgent);
+                if (NULL != frame) {
+                    return write_frame(&(*frame)[0], frame->size(), is_urgent);
+                }
+            }
+
+            compressed_post_t compressed;
+            if (!get_broadcast_compressed_post(cache, compressed)) {
+                return write(cache.get_buffer(), cache.get_length(), cache.get_priority());
+            }
+
+            if (is_urgent) {
+                return write_post(::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST, 0, cache.get_buffer(), cache.get_length(), 0, 0, true, &compressed);
+            }
+
+            return send_post_fragment(::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST, cache.get_buffer(), cache.get_length(), 0, 0, &compressed);
+        }
+
+        bool libatgw_proto_inner_v1::get_broadcast_compressed_post(broadcast_cache_t &cache, compressed_post_t &out) {
+            out.type   = ::atframe::gw::inner::v1::compression_t_EN_CT_NONE;
+            out.data   = cache.get_buffer();
+            out.length = cache.get_length();
+
+            // history of stream compression is different in every session
+            if (::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD_STREAM == compression_.type) {
+                return false;
+            }
+
+            if (::atframe::gw::inner::v1::compression_t_EN_CT_NONE == compression_.type || 0 == cache.get_length() ||
+                cache.get_length() < compression_.threshold) {
+                return true;
+            }
+
+            int  key[]  = {detail::broadcast_block_t::EN_BBT_COMPRESSED, compression_.type, compression_.level};
+            bool is_new = false;
+            std::vector<unsigned char> &block = cache.get_block(key, sizeof(key), is_new);
+            if (is_new) {
+                char *      zip_buffer    = reinterpret_cast<char *>(get_tls_buffer(tls_buffer_t::EN_TBT_ZIP));
+                size_t      zip_len       = get_tls_length(tls_buffer_t::EN_TBT_ZIP);
+                const char *in_start      = reinterpret_cast<const char *>(cache.get_buffer());
+                bool        is_overlapped = !(in_start + cache.get_length() <= zip_buffer || in_start >= zip_buffer + zip_len);
+
+                // only use compressed data when it's smaller
+                if (zip_len >= cache.get_length()) {
+                    zip_len = cache.get_length() - 1;
+                }
+
+                zip_len = is_overlapped ? 0 : detail::compress_buffer(compression_.type, compression_.level, in_start, cache.get_length(), zip_buffer, zip_len);
+                if (zip_len > 0) {
+                    block.assign(reinterpret_cast<unsigned char *>(zip_buffer), reinterpret_cast<unsigned char *>(zip_buffer) + zip_len);
+                }
+            }
+
+            // empty if compressed data is not smaller, send the original data
+            if (!block.empty()) {
+                out.type   = compression_.type;
+                out.data   = &block[0];
+                out.length = block.size();
+            }
+            return true;
+        }
+
+        const std::vector<unsigned char> *libatgw_proto_inner_v1::get_broadcast_frame(broadcast_cache_t &cache, bool is_urgent) {
+            using namespace ::atframe::gw::inner::v1;
+
+            compressed_post_t compressed;
+            if (!get_broadcast_compressed_post(cache, compressed)) {
+                return NULL;
+            }
+
+            // first 32bits is hash code, and then 32bits length
+            const size_t msg_header_len = sizeof(uint32_t) + sizeof(uint32_t);
+
+            // urgent posts are not numbered, so they can not share frame with normal posts
+            int  key[]  = {detail::broadcast_block_t::EN_BBT_FRAME, compressed.type, compression_t_EN_CT_NONE == compressed.type ? 0 : compression_.level,
+                         checksum_.type, is_urgent ? 1 : 0};
+            bool is_new = false;
+            std::vector<unsigned char> &block = cache.get_block(key, sizeof(key), is_new);
+            if (!is_new) {
+                return block.empty() ? NULL : &block;
+            }
+
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return NULL;
+            }
+            flatbuffers::FlatBufferBuilder & builder = builder_holder.get();
+            flatbuffers::Offset<cs_msg_head> header_data =
+                Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_POST, is_urgent ? 0 : ::atframe::gateway::detail::alloc_seq());
+            flatbuffers::Offset<flatbuffers::Vector<int8_t> > post_data =
+                builder.CreateVector(reinterpret_cast<const int8_t *>(compressed.data), compressed.length);
+            flatbuffers::Offset<cs_body_post> post_body = Createcs_body_post(
+                builder, static_cast<uint64_t>(cache.get_length()), post_data, static_cast<compression_t>(compressed.type),
+                static_cast<uint64_t>(compression_t_EN_CT_NONE == compressed.type ? 0 : compressed.length), 0, 0);
+            builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_post, post_body.Union()), cs_msgIdentifier());
+
+            const void *buf = reinterpret_cast<const void *>(builder.GetBufferPointer());
+            size_t      len = static_cast<size_t>(builder.GetSize());
+            if (NULL == buf || 0 == len || len >= std::numeric_limits<uint32_t>::max()) {
+                return NULL;
+            }
+
+            block.resize(msg_header_len + len);
+            uint32_t hash32 = detail::calc_frame_checksum(checksum_.type, buf, len);
+            memcpy(&block[0], &hash32, sizeof(uint32_t));
+            flatbuffers::WriteScalar<uint32_t>(&block[sizeof(uint32_t)], static_cast<uint32_t>(len));
+            memcpy(&block[msg_header_len], buf, len);
+            return &block;
+        }
+
+        int libatgw_proto_inner_v1::uncork() {
+            if (!check_flag(flag_t::EN_PFT_CORKED)) {
+                return 0;
+            }
+            set_flag(flag_t::EN_PFT_CORKED, false);
+
+            return try_write();
+        }
+
         int libatgw_proto_inner_v1::write_done(int status) {
             if (!check_flag(flag_t::EN_PFT_WRITING)) {
                 return status;
@@ -1420,17 +3675,23 @@ namespace atframe {
             // first 32bits is hash code, and then 32bits length
             // const size_t msg_header_len = sizeof(uint32_t) + sizeof(uint32_t);
 
+            // blocks being written are all in the same lane
+            write_queue_t &write_queue = is_writing_urgent_ ? write_urgent_queue_ : write_queue_;
+
             // popup the lost callback
             while (true) {
-                write_buffers_.front(data, nread, nwrite);
+                write_queue.front(data, nread, nwrite);
                 if (NULL == data) {
                     break;
                 }
 
-                assert(0 == nread);
+                // nread may be not 0, if the message is built in a reserved block
 
                 if (0 == nwrite) {
-                    write_buffers_.pop_front(0, true);
+                    write_queue.pop_front();
+                    if (!is_writing_urgent_ && write_urgent_barrier_ > 0) {
+                        --write_urgent_barrier_;
+                    }
                     break;
                 }
 
@@ -1458,14 +3719,18 @@ namespace atframe {
                 // }
 
                 // remove all cache buffer
-                write_buffers_.pop_front(nwrite, true);
+                write_queue.pop_front();
+                if (!is_writing_urgent_ && write_urgent_barrier_ > 0) {
+                    --write_urgent_barrier_;
+                }
 
                 // the end
                 if (last_write_ptr_ == data) {
                     break;
                 }
             };
-            last_write_ptr_ = NULL;
+            last_write_ptr_    = NULL;
+            is_writing_urgent_ = false;
 
             // unset writing mode
             set_flag(flag_t::EN_PFT_WRITING, false);
@@ -1493,6 +3758,12 @@ namespace atframe {
             }
             close_reason_ = reason;
 
+            // cached data should be sent before closed
+            if (check_flag(flag_t::EN_PFT_CORKED)) {
+                set_flag(flag_t::EN_PFT_CORKED, false);
+                try_write();
+            }
+
             // send kickoff message
             if (is_send_kickoff) {
                 send_kickoff(reason);
@@ -1515,7 +3786,6 @@ namespace atframe {
         }
 
         bool libatgw_proto_inner_v1::check_reconnect(const proto_base *other) {
-            bool ret = true;
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 return false;
             }
@@ -1529,6 +3799,21 @@ namespace atframe {
                 other_crypt_handshake = other_proto->crypt_handshake_;
             }
 
+            if (!check_reconnect_secret(other_crypt_handshake->type, other_crypt_handshake->secret)) {
+                return false;
+            }
+
+            // if success, copy crypt information
+            session_id_ = other_proto->session_id_;
+            // setup handshake
+            setup_handshake(other_crypt_handshake->shared_conf);
+            crypt_read_  = crypt_handshake_;
+            crypt_write_ = crypt_handshake_;
+            return true;
+        }
+
+        bool libatgw_proto_inner_v1::check_reconnect_secret(const std::string &secret_type, const std::vector<unsigned char> &secret) {
+            bool ret = true;
             do {
                 std::vector<unsigned char> handshake_secret;
                 std::string                crypt_type;
@@ -1538,10 +3823,10 @@ namespace atframe {
                 } else {
                     const ::atframe::gw::inner::v1::cs_body_handshake *body_handshake =
                         reinterpret_cast<const ::atframe::gw::inner::v1::cs_body_handshake *>(handshake_.ext_data);
-                    const flatbuffers::Vector<int8_t> *secret = body_handshake->crypt_param();
-                    if (NULL != secret) {
-                        handshake_secret.resize(secret->size());
-                        memcpy(handshake_secret.data(), secret->data(), secret->size());
+                    const flatbuffers::Vector<int8_t> *crypt_param = body_handshake->crypt_param();
+                    if (NULL != crypt_param) {
+                        handshake_secret.resize(crypt_param->size());
+                        memcpy(handshake_secret.data(), crypt_param->data(), crypt_param->size());
                     }
 
                     if (NULL != body_handshake->crypt_type()) {
@@ -1551,7 +3836,7 @@ namespace atframe {
 
 
                 // check crypt type and keybits
-                if (crypt_type != other_crypt_handshake->type) {
+                if (crypt_type != secret_type) {
                     ret = false;
                     break;
                 }
@@ -1570,7 +3855,7 @@ namespace atframe {
                 }
 
                 {
-                    std::vector<unsigned char> sec_swp = other_crypt_handshake->secret;
+                    std::vector<unsigned char> sec_swp = secret;
                     int                        libres  = 0;
                     res                                = crypt_handshake_->swap_secret(sec_swp, libres);
                     if (res < 0) {
@@ -1596,20 +3881,117 @@ namespace atframe {
                 }
             } while (false);
 
-            // if success, copy crypt information
-            if (ret) {
-                session_id_ = other_proto->session_id_;
-                // setup handshake
-                setup_handshake(other_crypt_handshake->shared_conf);
-                crypt_read_  = crypt_handshake_;
-                crypt_write_ = crypt_handshake_;
-            }
             return ret;
         }
 
+        int libatgw_proto_inner_v1::resume_ticket(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake) {
+            std::shared_ptr<detail::crypt_global_configure_t> global_cfg = detail::crypt_global_configure_t::current();
+            if (!global_cfg || !global_cfg->ticket_crypt_ || NULL == body_handshake.ticket()) {
+                return error_code_t::EN_ECT_SESSION_NOT_FOUND;
+            }
+
+            if (NULL == callbacks_ || !callbacks_->new_session_fn) {
+                return error_code_t::EN_ECT_MISS_CALLBACKS;
+            }
+
+            // explicit nonce + cipher text + tag
+            std::vector<unsigned char> ticket_data;
+            ticket_data.resize(body_handshake.ticket()->size());
+            size_t ticket_len = ticket_data.size();
+            int    ret;
+            {
+                std::lock_guard<std::mutex> lg(global_cfg->ticket_crypt_lock_);
+                ret = decrypt_data_aead(*global_cfg->ticket_crypt_, body_handshake.ticket()->data(), body_handshake.ticket()->size(), ticket_data.data(),
+                                        ticket_len, NULL, 0);
+            }
+            if (0 != ret) {
+                return error_code_t::EN_ECT_REFUSE_RECONNECT;
+            }
+
+            ::flatbuffers::Verifier ticket_verify(ticket_data.data(), ticket_len);
+            if (false == ticket_verify.VerifyBuffer< ::atframe::gw::inner::v1::cs_resume_ticket>(NULL)) {
+                return error_code_t::EN_ECT_BAD_DATA;
+            }
+
+            const ::atframe::gw::inner::v1::cs_resume_ticket *ticket =
+                ::flatbuffers::GetRoot< ::atframe::gw::inner::v1::cs_resume_ticket>(ticket_data.data());
+            if (0 == ticket->session_id() || ticket->session_id() != body_handshake.session_id() || NULL == ticket->secret()) {
+                return error_code_t::EN_ECT_REFUSE_RECONNECT;
+            }
+
+            int64_t now = static_cast<int64_t>(ping_data_t::clk_t::to_time_t(ping_data_t::clk_t::now()));
+            if (ticket->expire() < now) {
+                return error_code_t::EN_ECT_SESSION_EXPIRED;
+            }
+
+            // crypt type may be disabled in this gateway
+            std::string crypt_type;
+            if (NULL != ticket->crypt_type()) {
+                crypt_type = ticket->crypt_type()->str();
+            }
+            if (crypt_type.empty() || !global_cfg->check_type(crypt_type)) {
+                return error_code_t::EN_ECT_REFUSE_RECONNECT;
+            }
+
+            // crypt session may be already setup by check_reconnect with another session of the same id
+            if (crypt_handshake_->is_inited_) {
+                crypt_handshake_->close();
+            }
+
+            const unsigned char *      secret_data = reinterpret_cast<const unsigned char *>(ticket->secret()->data());
+            std::vector<unsigned char> secret(secret_data, secret_data + ticket->secret()->size());
+            if (!check_reconnect_secret(crypt_type, secret)) {
+                return error_code_t::EN_ECT_REFUSE_RECONNECT;
+            }
+
+            // crypt_param of reconnect request never changes, so the whole request can be replayed unless ticket is used only once
+            // client will get a new ticket after key is updated just after reconnected
+            if (!detail::crypt_global_configure_t::consume_ticket(ticket->expire(), ticket->session_id(),
+                                                                  flatbuffers::ReadScalar<uint64_t>(body_handshake.ticket()->data()), now)) {
+                ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_REFUSE_RECONNECT, "resumption ticket is already used.");
+                return error_code_t::EN_ECT_REFUSE_RECONNECT;
+            }
+
+            session_id_ = ticket->session_id();
+            ret         = setup_handshake(global_cfg);
+            if (ret < 0) {
+                return ret;
+            }
+            crypt_read_  = crypt_handshake_;
+            crypt_write_ = crypt_handshake_;
+
+            // session id in ticket is kept
+            return callbacks_->new_session_fn(this, session_id_);
+        }
+
+        void libatgw_proto_inner_v1::takeover_reconnect(proto_base *other) {
+            libatgw_proto_inner_v1 *other_proto = static_cast<libatgw_proto_inner_v1 *>(other);
+            if (NULL == other_proto || this == other_proto) {
+                return;
+            }
+
+            // posts in write buffer of the old connection are discarded when it's closed, but they are still in replay cache
+            replay_.send_sequence = other_proto->replay_.send_sequence;
+            replay_.cached_size   = other_proto->replay_.cached_size;
+            replay_.cache.swap(other_proto->replay_.cache);
+
+            other_proto->replay_.cached_size = 0;
+            other_proto->replay_.cache.clear();
+        }
+
         void libatgw_proto_inner_v1::set_recv_buffer_limit(size_t max_size, size_t max_number) { read_buffers_.set_mode(max_size, max_number); }
 
-        void libatgw_proto_inner_v1::set_send_buffer_limit(size_t max_size, size_t max_number) { write_buffers_.set_mode(max_size, max_number); }
+        void libatgw_proto_inner_v1::set_message_size_limit(size_t max_size) {
+            message_size_limit_ = 0 == max_size ? ATFRAME_GATEWAY_MACRO_MESSAGE_SIZE_LIMIT : max_size;
+        }
+
+        void libatgw_proto_inner_v1::set_send_buffer_limit(size_t max_size, size_t max_number) {
+            write_queue_.set_mode(max_size, max_number);
+            write_urgent_barrier_ = 0;
+
+            // urgent lane is usually small, so it never use static buffer
+            write_urgent_queue_.set_mode(max_size, 0);
+        }
 
         int libatgw_proto_inner_v1::handshake_update() { return send_key_syn(); }
 
@@ -1625,24 +4007,33 @@ namespace atframe {
             size_t            limit_sz = 0;
             ss << "atgateway inner protocol: session id=" << session_id_ << std::endl;
             ss << "    last ping delta=" << ping_.last_delta << std::endl;
-            ss << "    handshake=" << (handshake_.has_data ? "running" : "not running") << ", switch type=" << switch_secret_name << std::endl;
+            ss << "    handshake=" << (handshake_.has_data ? (handshake_.task ? "waiting for worker" : "running") : "not running")
+               << ", switch type=" << switch_secret_name << std::endl;
+            ss << "    compression type=" << (compression_t_EN_CT_NONE == compression_.type ? "NONE" : detail::get_compression_name(compression_.type))
+               << ", threshold=" << compression_.threshold << ", level=" << compression_.level << std::endl;
+            ss << "    checksum type=" << detail::get_checksum_name(checksum_.type) << ", read confirmed=" << checksum_.is_read_confirmed << std::endl;
+            ss << "    replay: sending=" << replay_.is_sending << ", sent sequence=" << replay_.send_sequence << ", cached number=" << replay_.cache.size()
+               << ", cached size=" << replay_.cached_size << "/" << replay_.window_size << ", receiving=" << replay_.is_receiving
+               << ", received sequence=" << replay_.received_sequence << ", lost number=" << replay_.lost_number << std::endl;
             ss << "    status: writing=" << check_flag(flag_t::EN_PFT_WRITING) << ",closing=" << check_flag(flag_t::EN_PFT_CLOSING)
                << ",closed=" << check_flag(flag_t::EN_PFT_CLOSED) << ",handshake done=" << check_flag(flag_t::EN_PFT_HANDSHAKE_DONE)
                << ",handshake update=" << check_flag(flag_t::EN_PFT_HANDSHAKE_UPDATE) << std::endl;
 
+            size_t read_head_len = NULL == read_head_ ? 0 : read_head_->len;
             if (read_buffers_.limit().limit_size_ > 0) {
-                limit_sz = read_buffers_.limit().limit_size_ + sizeof(read_head_.buffer) - read_head_.len - read_buffers_.limit().cost_size_;
-                ss << "    read buffer: used size=" << (read_head_.len + read_buffers_.limit().cost_size_) << ", free size=" << limit_sz << std::endl;
+                limit_sz = read_buffers_.limit().limit_size_ + ATFRAME_GATEWAY_MACRO_DATA_SMALL_SIZE - read_head_len - read_buffers_.limit().cost_size_;
+                ss << "    read buffer: used size=" << (read_head_len + read_buffers_.limit().cost_size_) << ", free size=" << limit_sz << std::endl;
             } else {
-                ss << "    read buffer: used size=" << (read_head_.len + read_buffers_.limit().cost_size_) << ", free size=unlimited" << std::endl;
+                ss << "    read buffer: used size=" << (read_head_len + read_buffers_.limit().cost_size_) << ", free size=unlimited" << std::endl;
             }
 
-            if (write_buffers_.limit().limit_size_ > 0) {
-                limit_sz = write_buffers_.limit().limit_size_ - write_buffers_.limit().cost_size_;
-                ss << "    write buffer: used size=" << write_buffers_.limit().cost_size_ << ", free size=" << limit_sz << std::endl;
+            if (write_queue_.limit().limit_size_ > 0) {
+                limit_sz = write_queue_.limit().limit_size_ - write_queue_.limit().cost_size_;
+                ss << "    write buffer: used size=" << write_queue_.limit().cost_size_ << ", free size=" << limit_sz << std::endl;
             } else {
-                ss << "    write buffer: used size=" << write_buffers_.limit().cost_size_ << ", free size=unlimited" << std::endl;
+                ss << "    write buffer: used size=" << write_queue_.limit().cost_size_ << ", free size=unlimited" << std::endl;
             }
+            ss << "    urgent write buffer: used size=" << write_urgent_queue_.limit().cost_size_ << ", barrier=" << write_urgent_barrier_ << std::endl;
 
 #define DUMP_INFO(name, h)                                                             \
     if (h) {                                                                           \
@@ -1665,9 +4056,67 @@ namespace atframe {
 
 #undef DUMP_INFO
 
+            ss << "    memory usage=" << get_memory_usage() << " bytes" << std::endl;
             return ss.str();
         }
 
+        size_t libatgw_proto_inner_v1::get_memory_usage() const {
+            size_t ret = sizeof(libatgw_proto_inner_v1);
+
+            // read, write and handshake usually point to the same crypt session after handshake
+            const crypt_session_ptr_t *crypt_sessions[] = {&crypt_read_, &crypt_write_, &crypt_handshake_};
+            for (size_t i = 0; i < sizeof(crypt_sessions) / sizeof(crypt_sessions[0]); ++i) {
+                if (!*crypt_sessions[i]) {
+                    continue;
+                }
+
+                bool is_counted = false;
+                for (size_t j = 0; j < i; ++j) {
+                    if (*crypt_sessions[j] == *crypt_sessions[i]) {
+                        is_counted = true;
+                        break;
+                    }
+                }
+
+                if (!is_counted) {
+                    ret += (*crypt_sessions[i])->get_memory_usage();
+                }
+            }
+
+            if (NULL != read_head_) {
+                ret += sizeof(read_head_t);
+            }
+
+            // static buffer is allocated all at once
+            ret += read_buffers_.is_static_mode() ? read_buffers_.limit().limit_size_ : read_buffers_.limit().cost_size_;
+            ret += write_queue_.get_memory_usage();
+            ret += write_urgent_queue_.get_memory_usage();
+
+            ret += compression_.available_types.capacity() + checksum_.available_types.capacity();
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+            if (NULL != compression_.stream_write) {
+                ret += ZSTD_sizeof_CCtx(compression_.stream_write);
+            }
+            if (NULL != compression_.stream_read) {
+                ret += ZSTD_sizeof_DCtx(compression_.stream_read);
+            }
+#endif
+
+            ret += post_fragment_.buffer.capacity();
+            ret += replay_.cache.size() * sizeof(replay_post_t);
+            for (std::deque<replay_post_t>::const_iterator iter = replay_.cache.begin(); iter != replay_.cache.end(); ++iter) {
+                ret += iter->data.capacity();
+            }
+            ret += handshake_.param.capacity();
+            ret += ticket_.capacity();
+            ret += handshake_.reconnect_req.capacity();
+            if (handshake_.dh_ctx) {
+                ret += sizeof(util::crypto::dh);
+            }
+
+            return ret;
+        }
+
         int libatgw_proto_inner_v1::start_session(const std::string &crypt_type) {
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 return error_code_t::EN_ECT_CLOSING;
@@ -1683,15 +4132,21 @@ namespace atframe {
 
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
             flatbuffers::Offset<cs_body_handshake> handshake_body;
 
             handshake_body = Createcs_body_handshake(builder, 0, handshake_step_t_EN_HST_START_REQ, switch_secret_t_EN_SST_DIRECT,
-                                                     builder.CreateString(crypt_type), builder.CreateVector(reinterpret_cast<const int8_t *>(NULL), 0));
+                                                     builder.CreateString(crypt_type), builder.CreateVector(reinterpret_cast<const int8_t *>(NULL), 0), 0,
+                                                     builder.CreateString(compression_.available_types), builder.CreateString(checksum_.available_types),
+                                                     replay_.received_sequence + 1);
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, handshake_body.Union()), cs_msgIdentifier());
-            return write_msg(builder);
+            return write_msg(builder, false, false, true);
         }
 
         int libatgw_proto_inner_v1::reconnect_session(uint64_t sess_id, const std::string &crypt_type, const std::vector<unsigned char> &secret) {
@@ -1723,19 +4178,103 @@ namespace atframe {
 
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
             flatbuffers::Offset<cs_body_handshake> handshake_body;
 
             handshake_body =
                 Createcs_body_handshake(builder, sess_id, handshake_step_t_EN_HST_RECONNECT_REQ, static_cast<switch_secret_t>(handshake_.switch_secret_type),
-                                        builder.CreateString(crypt_type), builder.CreateVector(reinterpret_cast<const int8_t *>(secret_buffer), secret_length));
+                                        builder.CreateString(crypt_type), builder.CreateVector(reinterpret_cast<const int8_t *>(secret_buffer), secret_length), 0,
+                                        builder.CreateString(compression_.available_types), builder.CreateString(checksum_.available_types),
+                                        replay_.received_sequence + 1,
+                                        ticket_.empty() ? 0 : builder.CreateVector(reinterpret_cast<const int8_t *>(ticket_.data()), ticket_.size()));
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, handshake_body.Union()), cs_msgIdentifier());
-            return write_msg(builder);
+            return write_msg(builder, false, false, true);
+        }
+
+        int libatgw_proto_inner_v1::send_post(::atframe::gw::inner::v1::cs_msg_type_t msg_type, const void *buffer, size_t len, bool is_urgent) {
+            if (len <= ATFRAME_GATEWAY_MACRO_POST_FRAGMENT_SIZE) {
+                // fragments can not be interleaved, so large urgent message is sent by order
+                if (is_urgent && check_urgent_post()) {
+                    return write_post(msg_type, 0, buffer, len, 0, 0, true);
+                }
+
+                return send_post_fragment(msg_type, buffer, len, 0, 0);
+            }
+
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            // large message will be split into fragments, make sure there is enough space for all of them
+            if (write_queue_.limit().limit_size_ > 0 && write_queue_.limit().cost_size_ + len > write_queue_.limit().limit_size_) {
+                return error_code_t::EN_ECT_BUSY;
+            }
+
+            const char *fragment_start  = reinterpret_cast<const char *>(buffer);
+            size_t      fragment_offset = 0;
+            while (fragment_offset < len) {
+                size_t fragment_len = len - fragment_offset;
+                if (fragment_len > ATFRAME_GATEWAY_MACRO_POST_FRAGMENT_SIZE) {
+                    fragment_len = ATFRAME_GATEWAY_MACRO_POST_FRAGMENT_SIZE;
+                }
+
+                int res = send_post_fragment(msg_type, fragment_start + fragment_offset, fragment_len, len, fragment_offset);
+                if (0 != res) {
+                    // peer can not receive the rest of this message any more
+                    if (fragment_offset > 0) {
+                        ATFRAME_GATEWAY_ON_ERROR(res, "send post fragment failed");
+                        close(close_reason_t::EN_CRT_EAGAIN);
+                    }
+                    return res;
+                }
+
+                fragment_offset += fragment_len;
+            }
+
+            return 0;
+        }
+
+        int libatgw_proto_inner_v1::send_post_fragment(::atframe::gw::inner::v1::cs_msg_type_t msg_type, const void *buffer, size_t len,
+                                                       size_t total_length, size_t fragment_offset, const compressed_post_t *compressed) {
+            if (!replay_.is_sending) {
+                return write_post(msg_type, ::atframe::gateway::detail::alloc_seq(), buffer, len, total_length, fragment_offset, false, compressed);
+            }
+
+            int res = write_post(msg_type, replay_.send_sequence + 1, buffer, len, total_length, fragment_offset, false, compressed);
+            if (0 != res) {
+                return res;
+            }
+
+            // keep it until client acknowledge it, the oldest ones are dropped if there are too many
+            ++replay_.send_sequence;
+            replay_.cache.push_back(replay_post_t());
+            replay_post_t &post  = replay_.cache.back();
+            post.sequence        = replay_.send_sequence;
+            post.msg_type        = static_cast<int>(msg_type);
+            post.total_length    = total_length;
+            post.fragment_offset = fragment_offset;
+            post.data.assign(reinterpret_cast<const unsigned char *>(buffer), reinterpret_cast<const unsigned char *>(buffer) + len);
+            replay_.cached_size += len;
+
+            // rest fragments of a dropped message are useless
+            bool is_dropped = false;
+            while (!replay_.cache.empty() && (replay_.cached_size > replay_.window_size || (is_dropped && replay_.cache.front().fragment_offset > 0))) {
+                replay_.cached_size -= replay_.cache.front().data.size();
+                replay_.cache.pop_front();
+                is_dropped = true;
+            }
+
+            return 0;
         }
 
-        int libatgw_proto_inner_v1::send_post(::atframe::gw::inner::v1::cs_msg_type_t msg_type, const void *buffer, size_t len) {
+        int libatgw_proto_inner_v1::write_post(::atframe::gw::inner::v1::cs_msg_type_t msg_type, uint64_t sequence, const void *buffer, size_t len,
+                                               size_t total_length, size_t fragment_offset, bool is_urgent, const compressed_post_t *compressed) {
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 return error_code_t::EN_ECT_CLOSING;
             }
@@ -1744,24 +4283,88 @@ namespace atframe {
                 return error_code_t::EN_ECT_MISS_CALLBACKS;
             }
 
+            using namespace ::atframe::gw::inner::v1;
+
+            // AEAD cipher encrypt data into write buffer directly, and the tag makes frame hash unnecessary
+            bool is_tagged = crypt_write_->is_aead();
+
             // encrypt/zip
-            size_t ori_len = len;
-            int    res     = encode_post(buffer, len, buffer, len);
+            size_t ori_len            = len;
+            int    compression_type   = compression_t_EN_CT_NONE;
+            size_t compression_length = 0;
+            int    res;
+            if (NULL == compressed) {
+                res = encode_post(buffer, len, buffer, len, compression_type, compression_length, !is_tagged);
+            } else {
+                // data is compressed already, only encrypt it here
+                if (compression_t_EN_CT_NONE != compressed->type) {
+                    compression_type   = compressed->type;
+                    compression_length = compressed->length;
+                    buffer             = compressed->data;
+                    len                = compressed->length;
+                }
+                res = is_tagged ? 0 : encrypt_data(*crypt_write_, buffer, len, buffer, len);
+            }
             if (0 != res) {
                 return res;
             }
 
-            // pack
-            using namespace ::atframe::gw::inner::v1;
+            size_t data_len = len;
+            if (is_tagged) {
+                data_len += crypt_write_->get_aead_extend_size();
+            }
 
-            flatbuffers::FlatBufferBuilder   builder;
-            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, msg_type, ::atframe::gateway::detail::alloc_seq());
+            // pack into write buffer directly
+            void * builder_buf = NULL;
+            size_t builder_len = 0;
+            res                = reserve_msg(data_len, builder_buf, builder_len, is_urgent);
+            if (0 != res) {
+                return res;
+            }
+
+            detail::reserved_msg_allocator   builder_alloc(builder_buf, builder_len);
+            flatbuffers::FlatBufferBuilder   builder(builder_len, &builder_alloc);
+            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, msg_type, sequence);
+
+            flatbuffers::Offset<flatbuffers::Vector<int8_t> > post_data;
+            if (is_tagged) {
+                uint64_t aead_ad[detail::EN_PAAD_MAX];
+                detail::make_post_aead_ad(aead_ad, static_cast<int>(msg_type), sequence, static_cast<uint64_t>(ori_len), compression_type,
+                                          static_cast<uint64_t>(compression_length), static_cast<uint64_t>(total_length),
+                                          static_cast<uint64_t>(fragment_offset));
+
+                // data_start is available until builder grows, so encrypt it immediately
+                int8_t *data_start = NULL;
+                post_data          = builder.CreateUninitializedVector(data_len, &data_start);
+                res                = encrypt_data_aead(*crypt_write_, buffer, len, data_start, data_len, aead_ad, sizeof(aead_ad));
+                if (0 != res) {
+                    (is_urgent ? write_urgent_queue_ : write_queue_).pop_back();
+                    return res;
+                }
+            } else {
+                post_data = builder.CreateVector(reinterpret_cast<const int8_t *>(buffer), len);
+            }
 
             flatbuffers::Offset<cs_body_post> post_body =
-                Createcs_body_post(builder, static_cast<uint64_t>(ori_len), builder.CreateVector(reinterpret_cast<const int8_t *>(buffer), len));
+                Createcs_body_post(builder, static_cast<uint64_t>(ori_len), post_data, static_cast<compression_t>(compression_type),
+                                   static_cast<uint64_t>(compression_length), static_cast<uint64_t>(total_length), static_cast<uint64_t>(fragment_offset));
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_post, post_body.Union()), cs_msgIdentifier());
-            return write_msg(builder);
+            return write_reserved_msg(builder, builder_buf, builder_len, is_tagged, is_urgent);
+        }
+
+        bool libatgw_proto_inner_v1::check_urgent_post() const {
+            if (!check_flag(flag_t::EN_PFT_HANDSHAKE_DONE) || !crypt_write_) {
+                return false;
+            }
+
+            // stream compression shares history between messages, so they must be decompressed in the same order as they are compressed
+            if (::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD_STREAM == compression_.type) {
+                return false;
+            }
+
+            // data encrypted by new key can not be received before the handshake message in normal lane
+            return 0 == write_urgent_barrier_;
         }
 
         int libatgw_proto_inner_v1::send_post(const void *buffer, size_t len) {
@@ -1779,15 +4382,23 @@ namespace atframe {
 
             ping_.last_ping = ping_data_t::clk_t::now();
 
+            void * builder_buf = NULL;
+            size_t builder_len = 0;
+            int    res         = reserve_msg(0, builder_buf, builder_len, true);
+            if (0 != res) {
+                return res;
+            }
+
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::reserved_msg_allocator   builder_alloc(builder_buf, builder_len);
+            flatbuffers::FlatBufferBuilder   builder(builder_len, &builder_alloc);
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_PING, ::atframe::gateway::detail::alloc_seq());
 
             flatbuffers::Offset<cs_body_ping> ping_body = Createcs_body_ping(builder, static_cast<int64_t>(ping_.last_ping.time_since_epoch().count()));
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_ping, ping_body.Union()), cs_msgIdentifier());
-            return write_msg(builder);
+            return write_reserved_msg(builder, builder_buf, builder_len, false, true);
         }
 
         int libatgw_proto_inner_v1::send_pong(int64_t tp) {
@@ -1799,15 +4410,23 @@ namespace atframe {
                 return error_code_t::EN_ECT_MISS_CALLBACKS;
             }
 
+            void * builder_buf = NULL;
+            size_t builder_len = 0;
+            int    res         = reserve_msg(0, builder_buf, builder_len, true);
+            if (0 != res) {
+                return res;
+            }
+
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::reserved_msg_allocator   builder_alloc(builder_buf, builder_len);
+            flatbuffers::FlatBufferBuilder   builder(builder_len, &builder_alloc);
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_PONG, ::atframe::gateway::detail::alloc_seq());
 
             flatbuffers::Offset<cs_body_ping> ping_body = Createcs_body_ping(builder, tp);
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_ping, ping_body.Union()), cs_msgIdentifier());
-            return write_msg(builder);
+            return write_reserved_msg(builder, builder_buf, builder_len, false, true);
         }
 
         int libatgw_proto_inner_v1::send_key_syn() {
@@ -1844,25 +4463,24 @@ namespace atframe {
                 return ret;
             }
 
-            using namespace ::atframe::gw::inner::v1;
-
-            flatbuffers::FlatBufferBuilder   builder;
-            flatbuffers::Offset<cs_msg_head> header_data =
-                Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_POST_KEY_SYN, ::atframe::gateway::detail::alloc_seq());
+            // DH key pair is taken from background pool, or made in worker thread if possible, key syn will be sent after that
+            if (0 != session_id_ && !crypt_type.empty() && (::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH == handshake_.switch_secret_type ||
+                                                            ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH == handshake_.switch_secret_type) &&
+                !use_prepared_dh()) {
+                ret = start_handshake_task(detail::handshake_task_t::EN_HTT_MAKE_PARAMS, ::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST_KEY_SYN,
+                                           crypt_type, NULL, 0);
+                if (0 == ret) {
+                    return ret;
+                }
 
-            flatbuffers::Offset<cs_body_handshake> handshake_body;
-            ret = pack_handshake_start_rsp(builder, session_id_, crypt_type, handshake_body);
-            if (ret < 0) {
-                handshake_done(ret);
-                return ret;
+                // workers are busy, keep the old key and try again next time
+                if (error_code_t::EN_ECT_BUSY == ret) {
+                    close_handshake(ret);
+                    return ret;
+                }
             }
 
-            builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, handshake_body.Union()), cs_msgIdentifier());
-            ret = write_msg(builder);
-            if (ret < 0) {
-                handshake_done(ret);
-            }
-            return ret;
+            return send_handshake_start_rsp(::atframe::gw::inner::v1::cs_msg_type_t_EN_MTT_POST_KEY_SYN, crypt_type);
         }
 
         int libatgw_proto_inner_v1::send_kickoff(int reason) {
@@ -1874,15 +4492,23 @@ namespace atframe {
                 return error_code_t::EN_ECT_MISS_CALLBACKS;
             }
 
+            void * builder_buf = NULL;
+            size_t builder_len = 0;
+            int    res         = reserve_msg(0, builder_buf, builder_len, true);
+            if (0 != res) {
+                return res;
+            }
+
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::reserved_msg_allocator   builder_alloc(builder_buf, builder_len);
+            flatbuffers::FlatBufferBuilder   builder(builder_len, &builder_alloc);
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_KICKOFF, ::atframe::gateway::detail::alloc_seq());
 
             flatbuffers::Offset<cs_body_kickoff> kickoff_body = Createcs_body_kickoff(builder, reason);
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_kickoff, kickoff_body.Union()), cs_msgIdentifier());
-            return write_msg(builder);
+            return write_reserved_msg(builder, builder_buf, builder_len, false, true);
         }
 
         int libatgw_proto_inner_v1::send_verify(const void *buf, size_t sz) {
@@ -1912,7 +4538,11 @@ namespace atframe {
 
             using namespace ::atframe::gw::inner::v1;
 
-            flatbuffers::FlatBufferBuilder   builder;
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
             flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_HANDSHAKE, ::atframe::gateway::detail::alloc_seq());
 
             flatbuffers::Offset<cs_body_handshake> verify_body = Createcs_body_handshake(
@@ -1920,24 +4550,285 @@ namespace atframe {
                 builder.CreateString(std::string()), builder.CreateVector<int8_t>(reinterpret_cast<const int8_t *>(outbuf), outsz));
 
             builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, verify_body.Union()), cs_msgIdentifier());
+            return write_msg(builder, false, false, true);
+        }
+
+        int libatgw_proto_inner_v1::send_post_ack() {
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            if (NULL == callbacks_ || !callbacks_->write_fn) {
+                return error_code_t::EN_ECT_MISS_CALLBACKS;
+            }
+
+            void * builder_buf = NULL;
+            size_t builder_len = 0;
+            int    res         = reserve_msg(0, builder_buf, builder_len, true);
+            if (0 != res) {
+                return res;
+            }
+
+            using namespace ::atframe::gw::inner::v1;
+
+            detail::reserved_msg_allocator   builder_alloc(builder_buf, builder_len);
+            flatbuffers::FlatBufferBuilder   builder(builder_len, &builder_alloc);
+            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_POST_ACK, replay_.received_sequence);
+
+            builder.Finish(Createcs_msg(builder, header_data), cs_msgIdentifier());
+            res = write_reserved_msg(builder, builder_buf, builder_len, false, true);
+            if (0 == res) {
+                replay_.acked_sequence = replay_.received_sequence;
+            }
+            return res;
+        }
+
+        int libatgw_proto_inner_v1::send_ticket() {
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            if (NULL == callbacks_ || !callbacks_->write_fn) {
+                return error_code_t::EN_ECT_MISS_CALLBACKS;
+            }
+
+            // only verified secret can be put into ticket
+            std::shared_ptr<detail::crypt_global_configure_t> global_cfg = detail::crypt_global_configure_t::current();
+            if (!global_cfg || !global_cfg->ticket_crypt_ || 0 == session_id_ || !crypt_read_ || crypt_read_->type.empty()) {
+                return 0;
+            }
+
+            using namespace ::atframe::gw::inner::v1;
+
+            detail::builder_holder_t        ticket_holder;
+            if (!ticket_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder &ticket_builder = ticket_holder.get();
+            int64_t expire = static_cast<int64_t>(ping_data_t::clk_t::to_time_t(ping_data_t::clk_t::now())) + global_cfg->conf_.ticket_lifetime;
+            ticket_builder.Finish(Createcs_resume_ticket(ticket_builder, session_id_, expire, ticket_builder.CreateString(crypt_read_->type),
+                                                         ticket_builder.CreateVector(reinterpret_cast<const int8_t *>(crypt_read_->secret.data()),
+                                                                                     crypt_read_->secret.size())));
+
+            detail::builder_holder_t         builder_holder;
+            if (!builder_holder.is_valid()) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            flatbuffers::FlatBufferBuilder & builder     = builder_holder.get();
+            flatbuffers::Offset<cs_msg_head> header_data = Createcs_msg_head(builder, cs_msg_type_t_EN_MTT_TICKET, ::atframe::gateway::detail::alloc_seq());
+
+            // encrypt into message directly, data_start is available until builder grows
+            size_t  ticket_len   = ticket_builder.GetSize() + global_cfg->ticket_crypt_->get_aead_extend_size();
+            int8_t *ticket_start = NULL;
+            flatbuffers::Offset<flatbuffers::Vector<int8_t> > ticket_data = builder.CreateUninitializedVector(ticket_len, &ticket_start);
+            int ret;
+            {
+                std::lock_guard<std::mutex> lg(global_cfg->ticket_crypt_lock_);
+                ret = encrypt_data_aead(*global_cfg->ticket_crypt_, ticket_builder.GetBufferPointer(), ticket_builder.GetSize(), ticket_start, ticket_len,
+                                        NULL, 0);
+            }
+            if (0 != ret) {
+                return ret;
+            }
+
+            flatbuffers::Offset<cs_body_handshake> ticket_body =
+                Createcs_body_handshake(builder, session_id_, handshake_step_t_EN_HST_START_REQ, static_cast<switch_secret_t>(handshake_.switch_secret_type), 0, 0,
+                                        0, 0, 0, 0, ticket_data);
+
+            builder.Finish(Createcs_msg(builder, header_data, cs_msg_body_cs_body_handshake, ticket_body.Union()), cs_msgIdentifier());
             return write_msg(builder);
         }
 
+        void libatgw_proto_inner_v1::release_replay_posts(uint64_t sequence) {
+            while (!replay_.cache.empty() && replay_.cache.front().sequence <= sequence) {
+                replay_.cached_size -= replay_.cache.front().data.size();
+                replay_.cache.pop_front();
+            }
+        }
+
+        int libatgw_proto_inner_v1::replay_posts() {
+            for (std::deque<replay_post_t>::iterator iter = replay_.cache.begin(); iter != replay_.cache.end(); ++iter) {
+                int res = write_post(static_cast< ::atframe::gw::inner::v1::cs_msg_type_t>(iter->msg_type), iter->sequence,
+                                     iter->data.empty() ? NULL : &iter->data[0], iter->data.size(), iter->total_length, iter->fragment_offset);
+                if (0 != res) {
+                    return res;
+                }
+            }
+
+            return 0;
+        }
+
         const libatgw_proto_inner_v1::crypt_session_ptr_t &libatgw_proto_inner_v1::get_crypt_read() const { return crypt_read_; }
 
         const libatgw_proto_inner_v1::crypt_session_ptr_t &libatgw_proto_inner_v1::get_crypt_write() const { return crypt_write_; }
 
         const libatgw_proto_inner_v1::crypt_session_ptr_t &libatgw_proto_inner_v1::get_crypt_handshake() const { return crypt_handshake_; }
 
-        int libatgw_proto_inner_v1::encode_post(const void *in, size_t insz, const void *&out, size_t &outsz) {
+        void libatgw_proto_inner_v1::set_compression_types(const std::string &types) { compression_.available_types = types; }
+
+        void libatgw_proto_inner_v1::set_checksum_types(const std::string &types) { checksum_.available_types = types; }
+
+        void libatgw_proto_inner_v1::setup_compression(const std::shared_ptr<detail::crypt_global_configure_t> &shared_conf, int compression_type,
+                                                       bool reset_stream) {
+            if (reset_stream || compression_.type != compression_type) {
+                reset_compression_stream();
+            }
+
+            compression_.type = compression_type;
+            if (shared_conf) {
+                compression_.threshold = shared_conf->conf_.compression_threshold;
+                compression_.level     = shared_conf->conf_.compression_level;
+            }
+        }
+
+        void libatgw_proto_inner_v1::reset_compression_stream() {
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+            if (NULL != compression_.stream_write) {
+                ZSTD_freeCCtx(compression_.stream_write);
+            }
+
+            if (NULL != compression_.stream_read) {
+                ZSTD_freeDCtx(compression_.stream_read);
+            }
+#endif
+            compression_.stream_write = NULL;
+            compression_.stream_read  = NULL;
+        }
+
+        void libatgw_proto_inner_v1::setup_checksum(int checksum_type) {
+            if (checksum_type < 0) {
+                checksum_type = checksum_t::EN_CKT_MURMUR3;
+            }
+
+            if (checksum_.type != checksum_type) {
+                checksum_.type              = checksum_type;
+                checksum_.is_read_confirmed = (checksum_t::EN_CKT_MURMUR3 == checksum_type);
+            }
+            checksum_.next_type = checksum_type;
+        }
+
+        bool libatgw_proto_inner_v1::check_frame_checksum(const char *buf, size_t len, uint32_t expect_hash) {
+            if (checksum_t::EN_CKT_NONE == checksum_.type) {
+                return true;
+            }
+
+            if (detail::calc_frame_checksum(checksum_.type, buf, len) == expect_hash) {
+                checksum_.is_read_confirmed = true;
+                return true;
+            }
+
+            // frames sent by peer before it received the negotiated algorithm
+            if (!checksum_.is_read_confirmed) {
+                return detail::calc_frame_checksum(checksum_t::EN_CKT_MURMUR3, buf, len) == expect_hash;
+            }
+
+            return false;
+        }
+
+        int libatgw_proto_inner_v1::dispatch_post_fragment(size_t total_length, size_t fragment_offset, const void *buffer, size_t len) {
+            // fragments must be received in order, and all fragments of a message must have the same total length
+            if (0 == len || NULL == buffer || fragment_offset != post_fragment_.received_length) {
+                return error_code_t::EN_ECT_BAD_DATA;
+            }
+
+            if (0 == fragment_offset) {
+                if (message_size_limit_ > 0 && total_length > message_size_limit_) {
+                    return error_code_t::EN_ECT_MSG_TOO_LARGE;
+                }
+
+                post_fragment_.total_length = total_length;
+                post_fragment_.buffer.resize(total_length);
+            } else if (total_length != post_fragment_.total_length) {
+                return error_code_t::EN_ECT_BAD_DATA;
+            }
+
+            if (len > post_fragment_.total_length - post_fragment_.received_length) {
+                return error_code_t::EN_ECT_BAD_DATA;
+            }
+
+            memcpy(&post_fragment_.buffer[fragment_offset], buffer, len);
+            post_fragment_.received_length += len;
+
+            if (post_fragment_.received_length < post_fragment_.total_length) {
+                return 0;
+            }
+
+            // the whole message is received, the reassembly buffer will be freed after message callback
+            std::vector<unsigned char> message;
+            message.swap(post_fragment_.buffer);
+            post_fragment_.total_length    = 0;
+            post_fragment_.received_length = 0;
+
+            if (NULL != callbacks_ && callbacks_->message_fn) {
+                callbacks_->message_fn(this, &message[0], message.size());
+            }
+
+            return 0;
+        }
+
+        int libatgw_proto_inner_v1::encode_post(const void *in, size_t insz, const void *&out, size_t &outsz, int &compression_type,
+                                                size_t &compression_length, bool is_encrypt) {
+            compression_type   = ::atframe::gw::inner::v1::compression_t_EN_CT_NONE;
+            compression_length = 0;
+
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 outsz = insz;
                 out   = in;
                 return error_code_t::EN_ECT_CLOSING;
             }
 
-            // TODO compression
             // we should compressed data first, because encrypted data will decrease compression rate.
+            if (::atframe::gw::inner::v1::compression_t_EN_CT_NONE != compression_.type && insz > 0 && insz >= compression_.threshold) {
+                char * zip_buffer = reinterpret_cast<char *>(get_tls_buffer(tls_buffer_t::EN_TBT_ZIP));
+                size_t zip_len    = get_tls_length(tls_buffer_t::EN_TBT_ZIP);
+
+                // data may be in zip buffer, when sending in message callback
+                const char *in_start      = reinterpret_cast<const char *>(in);
+                bool        is_overlapped = !(in_start + insz <= zip_buffer || in_start >= zip_buffer + zip_len);
+                if (::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD_STREAM == compression_.type) {
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+                    if (NULL == compression_.stream_write) {
+                        compression_.stream_write = detail::create_zstd_stream_compressor(compression_.level);
+                    }
+
+                    // data in stream context can not be rollback, so the result is always used
+                    // urgent lane is disabled when using stream compression(see check_urgent_post), so the peer always
+                    //   decompresses messages in the same order as they are compressed here
+                    if (is_overlapped) {
+                        memcpy(get_tls_buffer(tls_buffer_t::EN_TBT_CUSTOM), in, insz);
+                        in = get_tls_buffer(tls_buffer_t::EN_TBT_CUSTOM);
+                    }
+                    zip_len = detail::compress_stream(compression_.stream_write, in, insz, zip_buffer, zip_len);
+#else
+                    zip_len = 0;
+#endif
+                    if (0 == zip_len) {
+                        outsz = 0;
+                        out   = NULL;
+                        ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_COMPRESSION_OPERATION, "compress stream failed");
+                        close(close_reason_t::EN_CRT_INVALID_DATA);
+                        return error_code_t::EN_ECT_COMPRESSION_OPERATION;
+                    }
+
+                    compression_type   = compression_.type;
+                    compression_length = zip_len;
+                    in                 = zip_buffer;
+                    insz               = zip_len;
+                } else if (!is_overlapped) {
+                    // only use compressed data when it's smaller
+                    if (zip_len >= insz) {
+                        zip_len = insz - 1;
+                    }
+
+                    zip_len = detail::compress_buffer(compression_.type, compression_.level, in, insz, zip_buffer, zip_len);
+                    if (zip_len > 0) {
+                        compression_type   = compression_.type;
+                        compression_length = zip_len;
+                        in                 = zip_buffer;
+                        insz               = zip_len;
+                    }
+                }
+            }
 
             // encrypt
             if (!crypt_write_) {
@@ -1945,6 +4836,13 @@ namespace atframe {
                 out   = in;
                 return error_code_t::EN_ECT_HANDSHAKE;
             }
+
+            if (!is_encrypt) {
+                outsz = insz;
+                out   = in;
+                return error_code_t::EN_ECT_SUCCESS;
+            }
+
             int ret = encrypt_data(*crypt_write_, in, insz, out, outsz);
             // if (0 != ret) {
             //     return ret;
@@ -1953,7 +4851,10 @@ namespace atframe {
             return ret;
         }
 
-        int libatgw_proto_inner_v1::decode_post(const void *in, size_t insz, const void *&out, size_t &outsz) {
+        int libatgw_proto_inner_v1::decode_post(const void *in, size_t insz, int compression_type, size_t compression_length, const void *&out,
+                                                size_t &outsz, const void *ad, size_t ad_len) {
+            // outsz is the original length
+            size_t origin_len = outsz;
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 outsz = insz;
                 out   = in;
@@ -1966,14 +4867,59 @@ namespace atframe {
                 out   = in;
                 return error_code_t::EN_ECT_HANDSHAKE;
             }
-            int ret = decrypt_data(*crypt_read_, in, insz, out, outsz);
+            int ret = decrypt_data(*crypt_read_, in, insz, out, outsz, ad, ad_len);
             if (ret < 0) {
                 out   = in;
                 outsz = insz;
                 return ret;
             }
 
-            // TODO decompression
+            if (::atframe::gw::inner::v1::compression_t_EN_CT_NONE == compression_type) {
+                return ret;
+            }
+
+            // decrypted data may has padding, so use compression_length as the real length
+            if (compression_length > outsz || 0 == origin_len) {
+                out   = NULL;
+                outsz = 0;
+                return error_code_t::EN_ECT_BAD_DATA;
+            }
+
+            if (origin_len > get_tls_length(tls_buffer_t::EN_TBT_ZIP)) {
+                out   = NULL;
+                outsz = 0;
+                return error_code_t::EN_ECT_INVALID_SIZE;
+            }
+
+            void * zip_buffer = get_tls_buffer(tls_buffer_t::EN_TBT_ZIP);
+            size_t zip_len    = 0;
+            if (::atframe::gw::inner::v1::compression_t_EN_CT_ZSTD_STREAM == compression_type) {
+                // stream context is only available when negotiated
+                if (compression_type != compression_.type) {
+                    out   = NULL;
+                    outsz = 0;
+                    return error_code_t::EN_ECT_BAD_DATA;
+                }
+
+#if defined(ATFRAME_GATEWAY_ENABLE_ZSTD) && ATFRAME_GATEWAY_ENABLE_ZSTD
+                if (NULL == compression_.stream_read) {
+                    compression_.stream_read = detail::create_zstd_stream_decompressor();
+                }
+                zip_len = detail::decompress_stream(compression_.stream_read, out, compression_length, zip_buffer, origin_len);
+#endif
+            } else {
+                zip_len = detail::decompress_buffer(compression_type, out, compression_length, zip_buffer, origin_len);
+            }
+
+            if (zip_len != origin_len) {
+                out   = NULL;
+                outsz = 0;
+                ATFRAME_GATEWAY_ON_ERROR(error_code_t::EN_ECT_COMPRESSION_OPERATION, "decompress data failed");
+                return error_code_t::EN_ECT_COMPRESSION_OPERATION;
+            }
+
+            out   = zip_buffer;
+            outsz = zip_len;
             return ret;
         }
 
@@ -2001,6 +4947,19 @@ namespace atframe {
             void * buffer = get_tls_buffer(tls_buffer_t::EN_TBT_CRYPT);
             size_t len    = get_tls_length(tls_buffer_t::EN_TBT_CRYPT);
 
+            if (crypt_info.is_aead()) {
+                int res = encrypt_data_aead(crypt_info, in, insz, buffer, len, NULL, 0);
+                if (0 != res) {
+                    out   = NULL;
+                    outsz = 0;
+                    return res;
+                }
+
+                out   = buffer;
+                outsz = len;
+                return error_code_t::EN_ECT_SUCCESS;
+            }
+
             int res = crypt_info.cipher.encrypt(reinterpret_cast<const unsigned char *>(in), insz, reinterpret_cast<unsigned char *>(buffer), &len);
 
 // DEBUG CIPHER PROGRESS
@@ -2024,7 +4983,8 @@ namespace atframe {
             return error_code_t::EN_ECT_SUCCESS;
         }
 
-        int libatgw_proto_inner_v1::decrypt_data(crypt_session_t &crypt_info, const void *in, size_t insz, const void *&out, size_t &outsz) {
+        int libatgw_proto_inner_v1::decrypt_data(crypt_session_t &crypt_info, const void *in, size_t insz, const void *&out, size_t &outsz, const void *ad,
+                                                 size_t ad_len) {
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 return error_code_t::EN_ECT_CLOSING;
             }
@@ -2047,7 +5007,21 @@ namespace atframe {
 
             void * buffer = get_tls_buffer(tls_buffer_t::EN_TBT_CRYPT);
             size_t len    = get_tls_length(tls_buffer_t::EN_TBT_CRYPT);
-            int    res    = crypt_info.cipher.decrypt(reinterpret_cast<const unsigned char *>(in), insz, reinterpret_cast<unsigned char *>(buffer), &len);
+
+            if (crypt_info.is_aead()) {
+                int res = decrypt_data_aead(crypt_info, in, insz, buffer, len, ad, ad_len);
+                if (0 != res) {
+                    out   = NULL;
+                    outsz = 0;
+                    return res;
+                }
+
+                out   = buffer;
+                outsz = len;
+                return error_code_t::EN_ECT_SUCCESS;
+            }
+
+            int res = crypt_info.cipher.decrypt(reinterpret_cast<const unsigned char *>(in), insz, reinterpret_cast<unsigned char *>(buffer), &len);
 
 // DEBUG CIPHER PROGRESS
 #ifdef LIBATFRAME_ATGATEWAY_ENABLE_CIPHER_DEBUG
@@ -2070,6 +5044,92 @@ namespace atframe {
             return error_code_t::EN_ECT_SUCCESS;
         }
 
+        int libatgw_proto_inner_v1::encrypt_data_aead(crypt_session_t &crypt_info, const void *in, size_t insz, void *out, size_t &outsz, const void *ad,
+                                                      size_t ad_len) {
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            if (false == crypt_info.is_inited_ || !crypt_info.is_aead()) {
+                return error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
+            }
+
+            if (0 == insz || NULL == in || NULL == out) {
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            if (outsz < insz + crypt_info.get_aead_extend_size()) {
+                return error_code_t::EN_ECT_INVALID_SIZE;
+            }
+
+            // explicit nonce + cipher text + tag
+            unsigned char *nonce_start = reinterpret_cast<unsigned char *>(out);
+            unsigned char *data_start  = nonce_start + sizeof(uint64_t);
+            unsigned char *tag_start   = data_start + insz;
+
+            uint64_t nonce = crypt_info.aead_nonce++;
+            flatbuffers::WriteScalar<uint64_t>(nonce_start, nonce);
+
+            size_t len = insz;
+            int    res = crypt_info.set_aead_nonce(nonce);
+            if (res >= 0) {
+                res = crypt_info.cipher.encrypt_aead(reinterpret_cast<const unsigned char *>(in), insz, data_start, &len,
+                                                     reinterpret_cast<const unsigned char *>(ad), ad_len, tag_start, crypt_info.aead_tag_size);
+            }
+
+            if (res < 0 || len != insz) {
+                ATFRAME_GATEWAY_ON_ERROR(res, "encrypt data failed");
+                return error_code_t::EN_ECT_CRYPT_OPERATION;
+            }
+
+            outsz = insz + crypt_info.get_aead_extend_size();
+            return error_code_t::EN_ECT_SUCCESS;
+        }
+
+        int libatgw_proto_inner_v1::decrypt_data_aead(crypt_session_t &crypt_info, const void *in, size_t insz, void *out, size_t &outsz, const void *ad,
+                                                      size_t ad_len) {
+            if (check_flag(flag_t::EN_PFT_CLOSING)) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            if (false == crypt_info.is_inited_ || !crypt_info.is_aead()) {
+                return error_code_t::EN_ECT_CRYPT_NOT_SUPPORTED;
+            }
+
+            if (NULL == in || NULL == out) {
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            if (insz <= crypt_info.get_aead_extend_size()) {
+                return error_code_t::EN_ECT_BAD_DATA;
+            }
+
+            size_t data_len = insz - crypt_info.get_aead_extend_size();
+            if (outsz < data_len) {
+                return error_code_t::EN_ECT_INVALID_SIZE;
+            }
+
+            const unsigned char *nonce_start = reinterpret_cast<const unsigned char *>(in);
+            const unsigned char *data_start  = nonce_start + sizeof(uint64_t);
+            const unsigned char *tag_start   = data_start + data_len;
+
+            size_t len = outsz;
+            int    res = crypt_info.set_aead_nonce(flatbuffers::ReadScalar<uint64_t>(nonce_start));
+            if (res >= 0) {
+                res = crypt_info.cipher.decrypt_aead(data_start, data_len, reinterpret_cast<unsigned char *>(out), &len,
+                                                     reinterpret_cast<const unsigned char *>(ad), ad_len, tag_start, crypt_info.aead_tag_size);
+            }
+
+            // tag mismatch means data is modified or broken
+            if (res < 0) {
+                ATFRAME_GATEWAY_ON_ERROR(res, "decrypt data failed");
+                return error_code_t::EN_ECT_CRYPT_OPERATION;
+            }
+
+            outsz = len;
+            return error_code_t::EN_ECT_SUCCESS;
+        }
+
         int libatgw_proto_inner_v1::global_reload(crypt_conf_t &crypt_conf) {
             // spin_lock
             static ::util::lock::spin_lock                      global_proto_lock;
@@ -2082,10 +5142,19 @@ namespace atframe {
 
             int ret = inst->init();
             if (0 == ret) {
-                detail::crypt_global_configure_t::current().swap(inst);
+                detail::crypt_global_configure_t::set_current(inst);
             }
 
             return ret;
         }
+
+        void libatgw_proto_inner_v1::get_crypt_benchmark(std::vector<crypt_benchmark_t> &out) {
+            out.clear();
+
+            std::shared_ptr<detail::crypt_global_configure_t> global_cfg = detail::crypt_global_configure_t::current();
+            if (global_cfg) {
+                out = global_cfg->crypt_benchmarks_;
+            }
+        }
     } // namespace gateway
 } // namespace atframe
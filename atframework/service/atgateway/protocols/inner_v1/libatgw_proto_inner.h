@@ -4,6 +4,7 @@
 #pragma once
 
 #include <std/chrono.h>
+#include <deque>
 #include <std/smart_ptr.h>
 #include <vector>
 
@@ -31,10 +32,66 @@
 #define ATFRAME_GATEWAY_MACRO_DATA_SMALL_SIZE 3072
 #endif
 
+// max data length of a post fragment, larger message will be split into several fragments
+// every fragment is compressed and encrypted alone, so it must be small enough to be put into tls buffers
+#ifndef ATFRAME_GATEWAY_MACRO_POST_FRAGMENT_SIZE
+#define ATFRAME_GATEWAY_MACRO_POST_FRAGMENT_SIZE 32768
+#endif
+
+// default max length of a message reassembled from fragments
+#ifndef ATFRAME_GATEWAY_MACRO_MESSAGE_SIZE_LIMIT
+#define ATFRAME_GATEWAY_MACRO_MESSAGE_SIZE_LIMIT 16777216
+#endif
+
+// builder reused to pack handshake messages will release its memory when a message larger than this is built
+#ifndef ATFRAME_GATEWAY_MACRO_BUILDER_RETAIN_SIZE
+#define ATFRAME_GATEWAY_MACRO_BUILDER_RETAIN_SIZE 16384
+#endif
+
+// max number of free receive staging blocks kept in every thread
+#ifndef ATFRAME_GATEWAY_MACRO_READ_HEAD_POOL_SIZE
+#define ATFRAME_GATEWAY_MACRO_READ_HEAD_POOL_SIZE 1024
+#endif
+
+// max number of queued blocks passed to writev_fn at once
+#ifndef ATFRAME_GATEWAY_MACRO_WRITEV_MAX_BLOCKS
+#define ATFRAME_GATEWAY_MACRO_WRITEV_MAX_BLOCKS 16
+#endif
+
+// length of data encrypted every time in crypt type benchmark
+#ifndef ATFRAME_GATEWAY_MACRO_CRYPT_BENCHMARK_BLOCK_SIZE
+#define ATFRAME_GATEWAY_MACRO_CRYPT_BENCHMARK_BLOCK_SIZE 4096
+#endif
+
+// tag length of AEAD ciphers(AES-GCM, ChaCha20-Poly1305 and etc.), data encrypted by them is explicit nonce + cipher text + tag
+#ifndef ATFRAME_GATEWAY_MACRO_AEAD_TAG_SIZE
+#define ATFRAME_GATEWAY_MACRO_AEAD_TAG_SIZE 16
+#endif
+
+// window size of zstd stream compression, every session keeps a history of this size for each direction
+#ifndef ATFRAME_GATEWAY_MACRO_ZSTD_STREAM_WINDOW_LOG
+#define ATFRAME_GATEWAY_MACRO_ZSTD_STREAM_WINDOW_LOG 16
+#endif
+
+// default number of DH/ECDH shared contexts, handshakes in different threads use different contexts to reduce lock contention
+#ifndef ATFRAME_GATEWAY_MACRO_DH_CONTEXT_NUMBER
+#define ATFRAME_GATEWAY_MACRO_DH_CONTEXT_NUMBER 8
+#endif
+
+// replay_sequence of EN_HST_RECONNECT_RSP when server does not know posts sent by the old connection(resumed by ticket),
+// it's also returned by get_lost_post_number. it's part of the protocol and can not be changed
+#define ATFRAME_GATEWAY_MACRO_REPLAY_SEQUENCE_UNKNOWN 0xFFFFFFFFFFFFFFFFULL
+
+// zstd stream contexts, see zstd.h
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
 namespace atframe {
     namespace gateway {
         namespace detail {
             struct crypt_global_configure_t;
+            struct dh_context_slot_t;
+            struct handshake_task_t;
         }
 
         class libatgw_proto_inner_v1 : public proto_base {
@@ -47,7 +104,7 @@ namespace atframe {
             struct crypt_conf_t {
                 std::string default_key; /** default key, different used for different crypt protocol **/
                 time_t update_interval;  /** crypt key refresh interval **/
-                std::string type;        /** crypt type. XXTEA, AES and etc. **/
+                std::string type;        /** crypt type. XXTEA, AES, AEAD ciphers like AES-GCM and ChaCha20-Poly1305 and etc. **/
                 int switch_secret_type;  /** how to generate the secret key, dh, rsa or direct send. recommander to use DH **/
 
                 // Not supported now
@@ -55,7 +112,22 @@ namespace atframe {
                 // int hash_id;                 /** hash id, md5,sha1,sha256,sha512 **/
                 // std::string rsa_public_key;  /** RSA public key file path. **/
                 // std::string rsa_private_key; /** RSA private key file path. **/
-                std::string dh_param; /** DH parameter file path. **/
+                std::string dh_param;  /** DH parameter file path. **/
+                size_t dh_pool_size;   /** number of DH/ECDH key pairs made in background for new handshakes, 0 to disable **/
+                size_t dh_context_number; /** number of DH/ECDH shared contexts used in turn by handshakes, 0 for ATFRAME_GATEWAY_MACRO_DH_CONTEXT_NUMBER **/
+                time_t benchmark_time; /** milliseconds to benchmark every crypt type in global_reload, the fastest is preferred in handshake, 0 to disable **/
+
+                std::string compression_type; /** available compression algorithms. ZSTD, LZ4 and etc. empty to disable compression **/
+                size_t compression_threshold; /** only compress the message not smaller than this **/
+                int compression_level;        /** compression level of zstd, 0 for the default level **/
+
+                std::string checksum_type; /** available frame checksum algorithms by priority. CRC32C, NONE(only with AEAD cipher). empty for MURMUR3 **/
+
+                size_t replay_window; /** max bytes of posts kept in every session to send again after reconnect, until peer acknowledge them. 0 to disable **/
+
+                std::string ticket_key;  /** key of ticket_type to encrypt resumption tickets, raw bytes or hex string, gateways with the same key can resume sessions of each other. empty to disable **/
+                std::string ticket_type; /** AEAD cipher to encrypt resumption tickets, AES-256-GCM and etc. **/
+                time_t ticket_lifetime;  /** seconds a resumption ticket can be used after issued **/
 
                 bool client_mode; /** client mode, must be false in server when call global_reload(cfg) **/
             };
@@ -65,7 +137,11 @@ namespace atframe {
                 std::string type;                  /** crypt type. XXTEA, AES and etc. **/
                 std::vector<unsigned char> secret; /** crypt secret. **/
 
-                std::vector<unsigned char> param; /** cache data used for generate key, dhparam if using DH algorithm. **/
+                uint64_t aead_nonce;             /** explicit nonce of the next data encrypted by AEAD cipher, start from a random number **/
+                uint64_t aead_read_nonce;        /** min explicit nonce of the next post decrypted, smaller ones are replayed **/
+                uint64_t aead_urgent_read_nonce; /** the same as aead_read_nonce but for urgent posts, they are sent in another lane **/
+                uint32_t aead_tag_size;          /** tag length if cipher is AEAD, 0 for other ciphers **/
+                bool is_inited_;
 
                 crypt_session_t();
                 ~crypt_session_t();
@@ -75,11 +151,50 @@ namespace atframe {
                 int generate_secret(int &libres);
                 int swap_secret(std::vector<unsigned char> &in, int &libres);
 
+                inline bool is_aead() const { return aead_tag_size > 0; }
+
+                /**
+                 * @brief extra length of data encrypted by AEAD cipher, explicit nonce and tag
+                 */
+                size_t get_aead_extend_size() const;
+
+                /**
+                 * @brief set iv of AEAD cipher, it's the iv in secret xor explicit nonce
+                 * @return 0 or error code of cipher
+                 */
+                int set_aead_nonce(uint64_t nonce);
+
+                /**
+                 * @brief memory used by this crypt session, cipher context allocated by crypt library is not included
+                 */
+                size_t get_memory_usage() const;
+
                 util::crypto::cipher cipher;
-                bool is_inited_;
             };
             typedef std::shared_ptr<crypt_session_t> crypt_session_ptr_t;
 
+            struct checksum_t {
+                enum type {
+                    EN_CKT_MURMUR3 = 0, /** murmur hash3 x86_32, used when peer do not support checksum negotiation **/
+                    EN_CKT_CRC32C,      /** crc32c(Castagnoli), use SSE4.2 or ARMv8 CRC32 instructions if available **/
+                    EN_CKT_NONE,        /** no frame checksum, only available with AEAD cipher **/
+                };
+            };
+
+            struct crypt_benchmark_t {
+                std::string type;          /** crypt type **/
+                uint64_t bytes_per_second; /** encrypt throughput, 0 if benchmark failed **/
+            };
+
+            /**
+             * @brief post data compressed before, so it can be shared by sessions with the same compression algorithm
+             */
+            struct compressed_post_t {
+                int type;         /** compression algorithm, EN_CT_NONE if the original data should be sent **/
+                const void *data; /** compressed data, only used when type is not EN_CT_NONE **/
+                size_t length;    /** length of compressed data **/
+            };
+
             // ping/pong
             struct ping_data_t {
                 typedef std::chrono::system_clock clk_t;
@@ -94,13 +209,18 @@ namespace atframe {
             virtual void alloc_recv_buffer(size_t suggested_size, char *&out_buf, size_t &out_len);
             virtual void read(int ssz, const char *buff, size_t len, int &errcode);
 
-            void dispatch_data(const char *buff, size_t len, int errcode);
+            /**
+             * @brief dispatch a message
+             * @param is_tagged frame hash is not set because post data is protected by AEAD tag
+             */
+            void dispatch_data(const char *buff, size_t len, int errcode, bool is_tagged = false);
             int dispatch_handshake(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
 
             int dispatch_handshake_start_req(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
             int dispatch_handshake_start_rsp(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
             int dispatch_handshake_reconn_req(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
             int dispatch_handshake_reconn_rsp(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
+            int send_handshake_reconn_rsp(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake, int ret);
             int dispatch_handshake_dh_pubkey_req(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake,
                                                  ::atframe::gw::inner::v1::handshake_step_t next_step);
             int dispatch_handshake_dh_pubkey_rsp(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
@@ -112,10 +232,56 @@ namespace atframe {
                                              flatbuffers::Offset< ::atframe::gw::inner::v1::cs_body_handshake> &handshake_body,
                                              ::atframe::gw::inner::v1::handshake_step_t next_step);
 
+            int send_handshake_start_rsp(::atframe::gw::inner::v1::cs_msg_type_t msg_type, std::string &crypt_type);
+            int send_handshake_dh_pubkey_rsp(::atframe::gw::inner::v1::handshake_step_t next_step, int ret);
+
             int try_write();
-            int write_msg(flatbuffers::FlatBufferBuilder &builder);
+
+            /**
+             * @brief copy message into write buffer and try to write it
+             * @param is_tagged message is protected by AEAD tag, frame hash will be set to 0 instead of murmur hash
+             * @param is_urgent put it into urgent lane, which is written before normal lane
+             * @param is_barrier it's a handshake message in normal lane, encrypted urgent posts are not sent until it's written
+             * @return 0 or error code
+             */
+            int write_msg(flatbuffers::FlatBufferBuilder &builder, bool is_tagged = false, bool is_urgent = false, bool is_barrier = false);
+
+            /**
+             * @brief reserve a block in write buffer, so the builder can write message into it directly
+             * @param body_size size hint of message body(post data and etc.)
+             * @param builder_buf where builder can use, write_header_offset_ and message header is just before it
+             * @param builder_len length of builder_buf
+             * @param is_urgent reserve in urgent lane, which is written before normal lane
+             * @note write_reserved_msg must be called after this, with the same is_urgent
+             * @return 0 or error code
+             */
+            int reserve_msg(size_t body_size, void *&builder_buf, size_t &builder_len, bool is_urgent = false);
+
+            /**
+             * @brief finish a message built in the buffer reserved by reserve_msg and try to write it
+             * @note if the builder has grown out of the reserved buffer, the message will be copied just like write_msg(builder)
+             * @return 0 or error code
+             */
+            int write_reserved_msg(flatbuffers::FlatBufferBuilder &builder, void *builder_buf, size_t builder_len, bool is_tagged = false,
+                                   bool is_urgent = false);
+
+            /**
+             * @brief copy a post frame packed before(32bits hash, 32bits length and message) into write buffer and try to write it
+             * @note it's not a barrier of urgent posts, just like posts packed by write_post
+             * @return 0 or error code
+             */
+            int write_frame(const void *frame, size_t len, bool is_urgent = false);
             virtual int write(const void *buffer, size_t len);
+            virtual int write(const void *buffer, size_t len, int priority);
+
+            /**
+             * @brief write post shared by sessions
+             * @note the whole frame is shared by sessions without encryption and replay, and compressed data is shared by others
+             *       with the same compression algorithm, so the same message is only encoded once for each group of sessions
+             */
+            virtual int write_broadcast(broadcast_cache_t &cache);
             virtual int write_done(int status);
+            virtual int uncork();
 
             virtual int close(int reason);
             int close(int reason, bool is_send_kickoff);
@@ -125,24 +291,58 @@ namespace atframe {
 
             virtual bool check_reconnect(const proto_base *other);
 
+            /**
+             * @brief take posts not acknowledged by client from the old connection, they will be sent again after reconnect response
+             */
+            virtual void takeover_reconnect(proto_base *other);
+
+            /**
+             * @brief send reconnect response after the old session is taken over in another thread
+             */
+            virtual int finish_reconnect(int status);
+
             virtual void set_recv_buffer_limit(size_t max_size, size_t max_number);
             virtual void set_send_buffer_limit(size_t max_size, size_t max_number);
+            virtual void set_message_size_limit(size_t max_size);
 
             virtual int handshake_update();
 
             virtual std::string get_info() const;
 
+            /**
+             * @brief get memory used by this session, crypt sessions shared by read, write and handshake are counted only once
+             */
+            virtual size_t get_memory_usage() const;
+
             int start_session(const std::string &crypt_type);
             int reconnect_session(uint64_t sess_id, const std::string &crypt_type, const std::vector<unsigned char> &secret);
 
-            int send_post(::atframe::gw::inner::v1::cs_msg_type_t msg_type, const void *buffer, size_t len);
+            /**
+             * @brief send post data
+             * @param is_urgent send it by urgent lane if possible, such post is not numbered and will not be sent again after reconnect
+             * @return 0 or error code
+             */
+            int send_post(::atframe::gw::inner::v1::cs_msg_type_t msg_type, const void *buffer, size_t len, bool is_urgent = false);
             int send_post(const void *buffer, size_t len);
+            int send_post_fragment(::atframe::gw::inner::v1::cs_msg_type_t msg_type, const void *buffer, size_t len, size_t total_length,
+                                   size_t fragment_offset, const compressed_post_t *compressed = NULL);
             int send_ping();
             int send_pong(int64_t tp);
             int send_key_syn();
             int send_kickoff(int reason);
             int send_verify(const void *buf, size_t sz);
 
+            /**
+             * @brief acknowledge all posts received, so peer can release them from replay cache
+             */
+            int send_post_ack();
+
+            /**
+             * @brief send a resumption ticket of current secret to client, used in server mode
+             * @note it's sent every time handshake or handshake update is verified if ticket key is set
+             */
+            int send_ticket();
+
             const ping_data_t &get_last_ping() const { return ping_; }
 
             const crypt_session_ptr_t &get_crypt_read() const;
@@ -151,16 +351,180 @@ namespace atframe {
 
             inline uint64_t get_session_id() const { return session_id_; }
 
+            /**
+             * @brief set compression algorithms to request in start_session and reconnect_session, used in client mode
+             * @param types compression algorithm names, the same format as crypt type. empty to disable compression
+             * @note all supported compression algorithms will be requested by default
+             */
+            void set_compression_types(const std::string &types);
+
+            /**
+             * @brief get negotiated compression algorithm
+             * @return compression algorithm, see compression_t in libatgw_proto_inner.fbs
+             */
+            inline int get_compression_type() const { return compression_.type; }
+
+            /**
+             * @brief set frame checksum algorithms to request in start_session and reconnect_session, used in client mode
+             * @param types checksum algorithm names, the same format as crypt type. empty to use MURMUR3 only
+             * @note all supported checksum algorithms will be requested by default
+             */
+            void set_checksum_types(const std::string &types);
+
+            /**
+             * @brief get frame checksum algorithm used now
+             * @return checksum algorithm, see checksum_t
+             */
+            inline int get_checksum_type() const { return checksum_.type; }
+
+            /**
+             * @brief get sequence of the last post received, used in client mode
+             * @note pass it to set_received_sequence of the new connection before reconnect_session, so posts after it will be sent again
+             */
+            inline uint64_t get_received_sequence() const { return replay_.received_sequence; }
+
+            /**
+             * @brief set sequence of the last post received by the old connection, used in client mode
+             */
+            inline void set_received_sequence(uint64_t sequence) { replay_.received_sequence = sequence; }
+
+            /**
+             * @brief get number of posts lost by the last reconnect, used in client mode
+             * @note server drops the oldest posts not acknowledged when its replay window is full, they will never be received
+             * @note it's ATFRAME_GATEWAY_MACRO_REPLAY_SEQUENCE_UNKNOWN if the session is resumed by ticket and server can not tell how many posts
+             *       are lost
+             */
+            inline uint64_t get_lost_post_number() const { return replay_.lost_number; }
+
+            /**
+             * @brief get resumption ticket received from server, used in client mode
+             * @note pass it to set_ticket of the new connection before reconnect_session, so session can be resumed by any gateway sharing the ticket key
+             */
+            inline const std::vector<unsigned char> &get_ticket() const { return ticket_; }
+
+            /**
+             * @brief set resumption ticket to send in reconnect_session, used in client mode
+             */
+            inline void set_ticket(const std::vector<unsigned char> &ticket) { ticket_ = ticket; }
+
         private:
-            int encode_post(const void *in, size_t insz, const void *&out, size_t &outsz);
-            int decode_post(const void *in, size_t insz, const void *&out, size_t &outsz);
+            /**
+             * @brief setup negotiated compression algorithm
+             * @param reset_stream reset stream compression contexts, even if the compression algorithm is not changed
+             */
+            void setup_compression(const std::shared_ptr<detail::crypt_global_configure_t> &shared_conf, int compression_type, bool reset_stream);
+            void reset_compression_stream();
+
+            /**
+             * @brief switch to negotiated frame checksum algorithm, MURMUR3 frames are still accepted until peer switch to it
+             */
+            void setup_checksum(int checksum_type);
+            bool check_frame_checksum(const char *buf, size_t len, uint32_t expect_hash);
+
+            /**
+             * @brief run DH/ECDH operation of handshake in worker thread by async_work_fn, handshake is suspended until it finished
+             * @param task_type see detail::handshake_task_t
+             * @param msg_type message type of start response, or the next handshake step
+             * @return 0 or error code, on_handshake_task_done will be called later only if it's 0
+             */
+            int start_handshake_task(int task_type, int msg_type, const std::string &crypt_type, const void *input, size_t input_len);
+            static void on_handshake_task_done(const std::shared_ptr<detail::handshake_task_t> &task, int status);
+            void finish_handshake_task(detail::handshake_task_t &task, int status);
+
+            /**
+             * @brief take a DH/ECDH key pair made in background, so only shared secret need to be computed in handshake
+             * @return true if DH parameters is ready in handshake_.param
+             */
+            bool use_prepared_dh();
+
+            /**
+             * @brief setup crypt session of reconnect request with the secret of old session, and check if client has the same secret
+             */
+            bool check_reconnect_secret(const std::string &secret_type, const std::vector<unsigned char> &secret);
+
+            /**
+             * @brief resume the session in resumption ticket of reconnect request, used when the session is not found
+             * @return 0 or error code
+             */
+            int resume_ticket(const ::atframe::gw::inner::v1::cs_body_handshake &body_handshake);
+
+            int dispatch_post_fragment(size_t total_length, size_t fragment_offset, const void *buffer, size_t len);
+
+            /**
+             * @brief compress, encrypt and pack post data into write buffer
+             * @param sequence sequence in message head, numbered by session if replay is enabled
+             * @param compressed compressed data of buffer, NULL to compress it here
+             */
+            int write_post(::atframe::gw::inner::v1::cs_msg_type_t msg_type, uint64_t sequence, const void *buffer, size_t len, size_t total_length,
+                           size_t fragment_offset, bool is_urgent = false, const compressed_post_t *compressed = NULL);
+
+            /**
+             * @brief get compressed data of broadcast, it's compressed only once for all sessions with the same compression algorithm
+             * @param out compressed data, or the original data with EN_CT_NONE if it's too small or not smaller after compressed
+             * @return false if compressed data can not be shared, such as stream compression
+             */
+            bool get_broadcast_compressed_post(broadcast_cache_t &cache, compressed_post_t &out);
+
+            /**
+             * @brief get the whole frame of broadcast, it's packed only once for all sessions without encryption and replay
+             * @return frame cached in broadcast, NULL if packing failed
+             */
+            const std::vector<unsigned char> *get_broadcast_frame(broadcast_cache_t &cache, bool is_urgent);
+
+            /**
+             * @brief check if post can be sent by urgent lane now
+             * @note always false when using stream compression, because urgent posts may overtake normal posts
+             */
+            bool check_urgent_post() const;
+
+            /**
+             * @brief release cached posts not after sequence, peer has received them
+             */
+            void release_replay_posts(uint64_t sequence);
+
+            /**
+             * @brief send all cached posts again, in the order they are sent first time
+             * @return 0 or error code
+             */
+            int replay_posts();
+
+            /**
+             * @brief compress and encrypt post data
+             * @param is_encrypt false to only compress data, AEAD cipher will encrypt it into write buffer later
+             */
+            int encode_post(const void *in, size_t insz, const void *&out, size_t &outsz, int &compression_type, size_t &compression_length,
+                            bool is_encrypt = true);
+            int decode_post(const void *in, size_t insz, int compression_type, size_t compression_length, const void *&out, size_t &outsz,
+                            const void *ad = NULL, size_t ad_len = 0);
 
             int encrypt_data(crypt_session_t &crypt_info, const void *in, size_t insz, const void *&out, size_t &outsz);
-            int decrypt_data(crypt_session_t &crypt_info, const void *in, size_t insz, const void *&out, size_t &outsz);
+            int decrypt_data(crypt_session_t &crypt_info, const void *in, size_t insz, const void *&out, size_t &outsz, const void *ad = NULL,
+                             size_t ad_len = 0);
+
+            /**
+             * @brief encrypt data by AEAD cipher, output is explicit nonce + cipher text + tag
+             * @param out where to write, it can be in write buffer so data need not to be copied again
+             * @param outsz available length of out, and will be set to the length written
+             * @param ad additional data protected by tag
+             * @return 0 or error code
+             */
+            int encrypt_data_aead(crypt_session_t &crypt_info, const void *in, size_t insz, void *out, size_t &outsz, const void *ad, size_t ad_len);
+            int decrypt_data_aead(crypt_session_t &crypt_info, const void *in, size_t insz, void *out, size_t &outsz, const void *ad, size_t ad_len);
+
+            /**
+             * @brief if a frame with this hash is protected by AEAD tag of post data
+             */
+            inline bool is_tagged_frame(uint32_t hash) const { return 0 == hash && crypt_read_ && crypt_read_->is_aead(); }
 
         public:
             static int global_reload(crypt_conf_t &crypt_conf);
 
+            /**
+             * @brief get benchmark result of available crypt types, the fastest one is the first
+             * @note it's empty if crypt_conf_t::benchmark_time is 0 or in client mode
+             */
+            static void get_crypt_benchmark(std::vector<crypt_benchmark_t> &out);
+
         private:
             uint64_t session_id_;
             ::atbus::detail::buffer_manager read_buffers_;
@@ -172,9 +536,55 @@ namespace atframe {
                 char buffer[ATFRAME_GATEWAY_MACRO_DATA_SMALL_SIZE]; // 小数据包存储区
                 size_t len;                                         // 小数据包存储区已使用长度
             } read_head_t;
-            read_head_t read_head_;
+            /**
+             * @brief borrowed from the pool of current thread only when receiving, and given back when there is no partial message
+             */
+            read_head_t *read_head_;
+
+            /**
+             * @brief write buffer and the index of its blocks, blocks are always pushed and popped with the index together
+             * @note buffer_manager can only visit the front and the back block, so the index is used to pick several blocks for writev_fn
+             */
+            class write_queue_t {
+            public:
+                typedef std::deque< ::atbus::detail::buffer_block *>::const_iterator block_iterator;
+
+                int push_back(void *&data, size_t s);
+                int push_front(void *&data, size_t s);
+                /** pop the whole front block **/
+                void pop_front();
+                /** pop the whole back block **/
+                void pop_back();
+                void clear();
+                void set_mode(size_t max_size, size_t max_number);
+                size_t get_memory_usage() const;
+
+                inline bool empty() const { return buffers_.empty(); }
+                inline bool is_static_mode() const { return buffers_.is_static_mode(); }
+                inline const ::atbus::detail::buffer_manager::limit_t &limit() const { return buffers_.limit(); }
+                inline ::atbus::detail::buffer_block *front() { return buffers_.front(); }
+                inline ::atbus::detail::buffer_block *back() { return buffers_.back(); }
+                inline int front(void *&data, size_t &nread, size_t &nwrite) { return buffers_.front(data, nread, nwrite); }
+
+                inline size_t block_size() const { return blocks_.size(); }
+                inline block_iterator block_begin() const { return blocks_.begin(); }
+                inline block_iterator block_end() const { return blocks_.end(); }
+
+            private:
+                ::atbus::detail::buffer_manager buffers_;
+                std::deque< ::atbus::detail::buffer_block *> blocks_;
+            };
 
-            ::atbus::detail::buffer_manager write_buffers_;
+            write_queue_t write_queue_;
+            /**
+             * @brief control frames and urgent posts, written before write_queue_ but never interrupt the block being written
+             */
+            write_queue_t write_urgent_queue_;
+            /**
+             * @brief number of front blocks in write_queue_ which must be written before encrypted urgent posts, 0 if there is no barrier
+             */
+            size_t write_urgent_barrier_;
+            bool is_writing_urgent_;
             const void *last_write_ptr_;
             int close_reason_;
 
@@ -183,6 +593,58 @@ namespace atframe {
             crypt_session_ptr_t crypt_write_;
             crypt_session_ptr_t crypt_handshake_;
 
+            // compression option
+            struct compression_info_t {
+                int type;                    /** negotiated compression algorithm **/
+                size_t threshold;            /** only compress the message not smaller than this **/
+                int level;                   /** compression level **/
+                std::string available_types; /** compression algorithms to request, only used in client mode **/
+                ::ZSTD_CCtx_s *stream_write; /** stream compression context of sent messages, only used by EN_CT_ZSTD_STREAM **/
+                ::ZSTD_DCtx_s *stream_read;  /** stream decompression context of received messages, only used by EN_CT_ZSTD_STREAM **/
+            };
+            compression_info_t compression_;
+
+            // frame checksum option
+            struct checksum_info_t {
+                int type;                    /** frame checksum algorithm used now **/
+                int next_type;               /** negotiated frame checksum algorithm, server switch to it after the response is sent **/
+                bool is_read_confirmed;      /** peer has sent a frame with this algorithm, so MURMUR3 is not accepted any more **/
+                std::string available_types; /** checksum algorithms to request, only used in client mode **/
+            };
+            checksum_info_t checksum_;
+
+            // reassembly of fragmented post
+            struct post_fragment_t {
+                std::vector<unsigned char> buffer; /** only allocated when receiving fragments **/
+                size_t total_length;
+                size_t received_length;
+            };
+            post_fragment_t post_fragment_;
+            size_t message_size_limit_;
+
+            // posts cached to send again after reconnect
+            struct replay_post_t {
+                uint64_t sequence;
+                int msg_type;
+                size_t total_length;
+                size_t fragment_offset;
+                std::vector<unsigned char> data; /** post data before compression and encryption **/
+            };
+            struct replay_info_t {
+                bool is_sending;            /** posts sent are numbered and cached until peer acknowledge them, only used in server mode **/
+                bool is_receiving;          /** posts received are numbered by peer and should be acknowledged, only used in client mode **/
+                size_t window_size;         /** max bytes of cached posts, the oldest ones are dropped when it's full **/
+                size_t cached_size;         /** bytes of cached posts now **/
+                uint64_t send_sequence;     /** sequence of the last post sent **/
+                uint64_t received_sequence; /** sequence of the last post received, a fragment is counted only when it's the last one of a message **/
+                uint64_t acked_sequence;    /** sequence of the last post acknowledged to peer **/
+                uint64_t lost_number;       /** posts dropped by peer before they are received, counted by the last reconnect, or unknown **/
+                std::deque<replay_post_t> cache;
+            };
+            replay_info_t replay_;
+
+            std::vector<unsigned char> ticket_; /** resumption ticket received from server, only used in client mode **/
+
             // ping data
             ping_data_t ping_;
 
@@ -191,7 +653,12 @@ namespace atframe {
                 int switch_secret_type;
                 bool has_data;
                 const void *ext_data;
-                util::crypto::dh dh_ctx;
+                bool params_ready; /** DH parameters is already made into param by handshake task **/
+                std::vector<unsigned char> param; /** DH parameters or verify text, only used in handshake and released after it **/
+                std::shared_ptr<util::crypto::dh> dh_ctx;
+                std::shared_ptr<detail::dh_context_slot_t> dh_slot; /** shared context of dh_ctx, it must be locked when using dh_ctx **/
+                std::shared_ptr<detail::handshake_task_t> task; /** running handshake task, dh_ctx is used by worker thread now **/
+                std::vector<unsigned char> reconnect_req; /** copy of reconnect request waiting for finish_reconnect, ext_data points to it **/
             };
             handshake_t handshake_;
         };
@@ -21,6 +21,8 @@ struct cs_body_handshake;
 
 struct cs_body_ping;
 
+struct cs_resume_ticket;
+
 struct cs_msg;
 
 enum error_code_t {
@@ -134,6 +136,41 @@ inline const char *EnumNameswitch_secret_t(switch_secret_t e) {
   return EnumNamesswitch_secret_t()[index];
 }
 
+enum compression_t {
+  compression_t_EN_CT_NONE = 0,
+  compression_t_EN_CT_LZ4 = 1,
+  compression_t_EN_CT_ZSTD = 2,
+  compression_t_EN_CT_ZSTD_STREAM = 3,
+  compression_t_MIN = compression_t_EN_CT_NONE,
+  compression_t_MAX = compression_t_EN_CT_ZSTD_STREAM
+};
+
+inline const compression_t (&EnumValuescompression_t())[4] {
+  static const compression_t values[] = {
+    compression_t_EN_CT_NONE,
+    compression_t_EN_CT_LZ4,
+    compression_t_EN_CT_ZSTD,
+    compression_t_EN_CT_ZSTD_STREAM
+  };
+  return values;
+}
+
+inline const char * const *EnumNamescompression_t() {
+  static const char * const names[] = {
+    "EN_CT_NONE",
+    "EN_CT_LZ4",
+    "EN_CT_ZSTD",
+    "EN_CT_ZSTD_STREAM",
+    nullptr
+  };
+  return names;
+}
+
+inline const char *EnumNamecompression_t(compression_t e) {
+  const size_t index = static_cast<int>(e);
+  return EnumNamescompression_t()[index];
+}
+
 enum cs_msg_type_t {
   cs_msg_type_t_EN_MTT_UNKNOWN = 0,
   cs_msg_type_t_EN_MTT_POST = 1,
@@ -143,11 +180,13 @@ enum cs_msg_type_t {
   cs_msg_type_t_EN_MTT_KICKOFF = 5,
   cs_msg_type_t_EN_MTT_POST_KEY_SYN = 6,
   cs_msg_type_t_EN_MTT_POST_KEY_ACK = 7,
+  cs_msg_type_t_EN_MTT_POST_ACK = 8,
+  cs_msg_type_t_EN_MTT_TICKET = 9,
   cs_msg_type_t_MIN = cs_msg_type_t_EN_MTT_UNKNOWN,
-  cs_msg_type_t_MAX = cs_msg_type_t_EN_MTT_POST_KEY_ACK
+  cs_msg_type_t_MAX = cs_msg_type_t_EN_MTT_TICKET
 };
 
-inline const cs_msg_type_t (&EnumValuescs_msg_type_t())[8] {
+inline const cs_msg_type_t (&EnumValuescs_msg_type_t())[10] {
   static const cs_msg_type_t values[] = {
     cs_msg_type_t_EN_MTT_UNKNOWN,
     cs_msg_type_t_EN_MTT_POST,
@@ -156,7 +195,9 @@ inline const cs_msg_type_t (&EnumValuescs_msg_type_t())[8] {
     cs_msg_type_t_EN_MTT_PONG,
     cs_msg_type_t_EN_MTT_KICKOFF,
     cs_msg_type_t_EN_MTT_POST_KEY_SYN,
-    cs_msg_type_t_EN_MTT_POST_KEY_ACK
+    cs_msg_type_t_EN_MTT_POST_KEY_ACK,
+    cs_msg_type_t_EN_MTT_POST_ACK,
+    cs_msg_type_t_EN_MTT_TICKET
   };
   return values;
 }
@@ -171,6 +212,8 @@ inline const char * const *EnumNamescs_msg_type_t() {
     "EN_MTT_KICKOFF",
     "EN_MTT_POST_KEY_SYN",
     "EN_MTT_POST_KEY_ACK",
+    "EN_MTT_POST_ACK",
+    "EN_MTT_TICKET",
     nullptr
   };
   return names;
@@ -301,9 +344,14 @@ inline flatbuffers::Offset<cs_msg_head> Createcs_msg_head(
 struct cs_body_post FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   enum {
     VT_LENGTH = 4,
-    VT_DATA = 6
+    VT_DATA = 6,
+    VT_COMPRESSION = 8,
+    VT_COMPRESSION_LENGTH = 10,
+    VT_TOTAL_LENGTH = 12,
+    VT_FRAGMENT_OFFSET = 14
   };
   /// the length before encrypt, because encrypt data will pad data.
+  /// if data is compressed, it's also the length before compression
   uint64_t length() const {
     return GetField<uint64_t>(VT_LENGTH, 0);
   }
@@ -316,11 +364,44 @@ struct cs_body_post FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   flatbuffers::Vector<int8_t> *mutable_data() {
     return GetPointer<flatbuffers::Vector<int8_t> *>(VT_DATA);
   }
+  /// compression algorithm of data
+  compression_t compression() const {
+    return static_cast<compression_t>(GetField<uint8_t>(VT_COMPRESSION, 0));
+  }
+  bool mutate_compression(compression_t _compression) {
+    return SetField<uint8_t>(VT_COMPRESSION, static_cast<uint8_t>(_compression), 0);
+  }
+  /// the length after compression and before encrypt, only available when compression is not EN_CT_NONE
+  uint64_t compression_length() const {
+    return GetField<uint64_t>(VT_COMPRESSION_LENGTH, 0);
+  }
+  bool mutate_compression_length(uint64_t _compression_length) {
+    return SetField<uint64_t>(VT_COMPRESSION_LENGTH, _compression_length, 0);
+  }
+  /// length of the whole message if it's split into fragments, 0 if not fragmented.
+  /// every fragment is compressed and encrypted alone, and length is the length of this fragment
+  uint64_t total_length() const {
+    return GetField<uint64_t>(VT_TOTAL_LENGTH, 0);
+  }
+  bool mutate_total_length(uint64_t _total_length) {
+    return SetField<uint64_t>(VT_TOTAL_LENGTH, _total_length, 0);
+  }
+  /// where this fragment starts in the whole message, fragments must be sent in order
+  uint64_t fragment_offset() const {
+    return GetField<uint64_t>(VT_FRAGMENT_OFFSET, 0);
+  }
+  bool mutate_fragment_offset(uint64_t _fragment_offset) {
+    return SetField<uint64_t>(VT_FRAGMENT_OFFSET, _fragment_offset, 0);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<uint64_t>(verifier, VT_LENGTH) &&
            VerifyOffset(verifier, VT_DATA) &&
            verifier.VerifyVector(data()) &&
+           VerifyField<uint8_t>(verifier, VT_COMPRESSION) &&
+           VerifyField<uint64_t>(verifier, VT_COMPRESSION_LENGTH) &&
+           VerifyField<uint64_t>(verifier, VT_TOTAL_LENGTH) &&
+           VerifyField<uint64_t>(verifier, VT_FRAGMENT_OFFSET) &&
            verifier.EndTable();
   }
 };
@@ -334,6 +415,18 @@ struct cs_body_postBuilder {
   void add_data(flatbuffers::Offset<flatbuffers::Vector<int8_t>> data) {
     fbb_.AddOffset(cs_body_post::VT_DATA, data);
   }
+  void add_compression(compression_t compression) {
+    fbb_.AddElement<uint8_t>(cs_body_post::VT_COMPRESSION, static_cast<uint8_t>(compression), 0);
+  }
+  void add_compression_length(uint64_t compression_length) {
+    fbb_.AddElement<uint64_t>(cs_body_post::VT_COMPRESSION_LENGTH, compression_length, 0);
+  }
+  void add_total_length(uint64_t total_length) {
+    fbb_.AddElement<uint64_t>(cs_body_post::VT_TOTAL_LENGTH, total_length, 0);
+  }
+  void add_fragment_offset(uint64_t fragment_offset) {
+    fbb_.AddElement<uint64_t>(cs_body_post::VT_FRAGMENT_OFFSET, fragment_offset, 0);
+  }
   explicit cs_body_postBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -349,21 +442,37 @@ struct cs_body_postBuilder {
 inline flatbuffers::Offset<cs_body_post> Createcs_body_post(
     flatbuffers::FlatBufferBuilder &_fbb,
     uint64_t length = 0,
-    flatbuffers::Offset<flatbuffers::Vector<int8_t>> data = 0) {
+    flatbuffers::Offset<flatbuffers::Vector<int8_t>> data = 0,
+    compression_t compression = compression_t_EN_CT_NONE,
+    uint64_t compression_length = 0,
+    uint64_t total_length = 0,
+    uint64_t fragment_offset = 0) {
   cs_body_postBuilder builder_(_fbb);
+  builder_.add_fragment_offset(fragment_offset);
+  builder_.add_total_length(total_length);
+  builder_.add_compression_length(compression_length);
   builder_.add_length(length);
   builder_.add_data(data);
+  builder_.add_compression(compression);
   return builder_.Finish();
 }
 
 inline flatbuffers::Offset<cs_body_post> Createcs_body_postDirect(
     flatbuffers::FlatBufferBuilder &_fbb,
     uint64_t length = 0,
-    const std::vector<int8_t> *data = nullptr) {
+    const std::vector<int8_t> *data = nullptr,
+    compression_t compression = compression_t_EN_CT_NONE,
+    uint64_t compression_length = 0,
+    uint64_t total_length = 0,
+    uint64_t fragment_offset = 0) {
   return atframe::gw::inner::v1::Createcs_body_post(
       _fbb,
       length,
-      data ? _fbb.CreateVector<int8_t>(*data) : 0);
+      data ? _fbb.CreateVector<int8_t>(*data) : 0,
+      compression,
+      compression_length,
+      total_length,
+      fragment_offset);
 }
 
 struct cs_body_kickoff FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
@@ -417,6 +526,11 @@ inline flatbuffers::Offset<cs_body_kickoff> Createcs_body_kickoff(
 ///     step=EN_HST_DH_PUBKEY_RSP|EN_HST_ECDH_PUBKEY_RSP, switch_type=EN_SST_DH : verify data prefix
 ///     step=EN_HST_START_RSP, switch_type=EN_SST_DIRECT                        : secret
 ///     step=EN_HST_VERIFY, switch_type=ANY                                     : verify data prefix + suffix
+///
+/// compression_type is all available compression algorithms of client in EN_HST_START_REQ and EN_HST_RECONNECT_REQ,
+///     and is the selected one in EN_HST_START_RSP and EN_HST_RECONNECT_RSP
+/// checksum_type is the same as compression_type but for frame checksum algorithms(crc32c, murmur3 and none),
+///     murmur3 is used if it's not set, so old clients still work
 struct cs_body_handshake FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   enum {
     VT_SESSION_ID = 4,
@@ -424,7 +538,11 @@ struct cs_body_handshake FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
     VT_SWITCH_TYPE = 8,
     VT_CRYPT_TYPE = 10,
     VT_CRYPT_PARAM = 12,
-    VT_SWITCH_PARAM = 14
+    VT_SWITCH_PARAM = 14,
+    VT_COMPRESSION_TYPE = 16,
+    VT_CHECKSUM_TYPE = 18,
+    VT_REPLAY_SEQUENCE = 20,
+    VT_TICKET = 22
   };
   uint64_t session_id() const {
     return GetField<uint64_t>(VT_SESSION_ID, 0);
@@ -462,6 +580,30 @@ struct cs_body_handshake FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   flatbuffers::Vector<int8_t> *mutable_switch_param() {
     return GetPointer<flatbuffers::Vector<int8_t> *>(VT_SWITCH_PARAM);
   }
+  const flatbuffers::String *compression_type() const {
+    return GetPointer<const flatbuffers::String *>(VT_COMPRESSION_TYPE);
+  }
+  flatbuffers::String *mutable_compression_type() {
+    return GetPointer<flatbuffers::String *>(VT_COMPRESSION_TYPE);
+  }
+  const flatbuffers::String *checksum_type() const {
+    return GetPointer<const flatbuffers::String *>(VT_CHECKSUM_TYPE);
+  }
+  flatbuffers::String *mutable_checksum_type() {
+    return GetPointer<flatbuffers::String *>(VT_CHECKSUM_TYPE);
+  }
+  uint64_t replay_sequence() const {
+    return GetField<uint64_t>(VT_REPLAY_SEQUENCE, 0);
+  }
+  bool mutate_replay_sequence(uint64_t _replay_sequence) {
+    return SetField<uint64_t>(VT_REPLAY_SEQUENCE, _replay_sequence, 0);
+  }
+  const flatbuffers::Vector<int8_t> *ticket() const {
+    return GetPointer<const flatbuffers::Vector<int8_t> *>(VT_TICKET);
+  }
+  flatbuffers::Vector<int8_t> *mutable_ticket() {
+    return GetPointer<flatbuffers::Vector<int8_t> *>(VT_TICKET);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<uint64_t>(verifier, VT_SESSION_ID) &&
@@ -473,6 +615,13 @@ struct cs_body_handshake FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
            verifier.VerifyVector(crypt_param()) &&
            VerifyOffset(verifier, VT_SWITCH_PARAM) &&
            verifier.VerifyVector(switch_param()) &&
+           VerifyOffset(verifier, VT_COMPRESSION_TYPE) &&
+           verifier.VerifyString(compression_type()) &&
+           VerifyOffset(verifier, VT_CHECKSUM_TYPE) &&
+           verifier.VerifyString(checksum_type()) &&
+           VerifyField<uint64_t>(verifier, VT_REPLAY_SEQUENCE) &&
+           VerifyOffset(verifier, VT_TICKET) &&
+           verifier.VerifyVector(ticket()) &&
            verifier.EndTable();
   }
 };
@@ -498,6 +647,18 @@ struct cs_body_handshakeBuilder {
   void add_switch_param(flatbuffers::Offset<flatbuffers::Vector<int8_t>> switch_param) {
     fbb_.AddOffset(cs_body_handshake::VT_SWITCH_PARAM, switch_param);
   }
+  void add_compression_type(flatbuffers::Offset<flatbuffers::String> compression_type) {
+    fbb_.AddOffset(cs_body_handshake::VT_COMPRESSION_TYPE, compression_type);
+  }
+  void add_checksum_type(flatbuffers::Offset<flatbuffers::String> checksum_type) {
+    fbb_.AddOffset(cs_body_handshake::VT_CHECKSUM_TYPE, checksum_type);
+  }
+  void add_replay_sequence(uint64_t replay_sequence) {
+    fbb_.AddElement<uint64_t>(cs_body_handshake::VT_REPLAY_SEQUENCE, replay_sequence, 0);
+  }
+  void add_ticket(flatbuffers::Offset<flatbuffers::Vector<int8_t>> ticket) {
+    fbb_.AddOffset(cs_body_handshake::VT_TICKET, ticket);
+  }
   explicit cs_body_handshakeBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -517,9 +678,17 @@ inline flatbuffers::Offset<cs_body_handshake> Createcs_body_handshake(
     switch_secret_t switch_type = switch_secret_t_EN_SST_DIRECT,
     flatbuffers::Offset<flatbuffers::String> crypt_type = 0,
     flatbuffers::Offset<flatbuffers::Vector<int8_t>> crypt_param = 0,
-    flatbuffers::Offset<flatbuffers::Vector<int8_t>> switch_param = 0) {
+    flatbuffers::Offset<flatbuffers::Vector<int8_t>> switch_param = 0,
+    flatbuffers::Offset<flatbuffers::String> compression_type = 0,
+    flatbuffers::Offset<flatbuffers::String> checksum_type = 0,
+    uint64_t replay_sequence = 0,
+    flatbuffers::Offset<flatbuffers::Vector<int8_t>> ticket = 0) {
   cs_body_handshakeBuilder builder_(_fbb);
+  builder_.add_replay_sequence(replay_sequence);
   builder_.add_session_id(session_id);
+  builder_.add_ticket(ticket);
+  builder_.add_checksum_type(checksum_type);
+  builder_.add_compression_type(compression_type);
   builder_.add_switch_param(switch_param);
   builder_.add_crypt_param(crypt_param);
   builder_.add_crypt_type(crypt_type);
@@ -535,7 +704,11 @@ inline flatbuffers::Offset<cs_body_handshake> Createcs_body_handshakeDirect(
     switch_secret_t switch_type = switch_secret_t_EN_SST_DIRECT,
     const char *crypt_type = nullptr,
     const std::vector<int8_t> *crypt_param = nullptr,
-    const std::vector<int8_t> *switch_param = nullptr) {
+    const std::vector<int8_t> *switch_param = nullptr,
+    const char *compression_type = nullptr,
+    const char *checksum_type = nullptr,
+    uint64_t replay_sequence = 0,
+    const std::vector<int8_t> *ticket = nullptr) {
   return atframe::gw::inner::v1::Createcs_body_handshake(
       _fbb,
       session_id,
@@ -543,7 +716,11 @@ inline flatbuffers::Offset<cs_body_handshake> Createcs_body_handshakeDirect(
       switch_type,
       crypt_type ? _fbb.CreateString(crypt_type) : 0,
       crypt_param ? _fbb.CreateVector<int8_t>(*crypt_param) : 0,
-      switch_param ? _fbb.CreateVector<int8_t>(*switch_param) : 0);
+      switch_param ? _fbb.CreateVector<int8_t>(*switch_param) : 0,
+      compression_type ? _fbb.CreateString(compression_type) : 0,
+      checksum_type ? _fbb.CreateString(checksum_type) : 0,
+      replay_sequence,
+      ticket ? _fbb.CreateVector<int8_t>(*ticket) : 0);
 }
 
 struct cs_body_ping FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
@@ -590,6 +767,106 @@ inline flatbuffers::Offset<cs_body_ping> Createcs_body_ping(
   return builder_.Finish();
 }
 
+/// resumption ticket, it's encrypted by the ticket key shared by gateways and never parsed by client
+struct cs_resume_ticket FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  enum {
+    VT_SESSION_ID = 4,
+    VT_EXPIRE = 6,
+    VT_CRYPT_TYPE = 8,
+    VT_SECRET = 10
+  };
+  uint64_t session_id() const {
+    return GetField<uint64_t>(VT_SESSION_ID, 0);
+  }
+  bool mutate_session_id(uint64_t _session_id) {
+    return SetField<uint64_t>(VT_SESSION_ID, _session_id, 0);
+  }
+  /// unix timestamp in seconds, ticket can not be used after it
+  int64_t expire() const {
+    return GetField<int64_t>(VT_EXPIRE, 0);
+  }
+  bool mutate_expire(int64_t _expire) {
+    return SetField<int64_t>(VT_EXPIRE, _expire, 0);
+  }
+  const flatbuffers::String *crypt_type() const {
+    return GetPointer<const flatbuffers::String *>(VT_CRYPT_TYPE);
+  }
+  flatbuffers::String *mutable_crypt_type() {
+    return GetPointer<flatbuffers::String *>(VT_CRYPT_TYPE);
+  }
+  const flatbuffers::Vector<int8_t> *secret() const {
+    return GetPointer<const flatbuffers::Vector<int8_t> *>(VT_SECRET);
+  }
+  flatbuffers::Vector<int8_t> *mutable_secret() {
+    return GetPointer<flatbuffers::Vector<int8_t> *>(VT_SECRET);
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyField<uint64_t>(verifier, VT_SESSION_ID) &&
+           VerifyField<int64_t>(verifier, VT_EXPIRE) &&
+           VerifyOffset(verifier, VT_CRYPT_TYPE) &&
+           verifier.VerifyString(crypt_type()) &&
+           VerifyOffset(verifier, VT_SECRET) &&
+           verifier.VerifyVector(secret()) &&
+           verifier.EndTable();
+  }
+};
+
+struct cs_resume_ticketBuilder {
+  flatbuffers::FlatBufferBuilder &fbb_;
+  flatbuffers::uoffset_t start_;
+  void add_session_id(uint64_t session_id) {
+    fbb_.AddElement<uint64_t>(cs_resume_ticket::VT_SESSION_ID, session_id, 0);
+  }
+  void add_expire(int64_t expire) {
+    fbb_.AddElement<int64_t>(cs_resume_ticket::VT_EXPIRE, expire, 0);
+  }
+  void add_crypt_type(flatbuffers::Offset<flatbuffers::String> crypt_type) {
+    fbb_.AddOffset(cs_resume_ticket::VT_CRYPT_TYPE, crypt_type);
+  }
+  void add_secret(flatbuffers::Offset<flatbuffers::Vector<int8_t>> secret) {
+    fbb_.AddOffset(cs_resume_ticket::VT_SECRET, secret);
+  }
+  explicit cs_resume_ticketBuilder(flatbuffers::FlatBufferBuilder &_fbb)
+        : fbb_(_fbb) {
+    start_ = fbb_.StartTable();
+  }
+  cs_resume_ticketBuilder &operator=(const cs_resume_ticketBuilder &);
+  flatbuffers::Offset<cs_resume_ticket> Finish() {
+    const auto end = fbb_.EndTable(start_);
+    auto o = flatbuffers::Offset<cs_resume_ticket>(end);
+    return o;
+  }
+};
+
+inline flatbuffers::Offset<cs_resume_ticket> Createcs_resume_ticket(
+    flatbuffers::FlatBufferBuilder &_fbb,
+    uint64_t session_id = 0,
+    int64_t expire = 0,
+    flatbuffers::Offset<flatbuffers::String> crypt_type = 0,
+    flatbuffers::Offset<flatbuffers::Vector<int8_t>> secret = 0) {
+  cs_resume_ticketBuilder builder_(_fbb);
+  builder_.add_expire(expire);
+  builder_.add_session_id(session_id);
+  builder_.add_secret(secret);
+  builder_.add_crypt_type(crypt_type);
+  return builder_.Finish();
+}
+
+inline flatbuffers::Offset<cs_resume_ticket> Createcs_resume_ticketDirect(
+    flatbuffers::FlatBufferBuilder &_fbb,
+    uint64_t session_id = 0,
+    int64_t expire = 0,
+    const char *crypt_type = nullptr,
+    const std::vector<int8_t> *secret = nullptr) {
+  return atframe::gw::inner::v1::Createcs_resume_ticket(
+      _fbb,
+      session_id,
+      expire,
+      crypt_type ? _fbb.CreateString(crypt_type) : 0,
+      secret ? _fbb.CreateVector<int8_t>(*secret) : 0);
+}
+
 /// message
 struct cs_msg FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   enum {
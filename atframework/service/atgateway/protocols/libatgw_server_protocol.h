@@ -22,6 +22,10 @@ enum ATFRAME_GW_SERVER_PROTOCOL_CMD {
     ATFRAME_GW_CMD_SET_ROUTER_REQ = 15,
     ATFRAME_GW_CMD_SET_ROUTER_RSP = 16,
 
+    // 多播组控制协议
+    ATFRAME_GW_CMD_GROUP_JOIN = 21,
+    ATFRAME_GW_CMD_GROUP_LEAVE = 22,
+
     ATFRAME_GW_CMD_MAX
 };
 
@@ -64,13 +68,15 @@ namespace atframe {
         struct ss_body_post {
             std::vector<uint64_t> session_ids; // 多播目标, ID: 0
             bin_data_block content;            // ID: 1
+            int32_t priority;                  // atframe::gateway::write_priority_t, ID: 2
+            uint64_t group_id;                 // 多播组, 非0时发送给组内所有session, ID: 3
 
-            ss_body_post() {
+            ss_body_post() : priority(0), group_id(0) {
                 content.size = 0;
                 content.ptr = NULL;
             }
 
-            MSGPACK_DEFINE(session_ids, content);
+            MSGPACK_DEFINE(session_ids, content, priority, group_id);
 
             template <typename CharT, typename Traits>
             friend std::basic_ostream<CharT, Traits> &operator<<(std::basic_ostream<CharT, Traits> &os, const ss_body_post &mbc) {
@@ -87,6 +93,39 @@ namespace atframe {
                 }
 
                 os << "      content: " << mbc.content << std::endl;
+                if (0 != mbc.priority) {
+                    os << "      priority: " << mbc.priority << std::endl;
+                }
+                if (0 != mbc.group_id) {
+                    os << "      group_id: " << mbc.group_id << std::endl;
+                }
+                os << "    }";
+
+                return os;
+            }
+        };
+
+        struct ss_body_group {
+            uint64_t group_id;                 // ID: 0
+            std::vector<uint64_t> session_ids; // 加入或离开的session, 为空时使用head.session_id, 都为空时离开表示解散多播组, ID: 1
+
+            ss_body_group() : group_id(0) {}
+
+            MSGPACK_DEFINE(group_id, session_ids);
+
+            template <typename CharT, typename Traits>
+            friend std::basic_ostream<CharT, Traits> &operator<<(std::basic_ostream<CharT, Traits> &os, const ss_body_group &mbc) {
+                os << "{" << std::endl << "      group_id: " << mbc.group_id << std::endl;
+                if (!mbc.session_ids.empty()) {
+                    os << "      session_ids: ";
+                    for (size_t i = 0; i < mbc.session_ids.size(); ++i) {
+                        if (0 != i) {
+                            os << ", ";
+                        }
+                        os << mbc.session_ids[i];
+                    }
+                    os << std::endl;
+                }
                 os << "    }";
 
                 return os;
@@ -97,9 +136,10 @@ namespace atframe {
         public:
             ss_body_post *post;
             ss_body_session *session;
+            ss_body_group *group;
             uint64_t router;
 
-            ss_msg_body(): post(NULL), session(NULL), router(0) {
+            ss_msg_body(): post(NULL), session(NULL), group(NULL), router(0) {
             }
             ~ss_msg_body() {
                 if (NULL != post) {
@@ -109,6 +149,10 @@ namespace atframe {
                 if (NULL != session) {
                     delete session;
                 }
+
+                if (NULL != group) {
+                    delete group;
+                }
             }
 
             template <typename TPtr>
@@ -129,6 +173,19 @@ namespace atframe {
                 ret->session_ids.clear();
                 ret->content.ptr = buffer;
                 ret->content.size = s;
+                ret->priority = 0;
+                ret->group_id = 0;
+                return ret;
+            }
+
+            ss_body_group *make_group(uint64_t group_id) {
+                ss_body_group *ret = make_body(group);
+                if (NULL == ret) {
+                    return ret;
+                }
+
+                ret->group_id = group_id;
+                ret->session_ids.clear();
                 return ret;
             }
 
@@ -155,6 +212,10 @@ namespace atframe {
                     os << "    session:" << *mb.session << std::endl;
                 }
 
+                if (NULL != mb.group) {
+                    os << "    group:" << *mb.group << std::endl;
+                }
+
                 os << "  }";
 
                 return os;
@@ -267,6 +328,12 @@ namespace msgpack {
                             break;
                         }
 
+                        case ATFRAME_GW_CMD_GROUP_JOIN:
+                        case ATFRAME_GW_CMD_GROUP_LEAVE: {
+                            body_obj.convert(*v.body.make_body(v.body.group));
+                            break;
+                        }
+
                         default: { // invalid cmd
                             break;
                         }
@@ -308,6 +375,16 @@ namespace msgpack {
                         break;
                     }
 
+                    case ATFRAME_GW_CMD_GROUP_JOIN:
+                    case ATFRAME_GW_CMD_GROUP_LEAVE: {
+                        if (NULL == v.body.group) {
+                            o.pack_nil();
+                        } else {
+                            o.pack(*v.body.group);
+                        }
+                        break;
+                    }
+
                     default: { // just cmd, body is nil
                         o.pack_nil();
                         break;
@@ -350,6 +427,16 @@ namespace msgpack {
                         break;
                     }
 
+                    case ATFRAME_GW_CMD_GROUP_JOIN:
+                    case ATFRAME_GW_CMD_GROUP_LEAVE: {
+                        if (NULL == v.body.group) {
+                            o.via.map.ptr[1].val = msgpack::object();
+                        } else {
+                            v.body.group->msgpack_object(&o.via.map.ptr[1].val, o.zone);
+                        }
+                        break;
+                    }
+
                     default: { // invalid cmd
                         o.via.map.ptr[1].val = msgpack::object();
                         break;
@@ -76,6 +76,21 @@ namespace atframe {
             *flags_ &= ~v_;
         }
 
+        proto_base::broadcast_cache_t::broadcast_cache_t(const void *buffer, size_t len, int priority)
+            : buffer_(buffer), length_(len), priority_(priority) {}
+
+        std::vector<unsigned char> &proto_base::broadcast_cache_t::get_block(const void *key, size_t key_len, bool &is_new) {
+            std::string k(reinterpret_cast<const char *>(key), key_len);
+            std::map<std::string, std::vector<unsigned char> >::iterator iter = blocks_.find(k);
+            if (blocks_.end() != iter) {
+                is_new = false;
+                return iter->second;
+            }
+
+            is_new = true;
+            return blocks_[k];
+        }
+
         proto_base::proto_base() : flags_(0), write_header_offset_(0), callbacks_(NULL), private_data_(NULL) {}
         proto_base::~proto_base() {
             if (check_flag(flag_t::EN_PFT_HANDSHAKE_UPDATE) || !check_flag(flag_t::EN_PFT_HANDSHAKE_DONE)) {
@@ -106,6 +121,13 @@ namespace atframe {
             return 0;
         }
 
+        void proto_base::cork() { set_flag(flag_t::EN_PFT_CORKED, true); }
+
+        int proto_base::uncork() {
+            set_flag(flag_t::EN_PFT_CORKED, false);
+            return 0;
+        }
+
         int proto_base::close(int reason) {
             if (check_flag(flag_t::EN_PFT_CLOSING)) {
                 return 0;
@@ -121,8 +143,17 @@ namespace atframe {
 
         bool proto_base::check_reconnect(const proto_base * /*other*/) { return false; }
 
+        void proto_base::takeover_reconnect(proto_base * /*other*/) {}
+
+        int proto_base::finish_reconnect(int /*status*/) { return error_code_t::EN_ECT_BAD_PROTOCOL; }
+
+        int proto_base::write(const void *buffer, size_t len, int /*priority*/) { return write(buffer, len); }
+
+        int proto_base::write_broadcast(broadcast_cache_t &cache) { return write(cache.get_buffer(), cache.get_length(), cache.get_priority()); }
+
         void proto_base::set_recv_buffer_limit(size_t, size_t) {}
         void proto_base::set_send_buffer_limit(size_t, size_t) {}
+        void proto_base::set_message_size_limit(size_t) {}
 
         int proto_base::handshake_done(int status) {
             bool has_handshake_done = check_flag(flag_t::EN_PFT_HANDSHAKE_DONE);
@@ -153,5 +184,7 @@ namespace atframe {
         }
 
         std::string proto_base::get_info() const { return std::string(""); }
+
+        size_t proto_base::get_memory_usage() const { return 0; }
     } // namespace gateway
 } // namespace atframe
\ No newline at end of file
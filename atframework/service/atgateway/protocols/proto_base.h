@@ -4,8 +4,11 @@
 #pragma once
 
 #include <cstddef>
+#include <map>
 #include <std/functional.h>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 namespace atframe {
     namespace gateway {
@@ -36,6 +39,7 @@ namespace atframe {
                 EN_ECT_INVALID_SIZE = -1022,
                 EN_ECT_NO_DATA = -1023,
                 EN_ECT_MALLOC = -1024,
+                EN_ECT_RECONNECT_PENDING = -1025,
                 EN_ECT_CRYPT_ALREADY_INITED = -1101,
                 EN_ECT_CRYPT_VERIFY = -1102,
                 EN_ECT_CRYPT_OPERATION = -1103,
@@ -43,6 +47,8 @@ namespace atframe {
                 EN_ECT_CRYPT_INIT_DHPARAM = -1212,
                 EN_ECT_CRYPT_READ_RSA_PUBKEY = -1221,
                 EN_ECT_CRYPT_READ_RSA_PRIKEY = -1222,
+                EN_ECT_COMPRESSION_NOT_SUPPORTED = -1301,
+                EN_ECT_COMPRESSION_OPERATION = -1302,
             };
         };
 
@@ -68,6 +74,14 @@ namespace atframe {
             };
         };
 
+        struct write_priority_t {
+            enum type {
+                EN_WPT_NORMAL = 0, // bulk data, sent by order
+                EN_WPT_URGENT = 1, // latency-sensitive data, sent before bulk data which is not being written
+                EN_WPT_MAX,
+            };
+        };
+
         class proto_base {
         public:
             /**
@@ -84,6 +98,26 @@ namespace atframe {
              */
             typedef std::function<int(proto_base *, void *, size_t, bool *)> on_write_start_fn_t;
 
+            struct write_vector_t {
+                void *buffer;  /** buffer to write, the first write_header_offset_ bytes are headspace, just like on_write_start_fn_t **/
+                size_t length; /** buffer length, should be greater than write_header_offset_ **/
+            };
+
+            /**
+             * SPECIFY: callback when write several buffers at once. the last boolean return false means async write, you must call
+             * write_done(status) when all these buffers are written.
+             * PARAMETER:
+             *   0: proto object
+             *   1: scatter list of buffers to write, the array itself is only valid during the callback
+             *   2: number of buffers in scatter list
+             *   3: output if it's already done
+             * RETURN: 0 or error code
+             * OPTIONAL
+             * PROTOCOL: if provided, custom protocol can use this instead of on_write_start_fn_t to send several queued buffers without
+             *           copying them together. headspace of every buffer is reserved, but usually only the first one is used.
+             */
+            typedef std::function<int(proto_base *, write_vector_t *, size_t, bool *)> on_writev_start_fn_t;
+
             /**
              * SPECIFY: callback when receive any custom message
              * PARAMETER:
@@ -101,7 +135,7 @@ namespace atframe {
              * SPECIFY: callback when start init a new session
              * PARAMETER:
              *   0: proto object
-             *   1: output the new session's id
+             *   1: output the new session's id, if it's not 0, it's the id of session resumed by ticket and should be kept
              * RETURN: 0 or error code
              * REQUIRED
              * PROTOCOL: any custom protocol must call this when the new connection is a new session. check_flag(flag_t::EN_PFT_IN_CALLBACK)
@@ -114,10 +148,11 @@ namespace atframe {
              * PARAMETER:
              *   0: proto object
              *   1: old session id
-             * RETURN: 0 or error code
+             * RETURN: 0 or error code, EN_ECT_RECONNECT_PENDING if the old session is owned by another thread and the result will be
+             *         passed to finish_reconnect later
              * OPTIONAL
              * PROTOCOL: if not provided, we think reconnect is not supported. check_flag(flag_t::EN_PFT_IN_CALLBACK) must
-             *           return true here
+             *           return true here. check_reconnect may still be called before finish_reconnect if it's pending
              */
             typedef std::function<int(proto_base *, uint64_t)> on_init_reconnect_fn_t;
 
@@ -160,6 +195,22 @@ namespace atframe {
              */
             typedef std::function<int(proto_base *, const char *, int, int, const char *)> on_error_fn_t;
 
+            typedef std::function<void()> async_work_fn_t;
+            typedef std::function<void(int)> async_done_fn_t;
+
+            /**
+             * SPECIFY: callback when protocol want to run heavy work(DH/ECDH and etc.) out of the event loop
+             * PARAMETER:
+             *   0: proto object
+             *   1: work to run in worker thread, it never touch the proto object
+             *   2: callback to run in the event loop thread after the work finished, parameter is 0 or error code
+             * RETURN: 0 or error code, EN_ECT_BUSY means there are too many works waiting for workers
+             * OPTIONAL
+             * PROTOCOL: if not provided, custom protocol should do the work in event loop. if 0 is returned, the done callback must be
+             *           called exactly once, even if the proto object is already destroyed, so it should not be bound to the proto object.
+             */
+            typedef std::function<int(proto_base *, async_work_fn_t, async_done_fn_t)> on_async_work_fn_t;
+
             struct tls_buffer_t {
                 enum type {
                     EN_TBT_MERGE = 0,
@@ -176,6 +227,7 @@ namespace atframe {
                     EN_PFT_CLOSING = 0x0002,
                     EN_PFT_CLOSED = 0x0004,
                     EN_PFT_IN_CALLBACK = 0x0008,
+                    EN_PFT_CORKED = 0x0010,
                     EN_PFT_HANDSHAKE_DONE = 0x0100,
                     EN_PFT_HANDSHAKE_UPDATE = 0x0200,
                 };
@@ -191,8 +243,37 @@ namespace atframe {
                 flag_guard_t &operator=(const flag_guard_t &other);
             };
 
+            /**
+             * @brief the same data written to several protocol objects, protocols can cache encoded data in it and share with others
+             * @note it should only be used in one loop, because the cached data may depend on the time when it's encoded
+             */
+            class broadcast_cache_t {
+            public:
+                broadcast_cache_t(const void *buffer, size_t len, int priority);
+
+                inline const void *get_buffer() const { return buffer_; }
+                inline size_t get_length() const { return length_; }
+                inline int get_priority() const { return priority_; }
+
+                /**
+                 * @brief find or create cached data
+                 * @param key encoding parameters, protocols with the same key can share the cached data
+                 * @param key_len length of key
+                 * @param is_new output true if it's just created, and caller should fill it
+                 * @return cached data, it's empty if caller failed to fill it
+                 */
+                std::vector<unsigned char> &get_block(const void *key, size_t key_len, bool &is_new);
+
+            private:
+                const void *buffer_;
+                size_t length_;
+                int priority_;
+                std::map<std::string, std::vector<unsigned char> > blocks_;
+            };
+
             struct proto_callbacks_t {
                 on_write_start_fn_t write_fn;
+                on_writev_start_fn_t writev_fn;
                 on_message_fn_t message_fn;
                 on_init_new_session_fn_t new_session_fn;
                 on_init_reconnect_fn_t reconnect_fn;
@@ -200,6 +281,7 @@ namespace atframe {
                 on_handshake_done_fn_t on_handshake_done_fn;
                 on_handshake_done_fn_t on_handshake_update_fn;
                 on_error_fn_t on_error_fn;
+                on_async_work_fn_t async_work_fn;
             };
 
         protected:
@@ -239,6 +321,24 @@ namespace atframe {
              */
             virtual int write(const void *buffer, size_t len) = 0;
 
+            /**
+             * @biref call this when need to write custem message to peer with priority
+             * @param buffer written buffer address
+             * @param len written buffer length
+             * @param priority write_priority_t, protocols without priority lanes just send it by order
+             * @return 0 or error code
+             */
+            virtual int write(const void *buffer, size_t len, int priority);
+
+            /**
+             * @biref call this when need to write the same message to several protocol objects
+             * @param cache data and encoded cache shared by all protocol objects, encoded data can be reused when the encoding
+             *        parameters are the same
+             * @note protocols without sharable encoding just write it like write(buffer, len, priority)
+             * @return 0 or error code
+             */
+            virtual int write_broadcast(broadcast_cache_t &cache);
+
             /**
              * @biref call this to notify protocol object last write is finished.
              * @param status written status
@@ -246,6 +346,18 @@ namespace atframe {
              */
             virtual int write_done(int status);
 
+            /**
+             * @biref hold writing, data written after this will be cached and sent together when uncork() is called
+             * @note custom protocol should not start a new writing when EN_PFT_CORKED is set, except when it's closing
+             */
+            virtual void cork();
+
+            /**
+             * @biref stop holding writing and send all cached data
+             * @return 0 or error code
+             */
+            virtual int uncork();
+
             /**
              * @biref call this to close protocol's resource.
              * @note must call set_flag(flag_t::EN_PFT_CLOSING, true), and call set_flag(flag_t::EN_PFT_CLOSED, true) only if all resource
@@ -262,6 +374,19 @@ namespace atframe {
              */
             virtual bool check_reconnect(const proto_base *other);
 
+            /**
+             * @biref call this to move data which should be kept across reconnect from the old protocol object, after check_reconnect passed
+             * @param other old protocol object
+             */
+            virtual void takeover_reconnect(proto_base *other);
+
+            /**
+             * @biref call this to finish reconnect when on_init_reconnect_fn_t returned EN_ECT_RECONNECT_PENDING
+             * @param status result of reconnect, 0 or error code
+             * @return 0 or error code
+             */
+            virtual int finish_reconnect(int status);
+
             /**
              * @biref set receive buffer limit, it's useful only if custom protocol implement this
              * @param max_size max size, 0 for umlimited
@@ -276,6 +401,13 @@ namespace atframe {
              */
             virtual void set_send_buffer_limit(size_t max_size, size_t max_number);
 
+            /**
+             * @biref set max size of a message, it's useful only if custom protocol implement this
+             * @note it's usually used when a large message is split into several fragments
+             * @param max_size max size, 0 for the protocol's default limit
+             */
+            virtual void set_message_size_limit(size_t max_size);
+
             /**
              * @biref notify handshake finished
              * @note custom protocol should call it when handshake is finished or updated no matter if it's success
@@ -301,6 +433,13 @@ namespace atframe {
             */
             virtual std::string get_info() const;
 
+            /**
+            * @biref get memory used by this protocol object, it's used to estimate the cost of every session
+            * @note it's approximate, memory allocated inside crypt or compression libraries may be not included
+            * @return bytes used, 0 if custom protocol do not implement it
+            */
+            virtual size_t get_memory_usage() const;
+
         public:
             /**
              * @biref get thread-local storage buffer limit for message encrypt/decrypt, zip/unzip and etc
@@ -23,9 +23,15 @@ namespace atframe {
         static_assert(std::is_pod<session::limit_t>::value, "session::limit_t must be a POD type");
 #endif
 
-        session::session() : id_(0), router_(0), owner_(NULL), flags_(0), peer_port_(0), private_data_(NULL) {
+        session::session()
+            : id_(0), router_(0), owner_(NULL), flags_(0), peer_port_(0), paused_alloc_cb_(NULL), paused_read_cb_(NULL), private_data_(NULL), cork_bytes_(0),
+              cork_start_(0), delayed_send_bytes_(0) {
             memset(&limit_, 0, sizeof(limit_));
             raw_handle_.data = this;
+
+            for (int i = 0; i < timer_type_t::EN_STT_MAX; ++i) {
+                timers_[i].init(this, i);
+            }
         }
 
         session::~session() { assert(check_flag(flag_t::EN_FT_CLOSING)); }
@@ -139,10 +145,10 @@ namespace atframe {
             return 0;
         }
 
-        int session::init_new_session(::atbus::node::bus_id_t router) {
+        int session::init_new_session(::atbus::node::bus_id_t router, id_t id) {
             static ::atframe::component::timestamp_id_allocator<id_t> id_alloc;
-            // alloc id
-            id_                               = id_alloc.allocate();
+            // alloc id, session resumed by ticket keep its old id
+            id_                               = 0 == id ? id_alloc.allocate() : id;
             router_                           = router;
             limit_.update_handshake_timepoint = util::time::time_utility::get_now() + owner_->get_conf().crypt.update_interval;
 
@@ -159,6 +165,11 @@ namespace atframe {
 
             private_data_ = sess.private_data_;
 
+            // messages not received by client are kept by protocol of the old session
+            if (proto_ && sess.proto_) {
+                proto_->takeover_reconnect(sess.proto_.get());
+            }
+
             set_flag(flag_t::EN_FT_INITED, true);
             set_flag(flag_t::EN_FT_REGISTERED, sess.check_flag(flag_t::EN_FT_REGISTERED));
 
@@ -277,6 +288,10 @@ namespace atframe {
             if (check_flag(flag_t::EN_FT_HAS_FD)) {
                 set_flag(flag_t::EN_FT_HAS_FD, false);
 
+                // delayed data can not be sent any more
+                delayed_sends_.clear();
+                delayed_send_bytes_ = 0;
+
                 if (proto_) {
                     proto_->close(reason);
                 }
@@ -298,7 +313,13 @@ namespace atframe {
             return 0;
         }
 
-        int session::send_to_client(const void *data, size_t len) {
+        int session::send_to_client(const void *data, size_t len, int priority) { return send_to_client(data, len, priority, NULL); }
+
+        int session::send_to_client(proto_base::broadcast_cache_t &cache) {
+            return send_to_client(cache.get_buffer(), cache.get_length(), cache.get_priority(), &cache);
+        }
+
+        int session::send_to_client(const void *data, size_t len, int priority, proto_base::broadcast_cache_t *cache) {
             // send to proto_
             if (check_flag(flag_t::EN_FT_CLOSING)) {
                 return error_code_t::EN_ECT_CLOSING;
@@ -313,23 +334,132 @@ namespace atframe {
                 return error_code_t::EN_ECT_BAD_PROTOCOL;
             }
 
+            // keep order of data, new data must wait for data delayed before
+            if (!delayed_sends_.empty()) {
+                return delay_send(data, len, priority);
+            }
+
             // send limit
-            limit_.hour_send_bytes += len;
-            limit_.minute_send_bytes += len;
+            if (!check_send_limit(len)) {
+                if (check_flag(flag_t::EN_FT_CLOSING)) {
+                    return error_code_t::EN_ECT_CLOSING;
+                }
+
+                if (session_manager::limit_action_t::EN_LAT_DELAY != owner_->get_conf().limits.action) {
+                    return error_code_t::EN_ECT_BUSY;
+                }
+
+                return delay_send(data, len, priority);
+            }
+
+            return write_to_client(data, len, priority, cache);
+        }
+
+        int session::write_to_client(const void *data, size_t len, int priority, proto_base::broadcast_cache_t *cache) {
             limit_.total_send_bytes += len;
             ++limit_.total_send_times;
-            ++limit_.hour_send_times;
-            ++limit_.minute_send_times;
 
-            int ret = proto_->write(data, len);
+            // cork writing, cached data will be sent together at the end of this loop
+            const session_manager::send_cork_conf_t *cork_conf = NULL;
+            if (NULL != owner_ && owner_->get_conf().send_cork.enable) {
+                cork_conf = &owner_->get_conf().send_cork;
+            }
+
+            if (NULL != cork_conf && !check_flag(flag_t::EN_FT_CORKED) && 0 == owner_->cork_session(shared_from_this())) {
+                set_flag(flag_t::EN_FT_CORKED, true);
+                proto_->cork();
+                cork_bytes_ = 0;
+                cork_start_ = cork_conf->max_delay > 0 ? uv_hrtime() : 0;
+            }
+
+            int ret = NULL == cache ? proto_->write(data, len, priority) : proto_->write_broadcast(*cache);
+
+            // flush if too much data cached or the first cached data is too old, but keep corked until the end of this loop
+            if (NULL != cork_conf && check_flag(flag_t::EN_FT_CORKED)) {
+                cork_bytes_ += len;
+                if ((cork_conf->max_bytes > 0 && cork_bytes_ >= cork_conf->max_bytes) ||
+                    (cork_conf->max_delay > 0 && uv_hrtime() - cork_start_ >= static_cast<uint64_t>(cork_conf->max_delay) * 1000000)) {
+                    int res = proto_->uncork();
+                    if (0 == ret) {
+                        ret = res;
+                    }
+
+                    proto_->cork();
+                    cork_bytes_ = 0;
+                    cork_start_ = cork_conf->max_delay > 0 ? uv_hrtime() : 0;
+                }
+            }
 
-            check_hour_limit(false, true);
-            check_minute_limit(false, true);
             check_total_limit(false, true);
 
             return ret;
         }
 
+        int session::delay_send(const void *data, size_t len, int priority) {
+            size_t max_size = NULL == owner_ ? 0 : owner_->get_conf().limits.send_delay_size;
+            if (max_size > 0 && delayed_send_bytes_ + len > max_size) {
+                WLOGWARNING("session 0x%llx(%s:%d) delayed send data exceeded %llu bytes and will be closed", static_cast<unsigned long long>(id_),
+                            peer_ip_.c_str(), peer_port_, static_cast<unsigned long long>(max_size));
+                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            delayed_sends_.push_back(delayed_send_t());
+            delayed_send_t &delayed = delayed_sends_.back();
+            delayed.priority        = priority;
+            delayed.data.assign(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<const unsigned char *>(data) + len);
+            delayed_send_bytes_ += len;
+
+            // the first delayed data schedules flushing, buckets are just refilled by check_send_limit()
+            if (1 == delayed_sends_.size() && NULL != owner_) {
+                owner_->schedule_send_resume(*this, get_send_wait_time(len));
+            }
+
+            return 0;
+        }
+
+        void session::flush_delayed_send(bool force) {
+            while (!delayed_sends_.empty()) {
+                if (check_flag(flag_t::EN_FT_CLOSING) || !check_flag(flag_t::EN_FT_HAS_FD) || !proto_) {
+                    delayed_sends_.clear();
+                    delayed_send_bytes_ = 0;
+                    break;
+                }
+
+                size_t len = delayed_sends_.front().data.size();
+                if (!force && !check_send_limit(len)) {
+                    if (!check_flag(flag_t::EN_FT_CLOSING) && NULL != owner_) {
+                        owner_->schedule_send_resume(*this, get_send_wait_time(len));
+                    }
+                    break;
+                }
+
+                // writing may close session and clear delayed data, so take it out first
+                delayed_send_t delayed;
+                delayed.priority = delayed_sends_.front().priority;
+                delayed.data.swap(delayed_sends_.front().data);
+                delayed_sends_.pop_front();
+                delayed_send_bytes_ -= len;
+
+                write_to_client(delayed.data.empty() ? NULL : &delayed.data[0], len, delayed.priority, NULL);
+            }
+        }
+
+        int session::flush_cork() {
+            if (!check_flag(flag_t::EN_FT_CORKED)) {
+                return 0;
+            }
+            set_flag(flag_t::EN_FT_CORKED, false);
+            cork_bytes_ = 0;
+            cork_start_ = 0;
+
+            if (!proto_) {
+                return 0;
+            }
+
+            return proto_->uncork();
+        }
+
         int session::send_to_server(::atframe::gw::ss_msg &msg) { return send_to_server(msg, owner_); }
 
         int session::send_to_server(::atframe::gw::ss_msg &msg, session_manager *mgr) {
@@ -354,22 +484,7 @@ namespace atframe {
             std::string packed_buffer;
             ss.str().swap(packed_buffer);
 
-            size_t len = packed_buffer.size();
-            // recv limit
-            limit_.hour_recv_bytes += len;
-            limit_.minute_recv_bytes += len;
-            limit_.total_recv_bytes += len;
-            ++limit_.minute_recv_times;
-            ++limit_.hour_recv_times;
-            ++limit_.total_recv_times;
-
-            int ret = mgr->post_data(router_, ::atframe::component::service_type::EN_ATST_GATEWAY, packed_buffer.data(), len);
-
-            check_hour_limit(true, false);
-            check_minute_limit(true, false);
-            check_total_limit(true, false);
-
-            return ret;
+            return mgr->post_data(router_, ::atframe::component::service_type::EN_ATST_GATEWAY, packed_buffer.data(), packed_buffer.size());
         }
 
         proto_base *      session::get_protocol_handle() { return proto_.get(); }
@@ -402,89 +517,143 @@ namespace atframe {
             delete holder;
         }
 
-        void session::check_hour_limit(bool check_recv, bool check_send) {
-            time_t now_hr = ::util::time::time_utility::get_now() / ::util::time::time_utility::DAY_SECONDS;
-            if (now_hr != limit_.hour_timepoint) {
-                limit_.hour_timepoint  = now_hr;
-                limit_.hour_recv_bytes = 0;
-                limit_.hour_send_bytes = 0;
-                limit_.hour_recv_times = 0;
-                limit_.hour_send_times = 0;
-                return;
+        bool session::check_recv_limit(size_t len) {
+            limit_.total_recv_bytes += len;
+            ++limit_.total_recv_times;
+            check_total_limit(true, false);
+
+            if (check_flag(flag_t::EN_FT_CLOSING)) {
+                return false;
             }
 
             if (NULL == owner_) {
-                return;
+                return true;
             }
 
-            if (check_flag(flag_t::EN_FT_CLOSING)) {
-                return;
+            const session_manager::client_limit_t &conf = owner_->get_conf().limits;
+            peer_limit_t *peer = peer_limit_.get();
+            if (0 == conf.recv_bytes.rate && 0 == conf.recv_times.rate && (NULL == peer || (0 == conf.peer_recv_bytes.rate && 0 == conf.peer_recv_times.rate))) {
+                return true;
             }
 
-            if (check_recv && owner_->get_conf().limits.hour_recv_bytes > 0 && limit_.hour_recv_bytes > owner_->get_conf().limits.hour_recv_bytes) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            // all buckets are refilled, so wait time can be calculated from any of them
+            uint64_t now = uv_now(owner_->get_evloop());
+            bool passed = limit_.recv_bytes.check(conf.recv_bytes, len, now);
+            passed      = limit_.recv_times.check(conf.recv_times, 1, now) && passed;
+            if (NULL != peer) {
+                passed = peer->recv_bytes.check(conf.peer_recv_bytes, len, now) && passed;
+                passed = peer->recv_times.check(conf.peer_recv_times, 1, now) && passed;
             }
 
-            if (check_recv && owner_->get_conf().limits.hour_send_bytes > 0 && limit_.hour_send_bytes > owner_->get_conf().limits.hour_send_bytes) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            if (!passed && session_manager::limit_action_t::EN_LAT_DELAY != conf.action) {
+                if (session_manager::limit_action_t::EN_LAT_KICK == conf.action) {
+                    WLOGWARNING("session 0x%llx(%s:%d) recv traffic exceeded and will be closed", static_cast<unsigned long long>(id_), peer_ip_.c_str(),
+                                peer_port_);
+                    close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+                }
+                return false;
             }
 
-            if (check_send && owner_->get_conf().limits.hour_recv_times > 0 && limit_.hour_recv_times > owner_->get_conf().limits.hour_recv_times) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            // message is always forwarded when delay, and reading is paused until overdrawn tokens are refilled
+            limit_.recv_bytes.consume(conf.recv_bytes, len);
+            limit_.recv_times.consume(conf.recv_times, 1);
+            uint64_t wait_ms = limit_.recv_bytes.get_wait_time(conf.recv_bytes);
+            uint64_t wait_times_ms = limit_.recv_times.get_wait_time(conf.recv_times);
+            if (wait_times_ms > wait_ms) {
+                wait_ms = wait_times_ms;
             }
 
-            if (check_send && owner_->get_conf().limits.hour_send_times > 0 && limit_.hour_send_times > owner_->get_conf().limits.hour_send_times) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            if (NULL != peer) {
+                peer->recv_bytes.consume(conf.peer_recv_bytes, len);
+                peer->recv_times.consume(conf.peer_recv_times, 1);
+                wait_times_ms = peer->recv_bytes.get_wait_time(conf.peer_recv_bytes);
+                if (wait_times_ms > wait_ms) {
+                    wait_ms = wait_times_ms;
+                }
+                wait_times_ms = peer->recv_times.get_wait_time(conf.peer_recv_times);
+                if (wait_times_ms > wait_ms) {
+                    wait_ms = wait_times_ms;
+                }
             }
-        }
 
-        void session::check_minute_limit(bool check_recv, bool check_send) {
-            time_t now_mi = ::util::time::time_utility::get_now() / ::util::time::time_utility::MINITE_SECONDS;
-            if (now_mi != limit_.minute_timepoint) {
-                limit_.minute_timepoint  = now_mi;
-                limit_.minute_recv_bytes = 0;
-                limit_.minute_send_bytes = 0;
-                limit_.minute_recv_times = 0;
-                limit_.minute_send_times = 0;
-                return;
+            if (wait_ms > 0) {
+                pause_read(wait_ms);
             }
+            return true;
+        }
 
+        bool session::check_send_limit(size_t len) {
             if (NULL == owner_) {
-                return;
+                return true;
             }
 
-            if (check_flag(flag_t::EN_FT_CLOSING)) {
-                return;
+            const session_manager::client_limit_t &conf = owner_->get_conf().limits;
+            if (0 == conf.send_bytes.rate && 0 == conf.send_times.rate) {
+                return true;
             }
 
-            if (check_recv && owner_->get_conf().limits.minute_recv_bytes > 0 && limit_.minute_recv_bytes > owner_->get_conf().limits.minute_recv_bytes) {
+            // refill all buckets, so wait time can be calculated from any of them
+            uint64_t now = uv_now(owner_->get_evloop());
+            bool passed  = limit_.send_bytes.check(conf.send_bytes, len, now);
+            passed       = limit_.send_times.check(conf.send_times, 1, now) && passed;
+            if (passed) {
+                limit_.send_bytes.consume(conf.send_bytes, len);
+                limit_.send_times.consume(conf.send_times, 1);
+                return true;
+            }
+
+            if (session_manager::limit_action_t::EN_LAT_KICK == conf.action) {
+                WLOGWARNING("session 0x%llx(%s:%d) send traffic exceeded and will be closed", static_cast<unsigned long long>(id_), peer_ip_.c_str(),
+                            peer_port_);
                 close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            }
+            return false;
+        }
+
+        uint64_t session::get_send_wait_time(size_t len) const {
+            if (NULL == owner_) {
+                return 0;
+            }
+
+            const session_manager::client_limit_t &conf = owner_->get_conf().limits;
+            uint64_t wait_ms                            = limit_.send_bytes.get_wait_time(conf.send_bytes, len);
+            uint64_t wait_times_ms                      = limit_.send_times.get_wait_time(conf.send_times, 1);
+            return wait_times_ms > wait_ms ? wait_times_ms : wait_ms;
+        }
+
+        void session::pause_read(uint64_t wait_ms) {
+            if (check_flag(flag_t::EN_FT_READ_PAUSED) || !check_flag(flag_t::EN_FT_HAS_FD) || NULL == owner_) {
                 return;
             }
 
-            if (check_recv && owner_->get_conf().limits.minute_recv_times > 0 && limit_.minute_recv_times > owner_->get_conf().limits.minute_recv_times) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            // uv_read_stop will reset callbacks of stream
+            paused_alloc_cb_ = stream_handle_.alloc_cb;
+            paused_read_cb_  = stream_handle_.read_cb;
+            if (NULL == paused_read_cb_ || 0 != uv_read_stop(&stream_handle_)) {
                 return;
             }
 
-            if (check_send && owner_->get_conf().limits.minute_send_bytes > 0 && limit_.minute_send_bytes > owner_->get_conf().limits.minute_send_bytes) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            set_flag(flag_t::EN_FT_READ_PAUSED, true);
+            owner_->schedule_read_resume(*this, wait_ms);
+            WLOGDEBUG("session 0x%llx(%s:%d) recv traffic exceeded, pause reading for %llu ms", static_cast<unsigned long long>(id_), peer_ip_.c_str(),
+                      peer_port_, static_cast<unsigned long long>(wait_ms));
+        }
+
+        void session::resume_read() {
+            if (!check_flag(flag_t::EN_FT_READ_PAUSED)) {
                 return;
             }
+            set_flag(flag_t::EN_FT_READ_PAUSED, false);
 
-            if (check_send && owner_->get_conf().limits.minute_send_times > 0 && limit_.minute_send_times > owner_->get_conf().limits.minute_send_times) {
-                close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
+            if (check_flag(flag_t::EN_FT_CLOSING) || !check_flag(flag_t::EN_FT_HAS_FD)) {
                 return;
             }
 
-            if (NULL != owner_ && owner_->get_conf().crypt.update_interval > 0 && check_flag(flag_t::EN_FT_HAS_FD)) {
-                if (limit_.update_handshake_timepoint < ::util::time::time_utility::get_now()) {
-                    limit_.update_handshake_timepoint = ::util::time::time_utility::get_now() + owner_->get_conf().crypt.update_interval;
-                    proto_base *proto                 = get_protocol_handle();
-                    if (NULL != proto) {
-                        proto->handshake_update();
-                    }
-                }
+            int res = uv_read_start(&stream_handle_, paused_alloc_cb_, paused_read_cb_);
+            if (0 != res) {
+                WLOGERROR("session 0x%llx(%s:%d) resume reading failed, res: %d(%s)", static_cast<unsigned long long>(id_), peer_ip_.c_str(), peer_port_, res,
+                          uv_strerror(res));
+                close(close_reason_t::EN_CRT_RESET);
             }
         }
 
@@ -497,7 +666,7 @@ namespace atframe {
                 return;
             }
 
-            if (check_recv && owner_->get_conf().limits.total_recv_bytes > 0 && limit_.total_recv_bytes > owner_->get_conf().limits.total_send_bytes) {
+            if (check_recv && owner_->get_conf().limits.total_recv_bytes > 0 && limit_.total_recv_bytes > owner_->get_conf().limits.total_recv_bytes) {
                 close(close_reason_t::EN_CRT_TRAFIC_EXTENDED);
             }
 
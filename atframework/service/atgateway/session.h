@@ -5,7 +5,9 @@
 
 #include <cstddef>
 #include <ctime>
+#include <deque>
 #include <stdint.h>
+#include <vector>
 
 
 #include "uv.h"
@@ -16,6 +18,9 @@
 #include "protocols/inner_v1/libatgw_proto_inner.h"
 #include "protocols/libatgw_server_protocol.h"
 
+#include "timer_wheel.h"
+#include "token_bucket.h"
+
 
 namespace atframe {
     namespace gateway {
@@ -25,23 +30,26 @@ namespace atframe {
             struct limit_t {
                 size_t total_recv_bytes;
                 size_t total_send_bytes;
-                size_t hour_recv_bytes;
-                size_t hour_send_bytes;
-                size_t minute_recv_bytes;
-                size_t minute_send_bytes;
-
                 size_t total_recv_times;
                 size_t total_send_times;
-                size_t hour_recv_times;
-                size_t hour_send_times;
-                size_t minute_recv_times;
-                size_t minute_send_times;
 
-                time_t hour_timepoint;
-                time_t minute_timepoint;
+                token_bucket_t recv_bytes;
+                token_bucket_t send_bytes;
+                token_bucket_t recv_times;
+                token_bucket_t send_times;
+
                 time_t update_handshake_timepoint;
             };
 
+            /**
+             * @brief limits shared by all sessions from the same peer ip in a session manager
+             */
+            struct peer_limit_t {
+                token_bucket_t recv_bytes;
+                token_bucket_t recv_times;
+            };
+            typedef std::shared_ptr<peer_limit_t> peer_limit_ptr_t;
+
             typedef uint64_t id_t;
 
             struct flag_t {
@@ -54,6 +62,17 @@ namespace atframe {
                     EN_FT_CLOSING = 0x0020,
                     EN_FT_CLOSING_FD = 0x0040,
                     EN_FT_WRITING_FD = 0x0080,
+                    EN_FT_CORKED = 0x0100,
+                    EN_FT_READ_PAUSED = 0x0200,
+                };
+            };
+
+            struct timer_type_t {
+                enum type {
+                    EN_STT_FIRST_IDLE = 0, // close session if it's not registered
+                    EN_STT_RECONNECT,      // cleanup session waiting for reconnect
+                    EN_STT_CRYPT_UPDATE,   // update crypt key
+                    EN_STT_MAX
                 };
             };
 
@@ -74,7 +93,13 @@ namespace atframe {
             int accept_tcp(uv_stream_t *server);
             int accept_pipe(uv_stream_t *server);
 
-            int init_new_session(::atbus::node::bus_id_t router);
+            /**
+             * @brief init a new session
+             * @param router default router of this session
+             * @param id session id, allocate a new one if it's 0, or use the id resumed by ticket
+             * @return 0 or error code
+             */
+            int init_new_session(::atbus::node::bus_id_t router, id_t id = 0);
 
             int init_reconnect(session &sess);
 
@@ -88,7 +113,27 @@ namespace atframe {
 
             int close_fd(int reason);
 
-            int send_to_client(const void *data, size_t len);
+            /**
+             * @brief send data to client
+             * @param priority write_priority_t, urgent data is sent before bulk data cached in protocol
+             * @return 0 or error code
+             */
+            int send_to_client(const void *data, size_t len, int priority = write_priority_t::EN_WPT_NORMAL);
+
+            /**
+             * @brief send data shared by several sessions to client
+             * @param cache data and its encoded cache, sessions with the same encoding parameters only encode it once
+             * @return 0 or error code
+             */
+            int send_to_client(proto_base::broadcast_cache_t &cache);
+
+            /**
+             * @brief send all data cached since the session is corked
+             * @note session is corked in send_to_client when send_cork is enabled, and session_manager will call this at the end of
+             *       every loop
+             * @return 0 or error code
+             */
+            int flush_cork();
 
             int send_to_server(::atframe::gw::ss_msg &msg);
 
@@ -102,7 +147,41 @@ namespace atframe {
 
             int send_new_session();
 
+            /**
+             * @brief check traffic limits of a message received from client, it's called before forwarding the message to server
+             * @note reading is paused if limit is exceeded and action is delay, or session is closed if action is kick
+             * @return true if the message can be forwarded, false if it should be dropped
+             */
+            bool check_recv_limit(size_t len);
+
+            /**
+             * @brief start reading again after paused by traffic limit
+             */
+            void resume_read();
+
+            /**
+             * @brief send data delayed by traffic limit, it's rescheduled if tokens are still not enough
+             * @param force send all delayed data without checking limits
+             */
+            void flush_delayed_send(bool force);
+
         private:
+            /**
+             * @brief send data to client, by write_broadcast of protocol if cache is not NULL
+             */
+            int send_to_client(const void *data, size_t len, int priority, proto_base::broadcast_cache_t *cache);
+
+            /**
+             * @brief write data to protocol after limits are checked
+             */
+            int write_to_client(const void *data, size_t len, int priority, proto_base::broadcast_cache_t *cache);
+
+            /**
+             * @brief keep data until tokens are refilled, session is closed if too much data is delayed
+             * @return 0 or error code
+             */
+            int delay_send(const void *data, size_t len, int priority);
+
             int send_remove_session();
 
             int send_remove_session(session_manager *mgr);
@@ -110,10 +189,26 @@ namespace atframe {
             static void on_evt_shutdown(uv_shutdown_t *req, int status);
             static void on_evt_closed(uv_handle_t *handle);
 
-            void check_hour_limit(bool check_recv, bool check_send);
-            void check_minute_limit(bool check_recv, bool check_send);
+            /**
+             * @brief check traffic limits of data sent to client
+             * @note session is closed if limit is exceeded and action is kick
+             * @return true if the data can be sent, false if it should be delayed or dropped
+             */
+            bool check_send_limit(size_t len);
+
+            /**
+             * @brief get time to wait until data of len bytes can pass send limits
+             * @return milliseconds to wait
+             */
+            uint64_t get_send_wait_time(size_t len) const;
             void check_total_limit(bool check_recv, bool check_send);
 
+            /**
+             * @brief stop reading and wait for session_manager to resume it
+             * @param wait_ms milliseconds to wait
+             */
+            void pause_read(uint64_t wait_ms);
+
         public:
             inline void *get_private_data() const { return private_data_; }
             inline void set_private_data(void *priv_data) { private_data_ = priv_data; }
@@ -124,6 +219,17 @@ namespace atframe {
             inline int32_t get_peer_port() const { return peer_port_; }
             inline session_manager *get_manager() const { return owner_; }
 
+            inline void set_peer_limit(const peer_limit_ptr_t &peer_limit) { peer_limit_ = peer_limit; }
+
+            inline time_t get_update_handshake_timepoint() const { return limit_.update_handshake_timepoint; }
+            inline void set_update_handshake_timepoint(time_t tp) { limit_.update_handshake_timepoint = tp; }
+
+            /**
+             * @brief get timer of session, all timers of session are managed by timer wheel of session_manager
+             * @note timers are canceled automatically when session is destroyed
+             */
+            inline timer_node &get_timer(timer_type_t::type t) { return timers_[t]; }
+
         private:
             id_t id_;
             ::atbus::node::bus_id_t router_;
@@ -141,9 +247,26 @@ namespace atframe {
             uv_shutdown_t shutdown_req_;
             std::string peer_ip_;
             int32_t peer_port_;
+            peer_limit_ptr_t peer_limit_; /** empty if peer limits are not used **/
+            uv_alloc_cb paused_alloc_cb_; /** read callbacks kept when reading is paused **/
+            uv_read_cb paused_read_cb_;
 
             std::unique_ptr<proto_base> proto_;
             void *private_data_;
+
+            // cork
+            size_t cork_bytes_;
+            uint64_t cork_start_; // hrtime in nanoseconds
+
+            // data delayed by send limits
+            struct delayed_send_t {
+                int priority;
+                std::vector<unsigned char> data;
+            };
+            std::deque<delayed_send_t> delayed_sends_;
+            size_t delayed_send_bytes_;
+
+            timer_node timers_[timer_type_t::EN_STT_MAX];
         };
     }
 }
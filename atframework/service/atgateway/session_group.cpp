@@ -0,0 +1,120 @@
+#include <algorithm>
+
+#include "session_group.h"
+
+namespace atframe {
+    namespace gateway {
+        session_group::session_group() {}
+
+        session_group::~session_group() { reset(); }
+
+        int session_group::join(id_t group_id, session::id_t sess_id) {
+            if (0 == group_id || 0 == sess_id) {
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            group_t &group = groups_[group_id];
+            if (false == group.members.insert(sess_id).second) {
+                return error_code_t::EN_ECT_SESSION_ALREADY_EXIST;
+            }
+            group.member_list.reset();
+
+            session_groups_[sess_id].push_back(group_id);
+            return 0;
+        }
+
+        int session_group::leave(id_t group_id, session::id_t sess_id) {
+            group_map_t::iterator iter = groups_.find(group_id);
+            if (groups_.end() == iter || 0 == iter->second.members.erase(sess_id)) {
+                return error_code_t::EN_ECT_SESSION_NOT_FOUND;
+            }
+
+            if (iter->second.members.empty()) {
+                groups_.erase(iter);
+            } else {
+                iter->second.member_list.reset();
+            }
+
+            session_group_map_t::iterator sess_iter = session_groups_.find(sess_id);
+            if (session_groups_.end() != sess_iter) {
+                std::vector<id_t> &sess_groups = sess_iter->second;
+                std::vector<id_t>::iterator group_iter = std::find(sess_groups.begin(), sess_groups.end(), group_id);
+                if (sess_groups.end() != group_iter) {
+                    // order of groups is not cared
+                    *group_iter = sess_groups.back();
+                    sess_groups.pop_back();
+                }
+
+                if (sess_groups.empty()) {
+                    session_groups_.erase(sess_iter);
+                }
+            }
+
+            return 0;
+        }
+
+        size_t session_group::remove_group(id_t group_id) {
+            group_map_t::iterator iter = groups_.find(group_id);
+            if (groups_.end() == iter) {
+                return 0;
+            }
+
+            // leave() will erase the group when the last member left
+            std::vector<session::id_t> members(iter->second.members.begin(), iter->second.members.end());
+            for (size_t i = 0; i < members.size(); ++i) {
+                leave(group_id, members[i]);
+            }
+
+            return members.size();
+        }
+
+        size_t session_group::remove_session(session::id_t sess_id) {
+            session_group_map_t::iterator sess_iter = session_groups_.find(sess_id);
+            if (session_groups_.end() == sess_iter) {
+                return 0;
+            }
+
+            std::vector<id_t> sess_groups;
+            sess_groups.swap(sess_iter->second);
+            session_groups_.erase(sess_iter);
+
+            for (size_t i = 0; i < sess_groups.size(); ++i) {
+                group_map_t::iterator iter = groups_.find(sess_groups[i]);
+                if (groups_.end() == iter) {
+                    continue;
+                }
+
+                iter->second.members.erase(sess_id);
+                if (iter->second.members.empty()) {
+                    groups_.erase(iter);
+                } else {
+                    iter->second.member_list.reset();
+                }
+            }
+
+            return sess_groups.size();
+        }
+
+        int session_group::get_members(id_t group_id, member_list_ptr_t &out) const {
+            out.reset();
+
+            group_map_t::const_iterator iter = groups_.find(group_id);
+            if (groups_.end() == iter) {
+                return error_code_t::EN_ECT_SESSION_NOT_FOUND;
+            }
+
+            // posts to the same group usually come much more than joining and leaving, so the list is rebuilt only after members changed
+            if (!iter->second.member_list) {
+                iter->second.member_list = std::make_shared<std::vector<uint64_t> >(iter->second.members.begin(), iter->second.members.end());
+            }
+
+            out = iter->second.member_list;
+            return 0;
+        }
+
+        void session_group::reset() {
+            groups_.clear();
+            session_groups_.clear();
+        }
+    }
+}
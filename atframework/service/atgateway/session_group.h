@@ -0,0 +1,83 @@
+#ifndef ATFRAME_SERVICE_ATGATEWAY_SESSION_GROUP_H
+#define ATFRAME_SERVICE_ATGATEWAY_SESSION_GROUP_H
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <std/smart_ptr.h>
+#include <vector>
+
+#include "session_manager.h"
+
+namespace atframe {
+    namespace gateway {
+        /**
+         * @brief groups of sessions maintained by servers, data posted to a group is sent to all members by gateway
+         * @note members are kept by session id, so a session is still in its groups after reconnected
+         */
+        class session_group {
+        public:
+            typedef uint64_t id_t;
+            typedef ATFRAME_GATEWAY_AUTO_SET(session::id_t) member_set_t;
+            typedef std::shared_ptr<const std::vector<uint64_t> > member_list_ptr_t;
+
+        public:
+            session_group();
+            ~session_group();
+
+            /**
+             * @brief add session into group, group is created if it does not exist
+             * @return 0 or error code
+             */
+            int join(id_t group_id, session::id_t sess_id);
+
+            /**
+             * @brief remove session from group, group is removed when it has no member
+             * @return 0 or error code
+             */
+            int leave(id_t group_id, session::id_t sess_id);
+
+            /**
+             * @brief remove group and all its members
+             * @return the number of members removed
+             */
+            size_t remove_group(id_t group_id);
+
+            /**
+             * @brief remove session from all groups, it should be called when session is removed
+             * @return the number of groups the session left
+             */
+            size_t remove_session(session::id_t sess_id);
+
+            /**
+             * @brief get all members of a group
+             * @note the list is built once and shared until members changed, it's never modified, so sessions can leave groups when sending data to them
+             * @return 0 or error code
+             */
+            int get_members(id_t group_id, member_list_ptr_t &out) const;
+
+            inline size_t size() const { return groups_.size(); }
+
+            void reset();
+
+        private:
+            session_group(const session_group &);
+            session_group &operator=(const session_group &);
+
+            struct group_t {
+                member_set_t members;
+                mutable member_list_ptr_t member_list; /** members of get_members, reset when members changed **/
+            };
+
+            typedef ATFRAME_GATEWAY_AUTO_MAP(id_t, group_t) group_map_t;
+            typedef ATFRAME_GATEWAY_AUTO_MAP(session::id_t, std::vector<id_t>) session_group_map_t;
+
+        private:
+            group_map_t groups_;
+            session_group_map_t session_groups_; /** groups of every session, used to leave all of them **/
+        };
+    }
+}
+
+#endif
@@ -1,9 +1,15 @@
+#include <cerrno>
 #include <new>
 #include <sstream>
 
 #include "uv.h"
 
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#endif
+
 #include <common/string_oprs.h>
+#include <lock/lock_holder.h>
 #include <log/log_wrapper.h>
 #include <time/time_utility.h>
 
@@ -39,9 +45,30 @@ namespace atframe {
                 stream_conn->data = NULL;
                 return real_conn;
             }
+
+            static int session_manager_set_reuse_port(uv_tcp_t *handle) {
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+                uv_os_fd_t fd;
+                int res = uv_fileno(reinterpret_cast<uv_handle_t *>(handle), &fd);
+                if (0 != res) {
+                    return res;
+                }
+
+                int opt = 1;
+                if (0 != setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+                    return uv_translate_sys_error(errno);
+                }
+                return 0;
+#else
+                return UV_ENOTSUP;
+#endif
+            }
         } // namespace detail
 
-        session_manager::session_manager() : evloop_(NULL), app_node_(NULL), last_tick_time_(0), private_data_(NULL) {}
+        session_manager::session_manager()
+            : evloop_(NULL), app_node_(NULL), last_tick_time_(0), private_data_(NULL), cork_check_(NULL), limit_resume_timer_(NULL) {
+            random_generator_.init_seed(static_cast<util::random::mt19937::result_type>(time(NULL)));
+        }
 
         session_manager::~session_manager() { reset(); }
 
@@ -53,6 +80,21 @@ namespace atframe {
                 WLOGERROR("create protocol function is required");
                 return -1;
             }
+
+            timer_wheel_.init(util::time::time_utility::get_now());
+            return 0;
+        }
+
+        int session_manager::init(uv_loop_t *evloop, create_proto_fn_t fn) {
+            evloop_ = evloop;
+            app_node_ = NULL;
+            create_proto_fn_ = fn;
+            if (!fn) {
+                WLOGERROR("create protocol function is required");
+                return -1;
+            }
+
+            timer_wheel_.init(util::time::time_utility::get_now());
             return 0;
         }
 
@@ -92,13 +134,27 @@ namespace atframe {
                         break;
                     }
 
-                    libuv_res = uv_tcp_init(evloop_, tcp_handle);
+                    if (conf_.listen.reuse_port) {
+                        // socket must be created before bind to set SO_REUSEPORT
+                        libuv_res = uv_tcp_init_ex(evloop_, tcp_handle, '4' == addr.scheme[3] ? AF_INET : AF_INET6);
+                    } else {
+                        libuv_res = uv_tcp_init(evloop_, tcp_handle);
+                    }
                     if (0 != libuv_res) {
                         WLOGERROR("init listen to %s failed, libuv_res: %d(%s)", address, libuv_res, uv_strerror(libuv_res));
                         ret = error_code_t::EN_ECT_NETWORK;
                         break;
                     }
 
+                    if (conf_.listen.reuse_port) {
+                        libuv_res = ::atframe::gateway::detail::session_manager_set_reuse_port(tcp_handle);
+                        if (0 != libuv_res) {
+                            WLOGERROR("set SO_REUSEPORT to %s failed, libuv_res: %d(%s)", address, libuv_res, uv_strerror(libuv_res));
+                            ret = error_code_t::EN_ECT_NETWORK;
+                            break;
+                        }
+                    }
+
                     if ('4' == addr.scheme[3]) {
                         sockaddr_in sock_addr;
                         uv_ip4_addr(addr.host.c_str(), addr.port, &sock_addr);
@@ -190,34 +246,63 @@ namespace atframe {
         }
 
         int session_manager::reset() {
+            // flush all corked sessions
+            std::vector<session::ptr_t> corked_sessions;
+            corked_sessions.swap(corked_sessions_);
+            for (std::vector<session::ptr_t>::iterator iter = corked_sessions.begin(); iter != corked_sessions.end(); ++iter) {
+                (*iter)->flush_cork();
+            }
+
+            // handle may be closed after this session manager is destroyed, so it's freed in close callback
+            if (NULL != cork_check_) {
+                uv_check_stop(cork_check_);
+                cork_check_->data = NULL;
+                uv_close(reinterpret_cast<uv_handle_t *>(cork_check_), on_evt_cork_check_closed);
+                cork_check_ = NULL;
+            }
+
+            limit_resume_sessions_.clear();
+            if (NULL != limit_resume_timer_) {
+                uv_timer_stop(limit_resume_timer_);
+                limit_resume_timer_->data = NULL;
+                uv_close(reinterpret_cast<uv_handle_t *>(limit_resume_timer_), on_evt_limit_resume_closed);
+                limit_resume_timer_ = NULL;
+            }
+
             // close all sessions
-            for (session_map_t::iterator iter = actived_sessions_.begin(); iter != actived_sessions_.end(); ++iter) {
+            session_map_t actived_sessions;
+            session_map_t reconnect_cache;
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                actived_sessions.swap(actived_sessions_);
+                reconnect_cache.swap(reconnect_cache_);
+            }
+            for (session_map_t::iterator iter = actived_sessions.begin(); iter != actived_sessions.end(); ++iter) {
                 if (iter->second) {
                     iter->second->close(close_reason_t::EN_CRT_SERVER_CLOSED);
                 }
             }
-            actived_sessions_.clear();
+            actived_sessions.clear();
 
-            for (std::list<session_timeout_t>::iterator iter = first_idle_.begin(); iter != first_idle_.end(); ++iter) {
-                if (iter->s) {
-                    iter->s->close(close_reason_t::EN_CRT_SERVER_CLOSED);
-                }
-            }
-            first_idle_.clear();
-
-            for (session_map_t::iterator iter = reconnect_cache_.begin(); iter != reconnect_cache_.end(); ++iter) {
+            for (session_map_t::iterator iter = reconnect_cache.begin(); iter != reconnect_cache.end(); ++iter) {
                 if (iter->second) {
                     iter->second->close(close_reason_t::EN_CRT_SERVER_CLOSED);
                 }
             }
-            reconnect_cache_.clear();
+            reconnect_cache.clear();
 
-            for (std::list<session_timeout_t>::iterator iter = reconnect_timeout_.begin(); iter != reconnect_timeout_.end(); ++iter) {
-                if (iter->s) {
-                    iter->s->close(close_reason_t::EN_CRT_SERVER_CLOSED);
+            // close sessions waiting for first idle or reconnect timeout, and cleanup all timers
+            timer_node *timer;
+            while (NULL != (timer = timer_wheel_.get_any())) {
+                int timer_type = timer->get_type();
+                session::ptr_t s = reinterpret_cast<session *>(timer->get_private_data())->shared_from_this();
+                timer->cancel();
+
+                if (session::timer_type_t::EN_STT_CRYPT_UPDATE != timer_type) {
+                    s->close(close_reason_t::EN_CRT_SERVER_CLOSED);
                 }
             }
-            reconnect_timeout_.clear();
+            peer_limits_.clear();
 
             // close all listen socks
             for (std::list<listen_handle_ptr_t>::iterator iter = listen_handles_.begin(); iter != listen_handles_.end(); ++iter) {
@@ -240,58 +325,56 @@ namespace atframe {
 
             // 每分钟打印一次统计数据
             if (last_tick_time_ / util::time::time_utility::MINITE_SECONDS != now / util::time::time_utility::MINITE_SECONDS) {
-#if defined(__cpluscplus) && __cpluscplus >= 201103L
-                // std::list 在C++11以前可能是O(n)复杂度
-                WLOGINFO("[STAT] session manager: actived session %llu, reconnect session %llu, idle timer count %llu, reconnect timer count %llu",
-                         static_cast<unsigned long long>(actived_sessions_.size()), static_cast<unsigned long long>(reconnect_cache_.size()),
-                         static_cast<unsigned long long>(first_idle_.size()), static_cast<unsigned long long>(reconnect_timeout_.size()));
-#else
-                WLOGINFO("[STAT] session manager: actived session %llu, reconnect session %llu", static_cast<unsigned long long>(actived_sessions_.size()),
-                         static_cast<unsigned long long>(reconnect_cache_.size()));
-#endif
-            }
-            last_tick_time_ = now;
-
-
-            // reconnect timeout
-            while (!reconnect_timeout_.empty()) {
-                if (reconnect_timeout_.front().timeout > now) {
-                    break;
+                size_t reconnect_number;
+                {
+                    ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                    reconnect_number = reconnect_cache_.size();
                 }
-
-                if (reconnect_timeout_.front().s) {
-                    session::ptr_t s = reconnect_timeout_.front().s;
-                    if (s->check_flag(session::flag_t::EN_FT_RECONNECTED)) {
-                        WLOGINFO("session 0x%llx(%p) reconnected, cleanup", static_cast<unsigned long long>(s->get_id()), s.get());
+                WLOGINFO("[STAT] session manager: actived session %llu, reconnect session %llu, timer count %llu",
+                         static_cast<unsigned long long>(actived_sessions_.size()), static_cast<unsigned long long>(reconnect_number),
+                         static_cast<unsigned long long>(timer_wheel_.size()));
+
+                // remove limits of peer ip without session
+                for (peer_limit_map_t::iterator iter = peer_limits_.begin(); iter != peer_limits_.end();) {
+                    if (iter->second.expired()) {
+                        iter = peer_limits_.erase(iter);
                     } else {
-                        WLOGINFO("session 0x%llx(%p) reconnect timeout, close and cleanup", static_cast<unsigned long long>(s->get_id()), s.get());
+                        ++iter;
                     }
-                    reconnect_cache_.erase(s->get_id());
-
-                    // timeout and unset EN_FT_WAIT_RECONNECT to send remove notify
-                    s->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, false);
-                    s->close_with_manager(close_reason_t::EN_CRT_LOGOUT, this);
                 }
-                reconnect_timeout_.pop_front();
             }
+            last_tick_time_ = now;
 
-            // first idle timeout
-            while (!first_idle_.empty()) {
-                if (first_idle_.front().timeout > now) {
-                    break;
-                }
+            timer_wheel_.update(now);
 
-                if (first_idle_.front().s) {
-                    session::ptr_t s = first_idle_.front().s;
+            size_t crypt_updated_count = 0;
+            timer_node *timer;
+            while (NULL != (timer = timer_wheel_.get_expired())) {
+                // sessions of timers without holder are kept by session maps, or timers will be canceled when they are destroyed
+                session::ptr_t s = reinterpret_cast<session *>(timer->get_private_data())->shared_from_this();
 
-                    if (!s->check_flag(session::flag_t::EN_FT_REGISTERED) && !s->check_flag(session::flag_t::EN_FT_CLOSING)) {
-                        WLOGINFO("session 0x%llx(%p) register timeout", static_cast<unsigned long long>(s->get_id()), s.get());
-                        s->close(close_reason_t::EN_CRT_FIRST_IDLE);
-                    }
+                switch (timer->get_type()) {
+                case session::timer_type_t::EN_STT_FIRST_IDLE:
+                    timer->cancel();
+                    on_timer_first_idle(s);
+                    break;
+                case session::timer_type_t::EN_STT_RECONNECT:
+                    timer->cancel();
+                    on_timer_reconnect(s);
+                    break;
+                case session::timer_type_t::EN_STT_CRYPT_UPDATE:
+                    // timer will be canceled or scheduled again
+                    on_timer_crypt_update(s, now, crypt_updated_count);
+                    break;
+                default:
+                    timer->cancel();
+                    break;
                 }
-                first_idle_.pop_front();
             }
 
+            if (crypt_updated_count > 0) {
+                WLOGDEBUG("session manager: %llu sessions start to update crypt key", static_cast<unsigned long long>(crypt_updated_count));
+            }
             return 0;
         }
 
@@ -300,11 +383,19 @@ namespace atframe {
             if (actived_sessions_.end() == iter) {
                 // if not allow reconnect, close reconnect cache
                 if (!allow_reconnect) {
-                    iter = reconnect_cache_.find(sess_id);
-                    if (reconnect_cache_.end() != iter) {
-                        iter->second->close(reason);
-                        iter->second->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, false);
-                        reconnect_cache_.erase(iter);
+                    session::ptr_t s;
+                    {
+                        ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                        iter = reconnect_cache_.find(sess_id);
+                        if (reconnect_cache_.end() != iter) {
+                            s = iter->second;
+                            reconnect_cache_.erase(iter);
+                        }
+                    }
+
+                    if (s) {
+                        s->close(reason);
+                        s->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, false);
                     } else {
                         return error_code_t::EN_ECT_SESSION_NOT_FOUND;
                     }
@@ -317,27 +408,61 @@ namespace atframe {
 
 
             if (conf_.reconnect_timeout > 0 && allow_reconnect) {
-                reconnect_timeout_.push_back(session_timeout_t());
-                session_timeout_t &sess_timer = reconnect_timeout_.back();
-                sess_timer.s = iter->second;
-                sess_timer.timeout = util::time::time_utility::get_now() + conf_.reconnect_timeout;
-
-                reconnect_cache_[sess_timer.s->get_id()] = sess_timer.s;
-                WLOGINFO("session 0x%llx(%p) closed and setup reconnect timeout %lld(+%lld)", static_cast<unsigned long long>(sess_timer.s->get_id()),
-                         sess_timer.s.get(), static_cast<long long>(sess_timer.timeout), static_cast<long long>(conf_.reconnect_timeout));
+                session::ptr_t s = iter->second;
+                add_reconnect_cache(s);
 
                 // maybe transfer reconnecting session, old session still keep EN_FT_WAIT_RECONNECT flag
-                sess_timer.s->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, true);
+                s->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, true);
 
                 // just close fd
-                sess_timer.s->close_fd(reason);
+                s->close_fd(reason);
             } else {
                 WLOGINFO("session 0x%llx(%p) closed and disable reconnect", static_cast<unsigned long long>(iter->second->get_id()), iter->second.get());
                 iter->second->close(reason);
             }
 
             // erase from activited map
-            actived_sessions_.erase(iter);
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                actived_sessions_.erase(iter);
+            }
+            return 0;
+        }
+
+        int session_manager::cork_session(session::ptr_t sess) {
+            if (!sess) {
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            if (NULL == evloop_) {
+                return error_code_t::EN_ECT_HANDLE_NOT_FOUND;
+            }
+
+            if (NULL == cork_check_) {
+                uv_check_t *handle = new (std::nothrow) uv_check_t();
+                if (NULL == handle) {
+                    return error_code_t::EN_ECT_MALLOC;
+                }
+
+                int libuv_res = uv_check_init(evloop_, handle);
+                if (0 != libuv_res) {
+                    WLOGERROR("init cork check handle failed, libuv_res: %d(%s)", libuv_res, uv_strerror(libuv_res));
+                    delete handle;
+                    return error_code_t::EN_ECT_NETWORK;
+                }
+                handle->data = this;
+                cork_check_  = handle;
+            }
+
+            if (corked_sessions_.empty()) {
+                int libuv_res = uv_check_start(cork_check_, on_evt_cork_check);
+                if (0 != libuv_res) {
+                    WLOGERROR("start cork check handle failed, libuv_res: %d(%s)", libuv_res, uv_strerror(libuv_res));
+                    return error_code_t::EN_ECT_NETWORK;
+                }
+            }
+
+            corked_sessions_.push_back(sess);
             return 0;
         }
 
@@ -352,10 +477,25 @@ namespace atframe {
             std::string packed_buffer;
             ss.str().swap(packed_buffer);
 
+            if (ATFRAME_GW_CMD_SESSION_REMOVE == msg.head.cmd) {
+                // the session id may be taken by a session of another manager, which decides if the remove notify is still sent
+                if (post_remove_fn_) {
+                    return post_remove_fn_(msg.head.session_id, tid, type, packed_buffer.data(), packed_buffer.size());
+                }
+
+                if (on_session_route_fn_) {
+                    on_session_route_fn_(msg.head.session_id, false);
+                }
+            }
+
             return post_data(tid, type, packed_buffer.data(), packed_buffer.size());
         }
 
         int session_manager::post_data(::atbus::node::bus_id_t tid, int type, const void *buffer, size_t s) {
+            if (post_data_fn_) {
+                return post_data_fn_(tid, type, buffer, s);
+            }
+
             // send to process
             if (!app_node_) {
                 return error_code_t::EN_ECT_HANDLE_NOT_FOUND;
@@ -364,20 +504,23 @@ namespace atframe {
             return app_node_->send_data(tid, type, buffer, s);
         }
 
-        int session_manager::push_data(session::id_t sess_id, const void *buffer, size_t s) {
+        int session_manager::push_data(session::id_t sess_id, const void *buffer, size_t s, int priority) {
             session_map_t::iterator iter = actived_sessions_.find(sess_id);
             if (actived_sessions_.end() == iter) {
                 return error_code_t::EN_ECT_SESSION_NOT_FOUND;
             }
 
-            return iter->second->send_to_client(buffer, s);
+            return iter->second->send_to_client(buffer, s, priority);
         }
 
-        int session_manager::broadcast_data(const void *buffer, size_t s) {
+        int session_manager::broadcast_data(const void *buffer, size_t s, int priority) {
             int ret = error_code_t::EN_ECT_SESSION_NOT_FOUND;
+
+            // data is encoded only once for sessions with the same encoding parameters
+            proto_base::broadcast_cache_t cache(buffer, s, priority);
             for (session_map_t::iterator iter = actived_sessions_.begin(); iter != actived_sessions_.end(); ++iter) {
                 if (iter->second->check_flag(session::flag_t::EN_FT_REGISTERED)) {
-                    int res = iter->second->send_to_client(buffer, s);
+                    int res = iter->second->send_to_client(cache);
                     if (0 != res) {
                         WLOGERROR("broadcast data to session 0x%llx failed, res: %d", static_cast<unsigned long long>(iter->first), res);
                     }
@@ -391,6 +534,29 @@ namespace atframe {
             return ret;
         }
 
+        int session_manager::multicast_data(const std::vector<uint64_t> &sess_ids, const void *buffer, size_t s, int priority, size_t &not_found_number) {
+            int ret          = 0;
+            not_found_number = 0;
+
+            // data is encoded only once for sessions with the same encoding parameters
+            proto_base::broadcast_cache_t cache(buffer, s, priority);
+            for (std::vector<uint64_t>::const_iterator id_iter = sess_ids.begin(); id_iter != sess_ids.end(); ++id_iter) {
+                session_map_t::iterator iter = actived_sessions_.find(*id_iter);
+                if (actived_sessions_.end() == iter) {
+                    ++not_found_number;
+                    continue;
+                }
+
+                int res = iter->second->send_to_client(cache);
+                if (0 != res) {
+                    WLOGERROR("multicast data to session 0x%llx failed, res: %d", static_cast<unsigned long long>(iter->first), res);
+                    ret = res;
+                }
+            }
+
+            return ret;
+        }
+
         int session_manager::set_session_router(session::id_t sess_id, ::atbus::node::bus_id_t router) {
             session_map_t::iterator iter = actived_sessions_.find(sess_id);
             if (actived_sessions_.end() == iter) {
@@ -404,10 +570,15 @@ namespace atframe {
         int session_manager::reconnect(session &new_sess, session::id_t old_sess_id) {
             // find old session
             bool has_reconnect_checked = false;
-            session_map_t::iterator iter = reconnect_cache_.find(old_sess_id);
+            bool is_waiting_reconnect;
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                is_waiting_reconnect = reconnect_cache_.end() != reconnect_cache_.find(old_sess_id);
+            }
+
             // replace the existed session, in case of the lost connection has not be detected
-            if (iter == reconnect_cache_.end()) {
-                iter = actived_sessions_.find(old_sess_id);
+            if (!is_waiting_reconnect) {
+                session_map_t::iterator iter = actived_sessions_.find(old_sess_id);
                 if (iter != actived_sessions_.end() && NULL != new_sess.get_protocol_handle() && NULL != iter->second->get_protocol_handle()) {
                     has_reconnect_checked = true;
                     if (new_sess.get_protocol_handle()->check_reconnect(iter->second->get_protocol_handle())) {
@@ -419,14 +590,175 @@ namespace atframe {
                                   new_sess.get_peer_port(), static_cast<unsigned long long>(old_sess_id), iter->second.get());
                     }
                 } else if (iter == actived_sessions_.end()) {
-                    WLOGDEBUG("old session 0x%llx not found", static_cast<unsigned long long>(old_sess_id));
+                    WLOGDEBUG("old session 0x%llx not found in this worker", static_cast<unsigned long long>(old_sess_id));
                 } else if (NULL == iter->second->get_protocol_handle()) {
                     WLOGERROR("old session 0x%llx(%p) has no protocol handle", static_cast<unsigned long long>(old_sess_id), iter->second.get());
                 }
+            }
+
+            int ret = reconnect_from_cache(new_sess, old_sess_id, has_reconnect_checked);
+            if (error_code_t::EN_ECT_SESSION_NOT_FOUND != ret) {
+                return ret;
+            }
+
+            // connection of the same client may be accepted by another worker, but the old session can only be touched in its own thread,
+            //   so it's taken out by that worker and reconnected here later
+            for (std::vector<session_manager *>::iterator iter = reconnect_peers_.begin(); iter != reconnect_peers_.end(); ++iter) {
+                if (NULL == *iter || this == *iter || !(*iter)->post_task_fn_) {
+                    continue;
+                }
+
+                {
+                    ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard((*iter)->reconnect_lock_);
+                    if ((*iter)->reconnect_cache_.end() == (*iter)->reconnect_cache_.find(old_sess_id)) {
+                        continue;
+                    }
+                }
+
+                ret = (*iter)->post_task_fn_(
+                    std::bind(&session_manager::handover_reconnect, *iter, old_sess_id, this, std::weak_ptr<session>(new_sess.shared_from_this())));
+                if (0 != ret) {
+                    WLOGERROR("session %s:%d try to reconnect 0x%llx waiting in another worker, but post task failed, res: %d",
+                              new_sess.get_peer_host().c_str(), new_sess.get_peer_port(), static_cast<unsigned long long>(old_sess_id), ret);
+                    return ret;
+                }
+
+                WLOGDEBUG("session %s:%d try to reconnect 0x%llx waiting in another worker", new_sess.get_peer_host().c_str(), new_sess.get_peer_port(),
+                          static_cast<unsigned long long>(old_sess_id));
+                return error_code_t::EN_ECT_RECONNECT_PENDING;
+            }
+
+            // the old connection accepted by another worker may be lost but not detected yet, it can not be checked here because its protocol is
+            //   only touched in that thread. it's still not found, and the session resumed by ticket will kick it off when actived
+            if (NULL != find_peer_session(old_sess_id)) {
+                WLOGDEBUG("session %s:%d try to reconnect 0x%llx still actived in another worker", new_sess.get_peer_host().c_str(),
+                          new_sess.get_peer_port(), static_cast<unsigned long long>(old_sess_id));
+            }
+
+            return error_code_t::EN_ECT_SESSION_NOT_FOUND;
+        }
+
+        void session_manager::add_reconnect_cache(const session::ptr_t &sess) {
+            time_t timeout = util::time::time_utility::get_now() + conf_.reconnect_timeout;
+            timer_wheel_.insert(sess->get_timer(session::timer_type_t::EN_STT_RECONNECT), timeout, sess);
+
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                reconnect_cache_[sess->get_id()] = sess;
+            }
+            WLOGINFO("session 0x%llx(%p) closed and setup reconnect timeout %lld(+%lld)", static_cast<unsigned long long>(sess->get_id()), sess.get(),
+                     static_cast<long long>(timeout), static_cast<long long>(conf_.reconnect_timeout));
+        }
+
+        void session_manager::handover_reconnect(session::id_t old_sess_id, session_manager *target, std::weak_ptr<session> new_sess) {
+            session::ptr_t old_sess;
+            int            ret = 0;
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                session_map_t::iterator iter = reconnect_cache_.find(old_sess_id);
+                if (iter == reconnect_cache_.end() || !iter->second || iter->second->check_flag(session::flag_t::EN_FT_RECONNECTED)) {
+                    ret = error_code_t::EN_ECT_SESSION_NOT_FOUND;
+                } else if (iter->second->check_flag(session::flag_t::EN_FT_HAS_FD)) {
+                    ret = error_code_t::EN_ECT_ALREADY_HAS_FD;
+                } else {
+                    old_sess = iter->second;
+                    reconnect_cache_.erase(iter);
+                }
+            }
+
+            // session is not in any map of this manager now, and it will be owned by target after all timers are canceled
+            if (old_sess) {
+                for (int i = 0; i < session::timer_type_t::EN_STT_MAX; ++i) {
+                    old_sess->get_timer(static_cast<session::timer_type_t::type>(i)).cancel();
+                }
+            }
+
+            int res = target->post_task_fn_(std::bind(&session_manager::finish_handover_reconnect, target, new_sess, old_sess_id, old_sess, ret));
+            if (0 != res) {
+                WLOGERROR("hand over session 0x%llx waiting for reconnect failed, res: %d", static_cast<unsigned long long>(old_sess_id), res);
+                if (old_sess) {
+                    add_reconnect_cache(old_sess);
+                }
+            }
+        }
+
+        void session_manager::finish_handover_reconnect(std::weak_ptr<session> new_sess, session::id_t old_sess_id, session::ptr_t old_sess, int status) {
+            // old session is owned by this manager now, it keeps waiting for reconnect here if the new session can not take over it
+            if (old_sess) {
+                add_reconnect_cache(old_sess);
+
+                // data to this session should be sent to this manager from now on
+                if (on_session_route_fn_) {
+                    on_session_route_fn_(old_sess->get_id(), true);
+                }
+            }
 
-                iter = reconnect_cache_.find(old_sess_id);
+            session::ptr_t sess = new_sess.lock();
+            if (!sess || sess->check_flag(session::flag_t::EN_FT_CLOSING) || NULL == sess->get_protocol_handle()) {
+                return;
+            }
+
+            if (0 == status) {
+                status = reconnect_from_cache(*sess, old_sess_id, false);
             }
 
+            if (0 == status) {
+                WLOGINFO("session %s:%d reconnect to 0x%llx waiting in another worker", sess->get_peer_host().c_str(), sess->get_peer_port(),
+                         static_cast<unsigned long long>(old_sess_id));
+            } else {
+                WLOGINFO("session %s:%d reconnect to 0x%llx waiting in another worker failed, res: %d", sess->get_peer_host().c_str(),
+                         sess->get_peer_port(), static_cast<unsigned long long>(old_sess_id), status);
+            }
+
+            sess->get_protocol_handle()->finish_reconnect(status);
+        }
+
+        session_manager *session_manager::find_peer_session(session::id_t sess_id) const {
+            for (std::vector<session_manager *>::const_iterator iter = reconnect_peers_.begin(); iter != reconnect_peers_.end(); ++iter) {
+                if (NULL != *iter && this != *iter && (*iter)->has_session(sess_id)) {
+                    return *iter;
+                }
+            }
+
+            return NULL;
+        }
+
+        bool session_manager::has_session(session::id_t sess_id) const {
+            ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+            return actived_sessions_.end() != actived_sessions_.find(sess_id) || reconnect_cache_.end() != reconnect_cache_.find(sess_id);
+        }
+
+        void session_manager::kickoff_replaced_session(session::id_t sess_id) {
+            session::ptr_t s;
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                session_map_t::iterator iter = actived_sessions_.find(sess_id);
+                if (actived_sessions_.end() != iter) {
+                    s = iter->second;
+                    actived_sessions_.erase(iter);
+                } else if (reconnect_cache_.end() != (iter = reconnect_cache_.find(sess_id))) {
+                    s = iter->second;
+                    reconnect_cache_.erase(iter);
+                }
+            }
+
+            if (!s) {
+                return;
+            }
+
+            WLOGINFO("session 0x%llx(%p) is replaced by another session with the same id, kick it off", static_cast<unsigned long long>(sess_id), s.get());
+            // the new session owns this id on server, so no remove notify is sent for the replaced one
+            s->set_flag(session::flag_t::EN_FT_RECONNECTED, true);
+            s->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, false);
+            s->get_timer(session::timer_type_t::EN_STT_RECONNECT).cancel();
+            s->close(close_reason_t::EN_CRT_KICKOFF);
+        }
+
+        int session_manager::reconnect_from_cache(session &new_sess, session::id_t old_sess_id, bool has_reconnect_checked) {
+            // reconnect_cache_ may be read by other workers, but sessions in it are only touched in this thread
+            ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+
+            session_map_t::iterator iter = reconnect_cache_.find(old_sess_id);
             if (iter == reconnect_cache_.end() || !iter->second) {
                 return error_code_t::EN_ECT_SESSION_NOT_FOUND;
             }
@@ -455,8 +787,10 @@ namespace atframe {
 
             // init with reconnect
             new_sess.init_reconnect(*iter->second);
-            // close old session
+            // close old session, it has no fd now, so nothing will be called back
             iter->second->close(close_reason_t::EN_CRT_LOGOUT);
+            // old session is replaced and need not to wait for reconnect timeout any more
+            iter->second->get_timer(session::timer_type_t::EN_STT_RECONNECT).cancel();
 
             // erase reconnect cache, this session id may reconnect again
             reconnect_cache_.erase(iter);
@@ -468,20 +802,199 @@ namespace atframe {
                 return error_code_t::EN_ECT_SESSION_NOT_FOUND;
             }
 
-            session_map_t::iterator iter = actived_sessions_.find(sess->get_id());
-            if (iter != actived_sessions_.end()) {
-                close(sess->get_id(), close_reason_t::EN_CRT_KICKOFF);
+            // session resumed by ticket keeps its old id, the old session with the same id in any worker is replaced and server should keep it
+            kickoff_replaced_session(sess->get_id());
+            for (std::vector<session_manager *>::iterator iter = reconnect_peers_.begin(); iter != reconnect_peers_.end(); ++iter) {
+                if (NULL == *iter || this == *iter || !(*iter)->post_task_fn_ || !(*iter)->has_session(sess->get_id())) {
+                    continue;
+                }
+
+                int res = (*iter)->post_task_fn_(std::bind(&session_manager::kickoff_replaced_session, *iter, sess->get_id()));
+                if (0 != res) {
+                    WLOGERROR("session 0x%llx is actived, but kick off the old one in another worker failed, res: %d",
+                              static_cast<unsigned long long>(sess->get_id()), res);
+                }
+            }
+
+            // route must be set before server get the new session and send data to it
+            if (on_session_route_fn_) {
+                on_session_route_fn_(sess->get_id(), true);
             }
 
             int ret = sess->send_new_session();
             if (ret < 0) {
+                if (on_session_route_fn_) {
+                    on_session_route_fn_(sess->get_id(), false);
+                }
                 return ret;
             }
 
-            actived_sessions_[sess->get_id()] = sess;
+            {
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                actived_sessions_[sess->get_id()] = sess;
+            }
+            // registered, actived_sessions_ will keep it from now on
+            sess->get_timer(session::timer_type_t::EN_STT_FIRST_IDLE).cancel();
+
+            // new session or reconnected session, crypt key of both are just generated
+            schedule_crypt_update(sess);
             return 0;
         }
 
+        size_t session_manager::get_memory_usage(size_t &session_number) const {
+            size_t ret     = 0;
+            session_number = 0;
+
+            ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+            const session_map_t *sess_maps[] = {&actived_sessions_, &reconnect_cache_};
+            for (size_t i = 0; i < sizeof(sess_maps) / sizeof(sess_maps[0]); ++i) {
+                for (session_map_t::const_iterator iter = sess_maps[i]->begin(); iter != sess_maps[i]->end(); ++iter) {
+                    if (!iter->second) {
+                        continue;
+                    }
+
+                    ++session_number;
+                    ret += sizeof(session);
+                    if (NULL != iter->second->get_protocol_handle()) {
+                        ret += iter->second->get_protocol_handle()->get_memory_usage();
+                    }
+                }
+            }
+
+            return ret;
+        }
+
+        size_t session_manager::get_session_number() const {
+            ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+            return actived_sessions_.size() + reconnect_cache_.size();
+        }
+
+        void session_manager::schedule_crypt_update(const session::ptr_t &sess) {
+            if (!sess || conf_.crypt.update_interval <= 0) {
+                return;
+            }
+
+            time_t tp = util::time::time_utility::get_now() + conf_.crypt.update_interval;
+            if (conf_.crypt_update.jitter > 0) {
+                tp += random_generator_.random_between<time_t>(0, conf_.crypt_update.jitter + 1);
+            }
+
+            sess->set_update_handshake_timepoint(tp);
+            // no holder, timer will be canceled when session is destroyed
+            timer_wheel_.insert(sess->get_timer(session::timer_type_t::EN_STT_CRYPT_UPDATE), tp);
+        }
+
+        void session_manager::schedule_read_resume(session &sess, uint64_t delay_ms) { schedule_limit_resume(sess, delay_ms, false); }
+
+        void session_manager::schedule_send_resume(session &sess, uint64_t delay_ms) { schedule_limit_resume(sess, delay_ms, true); }
+
+        void session_manager::schedule_limit_resume(session &sess, uint64_t delay_ms, bool is_send) {
+            // timer wheel only has one second precision, it's too long for tokens refilled every millisecond
+            if (NULL == limit_resume_timer_ && NULL != evloop_) {
+                uv_timer_t *handle = new (std::nothrow) uv_timer_t();
+                if (NULL != handle) {
+                    int libuv_res = uv_timer_init(evloop_, handle);
+                    if (0 != libuv_res) {
+                        WLOGERROR("init limit resume timer failed, libuv_res: %d(%s)", libuv_res, uv_strerror(libuv_res));
+                        delete handle;
+                    } else {
+                        handle->data        = this;
+                        limit_resume_timer_ = handle;
+                    }
+                }
+            }
+
+            // can not wait without timer, just ignore limits this time
+            if (NULL == limit_resume_timer_) {
+                if (is_send) {
+                    sess.flush_delayed_send(true);
+                } else {
+                    sess.resume_read();
+                }
+                return;
+            }
+
+            uint64_t now     = uv_now(evloop_);
+            uint64_t timeout = now + (0 == delay_ms ? 1 : delay_ms);
+            bool is_earliest = limit_resume_sessions_.empty() || timeout < limit_resume_sessions_.begin()->first;
+
+            // no holder, session is skipped if it's destroyed before resumed
+            limit_resume_t resume;
+            resume.sess    = sess.shared_from_this();
+            resume.is_send = is_send;
+            limit_resume_sessions_.insert(limit_resume_map_t::value_type(timeout, resume));
+            if (is_earliest) {
+                uv_timer_start(limit_resume_timer_, on_evt_limit_resume, timeout - now, 0);
+            }
+        }
+
+        session::peer_limit_ptr_t session_manager::get_peer_limit(const std::string &peer_ip) {
+            std::weak_ptr<session::peer_limit_t> &ref = peer_limits_[peer_ip];
+            session::peer_limit_ptr_t ret = ref.lock();
+            if (!ret) {
+                // buckets are zero initialized and filled when checked the first time
+                ret = std::make_shared<session::peer_limit_t>();
+                ref = ret;
+            }
+
+            return ret;
+        }
+
+        void session_manager::on_timer_reconnect(const session::ptr_t &sess) {
+            {
+                // this session id may be used by another session which is waiting for reconnect now
+                ::util::lock::lock_holder< ::util::lock::spin_lock> lock_guard(reconnect_lock_);
+                session_map_t::iterator iter = reconnect_cache_.find(sess->get_id());
+                if (reconnect_cache_.end() != iter && iter->second == sess) {
+                    reconnect_cache_.erase(iter);
+                }
+            }
+
+            // session is not in reconnect_cache_ now, so it will not be reconnected by other workers
+            if (sess->check_flag(session::flag_t::EN_FT_RECONNECTED)) {
+                WLOGINFO("session 0x%llx(%p) reconnected, cleanup", static_cast<unsigned long long>(sess->get_id()), sess.get());
+            } else {
+                WLOGINFO("session 0x%llx(%p) reconnect timeout, close and cleanup", static_cast<unsigned long long>(sess->get_id()), sess.get());
+            }
+
+            // timeout and unset EN_FT_WAIT_RECONNECT to send remove notify
+            sess->set_flag(session::flag_t::EN_FT_WAIT_RECONNECT, false);
+            sess->close_with_manager(close_reason_t::EN_CRT_LOGOUT, this);
+        }
+
+        void session_manager::on_timer_first_idle(const session::ptr_t &sess) {
+            if (!sess->check_flag(session::flag_t::EN_FT_REGISTERED) && !sess->check_flag(session::flag_t::EN_FT_CLOSING)) {
+                WLOGINFO("session 0x%llx(%p) register timeout", static_cast<unsigned long long>(sess->get_id()), sess.get());
+                sess->close(close_reason_t::EN_CRT_FIRST_IDLE);
+            }
+        }
+
+        void session_manager::on_timer_crypt_update(const session::ptr_t &sess, time_t now, size_t &updated_count) {
+            timer_node &timer = sess->get_timer(session::timer_type_t::EN_STT_CRYPT_UPDATE);
+
+            // session waiting for reconnect will be scheduled again after reconnected
+            if (conf_.crypt.update_interval <= 0 || sess->check_flag(session::flag_t::EN_FT_CLOSING) ||
+                !sess->check_flag(session::flag_t::EN_FT_HAS_FD)) {
+                timer.cancel();
+                return;
+            }
+
+            // sessions out of budget will be updated in next second
+            if (conf_.crypt_update.budget > 0 && updated_count >= conf_.crypt_update.budget) {
+                timer_wheel_.insert(timer, now + 1);
+                return;
+            }
+
+            timer.cancel();
+            proto_base *proto = sess->get_protocol_handle();
+            if (NULL != proto) {
+                proto->handshake_update();
+                ++updated_count;
+            }
+
+            schedule_crypt_update(sess);
+        }
+
         void session_manager::on_evt_accept_tcp(uv_stream_t *server, int status) {
             if (0 != status) {
                 WLOGERROR("accept tcp socket failed, status: %d", status);
@@ -526,6 +1039,7 @@ namespace atframe {
             // setup send buffer size
             sess->get_protocol_handle()->set_recv_buffer_limit(ATBUS_MACRO_MSG_LIMIT, 2);
             sess->get_protocol_handle()->set_send_buffer_limit(mgr->conf_.send_buffer_size, 0);
+            sess->get_protocol_handle()->set_message_size_limit(mgr->conf_.limits.message_size);
 
             // setup default router
             sess->set_router(mgr->conf_.default_router);
@@ -537,9 +1051,12 @@ namespace atframe {
                 return;
             }
 
+            if (mgr->conf_.limits.peer_recv_bytes.rate > 0 || mgr->conf_.limits.peer_recv_times.rate > 0) {
+                sess->set_peer_limit(mgr->get_peer_limit(sess->get_peer_host()));
+            }
+
             // check session number limit
-            if (mgr->conf_.limits.max_client_number > 0 &&
-                mgr->reconnect_cache_.size() + mgr->actived_sessions_.size() >= mgr->conf_.limits.max_client_number) {
+            if (mgr->conf_.limits.max_client_number > 0 && mgr->get_session_number() >= mgr->conf_.limits.max_client_number) {
 
                 WLOGWARNING("accept tcp socket failed, gateway have too many sessions now");
                 sess->close(close_reason_t::EN_CRT_SERVER_BUSY);
@@ -550,18 +1067,17 @@ namespace atframe {
                 mgr->on_create_session_fn_(sess.get(), sess->get_uv_stream());
             }
 
-            // first idle timeout
-            mgr->first_idle_.push_back(session_timeout_t());
-            session_timeout_t &sess_timeout = mgr->first_idle_.back();
-            sess_timeout.s = sess;
+            // first idle timeout, session is kept by this timer before registered
+            time_t timeout;
             if (mgr->conf_.first_idle_timeout > 0) {
-                sess_timeout.timeout = util::time::time_utility::get_now() + mgr->conf_.first_idle_timeout;
+                timeout = util::time::time_utility::get_now() + mgr->conf_.first_idle_timeout;
             } else {
-                sess_timeout.timeout = util::time::time_utility::get_now() + 1;
+                timeout = util::time::time_utility::get_now() + 1;
             }
+            mgr->timer_wheel_.insert(sess->get_timer(session::timer_type_t::EN_STT_FIRST_IDLE), timeout, sess);
             WLOGINFO("accept a tcp socket(%s:%d), create sesson %p and to wait for handshake now, expired time is %lld(+%lld)", sess->get_peer_host().c_str(),
-                     sess->get_peer_port(), sess.get(), static_cast<long long>(sess_timeout.timeout),
-                     static_cast<long long>(sess_timeout.timeout - util::time::time_utility::get_now()));
+                     sess->get_peer_port(), sess.get(), static_cast<long long>(timeout),
+                     static_cast<long long>(timeout - util::time::time_utility::get_now()));
         }
 
         void session_manager::on_evt_accept_pipe(uv_stream_t *server, int status) {
@@ -605,6 +1121,7 @@ namespace atframe {
             // setup send buffer size
             proto->set_recv_buffer_limit(ATBUS_MACRO_MSG_LIMIT, 2);
             proto->set_send_buffer_limit(mgr->conf_.send_buffer_size, 0);
+            proto->set_message_size_limit(mgr->conf_.limits.message_size);
 
             // setup default router
             sess->set_router(mgr->conf_.default_router);
@@ -616,8 +1133,7 @@ namespace atframe {
             }
 
             // check session number limit
-            if (mgr->conf_.limits.max_client_number > 0 &&
-                mgr->reconnect_cache_.size() + mgr->actived_sessions_.size() >= mgr->conf_.limits.max_client_number) {
+            if (mgr->conf_.limits.max_client_number > 0 && mgr->get_session_number() >= mgr->conf_.limits.max_client_number) {
                 sess->close(close_reason_t::EN_CRT_SERVER_BUSY);
                 return;
             }
@@ -626,17 +1142,76 @@ namespace atframe {
                 mgr->on_create_session_fn_(sess.get(), sess->get_uv_stream());
             }
 
-            // first idle timeout
-            mgr->first_idle_.push_back(session_timeout_t());
-            session_timeout_t &sess_timeout = mgr->first_idle_.back();
-            sess_timeout.s = sess;
+            // first idle timeout, session is kept by this timer before registered
+            time_t timeout;
             if (mgr->conf_.first_idle_timeout > 0) {
-                sess_timeout.timeout = util::time::time_utility::get_now() + mgr->conf_.first_idle_timeout;
+                timeout = util::time::time_utility::get_now() + mgr->conf_.first_idle_timeout;
             } else {
-                sess_timeout.timeout = util::time::time_utility::get_now() + 1;
+                timeout = util::time::time_utility::get_now() + 1;
+            }
+            mgr->timer_wheel_.insert(sess->get_timer(session::timer_type_t::EN_STT_FIRST_IDLE), timeout, sess);
+        }
+
+        void session_manager::on_evt_cork_check(uv_check_t *handle) {
+            session_manager *mgr = reinterpret_cast<session_manager *>(handle->data);
+            if (NULL == mgr) {
+                return;
+            }
+
+            // sessions may be corked again when flushing, so swap them out first
+            std::vector<session::ptr_t> corked_sessions;
+            corked_sessions.swap(mgr->corked_sessions_);
+            for (std::vector<session::ptr_t>::iterator iter = corked_sessions.begin(); iter != corked_sessions.end(); ++iter) {
+                int res = (*iter)->flush_cork();
+                if (0 != res) {
+                    WLOGERROR("flush corked session 0x%llx failed, res: %d", static_cast<unsigned long long>((*iter)->get_id()), res);
+                }
+            }
+
+            // no more corked session, stop check until next cork_session(sess)
+            if (mgr->corked_sessions_.empty()) {
+                uv_check_stop(handle);
+            }
+
+            // reuse the memory
+            corked_sessions.clear();
+            if (mgr->corked_sessions_.empty()) {
+                mgr->corked_sessions_.swap(corked_sessions);
             }
         }
 
+        void session_manager::on_evt_cork_check_closed(uv_handle_t *handle) { delete reinterpret_cast<uv_check_t *>(handle); }
+
+        void session_manager::on_evt_limit_resume(uv_timer_t *handle) {
+            session_manager *self = reinterpret_cast<session_manager *>(handle->data);
+            if (NULL == self) {
+                return;
+            }
+
+            // sessions delayed again are scheduled after now, so this loop always ends
+            uint64_t now = uv_now(self->evloop_);
+            while (!self->limit_resume_sessions_.empty() && self->limit_resume_sessions_.begin()->first <= now) {
+                session::ptr_t sess = self->limit_resume_sessions_.begin()->second.sess.lock();
+                bool is_send        = self->limit_resume_sessions_.begin()->second.is_send;
+                self->limit_resume_sessions_.erase(self->limit_resume_sessions_.begin());
+                if (!sess) {
+                    continue;
+                }
+
+                if (is_send) {
+                    sess->flush_delayed_send(false);
+                } else {
+                    sess->resume_read();
+                }
+            }
+
+            if (!self->limit_resume_sessions_.empty() && NULL != self->limit_resume_timer_) {
+                uv_timer_start(self->limit_resume_timer_, on_evt_limit_resume, self->limit_resume_sessions_.begin()->first - now, 0);
+            }
+        }
+
+        void session_manager::on_evt_limit_resume_closed(uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); }
+
         void session_manager::on_evt_listen_closed(uv_handle_t *handle) {
             // delete shared ptr
             listen_handle_ptr_t *ptr = reinterpret_cast<listen_handle_ptr_t *>(handle->data);
@@ -6,14 +6,22 @@
 #include <list>
 #include <map>
 #include <std/functional.h>
+#include <vector>
+
+#include <lock/spin_lock.h>
+#include <random/random_generator.h>
 
 #if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1600)
 #include <unordered_map>
+#include <unordered_set>
 #define ATFRAME_GATEWAY_AUTO_MAP(...) std::unordered_map<__VA_ARGS__>
+#define ATFRAME_GATEWAY_AUTO_SET(...) std::unordered_set<__VA_ARGS__>
 
 #else
 #include <map>
+#include <set>
 #define ATFRAME_GATEWAY_AUTO_MAP(...) std::map<__VA_ARGS__>
+#define ATFRAME_GATEWAY_AUTO_SET(...) std::set<__VA_ARGS__>
 #endif
 
 #include "session.h"
@@ -22,28 +30,52 @@ namespace atframe {
     namespace gateway {
         class session_manager {
         public:
+            struct limit_action_t {
+                enum type {
+                    EN_LAT_DELAY = 0, // pause reading or delay data sent to client until tokens are refilled
+                    EN_LAT_DROP,      // drop messages
+                    EN_LAT_KICK,      // close session
+                };
+            };
+
             struct client_limit_t {
                 size_t total_recv_bytes;
                 size_t total_send_bytes;
-                size_t hour_recv_bytes;
-                size_t hour_send_bytes;
-                size_t minute_recv_bytes;
-                size_t minute_send_bytes;
-
                 size_t total_recv_times;
                 size_t total_send_times;
-                size_t hour_recv_times;
-                size_t hour_send_times;
-                size_t minute_recv_times;
-                size_t minute_send_times;
 
+                // token buckets of every session
+                token_bucket_conf_t recv_bytes;
+                token_bucket_conf_t send_bytes;
+                token_bucket_conf_t recv_times;
+                token_bucket_conf_t send_times;
+                // token buckets shared by sessions from the same ip, every worker has its own buckets
+                token_bucket_conf_t peer_recv_bytes;
+                token_bucket_conf_t peer_recv_times;
+                int action; /** limit_action_t, what to do when tokens are exhausted **/
+                size_t send_delay_size; /** max bytes delayed by send limits in a session, session is closed when it's exceeded, 0 for unlimited **/
+
+                size_t message_size; /** max size of a message reassembled from fragments, 0 for the protocol's default limit **/
                 size_t max_client_number;
             };
 
+            struct send_cork_conf_t {
+                bool enable;      /** cork writing of sessions, data sent in one loop will be written together **/
+                size_t max_bytes; /** flush when cached data reach this size, 0 for unlimited **/
+                time_t max_delay; /** flush when the first cached data is older than this (milliseconds), 0 for unlimited **/
+            };
+
+            struct crypt_update_conf_t {
+                time_t jitter; /** random delay added to crypt.update_interval of every session, so they will not update together (seconds) **/
+                size_t budget; /** max number of sessions to update crypt key in one second, 0 for unlimited **/
+            };
+
             struct lister_conf_t {
                 std::vector<std::string> address;
                 std::string type;
                 int backlog;
+                bool reuse_port; /** set SO_REUSEPORT on tcp listeners, so listeners of all workers can bind the same address **/
+                size_t workers;  /** number of worker threads running sessions, 0 to run sessions in the event loop of bus node **/
             };
 
             typedef ::atframe::gateway::libatgw_proto_inner_v1::crypt_conf_t crypt_conf_t;
@@ -55,6 +87,9 @@ namespace atframe {
                 time_t reconnect_timeout;
                 time_t first_idle_timeout;
                 size_t send_buffer_size;
+                send_cork_conf_t send_cork;
+                size_t crypt_max_pending; /** max number of handshakes waiting for crypt workers, 0 to do handshake crypt in event loop **/
+                crypt_update_conf_t crypt_update;
                 ::atbus::node::bus_id_t default_router;
 
                 crypt_conf_t crypt;
@@ -63,12 +98,22 @@ namespace atframe {
             typedef ATFRAME_GATEWAY_AUTO_MAP(session::id_t, session::ptr_t) session_map_t;
             typedef std::function<std::unique_ptr< ::atframe::gateway::proto_base>()> create_proto_fn_t;
             typedef std::function<int(session *, uv_stream_t *)> on_create_session_fn_t;
+            typedef std::function<int(::atbus::node::bus_id_t, int, const void *, size_t)> post_data_fn_t;
+            typedef std::function<void(session::id_t, bool)> on_session_route_fn_t;
+            typedef std::function<int(session::id_t, ::atbus::node::bus_id_t, int, const void *, size_t)> post_remove_fn_t;
+            typedef std::function<void()> task_fn_t;
+            typedef std::function<int(task_fn_t)> post_task_fn_t;
 
         public:
             session_manager();
             ~session_manager();
 
             int init(::atbus::node *bus_node, create_proto_fn_t fn);
+            /**
+             * @brief init a session manager running in its own event loop
+             * @note post_data_fn must be set, because bus node can only be used in its own thread
+             */
+            int init(uv_loop_t *evloop, create_proto_fn_t fn);
             /**
              * @brief listen all address in configure
              * @return the number of listened address
@@ -86,8 +131,15 @@ namespace atframe {
             int post_data(::atbus::node::bus_id_t tid, int type, ::atframe::gw::ss_msg &msg);
             int post_data(::atbus::node::bus_id_t tid, int type, const void *buffer, size_t s);
 
-            int push_data(session::id_t sess_id, const void *buffer, size_t s);
-            int broadcast_data(const void *buffer, size_t s);
+            int push_data(session::id_t sess_id, const void *buffer, size_t s, int priority = write_priority_t::EN_WPT_NORMAL);
+            int broadcast_data(const void *buffer, size_t s, int priority = write_priority_t::EN_WPT_NORMAL);
+
+            /**
+             * @brief send data to several sessions, it's encoded only once for sessions with the same encoding parameters
+             * @param not_found_number output the number of sessions not found, they may be closed or waiting for reconnect
+             * @return 0 or the last error code except session not found
+             */
+            int multicast_data(const std::vector<uint64_t> &sess_ids, const void *buffer, size_t s, int priority, size_t &not_found_number);
 
             int set_session_router(session::id_t sess_id, ::atbus::node::bus_id_t router);
 
@@ -97,37 +149,182 @@ namespace atframe {
             inline on_create_session_fn_t get_on_create_session() const { return on_create_session_fn_; }
             inline void set_on_create_session(on_create_session_fn_t fn) { on_create_session_fn_ = fn; }
 
+            /**
+             * @brief set function to send data to servers instead of bus node
+             */
+            inline void set_post_data_fn(post_data_fn_t fn) { post_data_fn_ = fn; }
+
+            /**
+             * @brief set function called with (session id, true) when a session is actived and (session id, false) when it's removed
+             */
+            inline void set_on_session_route(on_session_route_fn_t fn) { on_session_route_fn_ = fn; }
+
+            /**
+             * @brief set function to send remove notify of session instead of post_data_fn, it's called with (session id, target, type, data, size)
+             * @note it should drop the notify and keep the route if the session id is routed to another manager now
+             */
+            inline void set_post_remove_fn(post_remove_fn_t fn) { post_remove_fn_ = fn; }
+
+            /**
+             * @brief set session managers of other workers, sessions waiting for reconnect in them can also be reconnected
+             * @note session managers must be alive until this is reset
+             */
+            inline void set_reconnect_peers(const std::vector<session_manager *> &peers) { reconnect_peers_ = peers; }
+
+            /**
+             * @brief set function to run task in the thread of this session manager, it can be called in any thread
+             * @note it's required to reconnect sessions waiting in other workers
+             */
+            inline void set_post_task_fn(post_task_fn_t fn) { post_task_fn_ = fn; }
+
+            inline uv_loop_t *get_evloop() const { return evloop_; }
+
+            /**
+             * @brief reconnect to session waiting for reconnect
+             * @return 0 or error code, EN_ECT_RECONNECT_PENDING if the old session is in another worker, finish_reconnect of the protocol
+             *         of new session will be called after it's taken over
+             */
             int reconnect(session &new_sess, session::id_t old_sess_id);
 
             int active_session(session::ptr_t sess);
 
+            /**
+             * @brief add session into cork list, session_manager will call session::flush_cork() at the end of current loop
+             * @return 0 or error code
+             */
+            int cork_session(session::ptr_t sess);
+
+            /**
+             * @brief resume reading of session after a delay, it's used to throttle traffic of clients
+             * @param delay_ms milliseconds to wait, it's usually the time to refill overdrawn tokens
+             */
+            void schedule_read_resume(session &sess, uint64_t delay_ms);
+
+            /**
+             * @brief flush data delayed by send limits of session after a delay
+             * @param delay_ms milliseconds to wait, it's usually the time to refill tokens of the first delayed data
+             */
+            void schedule_send_resume(session &sess, uint64_t delay_ms);
+
+            /**
+             * @brief get memory used by protocols of all sessions, sessions waiting for reconnect are included
+             * @param session_number output the number of sessions counted
+             * @return bytes used
+             */
+            size_t get_memory_usage(size_t &session_number) const;
+
         private:
+            /**
+             * @brief get the number of actived sessions and sessions waiting for reconnect
+             */
+            size_t get_session_number() const;
+
+            /**
+             * @brief get limits shared by sessions from the same peer ip, it's created if not exists
+             */
+            session::peer_limit_ptr_t get_peer_limit(const std::string &peer_ip);
+
+            void schedule_limit_resume(session &sess, uint64_t delay_ms, bool is_send);
+
             static void on_evt_accept_tcp(uv_stream_t *server, int status);
             static void on_evt_accept_pipe(uv_stream_t *server, int status);
 
             static void on_evt_listen_closed(uv_handle_t *handle);
 
-        private:
-            struct session_timeout_t {
-                time_t timeout;
-                session::ptr_t s;
-            };
+            static void on_evt_cork_check(uv_check_t *handle);
+            static void on_evt_cork_check_closed(uv_handle_t *handle);
+            static void on_evt_limit_resume(uv_timer_t *handle);
+            static void on_evt_limit_resume_closed(uv_handle_t *handle);
+
+            /**
+             * @brief schedule next crypt key update of session, after crypt.update_interval and a random jitter
+             */
+            void schedule_crypt_update(const session::ptr_t &sess);
+
+            /**
+             * @brief reconnect to session waiting for reconnect in this session manager
+             */
+            int reconnect_from_cache(session &new_sess, session::id_t old_sess_id, bool has_reconnect_checked);
+
+            /**
+             * @brief wait for reconnect in this session manager, timers of session must be all canceled
+             */
+            void add_reconnect_cache(const session::ptr_t &sess);
+
+            /**
+             * @brief take a session waiting for reconnect out of this session manager, and pass it to the target manager
+             * @note it's run in thread of this session manager, session waiting for reconnect can only be touched in its own thread
+             */
+            void handover_reconnect(session::id_t old_sess_id, session_manager *target, std::weak_ptr<session> new_sess);
+
+            /**
+             * @brief reconnect with the session passed by handover_reconnect of another worker
+             * @note it's run in thread of this session manager
+             */
+            void finish_handover_reconnect(std::weak_ptr<session> new_sess, session::id_t old_sess_id, session::ptr_t old_sess, int status);
+
+            /**
+             * @brief find the session manager of another worker which has a session with this id
+             */
+            session_manager *find_peer_session(session::id_t sess_id) const;
+
+            /**
+             * @brief check if there is an actived session or a session waiting for reconnect with this id, it can be called by other workers
+             */
+            bool has_session(session::id_t sess_id) const;
 
+            /**
+             * @brief close the session replaced by another one with the same id, without remove notify to server
+             * @note it's run in thread of this session manager
+             */
+            void kickoff_replaced_session(session::id_t sess_id);
+
+            void on_timer_reconnect(const session::ptr_t &sess);
+            void on_timer_first_idle(const session::ptr_t &sess);
+            bool on_timer_crypt_update(const session::ptr_t &sess, time_t now, size_t &updated_count);
+
+        private:
             uv_loop_t *evloop_;
             ::atbus::node *app_node_;
             conf_t conf_;
 
             create_proto_fn_t create_proto_fn_;
             on_create_session_fn_t on_create_session_fn_;
+            post_data_fn_t post_data_fn_;
+            on_session_route_fn_t on_session_route_fn_;
+            post_remove_fn_t post_remove_fn_;
+            post_task_fn_t post_task_fn_;
 
             typedef std::shared_ptr<uv_stream_t> listen_handle_ptr_t;
             std::list<listen_handle_ptr_t> listen_handles_;
             session_map_t actived_sessions_;
-            std::list<session_timeout_t> first_idle_;
             session_map_t reconnect_cache_;
-            std::list<session_timeout_t> reconnect_timeout_;
+            // actived_sessions_ and reconnect_cache_ can also be read by other workers when reconnecting, but only modified in its own thread
+            mutable ::util::lock::spin_lock reconnect_lock_;
+            std::vector<session_manager *> reconnect_peers_;
             time_t last_tick_time_;
             void *private_data_;
+
+            // cork
+            uv_check_t *cork_check_; /** allocated when the first session is corked, and freed after closed by libuv **/
+            std::vector<session::ptr_t> corked_sessions_;
+
+            // limits of peer ip, expired ones are removed every minute
+            typedef ATFRAME_GATEWAY_AUTO_MAP(std::string, std::weak_ptr<session::peer_limit_t>) peer_limit_map_t;
+            peer_limit_map_t peer_limits_;
+
+            // sessions paused reading or delayed sending by traffic limit, keyed by when to resume(uv_now, milliseconds)
+            struct limit_resume_t {
+                std::weak_ptr<session> sess;
+                bool is_send; /** flush delayed data if true, or resume reading **/
+            };
+            typedef std::multimap<uint64_t, limit_resume_t> limit_resume_map_t;
+            limit_resume_map_t limit_resume_sessions_;
+            uv_timer_t *limit_resume_timer_; /** allocated when the first session is paused, and freed after closed by libuv **/
+
+            // first idle, reconnect and crypt key update timers of all sessions
+            timer_wheel timer_wheel_;
+            util::random::mt19937 random_generator_;
         };
     }
 }
@@ -0,0 +1,219 @@
+#include <assert.h>
+#include <new>
+
+#include <log/log_wrapper.h>
+
+#include "config/atframe_service_types.h"
+
+#include "session_shard.h"
+
+namespace atframe {
+    namespace gateway {
+        task_queue::task_queue() : tail_(NULL), async_inited_(false), closed_(false) {
+            // the first node is always a stub without task
+            node_t *stub = new node_t();
+            stub->next.store(NULL);
+            head_.store(stub);
+            tail_ = stub;
+        }
+
+        task_queue::~task_queue() {
+            close();
+
+            task_fn_t fn;
+            while (pop(fn)) {
+                fn = task_fn_t();
+            }
+
+            delete tail_;
+            tail_ = NULL;
+        }
+
+        int task_queue::init(uv_loop_t *evloop) {
+            std::lock_guard<std::mutex> lock_guard(state_lock_);
+            if (closed_) {
+                return error_code_t::EN_ECT_CLOSING;
+            }
+
+            if (async_inited_) {
+                return 0;
+            }
+
+            int res = uv_async_init(evloop, &async_handle_, on_evt_async);
+            if (0 != res) {
+                return res;
+            }
+
+            async_handle_.data = this;
+            async_inited_      = true;
+
+            // wake up consumer for tasks posted before init
+            if (NULL != tail_->next.load(std::memory_order_acquire)) {
+                uv_async_send(&async_handle_);
+            }
+            return 0;
+        }
+
+        void task_queue::close() {
+            std::lock_guard<std::mutex> lock_guard(state_lock_);
+            closed_ = true;
+            if (!async_inited_) {
+                return;
+            }
+
+            // no producer is sending to the handle now, and it will never be used after this
+            async_inited_ = false;
+            uv_close(reinterpret_cast<uv_handle_t *>(&async_handle_), NULL);
+        }
+
+        int task_queue::post(task_fn_t fn) {
+            if (!fn) {
+                return error_code_t::EN_ECT_PARAM;
+            }
+
+            node_t *node = new (std::nothrow) node_t();
+            if (NULL == node) {
+                return error_code_t::EN_ECT_MALLOC;
+            }
+            node->next.store(NULL, std::memory_order_relaxed);
+            node->fn.swap(fn);
+
+            {
+                // task must not be pushed after close, or it will be dropped silently
+                std::lock_guard<std::mutex> lock_guard(state_lock_);
+                if (!closed_) {
+                    // consumer will stop at prev until next is set, and it will be waked up again by uv_async_send
+                    node_t *prev = head_.exchange(node, std::memory_order_acq_rel);
+                    prev->next.store(node, std::memory_order_release);
+
+                    if (async_inited_) {
+                        uv_async_send(&async_handle_);
+                    }
+                    return 0;
+                }
+            }
+
+            // task is released out of lock, it may hold anything
+            delete node;
+            return error_code_t::EN_ECT_CLOSING;
+        }
+
+        size_t task_queue::run() {
+            size_t ret = 0;
+            task_fn_t fn;
+            while (pop(fn)) {
+                fn();
+                fn = task_fn_t();
+                ++ret;
+            }
+
+            return ret;
+        }
+
+        void task_queue::on_evt_async(uv_async_t *handle) {
+            task_queue *self = reinterpret_cast<task_queue *>(handle->data);
+            assert(self);
+            self->run();
+        }
+
+        bool task_queue::pop(task_fn_t &fn) {
+            node_t *tail = tail_;
+            node_t *next = tail->next.load(std::memory_order_acquire);
+            if (NULL == next) {
+                return false;
+            }
+
+            // next become the new stub
+            fn.swap(next->fn);
+            tail_ = next;
+            delete tail;
+            return true;
+        }
+
+        session_shard::session_shard(size_t index) : index_(index), loop_inited_(false) {}
+
+        session_shard::~session_shard() { stop(); }
+
+        int session_shard::init() {
+            if (loop_inited_) {
+                return 0;
+            }
+
+            int res = uv_loop_init(&evloop_);
+            if (0 != res) {
+                WLOGERROR("worker %llu init event loop failed, res: %d(%s)", static_cast<unsigned long long>(index_), res, uv_strerror(res));
+                return error_code_t::EN_ECT_NETWORK;
+            }
+            loop_inited_ = true;
+
+            uv_timer_init(&evloop_, &tick_timer_);
+            tick_timer_.data = this;
+
+            res = tasks_.init(&evloop_);
+            if (0 != res) {
+                WLOGERROR("worker %llu init task queue failed, res: %d(%s)", static_cast<unsigned long long>(index_), res, uv_strerror(res));
+                return error_code_t::EN_ECT_NETWORK;
+            }
+            return 0;
+        }
+
+        int session_shard::start() {
+            if (!loop_inited_) {
+                return error_code_t::EN_ECT_HANDLE_NOT_FOUND;
+            }
+
+            int ret = mgr_.listen_all();
+            if (ret <= 0) {
+                return ret;
+            }
+
+            // session manager only check timers once a second, so it's enough to tick several times a second
+            uv_timer_start(&tick_timer_, on_evt_tick, 100, 100);
+            thread_ = std::thread(&session_shard::run, this);
+            return ret;
+        }
+
+        void session_shard::stop() {
+            if (!loop_inited_) {
+                return;
+            }
+
+            if (thread_.joinable()) {
+                post(std::bind(&session_shard::do_stop, this));
+                thread_.join();
+            } else {
+                do_stop();
+                // wait for all handles closed
+                uv_run(&evloop_, UV_RUN_DEFAULT);
+            }
+
+            int res = uv_loop_close(&evloop_);
+            if (0 != res) {
+                WLOGERROR("worker %llu close event loop failed, res: %d(%s)", static_cast<unsigned long long>(index_), res, uv_strerror(res));
+            }
+            loop_inited_ = false;
+        }
+
+        int session_shard::post(task_fn_t fn) { return tasks_.post(fn); }
+
+        void session_shard::on_evt_tick(uv_timer_t *handle) {
+            session_shard *self = reinterpret_cast<session_shard *>(handle->data);
+            assert(self);
+            self->mgr_.tick();
+        }
+
+        void session_shard::run() {
+            WLOGINFO("worker %llu start", static_cast<unsigned long long>(index_));
+            uv_run(&evloop_, UV_RUN_DEFAULT);
+            WLOGINFO("worker %llu stop", static_cast<unsigned long long>(index_));
+        }
+
+        void session_shard::do_stop() {
+            mgr_.reset();
+
+            uv_timer_stop(&tick_timer_);
+            uv_close(reinterpret_cast<uv_handle_t *>(&tick_timer_), NULL);
+            tasks_.close();
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef ATFRAME_SERVICE_ATGATEWAY_SESSION_SHARD_H
+#define ATFRAME_SERVICE_ATGATEWAY_SESSION_SHARD_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <std/functional.h>
+#include <thread>
+
+#include "uv.h"
+
+#include "session_manager.h"
+
+namespace atframe {
+    namespace gateway {
+        /**
+         * @brief multi-producer single-consumer queue of tasks, consumer is waked up by uv_async_t
+         * @note consumer pops tasks without lock, producers are serialized with close() so no task is accepted after it's closed
+         */
+        class task_queue {
+        public:
+            typedef std::function<void()> task_fn_t;
+
+        public:
+            task_queue();
+            ~task_queue();
+
+            /**
+             * @brief init async handle in event loop of consumer
+             * @param evloop event loop running tasks
+             * @return 0 or libuv error code
+             */
+            int init(uv_loop_t *evloop);
+
+            /**
+             * @brief close async handle, it can only be called in thread of consumer
+             * @note tasks posted before it are still run by run(), and post() will fail after it
+             */
+            void close();
+
+            /**
+             * @brief push a task, it can be called in any thread
+             * @return 0 or error code, EN_ECT_CLOSING if it's already closed and the task will never run
+             */
+            int post(task_fn_t fn);
+
+            /**
+             * @brief run all tasks in queue, it can only be called in thread of consumer
+             * @return the number of tasks run
+             */
+            size_t run();
+
+        private:
+            task_queue(const task_queue &);
+            task_queue &operator=(const task_queue &);
+
+            static void on_evt_async(uv_async_t *handle);
+
+            bool pop(task_fn_t &fn);
+
+            struct node_t {
+                std::atomic<node_t *> next;
+                task_fn_t fn;
+            };
+
+            std::atomic<node_t *> head_; /** last pushed node, changed by producers **/
+            node_t *tail_;               /** node before the first task, changed by consumer **/
+            uv_async_t async_handle_;
+            std::mutex state_lock_; /** guard async_handle_ and states below between producers and close() **/
+            bool async_inited_;
+            bool closed_;
+        };
+
+        /**
+         * @brief sessions of one worker thread, which has its own event loop and session manager
+         */
+        class session_shard {
+        public:
+            typedef task_queue::task_fn_t task_fn_t;
+
+        public:
+            explicit session_shard(size_t index);
+            ~session_shard();
+
+            /**
+             * @brief init event loop of this worker, session manager should be set up after this
+             * @return 0 or error code
+             */
+            int init();
+
+            /**
+             * @brief listen all address and run event loop in a new thread
+             * @return the number of listened address
+             */
+            int start();
+
+            /**
+             * @brief close all sessions and wait for the worker thread
+             */
+            void stop();
+
+            /**
+             * @brief run task in worker thread, it can be called in any thread
+             * @return 0 or error code
+             */
+            int post(task_fn_t fn);
+
+            inline size_t get_index() const { return index_; }
+            inline uv_loop_t *get_evloop() { return &evloop_; }
+            inline session_manager &get_session_manager() { return mgr_; }
+            inline const session_manager &get_session_manager() const { return mgr_; }
+
+        private:
+            session_shard(const session_shard &);
+            session_shard &operator=(const session_shard &);
+
+            static void on_evt_tick(uv_timer_t *handle);
+            void run();
+            void do_stop();
+
+        private:
+            size_t index_;
+            bool loop_inited_;
+            uv_loop_t evloop_;
+            uv_timer_t tick_timer_;
+            task_queue tasks_;
+            session_manager mgr_;
+            std::thread thread_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,200 @@
+#include <assert.h>
+
+#include "timer_wheel.h"
+
+namespace atframe {
+    namespace gateway {
+        timer_node::timer_node() : owner_(NULL), timeout_(0), private_data_(NULL), type_(0) {
+            prev = NULL;
+            next = NULL;
+        }
+
+        timer_node::~timer_node() { cancel(); }
+
+        void timer_node::init(void *private_data, int type) {
+            private_data_ = private_data;
+            type_ = type;
+        }
+
+        void timer_node::cancel() {
+            if (NULL == owner_) {
+                return;
+            }
+
+            // holder must be released after unlinked, because this node may be destroyed with it
+            std::shared_ptr<void> holder;
+            holder.swap(holder_);
+            owner_->remove_node(*this);
+        }
+
+        timer_wheel::timer_wheel() : now_(0), size_(0) {
+            for (size_t i = 0; i < LEVEL0_SIZE; ++i) {
+                link_init(&level0_[i]);
+            }
+
+            for (size_t i = 0; i < LEVELN_COUNT; ++i) {
+                for (size_t j = 0; j < LEVELN_SIZE; ++j) {
+                    link_init(&leveln_[i][j]);
+                }
+            }
+
+            link_init(&expired_);
+        }
+
+        timer_wheel::~timer_wheel() { reset(); }
+
+        void timer_wheel::init(time_t now) {
+            reset();
+            now_ = now;
+        }
+
+        void timer_wheel::insert(timer_node &node, time_t timeout, const std::shared_ptr<void> &holder) {
+            // old holder may be the last reference of node, release it after node is linked again
+            std::shared_ptr<void> old_holder;
+            old_holder.swap(node.holder_);
+            if (NULL != node.owner_) {
+                node.owner_->remove_node(node);
+            }
+
+            node.holder_ = holder;
+            node.timeout_ = timeout;
+            node.owner_ = this;
+            add_node(node);
+            ++size_;
+        }
+
+        void timer_wheel::update(time_t now) {
+            while (now_ <= now) {
+                size_t index = static_cast<size_t>(now_) & (LEVEL0_SIZE - 1);
+
+                // cascade timers of upper levels when level 0 wraps
+                if (0 == index) {
+                    for (size_t level = 0; level < LEVELN_COUNT; ++level) {
+                        if (0 != cascade(level, static_cast<size_t>(now_ >> (LEVEL0_BITS + level * LEVELN_BITS)) & (LEVELN_SIZE - 1))) {
+                            break;
+                        }
+                    }
+                }
+
+                link_splice(&level0_[index], &expired_);
+                ++now_;
+            }
+        }
+
+        timer_node *timer_wheel::get_expired() {
+            if (link_empty(&expired_)) {
+                return NULL;
+            }
+
+            return static_cast<timer_node *>(expired_.next);
+        }
+
+        timer_node *timer_wheel::get_any() {
+            if (link_empty(&expired_)) {
+                // move all timers into expired list, so that the next call will be O(1)
+                for (size_t i = 0; i < LEVEL0_SIZE; ++i) {
+                    link_splice(&level0_[i], &expired_);
+                }
+
+                for (size_t i = 0; i < LEVELN_COUNT; ++i) {
+                    for (size_t j = 0; j < LEVELN_SIZE; ++j) {
+                        link_splice(&leveln_[i][j], &expired_);
+                    }
+                }
+            }
+
+            return get_expired();
+        }
+
+        void timer_wheel::reset() {
+            timer_node *node;
+            while (NULL != (node = get_any())) {
+                node->cancel();
+            }
+
+            assert(0 == size_);
+        }
+
+        void timer_wheel::link_init(detail::timer_link_t *head) {
+            head->prev = head;
+            head->next = head;
+        }
+
+        void timer_wheel::link_add(detail::timer_link_t *head, detail::timer_link_t *node) {
+            node->prev = head->prev;
+            node->next = head;
+            head->prev->next = node;
+            head->prev = node;
+        }
+
+        void timer_wheel::link_remove(detail::timer_link_t *node) {
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            node->prev = NULL;
+            node->next = NULL;
+        }
+
+        void timer_wheel::link_splice(detail::timer_link_t *from, detail::timer_link_t *to) {
+            if (link_empty(from)) {
+                return;
+            }
+
+            from->next->prev = to->prev;
+            to->prev->next = from->next;
+            from->prev->next = to;
+            to->prev = from->prev;
+
+            link_init(from);
+        }
+
+        void timer_wheel::add_node(timer_node &node) {
+            if (node.timeout_ < now_) {
+                link_add(&expired_, &node);
+                return;
+            }
+
+            time_t expires = node.timeout_;
+            time_t delta = expires - now_;
+            if (delta < LEVEL0_SIZE) {
+                link_add(&level0_[static_cast<size_t>(expires) & (LEVEL0_SIZE - 1)], &node);
+                return;
+            }
+
+            // too far, put it into the last slot it can reach and it will be cascaded into last level again
+            if (delta >= MAX_RANGE) {
+                expires = now_ + MAX_RANGE - 1;
+                delta = MAX_RANGE - 1;
+            }
+
+            for (size_t level = 0; level < LEVELN_COUNT; ++level) {
+                size_t shift = LEVEL0_BITS + (level + 1) * LEVELN_BITS;
+                if (level + 1 == LEVELN_COUNT || delta < (static_cast<time_t>(1) << shift)) {
+                    size_t index = static_cast<size_t>(expires >> (shift - LEVELN_BITS)) & (LEVELN_SIZE - 1);
+                    link_add(&leveln_[level][index], &node);
+                    return;
+                }
+            }
+        }
+
+        void timer_wheel::remove_node(timer_node &node) {
+            assert(this == node.owner_);
+            link_remove(&node);
+            node.owner_ = NULL;
+            --size_;
+        }
+
+        size_t timer_wheel::cascade(size_t level, size_t index) {
+            detail::timer_link_t cascading;
+            link_init(&cascading);
+            link_splice(&leveln_[level][index], &cascading);
+
+            while (!link_empty(&cascading)) {
+                timer_node *node = static_cast<timer_node *>(cascading.next);
+                link_remove(node);
+                add_node(*node);
+            }
+
+            return index;
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#ifndef ATFRAME_SERVICE_ATGATEWAY_TIMER_WHEEL_H
+#define ATFRAME_SERVICE_ATGATEWAY_TIMER_WHEEL_H
+
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+
+#include <std/smart_ptr.h>
+
+namespace atframe {
+    namespace gateway {
+        class timer_wheel;
+
+        namespace detail {
+            struct timer_link_t {
+                timer_link_t *prev;
+                timer_link_t *next;
+            };
+        }
+
+        /**
+         * @brief intrusive timer node, it's usually a member of the object it's waiting for
+         * @note node is unlinked automatically when destroyed, so the owner object need not cancel it before destroy
+         */
+        class timer_node : private detail::timer_link_t {
+        public:
+            timer_node();
+            ~timer_node();
+
+            /**
+             * @brief set data passed back to the handle of expired timers
+             * @param private_data private data, usually the owner object
+             * @param type timer type, used to dispatch expired timers
+             */
+            void init(void *private_data, int type);
+
+            inline bool is_linked() const { return NULL != owner_; }
+            inline time_t get_timeout() const { return timeout_; }
+            inline void *get_private_data() const { return private_data_; }
+            inline int get_type() const { return type_; }
+
+            /**
+             * @brief remove from timer wheel and release the holder, O(1)
+             * @note this node and its owner may be destroyed after cancel if the holder is the last reference
+             */
+            void cancel();
+
+        private:
+            timer_node(const timer_node &);
+            timer_node &operator=(const timer_node &);
+
+            friend class timer_wheel;
+
+            timer_wheel *owner_;
+            time_t timeout_;
+            void *private_data_;
+            int type_;
+            std::shared_ptr<void> holder_; /** keep owner object alive while waiting, can be empty **/
+        };
+
+        /**
+         * @brief hierarchical timer wheel with one second precision
+         * @note insert and cancel are O(1), timers are cascaded to lower levels at most 3 times
+         */
+        class timer_wheel {
+        public:
+            enum {
+                LEVEL0_BITS = 8,
+                LEVELN_BITS = 6,
+                LEVELN_COUNT = 3,
+                LEVEL0_SIZE = 1 << LEVEL0_BITS,
+                LEVELN_SIZE = 1 << LEVELN_BITS,
+                /** timers later than this will be put into the last level and cascaded again when it's reached **/
+                MAX_RANGE = 1 << (LEVEL0_BITS + LEVELN_BITS * LEVELN_COUNT),
+            };
+
+        public:
+            timer_wheel();
+            ~timer_wheel();
+
+            /**
+             * @brief reset all timers and set current time
+             * @param now current time
+             */
+            void init(time_t now);
+
+            /**
+             * @brief add timer or reschedule it if it's already in a wheel
+             * @param node timer node
+             * @param timeout expired time
+             * @param holder object kept alive until timer expired or canceled
+             */
+            void insert(timer_node &node, time_t timeout, const std::shared_ptr<void> &holder = std::shared_ptr<void>());
+
+            /**
+             * @brief move timers expired before or at now to expired list
+             * @param now current time
+             */
+            void update(time_t now);
+
+            /**
+             * @brief get first expired timer
+             * @note caller must cancel or insert it again, or this will return the same timer
+             * @return first expired timer, NULL if no more
+             */
+            timer_node *get_expired();
+
+            /**
+             * @brief get any timer in this wheel, used to cleanup all timers
+             * @return any timer, NULL if empty
+             */
+            timer_node *get_any();
+
+            inline size_t size() const { return size_; }
+
+            /**
+             * @brief remove all timers
+             */
+            void reset();
+
+        private:
+            timer_wheel(const timer_wheel &);
+            timer_wheel &operator=(const timer_wheel &);
+
+            friend class timer_node;
+
+            static void link_init(detail::timer_link_t *head);
+            static void link_add(detail::timer_link_t *head, detail::timer_link_t *node);
+            static void link_remove(detail::timer_link_t *node);
+            static void link_splice(detail::timer_link_t *from, detail::timer_link_t *to);
+            static inline bool link_empty(const detail::timer_link_t *head) { return head->next == head; }
+
+            void add_node(timer_node &node);
+            void remove_node(timer_node &node);
+            size_t cascade(size_t level, size_t index);
+
+        private:
+            time_t now_; /** next second to be processed **/
+            size_t size_;
+            detail::timer_link_t level0_[LEVEL0_SIZE];
+            detail::timer_link_t leveln_[LEVELN_COUNT][LEVELN_SIZE];
+            detail::timer_link_t expired_;
+        };
+    }
+}
+
+#endif
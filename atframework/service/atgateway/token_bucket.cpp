@@ -0,0 +1,69 @@
+#include "token_bucket.h"
+
+namespace atframe {
+    namespace gateway {
+        bool token_bucket_t::check(const token_bucket_conf_t &conf, size_t n, uint64_t now) {
+            if (0 == conf.rate) {
+                return true;
+            }
+
+            int64_t capacity = static_cast<int64_t>(0 == conf.burst ? conf.rate : conf.burst) * 1000;
+            if (0 == timepoint) {
+                tokens    = capacity;
+                timepoint = now;
+            } else if (now > timepoint) {
+                if (tokens < capacity) {
+                    // rate tokens per second is just rate milli-tokens per millisecond
+                    uint64_t elapsed = now - timepoint;
+                    uint64_t fill_time = static_cast<uint64_t>(capacity - tokens) / conf.rate + 1;
+                    if (elapsed >= fill_time) {
+                        tokens = capacity;
+                    } else {
+                        tokens += static_cast<int64_t>(elapsed * conf.rate);
+                        if (tokens > capacity) {
+                            tokens = capacity;
+                        }
+                    }
+                }
+                timepoint = now;
+            }
+
+            return tokens >= static_cast<int64_t>(n) * 1000 || tokens >= capacity;
+        }
+
+        void token_bucket_t::consume(const token_bucket_conf_t &conf, size_t n) {
+            if (0 == conf.rate) {
+                return;
+            }
+
+            tokens -= static_cast<int64_t>(n) * 1000;
+        }
+
+        uint64_t token_bucket_t::get_wait_time(const token_bucket_conf_t &conf) const {
+            if (0 == conf.rate || tokens >= 0) {
+                return 0;
+            }
+
+            return (static_cast<uint64_t>(-tokens) + conf.rate - 1) / conf.rate;
+        }
+
+        uint64_t token_bucket_t::get_wait_time(const token_bucket_conf_t &conf, size_t n) const {
+            if (0 == conf.rate) {
+                return 0;
+            }
+
+            // a full bucket always passes, so never wait for more than capacity
+            int64_t capacity = static_cast<int64_t>(0 == conf.burst ? conf.rate : conf.burst) * 1000;
+            int64_t need     = static_cast<int64_t>(n) * 1000;
+            if (need > capacity) {
+                need = capacity;
+            }
+
+            if (tokens >= need) {
+                return 0;
+            }
+
+            return (static_cast<uint64_t>(need - tokens) + conf.rate - 1) / conf.rate;
+        }
+    }
+}
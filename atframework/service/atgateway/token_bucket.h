@@ -0,0 +1,52 @@
+#ifndef ATFRAME_SERVICE_ATGATEWAY_TOKEN_BUCKET_H
+#define ATFRAME_SERVICE_ATGATEWAY_TOKEN_BUCKET_H
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace atframe {
+    namespace gateway {
+        struct token_bucket_conf_t {
+            size_t rate;  /** tokens added every second, 0 for unlimited **/
+            size_t burst; /** max tokens kept in bucket, 0 to use rate **/
+        };
+
+        /**
+         * @brief token bucket with millisecond precision
+         * @note it's a POD type and can be zero initialized, bucket is filled when it's checked the first time
+         */
+        struct token_bucket_t {
+            int64_t tokens;     /** tokens multiplied by 1000, it's negative when overdrawn **/
+            uint64_t timepoint; /** last refill time (milliseconds), 0 if not used yet **/
+
+            /**
+             * @brief refill tokens and check if n tokens can be consumed
+             * @note a full bucket always allows one consumption, so data larger than burst can still pass
+             * @param now current time (milliseconds), usually uv_now()
+             * @return true if there are enough tokens or it's unlimited
+             */
+            bool check(const token_bucket_conf_t &conf, size_t n, uint64_t now);
+
+            /**
+             * @brief consume n tokens, bucket can be overdrawn, check() should be called before this to refill tokens
+             */
+            void consume(const token_bucket_conf_t &conf, size_t n);
+
+            /**
+             * @brief get time to wait until bucket is not overdrawn
+             * @return milliseconds to wait
+             */
+            uint64_t get_wait_time(const token_bucket_conf_t &conf) const;
+
+            /**
+             * @brief get time to wait until n tokens can pass check(), tokens should be refilled by check() just now
+             * @return milliseconds to wait
+             */
+            uint64_t get_wait_time(const token_bucket_conf_t &conf, size_t n) const;
+        };
+    }
+}
+
+#endif
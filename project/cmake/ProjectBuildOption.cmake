@@ -17,5 +17,8 @@ set(PROJECT_RPC_DB_BUFFER_LENGTH 131072 CACHE STRING "DB package buffer length,
 # just like ATBUS_MACRO_DATA_SMALL_SIZE
 set(ATFRAME_GATEWAY_MACRO_DATA_SMALL_SIZE 3072 CACHE STRING "small message buffer for atgateway connection(used to reduce memory copy when there are many small messages)")
 
+# atgateway payload compression, zstd and lz4 will be used if found
+option(ATFRAME_GATEWAY_ENABLE_COMPRESSION "Enable payload compression of atgateway." ON)
+
 # libatbus
 set(ATBUS_MACRO_MSG_LIMIT 65536 CACHE STRING "message size limit of libatbus")
\ No newline at end of file
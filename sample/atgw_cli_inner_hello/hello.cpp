@@ -155,6 +155,15 @@ static void libuv_tcp_connect_callback(uv_connect_t *req, int status) {
         secret.resize(secret_len);
         std::string crypt_type = libatgw_inner_v1_c_get_crypt_type(g_client_sess.proto->ctx);
         libatgw_inner_v1_c_copy_crypt_secret(g_client_sess.proto->ctx, &secret[0], secret_len);
+        // messages after it will be sent again by server
+        libatgw_inner_v1_c_set_received_sequence(sess_proto->ctx, libatgw_inner_v1_c_get_received_sequence(g_client_sess.proto->ctx));
+        // the ticket can resume this session even if the gateway is restarted
+        std::vector<unsigned char> ticket;
+        ticket.resize(libatgw_inner_v1_c_get_ticket_size(g_client_sess.proto->ctx));
+        if (!ticket.empty()) {
+            libatgw_inner_v1_c_copy_ticket(g_client_sess.proto->ctx, &ticket[0], ticket.size());
+            libatgw_inner_v1_c_set_ticket(sess_proto->ctx, &ticket[0], ticket.size());
+        }
 
         g_client_sess.proto = sess_proto;
         ret                 = libatgw_inner_v1_c_reconnect_session(sess_proto->ctx, g_client_sess.session_id, crypt_type.c_str(), &secret[0], secret_len);
@@ -351,6 +360,11 @@ static int proto_inner_callback_on_handshake(libatgw_inner_v1_c_context ctx, int
         libatgw_inner_v1_c_get_info(ctx, buffer, 4096);
         printf("[Info]: handshake done\n%s\n", buffer);
         g_client_sess.session_id = libatgw_inner_v1_c_get_session_id(ctx);
+        if (LIBATGW_INNER_V1_C_LOST_POST_NUMBER_UNKNOWN == libatgw_inner_v1_c_get_lost_post_number(ctx)) {
+            fprintf(stderr, "[Warn]: messages sent before reconnecting are unknown, some of them may be lost\n");
+        } else if (libatgw_inner_v1_c_get_lost_post_number(ctx) > 0) {
+            fprintf(stderr, "[Warn]: %llu messages are lost when reconnecting\n", static_cast<unsigned long long>(libatgw_inner_v1_c_get_lost_post_number(ctx)));
+        }
     } else {
         fprintf(stderr, "[Error]: handshake failed, status=%d\n", status);
         // handshake failed, do not reconnect any more
@@ -0,0 +1,731 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "algorithm/crypto_cipher.h"
+#include "common/string_oprs.h"
+#include "std/smart_ptr.h"
+
+#include <inner_v1/libatgw_proto_inner.h>
+
+/**
+ * in-process benchmark of inner protocol, a client and a server protocol object are wired together by memory buffers.
+ * no socket is used, so the result only contains the cost of protocol, crypt, compression and checksum.
+ */
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+struct bench_options_t {
+    std::vector<std::string> crypt_types;
+    std::vector<size_t>      msg_sizes;
+    std::vector<std::string> write_modes;
+    size_t                   batch;
+    time_t                   case_time;      // milliseconds
+    time_t                   handshake_time; // milliseconds
+    std::string              compression_type;
+    size_t                   compression_threshold;
+    std::string              checksum_type;
+    std::string              dh_param;
+    size_t                   replay_window;
+};
+
+struct bench_endpoint_t {
+    std::unique_ptr< ::atframe::gateway::libatgw_proto_inner_v1> proto;
+    bench_endpoint_t *                                             peer;
+
+    std::vector<char>                     wire; // data written by peer and not read yet
+    bool                                  write_pending;
+    bool                                  handshake_done;
+    int                                   handshake_status;
+    std::deque<bench_clock_t::time_point> send_times; // send time of posts not received by peer yet
+};
+
+struct bench_stats_t {
+    size_t                recv_msgs;
+    size_t                recv_bytes;
+    size_t                wire_bytes;
+    size_t                errors;
+    std::vector<uint64_t> latency_ns;
+};
+
+static bench_options_t                                   g_opts;
+static bench_stats_t                                     g_stats;
+static std::string                                       g_write_mode = "direct";
+static uint64_t                                          g_session_id = 0;
+static ::atframe::gateway::proto_base::proto_callbacks_t g_callbacks;
+
+// old server protocol of replay case, only it can be reconnected
+static ::atframe::gateway::libatgw_proto_inner_v1 *g_reconnect_from = NULL;
+
+static std::vector<std::string> split_list(const std::string &in) {
+    std::vector<std::string> ret;
+    std::string              item;
+    for (size_t i = 0; i <= in.size(); ++i) {
+        if (i == in.size() || ':' == in[i] || ',' == in[i] || ' ' == in[i]) {
+            if (!item.empty()) {
+                ret.push_back(item);
+            }
+            item.clear();
+        } else {
+            item.push_back(static_cast<char>(::tolower(in[i])));
+        }
+    }
+
+    return ret;
+}
+
+static bench_endpoint_t *get_endpoint(::atframe::gateway::proto_base *proto) { return reinterpret_cast<bench_endpoint_t *>(proto->get_private_data()); }
+
+// ================= protocol callbacks =================
+static int proto_inner_callback_on_write(::atframe::gateway::proto_base *proto, void *buffer, size_t sz, bool *is_done) {
+    bench_endpoint_t *ep = get_endpoint(proto);
+    if (NULL == ep || NULL == ep->peer || sz < proto->get_write_header_offset()) {
+        if (NULL != is_done) {
+            *is_done = true;
+        }
+        return ::atframe::gateway::error_code_t::EN_ECT_PARAM;
+    }
+
+    const char *data = reinterpret_cast<const char *>(buffer) + proto->get_write_header_offset();
+    size_t      len  = sz - proto->get_write_header_offset();
+    ep->peer->wire.insert(ep->peer->wire.end(), data, data + len);
+    g_stats.wire_bytes += len;
+
+    // in merge and writev mode, writing is finished in next pump, so messages sent before that will be written together
+    if ("direct" == g_write_mode) {
+        *is_done = true;
+    } else {
+        ep->write_pending = true;
+        *is_done          = false;
+    }
+    return 0;
+}
+
+static int proto_inner_callback_on_writev(::atframe::gateway::proto_base *proto, ::atframe::gateway::proto_base::write_vector_t *bufs, size_t bufs_num,
+                                          bool *is_done) {
+    bench_endpoint_t *ep = get_endpoint(proto);
+    if (NULL == ep || NULL == ep->peer) {
+        if (NULL != is_done) {
+            *is_done = true;
+        }
+        return ::atframe::gateway::error_code_t::EN_ECT_PARAM;
+    }
+
+    for (size_t i = 0; i < bufs_num; ++i) {
+        const char *data = reinterpret_cast<const char *>(bufs[i].buffer) + proto->get_write_header_offset();
+        size_t      len  = bufs[i].length - proto->get_write_header_offset();
+        ep->peer->wire.insert(ep->peer->wire.end(), data, data + len);
+        g_stats.wire_bytes += len;
+    }
+
+    ep->write_pending = true;
+    *is_done          = false;
+    return 0;
+}
+
+static int proto_inner_callback_on_message(::atframe::gateway::proto_base *proto, const void * /*buffer*/, size_t sz) {
+    bench_endpoint_t *ep = get_endpoint(proto);
+    if (NULL == ep || NULL == ep->peer || ep->peer->send_times.empty()) {
+        ++g_stats.errors;
+        return 0;
+    }
+
+    bench_clock_t::time_point now = bench_clock_t::now();
+    g_stats.latency_ns.push_back(
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - ep->peer->send_times.front()).count()));
+    ep->peer->send_times.pop_front();
+
+    ++g_stats.recv_msgs;
+    g_stats.recv_bytes += sz;
+    return 0;
+}
+
+static int proto_inner_callback_on_new_session(::atframe::gateway::proto_base * /*proto*/, uint64_t &sess_id) {
+    sess_id = ++g_session_id;
+    return 0;
+}
+
+static int proto_inner_callback_on_reconnect(::atframe::gateway::proto_base *proto, uint64_t sess_id) {
+    // only the session of replay case can be reconnected
+    if (NULL == g_reconnect_from || g_reconnect_from->get_session_id() != sess_id || !proto->check_reconnect(g_reconnect_from)) {
+        return ::atframe::gateway::error_code_t::EN_ECT_REFUSE_RECONNECT;
+    }
+
+    proto->takeover_reconnect(g_reconnect_from);
+    return 0;
+}
+
+static int proto_inner_callback_on_close(::atframe::gateway::proto_base * /*proto*/, int /*reason*/) { return 0; }
+
+static int proto_inner_callback_on_handshake(::atframe::gateway::proto_base *proto, int status) {
+    bench_endpoint_t *ep = get_endpoint(proto);
+    if (NULL != ep) {
+        ep->handshake_done   = true;
+        ep->handshake_status = status;
+    }
+    return 0;
+}
+
+static int proto_inner_callback_on_error(::atframe::gateway::proto_base * /*proto*/, const char *filename, int line, int errcode, const char *errmsg) {
+    ++g_stats.errors;
+    fprintf(stderr, "[Error][%s:%d] error code: %d, msg: %s\n", filename, line, errcode, errmsg);
+    return 0;
+}
+
+// ================= wire =================
+static void init_endpoint(bench_endpoint_t &ep, bench_endpoint_t &peer) {
+    ep.proto.reset(new ::atframe::gateway::libatgw_proto_inner_v1());
+    ep.proto->set_callbacks(&g_callbacks);
+    ep.proto->set_private_data(&ep);
+    ep.proto->set_recv_buffer_limit(ATBUS_MACRO_MSG_LIMIT, 2);
+    ep.proto->set_send_buffer_limit(0, 0);
+    if (!g_opts.compression_type.empty()) {
+        ep.proto->set_compression_types(g_opts.compression_type);
+    }
+    if (!g_opts.checksum_type.empty()) {
+        ep.proto->set_checksum_types(g_opts.checksum_type);
+    }
+
+    ep.peer = &peer;
+    ep.wire.clear();
+    ep.write_pending    = false;
+    ep.handshake_done   = false;
+    ep.handshake_status = 0;
+    ep.send_times.clear();
+}
+
+static void reset_endpoint(bench_endpoint_t &ep) {
+    if (ep.proto) {
+        ep.proto->close(::atframe::gateway::close_reason_t::EN_CRT_EOF, false);
+        ep.proto.reset();
+    }
+    ep.wire.clear();
+    ep.send_times.clear();
+}
+
+/**
+ * @brief feed data written by peer into protocol, just like reading from socket
+ * @return false if read failed
+ */
+static bool deliver_wire(bench_endpoint_t &ep) {
+    if (ep.wire.empty()) {
+        return true;
+    }
+
+    // messages received may make this endpoint write to peer, so take all data before reading
+    std::vector<char> data;
+    data.swap(ep.wire);
+
+    size_t offset = 0;
+    while (offset < data.size()) {
+        char * out_buf = NULL;
+        size_t out_len = 0;
+        ep.proto->alloc_recv_buffer(data.size() - offset, out_buf, out_len);
+        if (NULL == out_buf || 0 == out_len) {
+            return false;
+        }
+
+        size_t nread = std::min(out_len, data.size() - offset);
+        memcpy(out_buf, &data[offset], nread);
+        offset += nread;
+
+        int errcode = 0;
+        ep.proto->read(static_cast<int>(nread), out_buf, nread, errcode);
+        if (errcode < 0) {
+            fprintf(stderr, "read data failed, res: %d\n", errcode);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief move all data between client and server until nothing to do
+ * @return false if any error happened
+ */
+static bool pump(bench_endpoint_t &client, bench_endpoint_t &server) {
+    bool has_progress = true;
+    while (has_progress) {
+        has_progress = false;
+
+        bench_endpoint_t *eps[2] = {&server, &client};
+        for (int i = 0; i < 2; ++i) {
+            bench_endpoint_t &ep = *eps[i];
+            if (!ep.wire.empty()) {
+                has_progress = true;
+                if (!deliver_wire(ep)) {
+                    return false;
+                }
+            }
+
+            if (ep.write_pending) {
+                has_progress     = true;
+                ep.write_pending = false;
+                ep.proto->write_done(0);
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool make_session(bench_endpoint_t &client, bench_endpoint_t &server, const std::string &crypt_type) {
+    init_endpoint(client, server);
+    init_endpoint(server, client);
+
+    int res = client.proto->start_session(crypt_type);
+    if (0 != res) {
+        fprintf(stderr, "start session with crypt type %s failed, res: %d\n", crypt_type.c_str(), res);
+        return false;
+    }
+
+    if (!pump(client, server)) {
+        return false;
+    }
+
+    if (!client.handshake_done || !server.handshake_done || 0 != client.handshake_status || 0 != server.handshake_status) {
+        fprintf(stderr, "handshake with crypt type %s failed, client status: %d, server status: %d\n", crypt_type.c_str(), client.handshake_status,
+                server.handshake_status);
+        return false;
+    }
+
+    return true;
+}
+
+// ================= benchmark cases =================
+static const char *get_negotiated_crypt_name(const bench_endpoint_t &ep) {
+    const ::atframe::gateway::libatgw_proto_inner_v1::crypt_session_ptr_t &crypt_info = ep.proto->get_crypt_write();
+    if (!crypt_info || crypt_info->type.empty()) {
+        return "none";
+    }
+
+    return crypt_info->type.c_str();
+}
+
+static double get_percentile_us(const std::vector<uint64_t> &sorted_ns, size_t per_thousand) {
+    if (sorted_ns.empty()) {
+        return 0.0;
+    }
+
+    size_t idx = sorted_ns.size() * per_thousand / 1000;
+    if (idx >= sorted_ns.size()) {
+        idx = sorted_ns.size() - 1;
+    }
+    return static_cast<double>(sorted_ns[idx]) / 1000.0;
+}
+
+static int run_post_case(const std::string &crypt_type, size_t msg_size) {
+    bench_endpoint_t client, server;
+    g_stats.recv_msgs  = 0;
+    g_stats.recv_bytes = 0;
+    g_stats.wire_bytes = 0;
+    g_stats.errors     = 0;
+    g_stats.latency_ns.clear();
+
+    if (!make_session(client, server, crypt_type)) {
+        reset_endpoint(client);
+        reset_endpoint(server);
+        return -1;
+    }
+
+    std::vector<unsigned char> payload;
+    payload.resize(msg_size);
+    std::mt19937 rnd(static_cast<std::mt19937::result_type>(msg_size));
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<unsigned char>(rnd());
+    }
+
+    // handshake messages are not counted
+    g_stats.wire_bytes = 0;
+    g_stats.latency_ns.reserve(1 << 20);
+
+    bench_clock_t::time_point start_time = bench_clock_t::now();
+    bench_clock_t::time_point end_time   = start_time + std::chrono::milliseconds(g_opts.case_time);
+    bench_clock_t::time_point now        = start_time;
+    int                       ret        = 0;
+    while (now < end_time && 0 == ret) {
+        for (size_t i = 0; i < g_opts.batch; ++i) {
+            client.send_times.push_back(bench_clock_t::now());
+            int res = client.proto->send_post(payload.empty() ? NULL : &payload[0], payload.size());
+            if (0 != res) {
+                client.send_times.pop_back();
+                fprintf(stderr, "send post failed, res: %d\n", res);
+                ret = res;
+                break;
+            }
+        }
+
+        if (!pump(client, server)) {
+            ret = ::atframe::gateway::error_code_t::EN_ECT_BAD_DATA;
+        }
+        now = bench_clock_t::now();
+    }
+
+    double seconds = std::chrono::duration_cast<std::chrono::duration<double> >(now - start_time).count();
+    if (seconds <= 0.0) {
+        seconds = 1e-9;
+    }
+
+    std::sort(g_stats.latency_ns.begin(), g_stats.latency_ns.end());
+    printf("%-20s %8llu %-7s %12.0f %10.2f %10.2f %9.2f %9.2f %9.2f %9.2f %9.2f%s\n", get_negotiated_crypt_name(client),
+           static_cast<unsigned long long>(msg_size), g_write_mode.c_str(), g_stats.recv_msgs / seconds, g_stats.recv_bytes / seconds / 1048576.0,
+           g_stats.wire_bytes / seconds / 1048576.0, get_percentile_us(g_stats.latency_ns, 500), get_percentile_us(g_stats.latency_ns, 900),
+           get_percentile_us(g_stats.latency_ns, 990), get_percentile_us(g_stats.latency_ns, 999),
+           g_stats.latency_ns.empty() ? 0.0 : static_cast<double>(g_stats.latency_ns.back()) / 1000.0,
+           (0 != ret || g_stats.errors > 0 || !client.send_times.empty()) ? " (failed)" : "");
+
+    reset_endpoint(client);
+    reset_endpoint(server);
+    return ret;
+}
+
+static int run_handshake_case(const std::string &crypt_type) {
+    size_t                    count      = 0;
+    size_t                    failed     = 0;
+    size_t                    mem_usage  = 0;
+    std::string               negotiated = "none";
+    bench_clock_t::time_point start_time = bench_clock_t::now();
+    bench_clock_t::time_point end_time   = start_time + std::chrono::milliseconds(g_opts.handshake_time);
+    bench_clock_t::time_point now        = start_time;
+
+    while (now < end_time) {
+        bench_endpoint_t client, server;
+        if (make_session(client, server, crypt_type)) {
+            ++count;
+            negotiated = get_negotiated_crypt_name(client);
+            mem_usage  = server.proto->get_memory_usage();
+        } else {
+            ++failed;
+        }
+
+        reset_endpoint(client);
+        reset_endpoint(server);
+        now = bench_clock_t::now();
+
+        // do not print the same error too many times
+        if (failed > 0 && 0 == count) {
+            break;
+        }
+    }
+
+    double seconds = std::chrono::duration_cast<std::chrono::duration<double> >(now - start_time).count();
+    if (seconds <= 0.0) {
+        seconds = 1e-9;
+    }
+
+    printf("%-20s %12.0f %12.2f %14llu %8llu\n", negotiated.c_str(), count / seconds, count > 0 ? seconds * 1000000.0 / count : 0.0,
+           static_cast<unsigned long long>(mem_usage), static_cast<unsigned long long>(failed));
+    return 0 == failed ? 0 : -1;
+}
+
+/**
+ * @brief reconnect after some posts from server are lost, check if client can find out how many of them can not be sent again
+ * @note it's a verification case, posts out of replay window of server must be reported by get_lost_post_number
+ */
+static int run_replay_case(const std::string &crypt_type) {
+    const size_t msg_size    = 256;
+    const size_t acked_posts = 2;
+    const size_t kept_posts  = g_opts.replay_window / msg_size;
+    const size_t lost_posts  = 3;
+    const size_t post_count  = kept_posts + lost_posts;
+
+    bench_endpoint_t client, server;
+    g_stats.recv_msgs = 0;
+    g_stats.errors    = 0;
+
+    if (!make_session(client, server, crypt_type)) {
+        reset_endpoint(client);
+        reset_endpoint(server);
+        return -1;
+    }
+
+    std::vector<unsigned char> payload;
+    payload.resize(msg_size, static_cast<unsigned char>('r'));
+
+    // posts received and acknowledged by client are never sent again
+    int ret = 0;
+    for (size_t i = 0; i < acked_posts && 0 == ret; ++i) {
+        server.send_times.push_back(bench_clock_t::now());
+        ret = server.proto->send_post(&payload[0], payload.size());
+    }
+    if (0 == ret && !pump(client, server)) {
+        ret = ::atframe::gateway::error_code_t::EN_ECT_BAD_DATA;
+    }
+
+    // then connection is broken, all posts are still on the wire
+    for (size_t i = 0; i < post_count && 0 == ret; ++i) {
+        ret = server.proto->send_post(&payload[0], payload.size());
+    }
+    client.wire.clear();
+
+    size_t   replayed_msgs = 0;
+    uint64_t lost_number   = 0;
+    if (0 == ret) {
+        bench_endpoint_t new_client, new_server;
+        init_endpoint(new_client, new_server);
+        init_endpoint(new_server, new_client);
+        new_server.send_times.resize(post_count, bench_clock_t::now());
+        new_client.proto->set_received_sequence(client.proto->get_received_sequence());
+
+        const ::atframe::gateway::libatgw_proto_inner_v1::crypt_session_ptr_t &crypt_info = client.proto->get_crypt_read();
+        g_reconnect_from  = server.proto.get();
+        g_stats.recv_msgs = 0;
+
+        ret = new_client.proto->reconnect_session(client.proto->get_session_id(), crypt_info ? crypt_info->type : std::string(),
+                                                  crypt_info ? crypt_info->secret : std::vector<unsigned char>());
+        if (0 == ret && !pump(new_client, new_server)) {
+            ret = ::atframe::gateway::error_code_t::EN_ECT_BAD_DATA;
+        }
+        g_reconnect_from = NULL;
+
+        if (0 == ret && (!new_client.handshake_done || 0 != new_client.handshake_status)) {
+            fprintf(stderr, "reconnect with crypt type %s failed, status: %d\n", crypt_type.c_str(), new_client.handshake_status);
+            ret = ::atframe::gateway::error_code_t::EN_ECT_HANDSHAKE;
+        }
+        replayed_msgs = g_stats.recv_msgs;
+        lost_number   = new_client.proto->get_lost_post_number();
+
+        reset_endpoint(new_client);
+        reset_endpoint(new_server);
+    }
+
+    if (0 == ret && (replayed_msgs != kept_posts || lost_number != lost_posts)) {
+        ret = ::atframe::gateway::error_code_t::EN_ECT_NO_DATA;
+    }
+
+    printf("%-20s %8llu %8llu %8llu %8llu %8llu%s\n", get_negotiated_crypt_name(client), static_cast<unsigned long long>(g_opts.replay_window),
+           static_cast<unsigned long long>(post_count), static_cast<unsigned long long>(replayed_msgs), static_cast<unsigned long long>(lost_number),
+           static_cast<unsigned long long>(lost_posts), 0 != ret ? " (failed)" : "");
+
+    reset_endpoint(client);
+    reset_endpoint(server);
+    return ret;
+}
+
+static int reload_global_configure() {
+    ::atframe::gateway::libatgw_proto_inner_v1::crypt_conf_t crypt_conf;
+    crypt_conf.default_key       = "atgw-benchmark";
+    crypt_conf.update_interval   = 0;
+    crypt_conf.dh_pool_size      = 0;
+    crypt_conf.dh_context_number = 0;
+    crypt_conf.benchmark_time    = 0;
+    crypt_conf.client_mode       = false;
+
+    for (size_t i = 0; i < g_opts.crypt_types.size(); ++i) {
+        if ("none" == g_opts.crypt_types[i]) {
+            continue;
+        }
+        if (!crypt_conf.type.empty()) {
+            crypt_conf.type += ":";
+        }
+        crypt_conf.type += g_opts.crypt_types[i];
+    }
+
+    crypt_conf.switch_secret_type = ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DIRECT;
+    crypt_conf.dh_param           = g_opts.dh_param;
+    if (!crypt_conf.dh_param.empty()) {
+        if (0 == UTIL_STRFUNC_STRNCASE_CMP("ecdh:", crypt_conf.dh_param.c_str(), 5)) {
+            crypt_conf.switch_secret_type = ::atframe::gw::inner::v1::switch_secret_t_EN_SST_ECDH;
+        } else {
+            crypt_conf.switch_secret_type = ::atframe::gw::inner::v1::switch_secret_t_EN_SST_DH;
+        }
+    }
+
+    crypt_conf.compression_type      = g_opts.compression_type;
+    crypt_conf.compression_threshold = g_opts.compression_threshold;
+    crypt_conf.compression_level     = 0;
+    crypt_conf.checksum_type         = g_opts.checksum_type;
+    crypt_conf.replay_window         = g_opts.replay_window;
+
+    return ::atframe::gateway::libatgw_proto_inner_v1::global_reload(crypt_conf);
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [options...]\n"
+            "options:\n"
+            "  --crypt <types>            crypt types to benchmark, none to disable crypt(default: none:xxtea:aes-128-cfb:aes-256-cfb:aes-128-gcm)\n"
+            "  --size <sizes>             message sizes(default: 64:512:4096:65536)\n"
+            "  --mode <modes>             write modes, direct, merge or writev(default: direct:merge:writev)\n"
+            "  --batch <number>           messages sent before pumping data(default: 16)\n"
+            "  --time <ms>                milliseconds of every post case(default: 1000)\n"
+            "  --handshake-time <ms>      milliseconds of every handshake case, 0 to skip(default: 1000)\n"
+            "  --compression <types>      compression algorithms, empty to disable(default: empty)\n"
+            "  --compression-threshold <bytes>  only compress the message not smaller than this(default: 1024)\n"
+            "  --checksum <types>         frame checksum algorithms(default: crc32c)\n"
+            "  --dh <param>               DH parameter file, or ecdh:<curve>, empty for direct secret(default: empty)\n"
+            "  --replay-window <bytes>    replay window of server, 0 to skip replay case(default: 4096)\n"
+            "example:\n"
+            "  %s --crypt xxtea:aes-128-gcm --size 128:4096 --mode merge --batch 64\n",
+            name, name);
+}
+
+static int parse_options(int argc, char *argv[]) {
+    g_opts.crypt_types           = split_list("none:xxtea:aes-128-cfb:aes-256-cfb:aes-128-gcm");
+    g_opts.write_modes           = split_list("direct:merge:writev");
+    g_opts.batch                 = 16;
+    g_opts.case_time             = 1000;
+    g_opts.handshake_time        = 1000;
+    g_opts.compression_threshold = 1024;
+    g_opts.checksum_type         = "crc32c";
+    g_opts.replay_window         = 4096;
+
+    std::string sizes = "64:512:4096:65536";
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if ("-h" == key || "--help" == key) {
+            return 1;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "option %s require a value\n", key.c_str());
+            return -1;
+        }
+        std::string val = argv[++i];
+
+        if ("--crypt" == key) {
+            g_opts.crypt_types = split_list(val);
+        } else if ("--size" == key) {
+            sizes = val;
+        } else if ("--mode" == key) {
+            g_opts.write_modes = split_list(val);
+        } else if ("--batch" == key) {
+            g_opts.batch = static_cast<size_t>(strtoull(val.c_str(), NULL, 10));
+        } else if ("--time" == key) {
+            g_opts.case_time = static_cast<time_t>(strtoll(val.c_str(), NULL, 10));
+        } else if ("--handshake-time" == key) {
+            g_opts.handshake_time = static_cast<time_t>(strtoll(val.c_str(), NULL, 10));
+        } else if ("--compression" == key) {
+            g_opts.compression_type = val;
+        } else if ("--compression-threshold" == key) {
+            g_opts.compression_threshold = static_cast<size_t>(strtoull(val.c_str(), NULL, 10));
+        } else if ("--checksum" == key) {
+            g_opts.checksum_type = val;
+        } else if ("--dh" == key) {
+            g_opts.dh_param = val;
+        } else if ("--replay-window" == key) {
+            g_opts.replay_window = static_cast<size_t>(strtoull(val.c_str(), NULL, 10));
+        } else {
+            fprintf(stderr, "unknown option %s\n", key.c_str());
+            return -1;
+        }
+    }
+
+    std::vector<std::string> size_list = split_list(sizes);
+    for (size_t i = 0; i < size_list.size(); ++i) {
+        g_opts.msg_sizes.push_back(static_cast<size_t>(strtoull(size_list[i].c_str(), NULL, 10)));
+    }
+
+    for (size_t i = 0; i < g_opts.write_modes.size(); ++i) {
+        if ("direct" != g_opts.write_modes[i] && "merge" != g_opts.write_modes[i] && "writev" != g_opts.write_modes[i]) {
+            fprintf(stderr, "unsupport write mode %s\n", g_opts.write_modes[i].c_str());
+            return -1;
+        }
+    }
+
+    if (0 == g_opts.batch) {
+        g_opts.batch = 1;
+    }
+
+    // unsupported crypt types are skipped, or the server will select none silently
+    const std::vector<std::string> &all_supported_type_list = util::crypto::cipher::get_all_cipher_names();
+    std::vector<std::string>        crypt_types;
+    for (size_t i = 0; i < g_opts.crypt_types.size(); ++i) {
+        if ("none" == g_opts.crypt_types[i] ||
+            all_supported_type_list.end() != std::find(all_supported_type_list.begin(), all_supported_type_list.end(), g_opts.crypt_types[i])) {
+            crypt_types.push_back(g_opts.crypt_types[i]);
+        } else {
+            fprintf(stderr, "crypt type %s is not supported and will be skipped\n", g_opts.crypt_types[i].c_str());
+        }
+    }
+    g_opts.crypt_types.swap(crypt_types);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // setup crypt algorithms
+    util::crypto::cipher::init_global_algorithm();
+
+    int ret = parse_options(argc, argv);
+    if (0 != ret) {
+        print_usage(argv[0]);
+        util::crypto::cipher::cleanup_global_algorithm();
+        return ret < 0 ? ret : 0;
+    }
+
+    ret = reload_global_configure();
+    if (ret < 0) {
+        fprintf(stderr, "reload inner protocol global configure failed, res: %d\n", ret);
+        util::crypto::cipher::cleanup_global_algorithm();
+        return ret;
+    }
+
+    g_callbacks.write_fn               = proto_inner_callback_on_write;
+    g_callbacks.message_fn             = proto_inner_callback_on_message;
+    g_callbacks.new_session_fn         = proto_inner_callback_on_new_session;
+    g_callbacks.reconnect_fn           = proto_inner_callback_on_reconnect;
+    g_callbacks.close_fn               = proto_inner_callback_on_close;
+    g_callbacks.on_handshake_done_fn   = proto_inner_callback_on_handshake;
+    g_callbacks.on_handshake_update_fn = proto_inner_callback_on_handshake;
+    g_callbacks.on_error_fn            = proto_inner_callback_on_error;
+
+    int failed_cases = 0;
+
+    // post: send_post -> write_fn -> read -> message_fn
+    printf("%-20s %8s %-7s %12s %10s %10s %9s %9s %9s %9s %9s\n", "crypt", "size", "mode", "msgs/s", "MB/s", "wire MB/s", "p50(us)", "p90(us)",
+           "p99(us)", "p999(us)", "max(us)");
+    for (size_t m = 0; m < g_opts.write_modes.size(); ++m) {
+        g_write_mode = g_opts.write_modes[m];
+        // only writev mode provide writev_fn, merge mode copy queued messages together
+        g_callbacks.writev_fn = NULL;
+        if ("writev" == g_write_mode) {
+            g_callbacks.writev_fn = proto_inner_callback_on_writev;
+        }
+
+        for (size_t c = 0; c < g_opts.crypt_types.size(); ++c) {
+            for (size_t s = 0; s < g_opts.msg_sizes.size(); ++s) {
+                if (0 != run_post_case("none" == g_opts.crypt_types[c] ? std::string() : g_opts.crypt_types[c], g_opts.msg_sizes[s])) {
+                    ++failed_cases;
+                }
+            }
+        }
+    }
+
+    // handshake: start_session -> start response -> handshake done in both sides, session bytes is memory used by server side after handshake
+    if (g_opts.handshake_time > 0) {
+        g_write_mode          = "direct";
+        g_callbacks.writev_fn = NULL;
+
+        printf("\n%-20s %12s %12s %14s %8s\n", "crypt", "handshakes/s", "avg(us)", "session bytes", "failed");
+        for (size_t c = 0; c < g_opts.crypt_types.size(); ++c) {
+            if (0 != run_handshake_case("none" == g_opts.crypt_types[c] ? std::string() : g_opts.crypt_types[c])) {
+                ++failed_cases;
+            }
+        }
+    }
+
+    // replay: posts lost when reconnecting must be reported to client, replayed is number of posts received again by new connection
+    if (g_opts.replay_window > 0) {
+        g_write_mode          = "direct";
+        g_callbacks.writev_fn = NULL;
+
+        printf("\n%-20s %8s %8s %8s %8s %8s\n", "crypt", "window", "posts", "replayed", "lost", "expected");
+        for (size_t c = 0; c < g_opts.crypt_types.size(); ++c) {
+            if (0 != run_replay_case("none" == g_opts.crypt_types[c] ? std::string() : g_opts.crypt_types[c])) {
+                ++failed_cases;
+            }
+        }
+    }
+
+    util::crypto::cipher::cleanup_global_algorithm();
+    return 0 == failed_cases ? 0 : 1;
+}